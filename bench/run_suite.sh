@@ -0,0 +1,25 @@
+#!/bin/bash
+# Runs examples/benchsuite for every backend over a range of connection counts,
+# one JSON file per backend and connection count.
+BINARY=../build/benchsuite
+CPU=${CPU:-"12800H"}
+TASKSET=${TASKSET:-"taskset -c 10"}
+BACKENDS=${BACKENDS:-"poll epoll select uring"}
+OPS=${OPS:-200000}
+# TLS runs only with a certificate, e.g. CERT=cert.pem KEY=key.pem ./run_suite.sh
+TLS=""
+if [[ -n "$CERT" && -n "$KEY" ]]; then
+    TLS="-C $CERT -K $KEY"
+fi
+
+for backend in $BACKENDS
+do
+    c=1
+    while (( c <= 100000 ))
+    do
+        file=suite_"$CPU"_"$backend"_"$c".json
+        echo "writing $file"
+        $TASKSET $BINARY -m $backend -c $c -n $OPS $TLS -o $file || echo "$backend $c failed"
+        ((c=$c * 10))
+    done
+done
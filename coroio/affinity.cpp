@@ -0,0 +1,160 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "affinity.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <sched.h>
+#elif defined(__FreeBSD__)
+#include <pthread_np.h>
+#include <sys/cpuset.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+namespace NNet::NUtils {
+
+namespace {
+
+#if defined(__linux__)
+std::string ReadLine(const std::string& path) {
+    std::string line;
+    if (FILE* f = fopen(path.c_str(), "r")) {
+        char buf[256];
+        if (fgets(buf, sizeof(buf), f)) {
+            line = buf;
+        }
+        fclose(f);
+    }
+    return line;
+}
+
+std::string CpuDir(int cpu) {
+    return "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+}
+#endif
+
+} // namespace
+
+std::vector<int> AllowedCpus() {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+        return cpus;
+    }
+#endif
+    int count = std::max(1u, std::thread::hardware_concurrency());
+    for (int cpu = 0; cpu < count; cpu++) {
+        cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+bool PinThread(int cpu) {
+    if (cpu < 0) {
+        return false;
+    }
+#if defined(__linux__)
+    if (cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#elif defined(__FreeBSD__)
+    cpuset_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    if (cpu >= 64) {
+        return false;
+    }
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+    // macOS has affinity tags only, a hint the scheduler is free to ignore
+    return false;
+#endif
+}
+
+int CurrentCpu() {
+#if defined(__linux__)
+    return sched_getcpu();
+#elif defined(_WIN32)
+    return static_cast<int>(GetCurrentProcessorNumber());
+#else
+    return -1;
+#endif
+}
+
+int CpuNode(int cpu) {
+#if defined(__linux__)
+    // the cpu directory links to its node as "node<N>"
+    DIR* dir = opendir(CpuDir(cpu).c_str());
+    if (!dir) {
+        return 0;
+    }
+    int node = 0;
+    while (auto* entry = readdir(dir)) {
+        std::string_view name = entry->d_name;
+        if (name.size() > 4 && name.substr(0, 4) == "node") {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+#else
+    (void)cpu;
+    return 0;
+#endif
+}
+
+int SiblingCpu(int cpu) {
+#if defined(__linux__)
+    // a list like "3,67" or "2-3"
+    auto list = ReadLine(CpuDir(cpu) + "/topology/thread_siblings_list");
+    const char* p = list.c_str();
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long sibling = first; sibling <= last; sibling++) {
+            if (sibling != cpu) {
+                return static_cast<int>(sibling);
+            }
+        }
+        if (*end != ',') {
+            break;
+        }
+        p = end + 1;
+    }
+    return -1;
+#else
+    (void)cpu;
+    return -1;
+#endif
+}
+
+} // namespace NNet::NUtils
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+namespace NNet {
+
+namespace NUtils {
+
+/**
+ * @brief Returns the CPUs the process may run on, in increasing order.
+ *
+ * On Linux this is the affinity mask of the process (e.g. set by @c taskset or a cgroup),
+ * elsewhere 0 ... hardware concurrency - 1.
+ */
+std::vector<int> AllowedCpus();
+
+/**
+ * @brief Pins the calling thread to @p cpu.
+ *
+ * Memory the thread touches first after that is placed on the NUMA node of @p cpu by the
+ * default first-touch policy, which is what keeps per-thread caches and frame pools local.
+ *
+ * @return False if the platform does not support pinning (macOS) or the call failed.
+ */
+bool PinThread(int cpu);
+
+/// Returns the CPU the calling thread runs on, -1 if unknown.
+int CurrentCpu();
+
+/// Returns the NUMA node of @p cpu, 0 if unknown or without NUMA.
+int CpuNode(int cpu);
+
+/**
+ * @brief Returns another hardware thread of the core of @p cpu, -1 if there is none.
+ *
+ * E.g. the CPU for the submission polling thread of a @ref TUring whose loop runs on @p cpu
+ * (@ref TUringOptions::SqThreadCpu): it shares the caches of the loop without taking its core.
+ */
+int SiblingCpu(int cpu);
+
+} // namespace NUtils
+
+} // namespace NNet
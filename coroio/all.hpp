@@ -12,6 +12,7 @@
 #include <assert.h>
 
 #include "utils.hpp"
+#include "affinity.hpp"
 #include "init.hpp"
 #include "address.hpp"
 #include "poller.hpp"
@@ -53,12 +54,21 @@
 #endif
 
 #include "loop.hpp"
+#include "multiloop.hpp"
+#include "workpool.hpp"
 #include "promises.hpp"
 #include "socket.hpp"
 #include "corochain.hpp"
+#include "arena.hpp"
+#include "cancel.hpp"
+#include "sync.hpp"
+#include "chain.hpp"
 #include "sockutils.hpp"
+#include "datagram.hpp"
+#include "handoff.hpp"
 #include "ssl.hpp"
 #include "resolver.hpp"
+#include "pool.hpp"
 
 #ifdef _WIN32
 int pipe(int pipes[2]);
@@ -90,10 +100,17 @@ using TDefaultPoller = TPoll;
  *
  * The library’s core functionality is exposed through a few high-level classes:
  * - @ref TSocket and @ref TPollerDrivenSocket for asynchronous networking.
+ * - @ref TDatagramSocket and @ref TPollerDrivenDatagramSocket for batched UDP sends and receives.
  * - @ref TFileHandle and @ref TPollerDrivenFileHandle for asynchronous file I/O.
  * - @ref TLineReader for efficient, line-based input.
- * - @ref TByteReader and @ref TByteWriter for byte-level I/O.
+ * - @ref TByteReader, @ref TByteWriter and @ref TBufferedWriter for byte-level I/O.
+ * - @ref TChainBuffer for copy-free buffering between them.
  * - @ref TResolver and @ref TResolvConf for DNS resolution.
+ * - @ref TConnectionPool for reuse of established outbound connections.
+ * - @ref TWorkPool for moving CPU-bound parts of coroutines off the poller threads.
+ * - @ref WhenAll(), @ref WhenAny() and @ref TCancellation for structured waiting with deadlines.
+ * - @ref TChannel, @ref TSharedChannel and @ref TSemaphore for backpressure between coroutines.
+ * - @ref TPollerStats, @ref THistogram and @ref TPollerBase::SetStallDetector() for event loop instrumentation.
  *
  * In addition to these, the library supports multiple polling mechanisms for asynchronous operations:
  *
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "framepool.hpp"
+
+namespace NNet {
+
+/**
+ * @class TArena
+ * @brief Request-scoped bump allocator for coroutine frames and buffers.
+ *
+ * While an arena is current (@ref TArenaScope, @ref WithArena()), with @c COROIO_ARENA
+ * (CMake option of the same name, off by default) every @ref TFuture frame is carved from
+ * it instead of the heap, and the frame's promise remembers the arena: the coroutine makes
+ * it current again each time it resumes, so the futures it creates later, after any
+ * suspension, land in the same arena. A request thus allocates its whole coroutine tree
+ * with pointer bumps, and @ref Reset() takes it back at once when the request is done.
+ *
+ * The option is off by default because it costs every frame a header of
+ * @c __STDCPP_DEFAULT_NEW_ALIGNMENT__ bytes and every @c co_await two thread-local stores,
+ * whether an arena is active or not; @c examples/allocbench @c -w @c frames measures both.
+ *
+ * The arena is also a @c std::pmr::memory_resource for the buffers of the request, e.g.
+ * @ref TByteReader::ReadUntil(const std::string&, std::pmr::memory_resource*).
+ *
+ * Individual deallocations are free; the last block is given back, so a short-lived
+ * future awaited at once reuses the memory of the previous one. Chunks are kept by
+ * @ref Reset() for the next request.
+ *
+ * The arena is not thread safe: a request may move between threads (e.g.
+ * @ref TPollerBase::SwitchTo()), but must not run on two at the same time.
+ */
+class TArena: public std::pmr::memory_resource {
+public:
+    static constexpr size_t DefaultChunkSize = 16 * 1024;
+
+    explicit TArena(size_t chunkSize = DefaultChunkSize)
+        : ChunkSize_(chunkSize)
+    { }
+
+    TArena(const TArena&) = delete;
+    TArena& operator=(const TArena&) = delete;
+
+    /// Returns @p size bytes aligned to @p alignment (a power of two).
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        auto pos = (Pos_ + alignment - 1) & ~(alignment - 1);
+        if (pos + size > End_) {
+            pos = NextChunk(size + alignment);
+            pos = (pos + alignment - 1) & ~(alignment - 1);
+        }
+        Pos_ = pos + size;
+        Live_++;
+        Allocated_ += size;
+        return reinterpret_cast<void*>(pos);
+    }
+
+    /// Releases a block of @ref Allocate(); the memory is reused only if it is the last one.
+    void Deallocate(void* ptr, size_t size) {
+        auto pos = reinterpret_cast<uintptr_t>(ptr);
+        if (pos + size == Pos_) {
+            Pos_ = pos;
+        }
+        Live_--;
+    }
+
+    /**
+     * @brief Makes all the memory available again.
+     *
+     * @return False, doing nothing, while blocks are still allocated, e.g. a future of the
+     *         request stored somewhere else outlives it.
+     */
+    bool Reset() {
+        if (Live_ != 0) {
+            return false;
+        }
+        Chunk_ = 0;
+        Pos_ = End_ = 0;
+        return true;
+    }
+
+    /// Returns the number of blocks not released yet.
+    size_t Live() const {
+        return Live_;
+    }
+
+    /// Returns the bytes handed out since construction.
+    size_t Allocated() const {
+        return Allocated_;
+    }
+
+    /// Returns the bytes reserved from the heap.
+    size_t Reserved() const {
+        size_t reserved = 0;
+        for (const auto& chunk : Chunks_) {
+            reserved += chunk.Size;
+        }
+        return reserved;
+    }
+
+    /// The arena of the running coroutine of this thread, nullptr for the heap.
+    static TArena*& Current() {
+        thread_local TArena* current = nullptr;
+        return current;
+    }
+
+private:
+    void* do_allocate(size_t size, size_t alignment) override {
+        return Allocate(size, alignment);
+    }
+
+    void do_deallocate(void* ptr, size_t size, size_t) override {
+        Deallocate(ptr, size);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    uintptr_t NextChunk(size_t size) {
+        // the kept chunks are reused in order; one too small for this block is skipped
+        while (Chunk_ < Chunks_.size() && Chunks_[Chunk_].Size < size) {
+            Chunk_++;
+        }
+        if (Chunk_ == Chunks_.size()) {
+            auto chunkSize = std::max(ChunkSize_, size);
+            Chunks_.push_back({std::make_unique<char[]>(chunkSize), chunkSize});
+        }
+        auto& chunk = Chunks_[Chunk_++];
+        auto begin = reinterpret_cast<uintptr_t>(chunk.Data.get());
+        End_ = begin + chunk.Size;
+        return begin;
+    }
+
+    struct TChunk {
+        std::unique_ptr<char[]> Data;
+        size_t Size;
+    };
+
+    size_t ChunkSize_;
+    std::vector<TChunk> Chunks_;
+    size_t Chunk_ = 0; ///< The next chunk to use.
+    uintptr_t Pos_ = 0;
+    uintptr_t End_ = 0;
+    size_t Live_ = 0;
+    size_t Allocated_ = 0;
+};
+
+/**
+ * @class TArenaScope
+ * @brief Makes @p arena current for the coroutines created in the scope, e.g. the root
+ *        future of a request.
+ */
+class TArenaScope {
+public:
+    explicit TArenaScope(TArena* arena)
+        : Prev_(std::exchange(TArena::Current(), arena))
+    { }
+
+    TArenaScope(const TArenaScope&) = delete;
+    TArenaScope& operator=(const TArenaScope&) = delete;
+
+    ~TArenaScope() {
+        TArena::Current() = Prev_;
+    }
+
+private:
+    TArena* Prev_;
+};
+
+namespace NDetail {
+
+/**
+ * @brief The arena of a coroutine frame and of the code that resumed it.
+ *
+ * @c Resumer is current again whenever the coroutine suspends, so the poller or the parent
+ * that called it continues with its own arena.
+ */
+struct TArenaLink {
+    TArena* Arena = TArena::Current();
+    TArena* Resumer = Arena;
+};
+
+/// Forwards an awaiter, switching the current arena around the suspension.
+template<typename TAwaiter>
+struct TArenaAwaiter {
+    bool await_ready() {
+        return Awaiter.await_ready();
+    }
+
+    template<typename TPromise>
+    decltype(auto) await_suspend(std::coroutine_handle<TPromise> h) {
+        // the coroutine may be resumed elsewhere before the call returns, not touched after it
+        TArena::Current() = Link->Resumer;
+        return Awaiter.await_suspend(h);
+    }
+
+    decltype(auto) await_resume() {
+        Link->Resumer = std::exchange(TArena::Current(), Link->Arena);
+        return Awaiter.await_resume();
+    }
+
+    TAwaiter& Awaiter;
+    TArenaLink* Link;
+};
+
+/// The frame header keeps the arena for operator delete.
+inline constexpr size_t FrameHeader = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+inline void* AllocateFrame(size_t size) {
+    auto* arena = TArena::Current();
+    void* block;
+    if (arena) {
+        block = arena->Allocate(size + FrameHeader, FrameHeader);
+    } else {
+#ifdef COROIO_FRAME_POOL
+        block = TFramePool::Allocate(size + FrameHeader);
+#else
+        block = ::operator new(size + FrameHeader);
+#endif
+    }
+    *static_cast<TArena**>(block) = arena;
+    return static_cast<char*>(block) + FrameHeader;
+}
+
+inline void DeallocateFrame(void* ptr, size_t size) {
+    void* block = static_cast<char*>(ptr) - FrameHeader;
+    if (auto* arena = *static_cast<TArena**>(block)) {
+        arena->Deallocate(block, size + FrameHeader);
+        return;
+    }
+#ifdef COROIO_FRAME_POOL
+    TFramePool::Deallocate(block, size + FrameHeader);
+#else
+    ::operator delete(block);
+#endif
+}
+
+} // namespace NDetail
+
+} // namespace NNet
@@ -28,6 +28,7 @@ struct THandlePair {
     THandle Read;
     THandle Write;
     THandle RHup;
+    THandle Err; ///< Waiter for a pending socket error or error queue message, see @ref TPollerBase::AddError().
 };
 
 struct TEvent {
@@ -35,7 +36,10 @@ struct TEvent {
     enum {
         READ = 1,
         WRITE = 2,
-        RHUP = 4
+        RHUP = 4,
+        ERR = 8,
+        CANCEL = 16, ///< A change queued by @ref TPollerBase::RemoveEvent(int, int, THandle).
+        RESULT = 32 ///< A completion whose value waits in the result queue of the poller.
     };
     int Type;
     THandle Handle;
@@ -45,6 +49,49 @@ struct TEvent {
     }
 };
 
+/**
+ * @brief Adaptive size of the event array passed to a wait.
+ *
+ * Doubled when a wait fills the array, since more events may be pending, and halved when
+ * the busiest wait of the last @c Period used less than a quarter of it. A burst is
+ * remembered for a whole period, so a busy loop does not flap between sizes.
+ */
+class TBatchSize {
+public:
+    static constexpr size_t Initial = 64;
+    static constexpr int Period = 256;
+
+    size_t Get() const {
+        return Size_;
+    }
+
+    /// Accounts a wait that returned @p n events, returns true if the size changed.
+    bool Update(size_t n) {
+        if (n >= Size_) {
+            Size_ *= 2;
+            Peak_ = 0;
+            Polls_ = 0;
+            return true;
+        }
+        Peak_ = Peak_ > n ? Peak_ : n;
+        if (++Polls_ < Period) {
+            return false;
+        }
+        bool shrink = Size_ > Initial && Peak_ * 4 < Size_;
+        if (shrink) {
+            Size_ /= 2;
+        }
+        Peak_ = 0;
+        Polls_ = 0;
+        return shrink;
+    }
+
+private:
+    size_t Size_ = Initial;
+    size_t Peak_ = 0;
+    int Polls_ = 0;
+};
+
 template<typename T1, typename T2>
 inline std::tuple<T1, T2>
 GetDurationPair(TTime now, TTime deadline, std::chrono::milliseconds maxDuration)
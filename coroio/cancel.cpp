@@ -0,0 +1,107 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "cancel.hpp"
+
+#include <algorithm>
+
+namespace NNet {
+
+struct TCancellation::TAwaitableWait {
+    TAwaitableWait(std::shared_ptr<TState> state)
+        : State(std::move(state))
+    { }
+
+    TAwaitableWait(const TAwaitableWait&) = delete;
+    TAwaitableWait& operator=(const TAwaitableWait&) = delete;
+
+    ~TAwaitableWait() {
+        if (Waiter.Handle) {
+            if (Waiter.TimerDeadline != TTime::max()) {
+                State->Poller->RemoveTimer(Waiter.TimerId, Waiter.TimerDeadline);
+            }
+            Unregister();
+        }
+    }
+
+    bool await_ready() {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        Waiter.Handle = h;
+        Waiter.TimerDeadline = State->Deadline;
+        // without a deadline only Cancel() wakes the waiter
+        if (Waiter.TimerDeadline != TTime::max()) {
+            Waiter.TimerId = State->Poller->AddTimer(Waiter.TimerDeadline, h);
+        }
+        for (auto* state = State.get(); state; state = state->Parent.get()) {
+            state->Waiters.push_back(&Waiter);
+        }
+    }
+
+    void await_resume() {
+        Unregister();
+        Waiter.Handle = {};
+    }
+
+    void Unregister() {
+        for (auto* state = State.get(); state; state = state->Parent.get()) {
+            auto& waiters = state->Waiters;
+            waiters.erase(std::remove(waiters.begin(), waiters.end(), &Waiter), waiters.end());
+        }
+    }
+
+    std::shared_ptr<TState> State;
+    TWaiter Waiter;
+};
+
+TCancellation::TCancellation(TPollerBase& poller, TTime deadline)
+    : State_(std::make_shared<TState>(TState{&poller, deadline, nullptr}))
+{ }
+
+TCancellation::TCancellation(const TCancellation& parent, TTime deadline)
+    : State_(std::make_shared<TState>(TState{
+        parent.State_->Poller,
+        std::min(deadline, parent.State_->Deadline),
+        parent.State_}))
+{ }
+
+void TCancellation::Cancel() {
+    if (State_->Cancelled) {
+        return;
+    }
+    State_->Cancelled = true;
+    // resuming here could destroy the coroutine calling Cancel(), so the waiters are rescheduled
+    auto* poller = State_->Poller;
+    for (auto* waiter : State_->Waiters) {
+        if (waiter->TimerDeadline != TTime::max()) {
+            poller->RemoveTimer(waiter->TimerId, waiter->TimerDeadline);
+        }
+        waiter->TimerDeadline = TTime{};
+        waiter->TimerId = poller->AddTimer(waiter->TimerDeadline, waiter->Handle);
+    }
+}
+
+bool TCancellation::Cancelled() const {
+    for (auto* state = State_.get(); state; state = state->Parent.get()) {
+        if (state->Cancelled) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TCancellation::Throw() const {
+    if (Cancelled()) {
+        throw std::system_error(std::make_error_code(std::errc::operation_canceled));
+    }
+    throw std::system_error(std::make_error_code(std::errc::timed_out));
+}
+
+TFuture<void> TCancellation::Wait() {
+    if (!Cancelled() && TClock::now() < State_->Deadline) {
+        co_await TAwaitableWait(State_);
+    }
+    Throw();
+}
+
+} // namespace NNet
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <memory>
+#include <system_error>
+#include <vector>
+
+#include "base.hpp"
+#include "poller.hpp"
+#include "corochain.hpp"
+
+namespace NNet {
+
+/**
+ * @class TCancellation
+ * @brief Cancellation token with a deadline.
+ *
+ * A token is cancelled explicitly with @ref Cancel() or when its deadline passes.
+ * A child token created from a parent gets the earlier of both deadlines and is
+ * cancelled together with its parent, so a request deadline set at the top of a call
+ * tree bounds every nested step.
+ *
+ * @ref Run() races a future against the token. When the token fires first, the future
+ * is destroyed, which removes the socket waits and timers of all the coroutines it is
+ * awaiting, and the caller gets a std::system_error with std::errc::timed_out or
+ * std::errc::operation_canceled.
+ *
+ * Example:
+ * @code{.cpp}
+ * TFuture<void> handle(TPollerBase& poller, TSocket socket) {
+ *     TCancellation request(poller, TClock::now() + std::chrono::seconds(5));
+ *     auto head = co_await request.Run(ReadHead(socket));
+ *     TCancellation backend(request, TClock::now() + std::chrono::seconds(1));
+ *     auto [user, orders] = co_await backend.Run(WhenAll(LoadUser(head), LoadOrders(head)));
+ *     ...
+ * }
+ * @endcode
+ *
+ * Copies share the state. Tokens are used from the thread of their poller.
+ */
+class TCancellation {
+public:
+    /// Creates a root token expiring at @p deadline.
+    explicit TCancellation(TPollerBase& poller, TTime deadline = TTime::max());
+    /// Creates a child of @p parent expiring at the earlier of @p deadline and the parent's deadline.
+    TCancellation(const TCancellation& parent, TTime deadline);
+
+    TCancellation(const TCancellation&) = default;
+    TCancellation& operator=(const TCancellation&) = default;
+
+    /// Cancels the token and all its children. Awaiting coroutines fail on the next poller iteration.
+    void Cancel();
+    /// Returns true if this token or one of its parents is cancelled.
+    bool Cancelled() const;
+    /// Returns the effective deadline.
+    TTime Deadline() const {
+        return State_->Deadline;
+    }
+
+    /**
+     * @brief Fails when the token is cancelled or its deadline passes.
+     *
+     * Never completes successfully.
+     */
+    TFuture<void> Wait();
+
+    /**
+     * @brief Awaits @p future unless the token fires first.
+     *
+     * @throws std::system_error With std::errc::timed_out or std::errc::operation_canceled
+     *         after destroying @p future.
+     */
+    template<typename T>
+    TFuture<T> Run(TFuture<T> future) {
+        auto result = co_await WhenAny(std::move(future), Wait());
+        if constexpr (!std::is_void_v<T>) {
+            co_return std::get<0>(std::move(result));
+        }
+    }
+
+private:
+    struct TWaiter {
+        THandle Handle;
+        unsigned TimerId = 0;
+        TTime TimerDeadline = {};
+    };
+
+    struct TState {
+        TPollerBase* Poller = nullptr;
+        TTime Deadline = {};
+        std::shared_ptr<TState> Parent = {};
+        bool Cancelled = false;
+        std::vector<TWaiter*> Waiters = {}; ///< Waiters of this token and of its children.
+    };
+
+    struct TAwaitableWait;
+
+    void Throw() const;
+
+    std::shared_ptr<TState> State_;
+};
+
+} // namespace NNet
@@ -0,0 +1,289 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "chain.hpp"
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace NNet {
+
+struct TChainBuffer::TSlab {
+    uint32_t Refs;
+    TSlab* Next; ///< Link of the free list.
+    char Data[SlabSize];
+};
+
+namespace {
+
+struct TSlabPool {
+    static constexpr size_t MaxCached = 64;
+
+    ~TSlabPool() {
+        while (Head) {
+            auto* next = Head->Next;
+            delete Head;
+            Head = next;
+        }
+    }
+
+    TChainBuffer::TSlab* Head = nullptr;
+    size_t Count = 0;
+};
+
+thread_local TSlabPool SlabPool;
+
+} // namespace
+
+TChainBuffer::TSlab* TChainBuffer::Allocate() {
+    auto& pool = SlabPool;
+    TSlab* slab = pool.Head;
+    if (slab) {
+        pool.Head = slab->Next;
+        pool.Count--;
+    } else {
+        slab = new TSlab;
+    }
+    slab->Refs = 1;
+    slab->Next = nullptr;
+    return slab;
+}
+
+void TChainBuffer::Release(TSlab* slab) {
+    if (--slab->Refs != 0) {
+        return;
+    }
+    auto& pool = SlabPool;
+    if (pool.Count >= TSlabPool::MaxCached) {
+        delete slab;
+        return;
+    }
+    slab->Next = pool.Head;
+    pool.Head = slab;
+    pool.Count++;
+}
+
+TChainBuffer::TChainBuffer(TChainBuffer&& other) noexcept
+    : Segments_(std::move(other.Segments_))
+    , Head_(other.Head_)
+    , Size_(other.Size_)
+{
+    other.Segments_.clear();
+    other.Head_ = other.Size_ = 0;
+}
+
+TChainBuffer& TChainBuffer::operator=(TChainBuffer&& other) noexcept {
+    if (this != &other) {
+        Clear();
+        Segments_ = std::move(other.Segments_);
+        Head_ = other.Head_;
+        Size_ = other.Size_;
+        other.Segments_.clear();
+        other.Head_ = other.Size_ = 0;
+    }
+    return *this;
+}
+
+TChainBuffer::~TChainBuffer() {
+    Clear();
+}
+
+void TChainBuffer::Clear() {
+    for (size_t i = Head_; i < Segments_.size(); i++) {
+        Release(Segments_[i].Slab);
+    }
+    Segments_.clear();
+    Head_ = Size_ = 0;
+}
+
+void TChainBuffer::ShrinkToFit() {
+    Clear();
+    Segments_.shrink_to_fit();
+}
+
+std::span<char> TChainBuffer::Writable(size_t size) {
+    if (Head_ < Segments_.size()) {
+        auto& last = Segments_.back();
+        // a shared slab may hold bytes of another buffer after our end
+        if (last.Slab->Refs == 1 && SlabSize - last.End >= size) {
+            return {last.Slab->Data + last.End, SlabSize - last.End};
+        }
+    }
+    auto* slab = Allocate();
+    Segments_.push_back({slab, 0, 0});
+    return {slab->Data, SlabSize};
+}
+
+void TChainBuffer::Commit(size_t size) {
+    Segments_.back().End += size;
+    Size_ += size;
+}
+
+void TChainBuffer::Append(const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size != 0) {
+        auto free = Writable();
+        size_t n = std::min(size, free.size());
+        memcpy(free.data(), p, n);
+        Commit(n);
+        p += n;
+        size -= n;
+    }
+}
+
+void TChainBuffer::Append(TChainBuffer&& other) {
+    if (this == &other) {
+        return;
+    }
+    if (Head_ < Segments_.size() && Segments_.back().Begin == Segments_.back().End) {
+        Release(Segments_.back().Slab);
+        Segments_.pop_back();
+    }
+    for (size_t i = other.Head_; i < other.Segments_.size(); i++) {
+        auto& segment = other.Segments_[i];
+        if (segment.Begin == segment.End) {
+            Release(segment.Slab);
+        } else {
+            Segments_.push_back(segment);
+        }
+    }
+    Size_ += other.Size_;
+    other.Segments_.clear();
+    other.Head_ = other.Size_ = 0;
+}
+
+void TChainBuffer::Consume(size_t size) {
+    size = std::min(size, Size_);
+    Size_ -= size;
+    while (size != 0) {
+        auto& segment = Segments_[Head_];
+        size_t len = segment.End - segment.Begin;
+        if (len > size) {
+            segment.Begin += size;
+            break;
+        }
+        size -= len;
+        Release(segment.Slab);
+        Head_++;
+    }
+    if (Size_ == 0) {
+        Clear();
+    } else if (Head_ > 16 && Head_ * 2 > Segments_.size()) {
+        Segments_.erase(Segments_.begin(), Segments_.begin() + Head_);
+        Head_ = 0;
+    }
+}
+
+size_t TChainBuffer::Read(void* data, size_t size) {
+    size = std::min(size, Size_);
+    char* p = static_cast<char*>(data);
+    size_t left = size;
+    for (size_t i = Head_; left != 0; i++) {
+        const auto& segment = Segments_[i];
+        size_t n = std::min<size_t>(left, segment.End - segment.Begin);
+        memcpy(p, segment.Slab->Data + segment.Begin, n);
+        p += n;
+        left -= n;
+    }
+    Consume(size);
+    return size;
+}
+
+TChainBuffer TChainBuffer::Cut(size_t size) {
+    size = std::min(size, Size_);
+    TChainBuffer result;
+    result.Size_ = size;
+    Size_ -= size;
+    while (size != 0) {
+        auto& segment = Segments_[Head_];
+        size_t len = segment.End - segment.Begin;
+        if (len > size) {
+            segment.Slab->Refs++;
+            result.Segments_.push_back({segment.Slab, segment.Begin, static_cast<uint32_t>(segment.Begin + size)});
+            segment.Begin += size;
+            break;
+        }
+        result.Segments_.push_back(segment);
+        size -= len;
+        Head_++;
+    }
+    if (Size_ == 0) {
+        Clear();
+    }
+    return result;
+}
+
+size_t TChainBuffer::Find(std::string_view needle, size_t from) const {
+    if (from > Size_) {
+        return npos;
+    }
+    if (needle.empty()) {
+        return from;
+    }
+    // compares the needle with the bytes at offset `at` of segment `i`, across segments
+    auto matches = [&](size_t i, size_t at) {
+        size_t matched = 0;
+        while (matched < needle.size()) {
+            if (i == Segments_.size()) {
+                return false;
+            }
+            const auto& segment = Segments_[i];
+            size_t n = std::min<size_t>(needle.size() - matched, segment.End - at);
+            if (memcmp(segment.Slab->Data + at, needle.data() + matched, n) != 0) {
+                return false;
+            }
+            matched += n;
+            if (++i < Segments_.size()) {
+                at = Segments_[i].Begin;
+            }
+        }
+        return true;
+    };
+
+    size_t base = 0;
+    for (size_t i = Head_; i < Segments_.size(); i++) {
+        const auto& segment = Segments_[i];
+        size_t len = segment.End - segment.Begin;
+        if (base + len <= from) {
+            base += len;
+            continue;
+        }
+        const char* begin = segment.Slab->Data + segment.Begin;
+        const char* p = begin + (from > base ? from - base : 0);
+        const char* end = segment.Slab->Data + segment.End;
+        while (p < end) {
+            auto* q = NUtils::FindByte(p, end - p, needle[0]);
+            if (!q) {
+                break;
+            }
+            if (matches(i, q - segment.Slab->Data)) {
+                return base + (q - begin);
+            }
+            p = q + 1;
+        }
+        base += len;
+    }
+    return npos;
+}
+
+int TChainBuffer::Iov(iovec* iov, int count) const {
+    int n = 0;
+    for (size_t i = Head_; i < Segments_.size() && n < count; i++) {
+        const auto& segment = Segments_[i];
+        if (segment.Begin != segment.End) {
+            iov[n++] = {segment.Slab->Data + segment.Begin, segment.End - segment.Begin};
+        }
+    }
+    return n;
+}
+
+std::string TChainBuffer::ToString() const {
+    std::string result;
+    result.reserve(Size_);
+    for (size_t i = Head_; i < Segments_.size(); i++) {
+        const auto& segment = Segments_[i];
+        result.append(segment.Slab->Data + segment.Begin, segment.End - segment.Begin);
+    }
+    return result;
+}
+
+} // namespace NNet
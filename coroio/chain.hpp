@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "socket.hpp"
+
+namespace NNet {
+
+/**
+ * @class TChainBuffer
+ * @brief Byte queue stored in a chain of pooled fixed-size slabs.
+ *
+ * Appending never moves stored bytes: when the last slab is full a new one is linked,
+ * so a reader can receive straight into @ref Writable() and a writer can send the whole
+ * queue with one vectored call over @ref Iov(). Data is handed between buffers without
+ * copying: @ref Append(TChainBuffer&&) relinks the slabs of another buffer and
+ * @ref Cut() detaches a prefix, sharing the slab it ends in by reference count.
+ *
+ * @ref Find() searches across slab boundaries from an offset, so a caller looking for a
+ * delimiter in a growing buffer scans every byte once.
+ *
+ * Released slabs are kept on a per-thread free list. Buffers sharing slabs must be used
+ * from one thread; an empty buffer allocates nothing.
+ *
+ * Example:
+ * @code{.cpp}
+ * TChainBuffer buffer;
+ * auto free = buffer.Writable();
+ * buffer.Commit(co_await socket.ReadSome(free.data(), free.size()));
+ * if (auto pos = buffer.Find("\r\n\r\n"); pos != TChainBuffer::npos) {
+ *     TChainBuffer head = buffer.Cut(pos + 4);
+ *     co_await TByteWriter(upstream).Write(head);
+ * }
+ * @endcode
+ */
+class TChainBuffer {
+public:
+    static constexpr size_t SlabSize = 16384; ///< Capacity of one slab.
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    struct TSlab; ///< Storage of @c SlabSize bytes, opaque.
+
+    TChainBuffer() = default;
+    TChainBuffer(TChainBuffer&& other) noexcept;
+    TChainBuffer& operator=(TChainBuffer&& other) noexcept;
+    TChainBuffer(const TChainBuffer&) = delete;
+    TChainBuffer& operator=(const TChainBuffer&) = delete;
+    ~TChainBuffer();
+
+    size_t Size() const {
+        return Size_;
+    }
+
+    bool Empty() const {
+        return Size_ == 0;
+    }
+
+    /// Copies @p size bytes to the end.
+    void Append(const void* data, size_t size);
+    /// Moves all bytes of @p other to the end, @p other becomes empty.
+    void Append(TChainBuffer&& other);
+
+    /**
+     * @brief Returns free space after the stored bytes, at least @p size bytes long.
+     *
+     * Links a new slab if the last one has less room or is shared with another buffer.
+     * @p size must not exceed @c SlabSize.
+     */
+    std::span<char> Writable(size_t size = 1);
+    /// Appends @p size bytes written into @ref Writable().
+    void Commit(size_t size);
+
+    /// Drops @p size bytes from the front.
+    void Consume(size_t size);
+    /// Copies out and drops up to @p size bytes, returns their number.
+    size_t Read(void* data, size_t size);
+    /// Detaches the first @p size bytes into a new buffer without copying them.
+    TChainBuffer Cut(size_t size);
+    /// Drops all bytes.
+    void Clear();
+    /// Drops all bytes and frees the segment list, e.g. while the connection is idle.
+    void ShrinkToFit();
+
+    /**
+     * @brief Finds the first occurrence of @p needle starting at offset @p from.
+     *
+     * @return The offset of the match, or @c npos.
+     */
+    size_t Find(std::string_view needle, size_t from = 0) const;
+
+    /**
+     * @brief Describes the stored bytes as up to @p count contiguous blocks.
+     *
+     * The blocks stay valid until the buffer is modified.
+     *
+     * @return The number of elements of @p iov filled.
+     */
+    int Iov(iovec* iov, int count) const;
+
+    /// Returns a copy of the stored bytes.
+    std::string ToString() const;
+
+private:
+    struct TSegment {
+        TSlab* Slab;
+        uint32_t Begin;
+        uint32_t End;
+    };
+
+    static TSlab* Allocate();
+    static void Release(TSlab* slab);
+
+    std::vector<TSegment> Segments_; ///< Segments before @c Head_ are consumed.
+    size_t Head_ = 0;
+    size_t Size_ = 0;
+};
+
+} // namespace NNet
@@ -55,13 +55,18 @@
  */
 
 #include <coroutine>
+#include <exception>
 #include <optional>
+#include <tuple>
+#include <utility>
 #include <variant>
 #include <memory>
 #include <functional>
 
 #include "promises.hpp"
 #include "poller.hpp"
+#include "framepool.hpp"
+#include "arena.hpp"
 
 namespace NNet {
 
@@ -73,7 +78,8 @@ template<typename T> struct TFuture;
  * @brief Base promise type for coroutines.
  *
  * Provides the initial and final suspension behavior and stores the caller
- * coroutine's handle.
+ * coroutine's handle. With @c COROIO_FRAME_POOL coroutine frames are allocated
+ * from @ref TFramePool, with @c COROIO_ARENA from the current @ref TArena if any.
  *
  * @tparam T The type of the coroutine's return value.
  */
@@ -81,8 +87,57 @@ template<typename T>
 struct TPromiseBase {
     std::suspend_never initial_suspend() { return {}; }
     TFinalAwaiter<T> final_suspend() noexcept;
+
+#ifdef COROIO_ARENA
+    static void* operator new(size_t size) {
+        return NDetail::AllocateFrame(size);
+    }
+
+    static void operator delete(void* ptr, size_t size) {
+        NDetail::DeallocateFrame(ptr, size);
+    }
+
+    /// Makes the arena of the frame current whenever the coroutine resumes.
+    template<typename TAwaiter>
+    NDetail::TArenaAwaiter<std::remove_reference_t<TAwaiter>> await_transform(TAwaiter&& awaiter) {
+        return {awaiter, &ArenaLink};
+    }
+
+    NDetail::TArenaLink ArenaLink;
+#elif defined(COROIO_FRAME_POOL)
+    static void* operator new(size_t size) {
+        return TFramePool::Allocate(size);
+    }
+
+    static void operator delete(void* ptr, size_t size) {
+        TFramePool::Deallocate(ptr, size);
+    }
+#endif
+
     /// Handle to the caller coroutine (initialized to a no-operation coroutine).
     std::coroutine_handle<> Caller = std::noop_coroutine();
+
+#ifdef COROIO_STATS
+    TPromiseBase() = default;
+    TPromiseBase(const TPromiseBase&) = delete;
+    TPromiseBase& operator=(const TPromiseBase&) = delete;
+
+    ~TPromiseBase() {
+        if (Traced) {
+            NDetail::TFrameRegistry::Get().Remove(Traced);
+        }
+    }
+
+    /// Makes the frame known to stall detectors, see @ref TPollerBase::SetStallDetector().
+    void Trace(void* frame) {
+        if (NDetail::TFrameRegistry::Enabled()) {
+            Traced = frame;
+            NDetail::TFrameRegistry::Get().Add(frame, &Caller);
+        }
+    }
+
+    void* Traced = nullptr;
+#endif
 };
 
 /**
@@ -126,7 +181,11 @@ struct TFutureBase {
     TFutureBase() = default;
     TFutureBase(TPromise<T>& promise)
         : Coro(Coro.from_promise(promise))
-    { }
+    {
+#ifdef COROIO_STATS
+        promise.Trace(Coro.address());
+#endif
+    }
     TFutureBase(TFutureBase&& other)
     {
         *this = std::move(other);
@@ -175,6 +234,12 @@ template<> struct TFuture<void>;
  */
 template<typename T>
 struct TFuture : public TFutureBase<T> {
+    /// Returns true if the coroutine finished with an exception.
+    bool Failed() const {
+        const auto& errorOr = this->Coro.promise().ErrorOr;
+        return errorOr && std::holds_alternative<std::exception_ptr>(*errorOr);
+    }
+
     T await_resume() {
         auto& errorOr = *this->Coro.promise().ErrorOr;
         if (auto* res = std::get_if<T>(&errorOr)) {
@@ -235,6 +300,12 @@ struct TPromise<void>: public TPromiseBase<void> {
  */
 template<>
 struct TFuture<void> : public TFutureBase<void> {
+    /// Returns true if the coroutine finished with an exception.
+    bool Failed() const {
+        const auto& errorOr = this->Coro.promise().ErrorOr;
+        return errorOr && *errorOr;
+    }
+
     void await_resume() {
         auto& errorOr = *this->Coro.promise().ErrorOr;
         if (errorOr) {
@@ -278,6 +349,9 @@ template<typename T>
 struct TFinalAwaiter {
     bool await_ready() noexcept { return false; }
     std::coroutine_handle<> await_suspend(std::coroutine_handle<TPromise<T>> h) noexcept {
+#ifdef COROIO_ARENA
+        TArena::Current() = h.promise().ArenaLink.Resumer;
+#endif
         return h.promise().Caller;
     }
     void await_resume() noexcept { }
@@ -291,6 +365,35 @@ TFuture<T> TPromise<T>::get_return_object() { return { TFuture<T>{*this} }; }
 template<typename T>
 TFinalAwaiter<T> TPromiseBase<T>::final_suspend() noexcept { return {}; }
 
+/**
+ * @brief Runs a request with its own arena.
+ *
+ * The future returned by @p func and all the futures it creates are allocated from
+ * @p arena (with @c COROIO_ARENA), which is reset once the request is done and they are
+ * destroyed.
+ *
+ * @code{.cpp}
+ * TArena arena; // one per connection, reused by its requests
+ * while (true) {
+ *     co_await WithArena(arena, [&]() { return Serve(reader, writer); });
+ * }
+ * @endcode
+ *
+ * @tparam TFunc Returns a @ref TFuture.
+ */
+template<typename TFunc, typename TResult = decltype(std::declval<TFunc>()())>
+TResult WithArena(TArena& arena, TFunc func) {
+    struct TReset {
+        ~TReset() { Arena.Reset(); }
+        TArena& Arena;
+    } reset{arena};
+    auto future = [&]() {
+        TArenaScope scope(&arena);
+        return func();
+    }();
+    co_return co_await future;
+}
+
 /**
  * @brief Awaits the completion of all futures and collects their results.
  *
@@ -370,4 +473,146 @@ inline TFuture<void> Any(std::vector<TFuture<void>>&& futures) {
     co_return;
 }
 
+namespace NDetail {
+
+/// Result type of a future in @ref WhenAll() and @ref WhenAny(), void becomes std::monostate.
+template<typename T>
+struct TWhenResult {
+    using TType = T;
+};
+
+template<>
+struct TWhenResult<void> {
+    using TType = std::monostate;
+};
+
+template<typename T>
+typename TWhenResult<T>::TType TakeResult(TFuture<T>& future) {
+    if constexpr (std::is_void_v<T>) {
+        future.await_resume();
+        return {};
+    } else {
+        return future.await_resume();
+    }
+}
+
+/// Destroys the coroutine of @p future, cancelling the operations it waits for.
+template<typename T>
+void Drop(TFuture<T>& future) {
+    [[maybe_unused]] auto dropped = std::move(future);
+}
+
+} // namespace NDetail
+
+/**
+ * @brief Awaits a fixed set of futures and returns all their results.
+ *
+ * Unlike @ref All() the futures may have different types and no vector is built:
+ * the futures live in the frame of the combinator, the only allocation. If a future
+ * fails, the others are destroyed at once, which cancels their pending socket waits
+ * and timers, and its exception is rethrown.
+ *
+ * @code{.cpp}
+ * auto [user, orders] = co_await WhenAll(LoadUser(id), LoadOrders(id));
+ * @endcode
+ *
+ * @return A future of a tuple with one element per future, std::monostate for void ones.
+ */
+template<typename... T>
+TFuture<std::tuple<typename NDetail::TWhenResult<T>::TType...>> WhenAll(TFuture<T>... futures) {
+    auto self = co_await Self();
+    while (true) {
+        bool pending = false;
+        std::exception_ptr error;
+        auto check = [&](auto& f) {
+            if (!f.done()) {
+                pending = true;
+            } else if (!error && f.Failed()) {
+                try {
+                    f.await_resume();
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+        };
+        (check(futures), ...);
+        if (error) {
+            (NDetail::Drop(futures), ...);
+            std::rethrow_exception(error);
+        }
+        if (!pending) {
+            break;
+        }
+        auto subscribe = [&](auto& f) {
+            if (!f.done()) {
+                f.await_suspend(self);
+            }
+        };
+        (subscribe(futures), ...);
+        co_await std::suspend_always();
+    }
+    co_return std::tuple<typename NDetail::TWhenResult<T>::TType...>{NDetail::TakeResult(futures)...};
+}
+
+/**
+ * @brief Awaits the first of a fixed set of futures to finish.
+ *
+ * The other futures are destroyed as soon as the first one finishes, so their pending
+ * socket waits and timers are cancelled right away. If the first one failed, its
+ * exception is rethrown.
+ *
+ * @code{.cpp}
+ * auto result = co_await WhenAny(Query(primary), Query(replica));
+ * auto& answer = result.index() == 0 ? std::get<0>(result) : std::get<1>(result);
+ * @endcode
+ *
+ * @return A future of a variant holding the result of the winner at its index,
+ *         std::monostate for void futures.
+ */
+template<typename... T>
+TFuture<std::variant<typename NDetail::TWhenResult<T>::TType...>> WhenAny(TFuture<T>... futures) {
+    using TResult = std::variant<typename NDetail::TWhenResult<T>::TType...>;
+    constexpr size_t none = sizeof...(T);
+    auto self = co_await Self();
+    size_t winner = none;
+    while (true) {
+        size_t index = 0;
+        auto find = [&](auto& f) {
+            if (winner == none && f.done()) {
+                winner = index;
+            }
+            index++;
+        };
+        (find(futures), ...);
+        if (winner != none) {
+            break;
+        }
+        (futures.await_suspend(self), ...);
+        co_await std::suspend_always();
+    }
+
+    std::optional<TResult> result;
+    std::exception_ptr error;
+    auto refs = std::tie(futures...);
+    [&]<size_t... I>(std::index_sequence<I...>) {
+        auto take = [&]<size_t J>(std::integral_constant<size_t, J>) {
+            auto& f = std::get<J>(refs);
+            if (J != winner) {
+                NDetail::Drop(f);
+                return;
+            }
+            try {
+                result.emplace(std::in_place_index<J>, NDetail::TakeResult(f));
+            } catch (...) {
+                error = std::current_exception();
+            }
+        };
+        (take(std::integral_constant<size_t, I>{}), ...);
+    }(std::index_sequence_for<T...>{});
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    co_return std::move(*result);
+}
+
 } // namespace NNet
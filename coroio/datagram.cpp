@@ -0,0 +1,184 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "datagram.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+namespace NNet {
+
+TDatagramSocket::TDatagramSocket(TPollerBase& poller, int domain)
+    : TSocket(poller, domain, SOCK_DGRAM)
+{ }
+
+TFuture<int> TDatagramSocket::SendTo(const void* buf, size_t size, const TAddress& address) {
+    TDatagram datagram{.Data = const_cast<void*>(buf), .Size = size, .Address = address};
+    co_await SendMany(&datagram, 1);
+    co_return static_cast<int>(size);
+}
+
+TFuture<int> TDatagramSocket::RecvFrom(void* buf, size_t size, TAddress* from) {
+    TDatagram datagram{.Data = buf, .Size = size};
+    co_await RecvMany(&datagram, 1);
+    if (from) {
+        *from = *datagram.Address;
+    }
+    co_return static_cast<int>(datagram.Size);
+}
+
+bool TDatagramSocket::SetGro(int fd, bool enable) {
+#ifdef __linux__
+    int value = enable;
+    return setsockopt(fd, IPPROTO_UDP, UDP_GRO, &value, sizeof(value)) == 0;
+#else
+    (void)fd; (void)enable;
+    return false;
+#endif
+}
+
+#ifdef __linux__
+
+namespace {
+
+struct TMessages {
+    mmsghdr Headers[TDatagramSocket::MaxBatch];
+    iovec Iov[TDatagramSocket::MaxBatch];
+    sockaddr_storage Addresses[TDatagramSocket::MaxBatch];
+    alignas(cmsghdr) char Control[TDatagramSocket::MaxBatch][CMSG_SPACE(sizeof(int))];
+};
+
+} // namespace
+
+void TDatagramSocket::PrepareSend(msghdr& h, iovec& iov, char* control, const TDatagram& d) {
+    iov = {d.Data, d.Size};
+    h.msg_iov = &iov;
+    h.msg_iovlen = 1;
+    if (d.Address) {
+        auto [addr, len] = d.Address->RawAddr();
+        h.msg_name = const_cast<sockaddr*>(addr);
+        h.msg_namelen = len;
+    }
+    if (d.Segment) {
+        h.msg_control = control;
+        h.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+        auto* cmsg = CMSG_FIRSTHDR(&h);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        memcpy(CMSG_DATA(cmsg), &d.Segment, sizeof(uint16_t));
+    }
+}
+
+void TDatagramSocket::PrepareRecv(msghdr& h, iovec& iov, char* control, size_t controlSize, sockaddr_storage& addr, const TDatagram& d) {
+    iov = {d.Data, d.Size};
+    h.msg_iov = &iov;
+    h.msg_iovlen = 1;
+    h.msg_name = &addr;
+    h.msg_namelen = sizeof(addr);
+    h.msg_control = control;
+    h.msg_controllen = controlSize;
+}
+
+void TDatagramSocket::CompleteRecv(const msghdr& h, size_t size, TDatagram& d) {
+    d.Size = size;
+    d.Truncated = h.msg_flags & MSG_TRUNC;
+    d.Segment = 0;
+    d.Address.reset();
+    if (h.msg_namelen > 0) {
+        d.Address = TAddress(static_cast<sockaddr*>(h.msg_name), h.msg_namelen);
+    }
+    for (auto* cmsg = CMSG_FIRSTHDR(&h); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&h), cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int segment;
+            memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+            d.Segment = segment;
+        }
+    }
+}
+
+void TDatagramSocket::CompleteRecv(const TMessage& m, int size, TDatagram& d) {
+    CompleteRecv(m.Header, size, d);
+}
+
+int TDatagramSocket::SendBatch(int fd, TDatagram* datagrams, size_t count) {
+    count = std::min(count, MaxBatch);
+    TMessages m;
+    memset(m.Headers, 0, sizeof(m.Headers[0]) * count);
+    for (size_t i = 0; i < count; i++) {
+        PrepareSend(m.Headers[i].msg_hdr, m.Iov[i], m.Control[i], datagrams[i]);
+    }
+    return sendmmsg(fd, m.Headers, count, 0);
+}
+
+int TDatagramSocket::RecvBatch(int fd, TDatagram* datagrams, size_t count) {
+    count = std::min(count, MaxBatch);
+    TMessages m;
+    memset(m.Headers, 0, sizeof(m.Headers[0]) * count);
+    for (size_t i = 0; i < count; i++) {
+        PrepareRecv(m.Headers[i].msg_hdr, m.Iov[i], m.Control[i], sizeof(m.Control[i]), m.Addresses[i], datagrams[i]);
+    }
+    int ret = recvmmsg(fd, m.Headers, count, 0, nullptr);
+    for (int i = 0; i < ret; i++) {
+        CompleteRecv(m.Headers[i].msg_hdr, m.Headers[i].msg_len, datagrams[i]);
+    }
+    return ret;
+}
+
+#else
+
+int TDatagramSocket::SendBatch(int fd, TDatagram* datagrams, size_t count) {
+    int sent = 0;
+    for (size_t i = 0; i < count; i++, sent++) {
+        auto& d = datagrams[i];
+        const sockaddr* addr = nullptr;
+        socklen_t len = 0;
+        if (d.Address) {
+            auto raw = d.Address->RawAddr();
+            addr = raw.first;
+            len = raw.second;
+        }
+        if (::sendto(fd, static_cast<const char*>(d.Data), d.Size, 0, addr, len) < 0) {
+            // the errno of the first failure is reported to the awaitable
+            return sent ? sent : -1;
+        }
+    }
+    return sent;
+}
+
+int TDatagramSocket::RecvBatch(int fd, TDatagram* datagrams, size_t count) {
+    int received = 0;
+    for (size_t i = 0; i < count; i++, received++) {
+        auto& d = datagrams[i];
+        sockaddr_storage addr;
+        socklen_t len = sizeof(addr);
+        auto size = ::recvfrom(fd, static_cast<char*>(d.Data), d.Size, 0, reinterpret_cast<sockaddr*>(&addr), &len);
+        if (size < 0) {
+            return received ? received : -1;
+        }
+        d.Truncated = false; // not reported by recvfrom(2)
+        d.Size = size;
+        d.Segment = 0;
+        d.Address = TAddress(reinterpret_cast<sockaddr*>(&addr), len);
+    }
+    return received;
+}
+
+void TDatagramSocket::CompleteRecv(const TMessage& m, int size, TDatagram& d) {
+    d.Size = size;
+    d.Truncated = false;
+    d.Segment = 0;
+    d.Address = TAddress(reinterpret_cast<sockaddr*>(const_cast<sockaddr_storage*>(&m.Address)), m.AddressLen);
+}
+
+#endif
+
+} // namespace NNet
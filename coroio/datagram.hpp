@@ -0,0 +1,286 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+
+#include "socket.hpp"
+
+namespace NNet {
+
+/**
+ * @struct TDatagram
+ * @brief One message of a batched @ref TDatagramSocket operation.
+ */
+struct TDatagram {
+    void* Data = nullptr; ///< Payload to send, or the buffer to receive into.
+    size_t Size = 0;      ///< Payload size; on receive the buffer size, replaced by the received size.
+    std::optional<TAddress> Address = {}; ///< Destination (none on a connected socket), or the source on receive.
+    /**
+     * @brief UDP segment size (GSO/GRO, Linux only).
+     *
+     * On send, a non-zero value makes the kernel split @c Data into datagrams of this size
+     * (the last may be shorter). On receive with @ref TDatagramSocket::SetGro(), the size of
+     * the datagrams coalesced into @c Data, or 0 if it holds a single datagram.
+     */
+    uint16_t Segment = 0;
+    bool Truncated = false; ///< Set on receive if the datagram did not fit into @c Size bytes.
+};
+
+/**
+ * @class TDatagramSocket
+ * @brief UDP socket with addressed and batched sends and receives.
+ *
+ * @ref SendMany() and @ref RecvMany() move a whole array of @ref TDatagram per system call
+ * on Linux (sendmmsg(2), recvmmsg(2)); elsewhere they loop over sendto(2)/recvfrom(2) until
+ * the socket would block. Both return as soon as at least one message is transferred, so a
+ * receive loop drains everything queued in the kernel with a single wakeup.
+ *
+ * With Linux UDP segmentation offload one large send is split into many datagrams by the
+ * kernel (@ref TDatagram::Segment), and with @ref SetGro() consecutive datagrams of one flow
+ * are received as a single buffer.
+ *
+ * Example:
+ * @code{.cpp}
+ * TDatagramSocket socket(poller, AF_INET);
+ * socket.Bind(TAddress{"0.0.0.0", 9000});
+ * std::array<std::array<char, 1500>, 32> buffers;
+ * std::array<TDatagram, 32> batch;
+ * while (true) {
+ *     for (size_t i = 0; i < batch.size(); i++) {
+ *         batch[i] = {.Data = buffers[i].data(), .Size = buffers[i].size()};
+ *     }
+ *     int n = co_await socket.RecvMany(batch.data(), batch.size());
+ *     for (int i = 0; i < n; i++) {
+ *         Process(batch[i].Data, batch[i].Size, *batch[i].Address);
+ *     }
+ * }
+ * @endcode
+ *
+ * Readiness-based pollers only (@ref TSelect, @ref TPoll, @ref TEPoll, @ref TKqueue); see
+ * @ref TPollerDrivenDatagramSocket for the others, or use @c TPoller::TDatagramSocket.
+ */
+class TDatagramSocket: public TSocket {
+public:
+    /// Maximum number of messages moved by one system call, larger batches are cut.
+    static constexpr size_t MaxBatch = 64;
+
+    TDatagramSocket() = default;
+    TDatagramSocket(TPollerBase& poller, int domain);
+
+    TDatagramSocket(TDatagramSocket&& other) = default;
+    TDatagramSocket& operator=(TDatagramSocket&& other) = default;
+
+    /**
+     * @brief Sends the datagrams of @p datagrams.
+     *
+     * @return An awaitable yielding the number of datagrams sent, at least one.
+     */
+    auto SendMany(TDatagram* datagrams, size_t count) {
+        struct TAwaitableSend: public TAwaitable<TAwaitableSend> {
+            void run() {
+                this->ret = TDatagramSocket::SendBatch(this->fd, static_cast<TDatagram*>(this->b), this->s);
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                this->poller->AddWrite(this->fd, h);
+                this->wait.Arm(this->poller, this->fd, TEvent::WRITE, h);
+            }
+        };
+        return TAwaitableSend{Poller_, Fd_, datagrams, count};
+    }
+
+    /**
+     * @brief Receives up to @p count datagrams into the buffers of @p datagrams.
+     *
+     * Updates @c Size, @c Address, @c Segment and @c Truncated of every filled entry.
+     *
+     * @return An awaitable yielding the number of datagrams received, at least one.
+     */
+    auto RecvMany(TDatagram* datagrams, size_t count) {
+        struct TAwaitableRecv: public TAwaitable<TAwaitableRecv> {
+            void run() {
+                this->ret = TDatagramSocket::RecvBatch(this->fd, static_cast<TDatagram*>(this->b), this->s);
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                this->poller->AddRead(this->fd, h);
+                this->wait.Arm(this->poller, this->fd, TEvent::READ, h);
+            }
+        };
+        return TAwaitableRecv{Poller_, Fd_, datagrams, count};
+    }
+
+    /// Sends one datagram to @p address, returns the number of bytes sent.
+    TFuture<int> SendTo(const void* buf, size_t size, const TAddress& address);
+    /// Receives one datagram, stores its source into @p from if not null; returns its size.
+    TFuture<int> RecvFrom(void* buf, size_t size, TAddress* from = nullptr);
+
+    /**
+     * @brief Enables UDP generic receive offload (UDP_GRO).
+     *
+     * @return False if the platform does not support it.
+     */
+    bool SetGro(bool enable) {
+        return SetGro(Fd_, enable);
+    }
+
+private:
+    template<typename T> friend class TPollerDrivenDatagramSocket;
+
+    static bool SetGro(int fd, bool enable);
+    static int SendBatch(int fd, TDatagram* datagrams, size_t count);
+    static int RecvBatch(int fd, TDatagram* datagrams, size_t count);
+
+    /// Storage of one message submitted to a completion-based poller.
+    struct TMessage {
+#ifdef __linux__
+        msghdr Header;
+        iovec Iov;
+        alignas(cmsghdr) char Control[CMSG_SPACE(sizeof(int))];
+#endif
+        sockaddr_storage Address;
+        socklen_t AddressLen;
+    };
+
+#ifdef __linux__
+    static void PrepareSend(msghdr& h, iovec& iov, char* control, const TDatagram& d);
+    static void PrepareRecv(msghdr& h, iovec& iov, char* control, size_t controlSize, sockaddr_storage& addr, const TDatagram& d);
+    static void CompleteRecv(const msghdr& h, size_t size, TDatagram& d);
+#endif
+    /// Fills @p d from the first message of a @ref TPollerDrivenDatagramSocket::RecvMany().
+    static void CompleteRecv(const TMessage& m, int size, TDatagram& d);
+};
+
+/**
+ * @class TPollerDrivenDatagramSocket
+ * @brief @ref TDatagramSocket of the completion-based pollers (@ref TUring, @ref TIOCp).
+ *
+ * The first datagram of @ref SendMany() and @ref RecvMany() is an operation of the poller:
+ * IORING_OP_SENDMSG and IORING_OP_RECVMSG with @ref TUring (segmentation offload included),
+ * an overlapped WSASendTo and WSARecvFrom with @ref TIOCp. Once it completes, the rest of the
+ * batch is moved at once without waiting, as many as the socket takes or has queued, with
+ * sendmmsg(2)/recvmmsg(2) on Linux. So a batch still costs one wakeup and, on Linux, two
+ * system calls.
+ *
+ * IOCP reports no truncation: a datagram larger than its buffer is received cut, with
+ * @c Truncated unset.
+ */
+template<typename T>
+class TPollerDrivenDatagramSocket: public TPollerDrivenSocket<T> {
+public:
+    TPollerDrivenDatagramSocket() = default;
+    TPollerDrivenDatagramSocket(T& poller, int domain)
+        : TPollerDrivenSocket<T>(poller, domain, SOCK_DGRAM)
+    { }
+
+    TPollerDrivenDatagramSocket(TPollerDrivenDatagramSocket&& other) = default;
+    TPollerDrivenDatagramSocket& operator=(TPollerDrivenDatagramSocket&& other) = default;
+
+    /// Same as @ref TDatagramSocket::SendMany().
+    auto SendMany(TDatagram* datagrams, size_t count) {
+        struct TAwaitable {
+            bool await_ready() const { return false; }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                auto& d = datagrams[0];
+#ifdef __linux__
+                TDatagramSocket::PrepareSend(m.Header, m.Iov, m.Control, d);
+                poller->SendMsg(fd, &m.Header, h);
+#else
+                const sockaddr* addr = nullptr;
+                socklen_t len = 0;
+                if (d.Address) {
+                    auto raw = d.Address->RawAddr();
+                    addr = raw.first;
+                    len = raw.second;
+                }
+                poller->SendTo(fd, d.Data, static_cast<int>(d.Size), addr, len, h);
+#endif
+                pending.Arm(poller, h);
+            }
+
+            int await_resume() {
+                pending.Disarm();
+                int ret = poller->Result();
+                if (ret < 0) {
+                    throw std::system_error(-ret, std::generic_category(), "sendmsg");
+                }
+                // an error of the rest, e.g. a full buffer, is reported by the next call
+                int more = count > 1 ? TDatagramSocket::SendBatch(fd, datagrams + 1, count - 1) : 0;
+                return 1 + std::max(more, 0);
+            }
+
+            T* poller;
+            int fd;
+            TDatagram* datagrams;
+            size_t count;
+            TDatagramSocket::TMessage m = {};
+            TPendingOp<T> pending = {};
+        };
+        return TAwaitable{this->Poller_, this->Fd_, datagrams, std::min(count, TDatagramSocket::MaxBatch)};
+    }
+
+    /// Same as @ref TDatagramSocket::RecvMany().
+    auto RecvMany(TDatagram* datagrams, size_t count) {
+        struct TAwaitable {
+            bool await_ready() const { return false; }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                auto& d = datagrams[0];
+#ifdef __linux__
+                TDatagramSocket::PrepareRecv(m.Header, m.Iov, m.Control, sizeof(m.Control), m.Address, d);
+                poller->RecvMsg(fd, &m.Header, h);
+#else
+                m.AddressLen = sizeof(m.Address);
+                poller->RecvFrom(fd, d.Data, static_cast<int>(d.Size), reinterpret_cast<sockaddr*>(&m.Address), &m.AddressLen, h);
+#endif
+                pending.Arm(poller, h);
+            }
+
+            int await_resume() {
+                pending.Disarm();
+                int ret = poller->Result();
+                if (ret < 0) {
+                    throw std::system_error(-ret, std::generic_category(), "recvmsg");
+                }
+                TDatagramSocket::CompleteRecv(m, ret, datagrams[0]);
+                // the datagrams that arrived meanwhile, without waiting for more
+                int more = count > 1 ? TDatagramSocket::RecvBatch(fd, datagrams + 1, count - 1) : 0;
+                return 1 + std::max(more, 0);
+            }
+
+            T* poller;
+            int fd;
+            TDatagram* datagrams;
+            size_t count;
+            TDatagramSocket::TMessage m = {};
+            TPendingOp<T> pending = {};
+        };
+        return TAwaitable{this->Poller_, this->Fd_, datagrams, std::min(count, TDatagramSocket::MaxBatch)};
+    }
+
+    /// Same as @ref TDatagramSocket::SendTo().
+    TFuture<int> SendTo(const void* buf, size_t size, const TAddress& address) {
+        TDatagram datagram{.Data = const_cast<void*>(buf), .Size = size, .Address = address};
+        co_await SendMany(&datagram, 1);
+        co_return static_cast<int>(size);
+    }
+
+    /// Same as @ref TDatagramSocket::RecvFrom().
+    TFuture<int> RecvFrom(void* buf, size_t size, TAddress* from = nullptr) {
+        TDatagram datagram{.Data = buf, .Size = size};
+        co_await RecvMany(&datagram, 1);
+        if (from) {
+            *from = *datagram.Address;
+        }
+        co_return static_cast<int>(datagram.Size);
+    }
+
+    /// Same as @ref TDatagramSocket::SetGro().
+    bool SetGro(bool enable) {
+        return TDatagramSocket::SetGro(this->Fd_, enable);
+    }
+};
+
+} // namespace NNet
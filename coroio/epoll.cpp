@@ -2,6 +2,12 @@
 #if defined(__linux__) || defined(_WIN32)
 #include "epoll.hpp"
 
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#endif
+
 namespace NNet {
 
 namespace {
@@ -16,22 +22,62 @@ int epoll_pwait2(HANDLE ephnd, struct epoll_event* events, int maxevents, const
     return epoll_wait(ephnd, events, maxevents, timeout);
 }
 #endif
+
+THandle& Waiter(THandlePair& ev, int type) {
+    switch (type) {
+    case TEvent::READ: return ev.Read;
+    case TEvent::WRITE: return ev.Write;
+    case TEvent::RHUP: return ev.RHup;
+    default: return ev.Err;
+    }
+}
+
+constexpr int EventTypes[] = {TEvent::READ, TEvent::WRITE, TEvent::RHUP, TEvent::ERR};
+
+#ifdef __linux__
+// struct epoll_params of <linux/eventpoll.h>, which clashes with <sys/epoll.h>
+struct TEpollParams {
+    uint32_t BusyPollUsecs;
+    uint16_t BusyPollBudget;
+    uint8_t PreferBusyPoll;
+    uint8_t Pad;
+};
+constexpr unsigned long EpollSetParams = _IOW(0x8A, 0x01, TEpollParams); // EPIOCSPARAMS
+constexpr uint16_t BusyPollPackets = 8; ///< Kernel default of busy_poll_budget.
+#endif
+
+uint64_t Tag(int fd, uint32_t generation) {
+    return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
+}
 }
 
 #ifdef __linux__
 static constexpr int epoll_flags = EPOLL_CLOEXEC;
 static constexpr int invalid_handle = -1;
+static constexpr uint32_t edge_events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
 #else
 static constexpr int epoll_flags = 0;
 static constexpr HANDLE invalid_handle = nullptr;
+static constexpr uint32_t edge_events = 0; // never used, see SetEdgeTriggered()
 #endif
 
 TEPoll::TEPoll()
     : Fd_(epoll_create1(epoll_flags))
+    , OutEvents_(TBatchSize::Initial)
 {
     if (Fd_ ==  invalid_handle) {
         throw std::system_error(errno, std::generic_category(), "epoll_create1");
     }
+
+    epoll_event eev = {};
+    eev.data.u64 = Tag(Wakeup_.Fd(), 0);
+    eev.events = EPOLLIN;
+    if (epoll_ctl(Fd_, EPOLL_CTL_ADD, Wakeup_.Fd(), &eev) < 0) {
+        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+    }
+    Interrupter_ = [this]() { Wakeup_.Notify(); };
+    Deregister_ = [this](int fd) { Deregister(fd); };
+    ErrorEvents_ = true;
 }
 
 TEPoll::~TEPoll()
@@ -49,19 +95,145 @@ TEPoll::~TEPoll()
 void TEPoll::Poll() {
     auto ts = GetTimeout();
 
-    if (static_cast<int>(InEvents_.size()) <= MaxFd_) {
-        InEvents_.resize(MaxFd_+1);
+    if (EdgeTriggered_) {
+        ApplyEdgeChanges();
+    } else {
+        ApplyChanges();
+    }
+
+    Reset();
+
+    if (!Cached_.empty()) {
+        ReadyEvents_.insert(ReadyEvents_.end(), Cached_.begin(), Cached_.end());
+        Cached_.clear();
+        ts = {0, 0};
+    }
+
+    auto pollStart = StatsStart();
+    int nfds = Wait(ts);
+    RecordPoll(pollStart);
+    if (nfds < 0) {
+        if (errno == EINTR) {
+            return;
+        }
+        throw std::system_error(errno, std::generic_category(), "epoll_wait");
+    }
+
+    for (int i = 0; i < nfds; ++i) {
+        int fd = static_cast<int>(OutEvents_[i].data.u64 & 0xffffffff);
+        if (fd == Wakeup_.Fd()) {
+            Wakeup_.Drain();
+            continue;
+        }
+        auto* state = InEvents_.Find(fd);
+        if (!state || InEvents_.Generation(fd) != OutEvents_[i].data.u64 >> 32) {
+            // a registration of a file that is gone, its fd number may be reused
+            continue;
+        }
+        if (EdgeTriggered_) {
+            HandleEdge(*state, fd, OutEvents_[i].events);
+            continue;
+        }
+        auto ev = *state;
+        if (OutEvents_[i].events & EPOLLIN) {
+            ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
+            ev.Read = {};
+        }
+        if (OutEvents_[i].events & EPOLLOUT) {
+            ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
+            ev.Write = {};
+        }
+        if ((OutEvents_[i].events & EPOLLERR) && ev.Err) {
+            ReadyEvents_.emplace_back(TEvent{fd, TEvent::ERR, ev.Err});
+        }
+        if (OutEvents_[i].events & EPOLLHUP) {
+            if (ev.Read) {
+                ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
+            }
+            if (ev.Write) {
+                ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
+            }
+        }
+        if (OutEvents_[i].events & EPOLLRDHUP) {
+            if (ev.Read) {
+                ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
+            }
+            if (ev.Write) {
+                ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
+            }
+            if (ev.RHup) {
+                ReadyEvents_.emplace_back(TEvent{fd, TEvent::RHUP, ev.RHup});
+            }
+        }
+    }
+    if (Batch_.Update(nfds)) {
+        OutEvents_.resize(Batch_.Get());
+        OutEvents_.shrink_to_fit();
+    }
+
+    ProcessPosted();
+    ProcessTimers();
+}
+
+int TEPoll::Wait(timespec ts) {
+    if (BusyPoll_.Budget.count() > 0 && (ts.tv_sec || ts.tv_nsec)) {
+        auto start = TClock::now();
+        auto timeout = std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        auto spin = std::min<TClock::duration>(BusyPoll_.Budget, timeout);
+        const timespec zero = {0, 0};
+        TClock::duration spent = {};
+        do {
+            int nfds = epoll_pwait2(Fd_, &OutEvents_[0], OutEvents_.size(), &zero, nullptr);
+            if (nfds != 0) {
+                return nfds;
+            }
+            spent = TClock::now() - start;
+        } while (spent < spin);
+        auto left = std::max<TClock::duration>(TClock::duration::zero(), timeout - spent);
+        auto sec = std::chrono::duration_cast<std::chrono::seconds>(left);
+        ts.tv_sec = sec.count();
+        ts.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(left - sec).count();
+    }
+    return epoll_pwait2(Fd_, &OutEvents_[0], OutEvents_.size(), &ts, nullptr);
+}
+
+bool TEPoll::SetBusyPoll(TBusyPollOptions options) {
+    BusyPoll_ = options;
+#ifdef __linux__
+    if (options.PreferBusyPoll || options.Budget.count() == 0) {
+        TEpollParams params = {};
+        if (options.PreferBusyPoll) {
+            params.BusyPollUsecs = static_cast<uint32_t>(std::min<int64_t>(options.Budget.count(), UINT32_MAX));
+            params.BusyPollBudget = BusyPollPackets;
+            params.PreferBusyPoll = 1;
+        }
+        // resets the kernel side when the mode is turned off
+        if (ioctl(Fd_, EpollSetParams, &params) < 0) {
+            return !options.PreferBusyPoll;
+        }
     }
+    return true;
+#else
+    return !options.PreferBusyPoll;
+#endif
+}
 
-    for (const auto& ch : Changes_) {
+void TEPoll::ApplyChanges() {
+    for (size_t i = 0; i < Changes_.size(); i++) {
+        auto& ch = Changes_[i];
         int fd = ch.Fd;
-        auto& ev  = InEvents_[fd];
+        auto* state = Superseded(i) ? nullptr : Registration(InEvents_, ch);
+        if (!state) {
+            continue;
+        }
+        auto& ev = *state;
+        if ((ch.Type & TEvent::CANCEL) && !ResolveCancel(ch, ev)) {
+            continue;
+        }
         epoll_event eev = {};
-        eev.data.fd = fd;
+        eev.data.u64 = Tag(fd, InEvents_.Generation(fd));
         bool change = false;
-        bool newEv = false;
         if (ch.Handle) {
-            newEv = !!ev.Read && !!ev.Write && !!ev.RHup;
             if (ch.Type & TEvent::READ) {
                 eev.events |= EPOLLIN;
                 change |= ev.Read != ch.Handle;
@@ -77,6 +249,11 @@ void TEPoll::Poll() {
                 change |= ev.RHup != ch.Handle;
                 ev.RHup = ch.Handle;
             }
+            if (ch.Type & TEvent::ERR) {
+                // EPOLLERR is always reported, the descriptor only has to be registered
+                change |= ev.Err != ch.Handle;
+                ev.Err = ch.Handle;
+            }
         } else {
             if (ch.Type & TEvent::READ) {
                 change |= !!ev.Read;
@@ -86,6 +263,14 @@ void TEPoll::Poll() {
                 change |= !!ev.Write;
                 ev.Write = {};
             }
+            if (ch.Type & TEvent::RHUP) {
+                change |= !!ev.RHup;
+                ev.RHup = {};
+            }
+            if (ch.Type & TEvent::ERR) {
+                change |= !!ev.Err;
+                ev.Err = {};
+            }
             if (ev.Read) {
                 eev.events |= EPOLLIN;
             }
@@ -97,74 +282,129 @@ void TEPoll::Poll() {
             }
         }
 
-        if (newEv) {
+        if (!eev.events && !ev.Err) {
+            if (ev.Registered) {
+                RecordSubmissions(1);
+                if (epoll_ctl(Fd_, EPOLL_CTL_DEL, fd, nullptr) < 0) {
+                    if (!(errno == EBADF || errno == ENOENT)) { // closed bypassing TSocketBase::Close()
+                        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+                    }
+                }
+            }
+            InEvents_.Release(fd);
+        } else if (!ev.Registered) {
+            RecordSubmissions(1);
             if (epoll_ctl(Fd_, EPOLL_CTL_ADD, fd, &eev) < 0) {
                 throw std::system_error(errno, std::generic_category(), "epoll_ctl");
             }
-        } else if (!eev.events) {
-            if (epoll_ctl(Fd_, EPOLL_CTL_DEL, fd, nullptr) < 0) {
-                if (!(errno == EBADF || errno == ENOENT)) { // closed descriptor after TSocket -> close
-                    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
-                }
-            }
+            ev.Registered = true;
         } else if (change) {
+            RecordSubmissions(1);
             if (epoll_ctl(Fd_, EPOLL_CTL_MOD, fd, &eev) < 0) {
-                if (errno == ENOENT) {
-                    if (epoll_ctl(Fd_, EPOLL_CTL_ADD, fd, &eev) < 0) {
-                        throw std::system_error(errno, std::generic_category(), "epoll_ctl");
-                    }
-                } else {
+                // closed bypassing TSocketBase::Close() and reused
+                if (errno != ENOENT || epoll_ctl(Fd_, EPOLL_CTL_ADD, fd, &eev) < 0) {
                     throw std::system_error(errno, std::generic_category(), "epoll_ctl");
                 }
             }
         }
     }
+}
 
-    Reset();
-
-    OutEvents_.resize(std::max<size_t>(1, InEvents_.size()));
-
-    int nfds;
-    if ((nfds =  epoll_pwait2(Fd_, &OutEvents_[0], OutEvents_.size(), &ts, nullptr)) < 0) {
-        if (errno == EINTR) {
-            return;
+void TEPoll::ApplyEdgeChanges() {
+    for (size_t i = 0; i < Changes_.size(); i++) {
+        auto& ch = Changes_[i];
+        int fd = ch.Fd;
+        auto* state = Superseded(i) ? nullptr : Registration(InEvents_, ch);
+        if (!state) {
+            continue;
         }
-        throw std::system_error(errno, std::generic_category(), "epoll_wait");
-    }
-
-    for (int i = 0; i < nfds; ++i) {
-        int fd = OutEvents_[i].data.fd;
-        auto ev = InEvents_[fd];
-        if (OutEvents_[i].events & EPOLLIN) {
-            ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
-            ev.Read = {};
+        auto& ev = *state;
+        if ((ch.Type & TEvent::CANCEL) && !ResolveCancel(ch, ev)) {
+            continue;
         }
-        if (OutEvents_[i].events & EPOLLOUT) {
-            ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
-            ev.Write = {};
-        }
-        if (OutEvents_[i].events & EPOLLHUP) {
-            if (ev.Read) {
-                ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
-            }
-            if (ev.Write) {
-                ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
+        if (!ch.Handle) {
+            for (int type : EventTypes) {
+                if (ch.Type & type) {
+                    Waiter(ev, type) = {};
+                }
             }
+            continue;
         }
-        if (OutEvents_[i].events & EPOLLRDHUP) {
-            if (ev.Read) {
-                ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
+
+        if (!ev.Registered) {
+            RecordSubmissions(1);
+            epoll_event eev = {};
+            eev.data.u64 = Tag(fd, InEvents_.Generation(fd));
+            eev.events = edge_events;
+            if (epoll_ctl(Fd_, EPOLL_CTL_ADD, fd, &eev) < 0) {
+                // still registered by the level-triggered mode
+                if (errno != EEXIST || epoll_ctl(Fd_, EPOLL_CTL_MOD, fd, &eev) < 0) {
+                    throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+                }
             }
-            if (ev.Write) {
-                ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
+            ev.Registered = true;
+        }
+
+        for (int type : EventTypes) {
+            if (!(ch.Type & type)) {
+                continue;
             }
-            if (ev.RHup) {
-                ReadyEvents_.emplace_back(TEvent{fd, TEvent::RHUP, ev.RHup});
+            if (ev.Ready & type) {
+                // the edge has already been reported, no other one may follow
+                ev.Ready &= ~type;
+                Waiter(ev, type) = {};
+                Cached_.emplace_back(TEvent{fd, type, ch.Handle});
+            } else {
+                Waiter(ev, type) = ch.Handle;
             }
         }
     }
+}
 
-    ProcessTimers();
+void TEPoll::HandleEdge(TFdState& ev, int fd, uint32_t events) {
+    int ready = 0;
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) {
+        ready |= TEvent::READ;
+    }
+    if (events & (EPOLLOUT | EPOLLRDHUP | EPOLLHUP)) {
+        ready |= TEvent::WRITE;
+    }
+    if (events & (EPOLLRDHUP | EPOLLHUP)) {
+        ready |= TEvent::RHUP;
+    }
+    if (events & EPOLLERR) {
+        ready |= TEvent::ERR;
+    }
+    for (int type : EventTypes) {
+        if (!(ready & type)) {
+            continue;
+        }
+        auto& waiter = Waiter(ev, type);
+        if (waiter) {
+            ReadyEvents_.emplace_back(TEvent{fd, type, waiter});
+            waiter = {};
+        } else {
+            ev.Ready |= type;
+        }
+    }
+}
+
+void TEPoll::Deregister(int fd) noexcept {
+    auto* state = InEvents_.Find(fd);
+    if (!state) {
+        return;
+    }
+    // close() drops an edge-triggered registration, the events of a dup() that outlives it
+    // carry an old generation. A level-triggered one would keep reporting such a dup(), so
+    // it is removed while the descriptor still refers to the file.
+    if (state->Registered && !EdgeTriggered_) {
+        RecordSubmissions(1);
+        // Runs from ~TSocketBase(), so it must not throw: EBADF (closed behind our back) and
+        // ENOENT (never added) both mean there is nothing left to remove, and the slot and
+        // its generation are dropped regardless.
+        epoll_ctl(Fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    InEvents_.Release(fd);
 }
 
 } // namespace NNet
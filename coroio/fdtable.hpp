@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace NNet {
+
+/**
+ * @class TFdTable
+ * @brief Per-descriptor registrations of a poller, a two-level page table indexed by fd.
+ *
+ * The first level is a vector of page pointers, the second a page of @c PageSize
+ * entries allocated when a descriptor of its range is registered and freed when the
+ * last one is released. A process with a few high-numbered descriptors pays for a few
+ * pages instead of a vector as long as its highest fd, and the table shrinks back
+ * when connections go away. One free page is kept to absorb churn at a page boundary.
+ *
+ * Every registration gets a generation from a table-wide counter, so a value taken
+ * while a descriptor was registered tells whether the entry still belongs to the same
+ * registration after the fd number has been closed and reused.
+ *
+ * Only the poller thread touches the table, it takes no locks.
+ *
+ * @tparam T Entry type, default-constructed on registration and reset on release.
+ */
+template<typename T, size_t PageBits = 8>
+class TFdTable {
+public:
+    static constexpr size_t PageSize = size_t{1} << PageBits;
+
+    /// Returns the entry of @p fd, registering it if needed.
+    T& operator[](int fd) {
+        auto& page = Pages_.size() > Page(fd) ? Pages_[Page(fd)] : Grow(fd);
+        if (!page) {
+            page = Spare_ ? std::move(Spare_) : std::make_unique<TPage>();
+        }
+        size_t i = Slot(fd);
+        if (!page->Generations[i]) {
+            if (!++Generation_) {
+                ++Generation_;
+            }
+            page->Generations[i] = Generation_;
+            page->Live++;
+            Size_++;
+        }
+        return page->Items[i];
+    }
+
+    /// Returns the entry of @p fd, nullptr if it is not registered.
+    T* Find(int fd) {
+        size_t p = Page(fd);
+        if (p >= Pages_.size() || !Pages_[p] || !Pages_[p]->Generations[Slot(fd)]) {
+            return nullptr;
+        }
+        return &Pages_[p]->Items[Slot(fd)];
+    }
+
+    /// Returns the generation of the registration of @p fd, 0 if it is not registered.
+    uint32_t Generation(int fd) const {
+        size_t p = Page(fd);
+        return p < Pages_.size() && Pages_[p] ? Pages_[p]->Generations[Slot(fd)] : 0;
+    }
+
+    /// Forgets the registration of @p fd, frees its page when it was the last one.
+    void Release(int fd) {
+        size_t p = Page(fd);
+        if (p >= Pages_.size() || !Pages_[p] || !Pages_[p]->Generations[Slot(fd)]) {
+            return;
+        }
+        auto& page = Pages_[p];
+        page->Items[Slot(fd)] = T{};
+        page->Generations[Slot(fd)] = 0;
+        Size_--;
+        if (--page->Live == 0) {
+            if (!Spare_) {
+                Spare_ = std::move(page);
+            } else {
+                page.reset();
+            }
+            while (!Pages_.empty() && !Pages_.back()) {
+                Pages_.pop_back();
+            }
+        }
+    }
+
+    /// Returns the number of registered descriptors.
+    size_t Size() const {
+        return Size_;
+    }
+
+    /// Returns the number of allocated pages, without the spare one.
+    size_t Pages() const {
+        size_t n = 0;
+        for (const auto& page : Pages_) {
+            n += !!page;
+        }
+        return n;
+    }
+
+private:
+    struct alignas(64) TPage {
+        uint32_t Generations[PageSize] = {}; ///< 0 marks a free entry.
+        size_t Live = 0;
+        T Items[PageSize] = {};
+    };
+
+    static size_t Page(int fd) {
+        return static_cast<size_t>(fd) >> PageBits;
+    }
+
+    static size_t Slot(int fd) {
+        return static_cast<size_t>(fd) & (PageSize - 1);
+    }
+
+    std::unique_ptr<TPage>& Grow(int fd) {
+        Pages_.resize(Page(fd) + 1);
+        return Pages_.back();
+    }
+
+    std::vector<std::unique_ptr<TPage>> Pages_;
+    std::unique_ptr<TPage> Spare_;
+    size_t Size_ = 0;
+    uint32_t Generation_ = 0;
+};
+
+} // namespace NNet
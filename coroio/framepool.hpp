@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace NNet {
+
+/**
+ * @class TFramePool
+ * @brief Per-thread size-class free lists for coroutine frames.
+ *
+ * Used by @ref TPromiseBase when the library is built with @c COROIO_FRAME_POOL
+ * (CMake option of the same name, on by default). Frame sizes are rounded up to
+ * @c Granularity bytes; every size class keeps up to @c MaxCached released frames
+ * of the current thread for reuse, so short-lived futures such as
+ * @ref TByteReader::Read() stop hitting the global allocator after warm-up.
+ *
+ * Frames are allocated one by one with the global operator new, so a frame may be
+ * released on a different thread than the one that allocated it (e.g. after
+ * @ref TPollerBase::SwitchTo()) and cached frames are freed at thread exit.
+ * Frames larger than the largest size class bypass the cache.
+ */
+class TFramePool {
+public:
+    static constexpr size_t Granularity = 64;
+    static constexpr size_t Classes = 32;
+    static constexpr size_t MaxCached = 1024;
+
+    /// Returns a block of at least @p size bytes.
+    static void* Allocate(size_t size) {
+        size_t cls = ClassOf(size);
+        if (cls >= Classes) {
+            return ::operator new(size);
+        }
+        auto& cache = Cache();
+        if (auto* node = cache.Heads[cls]) {
+            cache.Heads[cls] = node->Next;
+            cache.Counts[cls]--;
+            return node;
+        }
+        return ::operator new((cls + 1) * Granularity);
+    }
+
+    /// Releases a block returned by @ref Allocate() with the same @p size.
+    static void Deallocate(void* ptr, size_t size) {
+        size_t cls = ClassOf(size);
+        if (cls >= Classes) {
+            ::operator delete(ptr);
+            return;
+        }
+        auto& cache = Cache();
+        if (cache.Counts[cls] >= MaxCached) {
+            ::operator delete(ptr);
+            return;
+        }
+        auto* node = static_cast<TFreeNode*>(ptr);
+        node->Next = cache.Heads[cls];
+        cache.Heads[cls] = node;
+        cache.Counts[cls]++;
+    }
+
+private:
+    struct TFreeNode {
+        TFreeNode* Next;
+    };
+
+    struct TCache {
+        ~TCache() {
+            for (size_t cls = 0; cls < Classes; cls++) {
+                while (auto* head = Heads[cls]) {
+                    Heads[cls] = head->Next;
+                    ::operator delete(head);
+                }
+                // frames released later during thread exit go straight to operator delete
+                Counts[cls] = MaxCached;
+            }
+        }
+
+        std::array<TFreeNode*, Classes> Heads = {};
+        std::array<uint32_t, Classes> Counts = {};
+    };
+
+    static size_t ClassOf(size_t size) {
+        return (size + Granularity - 1) / Granularity - 1;
+    }
+
+    static TCache& Cache() {
+        thread_local TCache cache;
+        return cache;
+    }
+};
+
+} // namespace NNet
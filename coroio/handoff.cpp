@@ -0,0 +1,281 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "handoff.hpp"
+
+#ifndef _WIN32
+
+#include <cstring>
+
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace NNet {
+
+namespace {
+
+// readiness wait of the SCM_RIGHTS transfers, completion-based pollers do not serve it
+struct TFdWait {
+    bool await_ready() const { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        if (write) {
+            poller->AddWrite(fd, h);
+        } else {
+            poller->AddRead(fd, h);
+        }
+        wait.Arm(poller, fd, write ? TEvent::WRITE : TEvent::READ, h);
+    }
+
+    void await_resume() {
+        wait.Disarm();
+    }
+
+    TPollerBase* poller;
+    int fd;
+    bool write;
+    TEventWait wait = {};
+};
+
+sockaddr_un UnixAddress(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Unix socket path is too long: " + path);
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.data(), path.size());
+    return addr;
+}
+
+void Advance(iovec*& iov, int& count, size_t size) {
+    while (count > 0 && size >= iov->iov_len) {
+        size -= iov->iov_len;
+        iov++; count--;
+    }
+    if (count > 0) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + size;
+        iov->iov_len -= size;
+    }
+}
+
+} // namespace
+
+struct THandoffChannel::THeader {
+    enum EKind: uint32_t {
+        Item = 1,
+        End = 2,
+    };
+
+    uint32_t Kind = Item;
+    uint32_t HasFd = 0;
+    uint32_t TagSize = 0;
+    uint32_t StateSize = 0;
+};
+
+THandoffSocket::THandoffSocket(THandoffSocket&& other) noexcept
+    : Fd(std::exchange(other.Fd, -1))
+    , Tag(std::move(other.Tag))
+    , State(std::move(other.State))
+{ }
+
+THandoffSocket& THandoffSocket::operator=(THandoffSocket&& other) noexcept {
+    if (this != &other) {
+        if (Fd >= 0) {
+            close(Fd);
+        }
+        Fd = std::exchange(other.Fd, -1);
+        Tag = std::move(other.Tag);
+        State = std::move(other.State);
+    }
+    return *this;
+}
+
+THandoffSocket::~THandoffSocket() {
+    if (Fd >= 0) {
+        close(Fd);
+    }
+}
+
+TAddress THandoffSocket::Peer() const {
+    sockaddr_storage addr{};
+    socklen_t len = sizeof(addr);
+    if (Fd < 0 || getpeername(Fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+        return {};
+    }
+    if (addr.ss_family != AF_INET && addr.ss_family != AF_INET6) {
+        return {};
+    }
+    return TAddress{reinterpret_cast<sockaddr*>(&addr), len};
+}
+
+THandoffChannel::THandoffChannel(int fd, TPollerBase& poller)
+    : TSocket(TAddress{}, fd, poller)
+{ }
+
+THandoffChannel THandoffChannel::Connect(TPollerBase& poller, const std::string& path) {
+    auto addr = UnixAddress(path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "socket");
+    }
+    // a local connect completes at once, no reason to wait for it in the poller
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "connect " + path);
+    }
+    return THandoffChannel(fd, poller);
+}
+
+TFuture<void> THandoffChannel::Send(int fd, std::string_view tag, std::string_view state) {
+    if (tag.size() > MaxTagSize || state.size() > MaxStateSize) {
+        throw std::invalid_argument("Handoff tag or state is too large");
+    }
+    THeader header;
+    header.HasFd = fd >= 0;
+    header.TagSize = static_cast<uint32_t>(tag.size());
+    header.StateSize = static_cast<uint32_t>(state.size());
+    co_await SendMessage(header, fd, tag, state);
+}
+
+TFuture<void> THandoffChannel::Finish() {
+    THeader header;
+    header.Kind = THeader::End;
+    co_await SendMessage(header, -1, {}, {});
+}
+
+TFuture<std::optional<THandoffSocket>> THandoffChannel::Receive() {
+    THeader header;
+    THandoffSocket item;
+    co_await RecvExact(&header, sizeof(header), item.Fd);
+    if (header.Kind == THeader::End) {
+        co_return std::nullopt;
+    }
+    if (header.Kind != THeader::Item || header.TagSize > MaxTagSize || header.StateSize > MaxStateSize
+        || bool(header.HasFd) != (item.Fd >= 0))
+    {
+        throw std::runtime_error("Bad handoff message");
+    }
+    item.Tag.resize(header.TagSize);
+    item.State.resize(header.StateSize);
+    int extra = -1;
+    co_await RecvExact(item.Tag.data(), item.Tag.size(), extra);
+    co_await RecvExact(item.State.data(), item.State.size(), extra);
+    if (extra >= 0) {
+        close(extra);
+    }
+    co_return std::move(item);
+}
+
+TFuture<void> THandoffChannel::SendMessage(const THeader& header, int fd, std::string_view tag, std::string_view state) {
+    iovec parts[3] = {
+        {const_cast<THeader*>(&header), sizeof(header)},
+        {const_cast<char*>(tag.data()), tag.size()},
+        {const_cast<char*>(state.data()), state.size()},
+    };
+    iovec* iov = parts;
+    int count = 3;
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    bool attach = fd >= 0;
+    while (count > 0) {
+        msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        if (attach) {
+            // the descriptor goes with the first byte sent, the header
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            auto* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+        ssize_t ret = sendmsg(Fd_, &msg, MSG_NOSIGNAL);
+        if (ret < 0) {
+            if (!(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+                throw std::system_error(errno, std::generic_category(), "sendmsg");
+            }
+            co_await TFdWait{Poller_, Fd_, true};
+            continue;
+        }
+        attach = false;
+        Advance(iov, count, static_cast<size_t>(ret));
+    }
+}
+
+TFuture<void> THandoffChannel::RecvExact(void* data, size_t size, int& fd) {
+    char* p = static_cast<char*>(data);
+    // room for a few descriptors, the ones that do not fit are closed by the kernel
+    alignas(cmsghdr) char control[CMSG_SPACE(4 * sizeof(int))];
+    while (size > 0) {
+        iovec iov{p, size};
+        msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+        flags |= MSG_CMSG_CLOEXEC;
+#endif
+        ssize_t ret = recvmsg(Fd_, &msg, flags);
+        if (ret < 0) {
+            if (!(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+                throw std::system_error(errno, std::generic_category(), "recvmsg");
+            }
+            co_await TFdWait{Poller_, Fd_, false};
+            continue;
+        }
+        for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+                continue;
+            }
+            size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < n; i++) {
+                int received;
+                memcpy(&received, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                if (fd < 0 && p == data) {
+                    fd = received;
+                } else {
+                    close(received); // not announced by a header, would leak otherwise
+                }
+            }
+        }
+        if (ret == 0) {
+            throw std::runtime_error("Handoff channel closed");
+        }
+        p += ret;
+        size -= static_cast<size_t>(ret);
+    }
+}
+
+THandoffListener::THandoffListener(TPollerBase& poller, const std::string& path)
+    : TSocket(poller, AF_UNIX)
+{
+    auto addr = UnixAddress(path);
+    unlink(path.c_str());
+    if (bind(Fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        throw std::system_error(errno, std::generic_category(), "bind " + path);
+    }
+    Listen();
+}
+
+TFuture<THandoffChannel> THandoffListener::Accept() {
+    while (true) {
+        int fd = accept(Fd_, nullptr, nullptr);
+        if (fd >= 0) {
+            co_return THandoffChannel(fd, *Poller_);
+        }
+        if (!(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED)) {
+            throw std::system_error(errno, std::generic_category(), "accept");
+        }
+        co_await TFdWait{Poller_, Fd_, false};
+    }
+}
+
+} // namespace NNet
+
+#endif // _WIN32
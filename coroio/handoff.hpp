@@ -0,0 +1,153 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "socket.hpp"
+
+namespace NNet {
+
+#ifndef _WIN32
+
+/**
+ * @struct THandoffSocket
+ * @brief A descriptor received from the previous process with @ref THandoffChannel::Receive().
+ *
+ * Owns @c Fd and closes it unless it is released, e.g. with @ref Take().
+ */
+struct THandoffSocket {
+    THandoffSocket() = default;
+    THandoffSocket(THandoffSocket&& other) noexcept;
+    THandoffSocket& operator=(THandoffSocket&& other) noexcept;
+    THandoffSocket(const THandoffSocket&) = delete;
+    THandoffSocket& operator=(const THandoffSocket&) = delete;
+    ~THandoffSocket();
+
+    /// Gives up the descriptor, the caller closes it.
+    int Release() {
+        return std::exchange(Fd, -1);
+    }
+
+    /// Returns the peer of a connected inet socket, an empty address otherwise (listeners).
+    TAddress Peer() const;
+
+    /**
+     * @brief Wraps the descriptor into a socket of @p poller, e.g. a listener to accept from.
+     *
+     * @tparam TSocket @c typename TPoller::TSocket.
+     */
+    template<typename TSocket, typename TPoller>
+    TSocket Take(TPoller& poller) {
+        auto peer = Peer();
+        return TSocket(peer, Release(), poller);
+    }
+
+    int Fd = -1;       ///< -1 for an item carrying state only.
+    std::string Tag;   ///< What the descriptor is, given by the sender, e.g. "listen :443".
+    std::string State; ///< Opaque bytes of the sender, e.g. the unread input of a connection.
+};
+
+/**
+ * @class THandoffChannel
+ * @brief Unix domain stream over which a process hands its sockets to its successor.
+ *
+ * Descriptors travel with SCM_RIGHTS: the receiver gets its own descriptor of the same
+ * socket, with its queue of pending connections or unread data, so a listener never stops
+ * listening and nothing is bound again. Every @ref Send() is one message of a tag, opaque
+ * state and an optional descriptor; @ref Finish() ends the sequence.
+ *
+ * A hot restart:
+ *  - the running process listens with a @ref THandoffListener on a known path;
+ *  - the new binary @ref Connect() -s to it, @ref Receive() -s until the end, adopts the
+ *    listeners with @ref THandoffSocket::Take() and starts accepting at once;
+ *  - the old process, after @ref Finish(), stops accepting and closes its listeners (the
+ *    sockets stay open in the new process), finishes its in-flight requests and exits.
+ *    Idle keep-alive connections may also be sent, with what was read from them but not
+ *    processed as their state.
+ *
+ * @code{.cpp}
+ * // old process
+ * auto channel = co_await handoffListener.Accept();
+ * co_await channel.Send(listener.Fd(), "listen :443", ticketKeys);
+ * co_await channel.Finish();
+ * listener.Close();
+ *
+ * // new process
+ * auto channel = THandoffChannel::Connect(poller, path);
+ * while (auto item = co_await channel.Receive()) {
+ *     if (item->Tag == "listen :443") {
+ *         listener = item->Take<TPoller::TSocket>(poller);
+ *     }
+ * }
+ * @endcode
+ *
+ * TLS connections cannot be handed over, OpenSSL has no way to export their state. Hand
+ * over the ticket keys instead (@ref TSslContext::TicketKeys()), so that clients resume
+ * their sessions with the new process without a full handshake.
+ *
+ * POSIX only. The sendmsg()/recvmsg() calls carrying the descriptors wait for readiness
+ * with @ref TPollerBase::AddRead() / @ref TPollerBase::AddWrite(), which completion-based
+ * pollers never report, so the channel works with @ref TSelect, @ref TPoll, @ref TEPoll and
+ * @ref TKqueue but not with @ref TUring.
+ */
+class THandoffChannel: public TSocket {
+public:
+    THandoffChannel() = default;
+    /// Takes over a connected unix stream socket.
+    THandoffChannel(int fd, TPollerBase& poller);
+
+    /**
+     * @brief Connects to the process listening at @p path.
+     *
+     * @throws std::system_error ENOENT or ECONNREFUSED if no process listens, e.g. on the first start.
+     */
+    static THandoffChannel Connect(TPollerBase& poller, const std::string& path);
+
+    /**
+     * @brief Sends a copy of @p fd (-1 for none) with @p tag and @p state.
+     *
+     * The descriptor stays open in this process.
+     */
+    TFuture<void> Send(int fd, std::string_view tag, std::string_view state = {});
+    /// Tells the receiver that nothing more follows.
+    TFuture<void> Finish();
+    /**
+     * @brief Receives the next item.
+     *
+     * @return The item, std::nullopt after the sender's @ref Finish().
+     * @throws std::runtime_error If the connection closes before that or a message is malformed.
+     */
+    TFuture<std::optional<THandoffSocket>> Receive();
+
+    static constexpr size_t MaxTagSize = 4096;
+    static constexpr size_t MaxStateSize = 16 << 20;
+
+private:
+    struct THeader;
+
+    TFuture<void> SendMessage(const THeader& header, int fd, std::string_view tag, std::string_view state);
+    /// Reads exactly @p size bytes, stores a descriptor arriving with them into @p fd.
+    TFuture<void> RecvExact(void* data, size_t size, int& fd);
+};
+
+/**
+ * @class THandoffListener
+ * @brief Listens on a unix domain socket path for the successor of the process, see
+ *        @ref THandoffChannel.
+ *
+ * A stale socket file at @p path is replaced. Bind it after the handoff in the new process,
+ * the old one no longer needs its listener then.
+ */
+class THandoffListener: public TSocket {
+public:
+    THandoffListener(TPollerBase& poller, const std::string& path);
+
+    /// Waits for the next process to connect.
+    TFuture<THandoffChannel> Accept();
+};
+
+#endif // _WIN32
+
+} // namespace NNet
@@ -0,0 +1,408 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "http.hpp"
+#include "utils.hpp"
+
+namespace NNet {
+
+namespace {
+
+bool EqualsNoCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+        char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] - 'A' + 'a' : b[i];
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view Trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// tchar of RFC 9110, 5.6.2
+bool IsToken(std::string_view s) {
+    if (s.empty()) {
+        return false;
+    }
+    for (unsigned char c : s) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+            || (c && std::string_view("!#$%&'*+-.^_`|~").find(c) != std::string_view::npos);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Calls @p f for every element of a comma-separated list.
+template<typename F>
+void ForEachToken(std::string_view list, F&& f) {
+    while (!list.empty()) {
+        auto comma = list.find(',');
+        f(Trim(list.substr(0, comma)));
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+}
+
+int HexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+} // namespace
+
+std::string_view THttpRequest::Header(std::string_view name) const {
+    for (const auto& header : Headers) {
+        if (EqualsNoCase(header.Name, name)) {
+            return header.Value;
+        }
+    }
+    return {};
+}
+
+void THttpParser::Reset() {
+    auto headers = std::move(Request_.Headers);
+    headers.clear();
+    Request_ = THttpRequest{};
+    Request_.Headers = std::move(headers);
+    Start_ = Scanned_ = LineStart_ = HeadSize_ = 0;
+    Error_.clear();
+}
+
+EHttpParseStatus THttpParser::Fail(std::string error) {
+    Error_ = std::move(error);
+    return EHttpParseStatus::Error;
+}
+
+EHttpParseStatus THttpParser::Parse(std::string_view data) {
+    while (Scanned_ < data.size()) {
+        auto* lf = NUtils::FindByte(data.data() + Scanned_, data.size() - Scanned_, '\n');
+        if (!lf) {
+            Scanned_ = data.size();
+            break;
+        }
+        size_t end = lf - data.data() + 1;
+        auto line = data.substr(LineStart_, end - LineStart_);
+        size_t lineStart = LineStart_;
+        Scanned_ = LineStart_ = end;
+        if (end > MaxHeadSize_) {
+            return Fail("Header too large");
+        }
+        if (line != "\n" && line != "\r\n") {
+            continue;
+        }
+        if (lineStart == Start_) {
+            // an empty line before the request line, e.g. after the body of the previous request
+            Start_ = end;
+            continue;
+        }
+        HeadSize_ = end;
+        return ParseHead(data.substr(Start_, end - Start_));
+    }
+    if (Scanned_ > MaxHeadSize_) {
+        return Fail("Header too large");
+    }
+    return EHttpParseStatus::NeedMore;
+}
+
+EHttpParseStatus THttpParser::ParseHead(std::string_view head) {
+    auto nextLine = [&head]() {
+        auto lf = head.find('\n');
+        auto line = head.substr(0, lf);
+        head.remove_prefix(lf + 1);
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        return line;
+    };
+
+    auto requestLine = nextLine();
+    auto sp1 = requestLine.find(' ');
+    auto sp2 = sp1 == std::string_view::npos ? sp1 : requestLine.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos) {
+        return Fail("Malformed request line");
+    }
+    Request_.Method = requestLine.substr(0, sp1);
+    Request_.Target = requestLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    auto version = requestLine.substr(sp2 + 1);
+    if (!IsToken(Request_.Method) || Request_.Target.empty()) {
+        return Fail("Malformed request line");
+    }
+    if (version == "HTTP/1.1") {
+        Request_.MinorVersion = 1;
+    } else if (version == "HTTP/1.0") {
+        Request_.MinorVersion = 0;
+    } else {
+        return Fail("Unsupported version");
+    }
+
+    bool hasLength = false;
+    bool hasEncoding = false;
+    bool close = false;
+    bool keepAlive = false;
+    while (true) {
+        auto line = nextLine();
+        if (line.empty()) {
+            break;
+        }
+        if (line.front() == ' ' || line.front() == '\t') {
+            return Fail("Obsolete line folding");
+        }
+        auto* colon = NUtils::FindByte(line.data(), line.size(), ':');
+        if (!colon) {
+            return Fail("Malformed header");
+        }
+        auto name = line.substr(0, colon - line.data());
+        auto value = Trim(line.substr(name.size() + 1));
+        if (!IsToken(name)) {
+            return Fail("Malformed header");
+        }
+        Request_.Headers.push_back({name, value});
+
+        if (EqualsNoCase(name, "Content-Length")) {
+            uint64_t length = 0;
+            if (value.empty() || value.size() > 19) {
+                return Fail("Bad Content-Length");
+            }
+            for (char c : value) {
+                if (c < '0' || c > '9') {
+                    return Fail("Bad Content-Length");
+                }
+                length = length * 10 + (c - '0');
+            }
+            if (hasLength && length != Request_.ContentLength) {
+                return Fail("Conflicting Content-Length");
+            }
+            hasLength = true;
+            Request_.ContentLength = length;
+        } else if (EqualsNoCase(name, "Transfer-Encoding")) {
+            hasEncoding = true;
+            std::string_view last;
+            ForEachToken(value, [&](std::string_view coding) { last = coding; });
+            if (!EqualsNoCase(last, "chunked")) {
+                // the length of the body is unknown, RFC 9112, 6.3
+                return Fail("Unsupported Transfer-Encoding");
+            }
+            Request_.Chunked = true;
+        } else if (EqualsNoCase(name, "Connection")) {
+            ForEachToken(value, [&](std::string_view option) {
+                close |= EqualsNoCase(option, "close");
+                keepAlive |= EqualsNoCase(option, "keep-alive");
+            });
+        } else if (EqualsNoCase(name, "Expect")) {
+            Request_.ExpectContinue = EqualsNoCase(value, "100-continue");
+        }
+    }
+    if (hasLength && hasEncoding) {
+        return Fail("Both Content-Length and Transfer-Encoding");
+    }
+    if (Request_.Chunked) {
+        Request_.ContentLength = 0;
+    }
+    Request_.KeepAlive = !close && (Request_.MinorVersion == 1 || keepAlive);
+    return EHttpParseStatus::Done;
+}
+
+size_t THttpChunkedDecoder::Decode(std::string_view in, std::string_view& data) {
+    data = {};
+    size_t i = 0;
+    auto endOfSizeLine = [this]() {
+        State_ = Remaining_ == 0 ? EState::TrailerStart : EState::Data;
+    };
+    while (i < in.size() && State_ != EState::Finished && State_ != EState::Failed) {
+        char c = in[i];
+        switch (State_) {
+        case EState::Size:
+            if (int digit = HexDigit(c); digit >= 0) {
+                if (++Digits_ > 15) {
+                    State_ = EState::Failed;
+                    break;
+                }
+                Remaining_ = Remaining_ * 16 + digit;
+            } else if (Digits_ == 0) {
+                State_ = EState::Failed;
+                break;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                State_ = EState::Extension;
+            } else if (c == '\r') {
+                State_ = EState::SizeLf;
+            } else if (c == '\n') {
+                endOfSizeLine();
+            } else {
+                State_ = EState::Failed;
+                break;
+            }
+            i++;
+            break;
+        case EState::Extension:
+            if (c == '\n') {
+                endOfSizeLine();
+            }
+            i++;
+            break;
+        case EState::SizeLf:
+            if (c != '\n') {
+                State_ = EState::Failed;
+                break;
+            }
+            endOfSizeLine();
+            i++;
+            break;
+        case EState::Data: {
+            size_t size = std::min<uint64_t>(Remaining_, in.size() - i);
+            data = in.substr(i, size);
+            Remaining_ -= size;
+            if (Remaining_ == 0) {
+                State_ = EState::DataCr;
+            }
+            return i + size;
+        }
+        case EState::DataCr:
+            if (c == '\r') {
+                State_ = EState::DataLf;
+            } else if (c == '\n') {
+                State_ = EState::Size;
+                Digits_ = 0;
+            } else {
+                State_ = EState::Failed;
+                break;
+            }
+            i++;
+            break;
+        case EState::DataLf:
+            if (c != '\n') {
+                State_ = EState::Failed;
+                break;
+            }
+            State_ = EState::Size;
+            Digits_ = 0;
+            i++;
+            break;
+        case EState::TrailerStart:
+            if (c == '\r') {
+                State_ = EState::TrailerLf;
+            } else if (c == '\n') {
+                State_ = EState::Finished;
+            } else {
+                State_ = EState::Trailer;
+            }
+            i++;
+            break;
+        case EState::Trailer:
+            if (c == '\n') {
+                State_ = EState::TrailerStart;
+            }
+            i++;
+            break;
+        case EState::TrailerLf:
+            if (c != '\n') {
+                State_ = EState::Failed;
+                break;
+            }
+            State_ = EState::Finished;
+            i++;
+            break;
+        case EState::Finished:
+        case EState::Failed:
+            break;
+        }
+    }
+    return i;
+}
+
+THttpResponse::THttpResponse(int status, std::string_view reason)
+    : Status_(status)
+    , ReasonPhrase_(reason.empty() ? Reason(status) : reason)
+{ }
+
+std::string THttpResponse::Head() const {
+    std::string head;
+    head.reserve(64 + Headers_.size() * 32);
+    head += "HTTP/1.1 ";
+    head += std::to_string(Status_);
+    head += ' ';
+    head += ReasonPhrase_;
+    head += "\r\n";
+    for (const auto& header : Headers_) {
+        head += header.Name;
+        head += ": ";
+        head += header.Value;
+        head += "\r\n";
+    }
+    // these responses have no body, RFC 9110, 8.6
+    if (Status_ >= 200 && Status_ != 204 && Status_ != 304) {
+        head += "Content-Length: ";
+        head += std::to_string(Body_.size());
+        head += "\r\n";
+    }
+    if (!KeepAlive_) {
+        head += "Connection: close\r\n";
+    }
+    head += "\r\n";
+    return head;
+}
+
+void THttpResponse::AppendTo(std::string& out) const {
+    out += Head();
+    out += Body_;
+}
+
+std::string_view THttpResponse::Reason(int status) {
+    switch (status) {
+    case 100: return "Continue";
+    case 101: return "Switching Protocols";
+    case 200: return "OK";
+    case 201: return "Created";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 307: return "Temporary Redirect";
+    case 308: return "Permanent Redirect";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Content Too Large";
+    case 414: return "URI Too Long";
+    case 417: return "Expectation Failed";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    case 505: return "HTTP Version Not Supported";
+    default: return "Unknown";
+    }
+}
+
+} // namespace NNet
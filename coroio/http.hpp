@@ -0,0 +1,435 @@
+#pragma once
+
+#include "sockutils.hpp"
+#include "utils.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace NNet
+{
+
+/**
+ * @struct THttpHeader
+ * @brief A header field of an HTTP message, views into the buffer it was parsed from.
+ */
+struct THttpHeader {
+    std::string_view Name;
+    std::string_view Value; ///< Without the surrounding whitespace.
+};
+
+/**
+ * @struct THttpRequest
+ * @brief The head of an HTTP/1.x request, see @ref THttpParser.
+ *
+ * All views point into the buffer of the parser's caller and stay valid as long as it does.
+ */
+struct THttpRequest {
+    std::string_view Method;
+    std::string_view Target;
+    int MinorVersion = 1;              ///< 1 for HTTP/1.1, 0 for HTTP/1.0.
+    std::vector<THttpHeader> Headers;
+    bool KeepAlive = true;             ///< From the version and the Connection header.
+    bool Chunked = false;              ///< Transfer-Encoding ends with chunked.
+    uint64_t ContentLength = 0;        ///< 0 if absent or if @c Chunked.
+    bool ExpectContinue = false;       ///< Expect: 100-continue.
+
+    /// Returns the value of the first header called @p name (case-insensitive), empty if none.
+    std::string_view Header(std::string_view name) const;
+};
+
+/**
+ * @enum EHttpParseStatus
+ * @brief Outcome of @ref THttpParser::Parse().
+ */
+enum class EHttpParseStatus {
+    NeedMore, ///< The head is not complete, call again with more data.
+    Done,     ///< @ref THttpParser::Request() is ready.
+    Error,    ///< Malformed or too large, see @ref THttpParser::Error().
+};
+
+/**
+ * @class THttpParser
+ * @brief Resumable parser of HTTP/1.x request heads that does not copy.
+ *
+ * @ref Parse() is called with the buffered bytes each time more arrive. The bytes
+ * searched by a previous call are not searched again: the end of the head is found
+ * by scanning for line feeds with @ref NUtils::FindByte() (SSE2/AVX2/NEON), and the
+ * head is split into fields once, when it is complete, so the views never point into
+ * a buffer that moved between calls.
+ *
+ * Both CRLF and bare LF line endings are accepted, empty lines before the request line are
+ * skipped (RFC 9112, 2.2). Requests with both Content-Length and Transfer-Encoding, or with
+ * conflicting Content-Length values, are rejected: a proxy could frame them differently.
+ */
+class THttpParser {
+public:
+    /// @param maxHeadSize Larger heads are an error.
+    explicit THttpParser(size_t maxHeadSize = 65536)
+        : MaxHeadSize_(maxHeadSize)
+    { }
+
+    /**
+     * @brief Parses the head at the start of @p data.
+     *
+     * @param data The bytes of the previous calls followed by the new ones.
+     */
+    EHttpParseStatus Parse(std::string_view data);
+
+    /// The parsed head, valid after @ref Parse() returned Done.
+    const THttpRequest& Request() const {
+        return Request_;
+    }
+
+    /// Number of bytes of the head, the empty line included; the body starts there.
+    size_t HeadSize() const {
+        return HeadSize_;
+    }
+
+    const std::string& Error() const {
+        return Error_;
+    }
+
+    /// Prepares the parser for the next request.
+    void Reset();
+
+private:
+    EHttpParseStatus Fail(std::string error);
+    EHttpParseStatus ParseHead(std::string_view head);
+
+    size_t MaxHeadSize_;
+    size_t Start_ = 0;      ///< Skipped empty lines before the request line.
+    size_t Scanned_ = 0;    ///< Bytes searched for line feeds.
+    size_t LineStart_ = 0;  ///< Beginning of the line being scanned.
+    size_t HeadSize_ = 0;
+    THttpRequest Request_;
+    std::string Error_;
+};
+
+/**
+ * @class THttpChunkedDecoder
+ * @brief Incremental decoder of the chunked transfer coding.
+ *
+ * Chunk data is returned as views into the input, so the body is not copied.
+ * Chunk extensions and trailer fields are skipped.
+ */
+class THttpChunkedDecoder {
+public:
+    /**
+     * @brief Decodes a prefix of @p in.
+     *
+     * @param in   Encoded bytes.
+     * @param data Set to the body bytes found, a part of @p in; empty if the prefix held none.
+     * @return The number of bytes of @p in consumed. Call again with the rest.
+     */
+    size_t Decode(std::string_view in, std::string_view& data);
+
+    /// The last chunk and the trailer section have been consumed.
+    bool Done() const {
+        return State_ == EState::Finished;
+    }
+
+    bool Failed() const {
+        return State_ == EState::Failed;
+    }
+
+    void Reset() {
+        *this = THttpChunkedDecoder();
+    }
+
+private:
+    enum class EState {
+        Size, Extension, SizeLf, Data, DataCr, DataLf, TrailerStart, Trailer, TrailerLf, Finished, Failed
+    };
+
+    EState State_ = EState::Size;
+    uint64_t Remaining_ = 0;
+    int Digits_ = 0;
+};
+
+/**
+ * @class THttpReader
+ * @brief Reads pipelined HTTP/1.x requests from a connection.
+ *
+ * Requests are parsed in place in a buffer owned by the reader: @ref Request() and the
+ * body pieces returned by @ref ReadBody() are views into it. What the socket delivered
+ * after a request stays buffered for the next one, so pipelined requests are parsed
+ * without reading the socket; @ref Buffered() tells whether one may be waiting, which lets
+ * a server collect their responses in a single write.
+ *
+ * @tparam TSocket A socket-like type with @c ReadSome(void*, size_t).
+ *
+ * ### Example Usage
+ * @code{.cpp}
+ * THttpReader reader(socket);
+ * while (co_await reader.ReadRequest()) {
+ *     std::string body;
+ *     co_await reader.ReadBody(body);
+ *     co_await THttpResponse(200).Body("ok").KeepAlive(reader.Request().KeepAlive).Write(socket);
+ * }
+ * @endcode
+ */
+template<typename TSocket>
+class THttpReader {
+public:
+    /**
+     * @param socket      The connection.
+     * @param maxHeadSize Larger request heads fail @ref ReadRequest().
+     */
+    THttpReader(TSocket& socket, size_t maxHeadSize = 65536)
+        : Socket_(socket)
+        , Parser_(maxHeadSize)
+        , Buffer_(InitialSize)
+    { }
+
+    /**
+     * @brief Reads the head of the next request.
+     *
+     * The unread rest of the previous request's body is skipped first.
+     *
+     * @return False if the peer closed the connection between requests.
+     * @throws std::runtime_error On a malformed request or if the connection closes within one.
+     */
+    TFuture<bool> ReadRequest() {
+        while (!BodyDone_) {
+            auto piece = co_await ReadBody();
+            (void)piece;
+        }
+        Parser_.Reset();
+        Compact();
+        if constexpr (requires { Socket_.WaitReadable(); }) {
+            if (Hibernation_ && Begin_ == End_) {
+                NUtils::ReleaseBuffer(std::move(Buffer_));
+                co_await Socket_.WaitReadable();
+            }
+        }
+        if (Buffer_.empty()) {
+            Buffer_ = NUtils::AcquireBuffer(InitialSize);
+        }
+        while (true) {
+            auto status = Parser_.Parse(std::string_view(Buffer_.data() + Begin_, End_ - Begin_));
+            if (status == EHttpParseStatus::Done) {
+                break;
+            }
+            if (status == EHttpParseStatus::Error) {
+                throw std::runtime_error("Bad request: " + Parser_.Error());
+            }
+            if (End_ == Buffer_.size()) {
+                // the parser fails once the head exceeds its limit
+                Buffer_.resize(Buffer_.size() * 2);
+            }
+            if (!co_await Fill()) {
+                if (Begin_ == End_) {
+                    co_return false;
+                }
+                throw std::runtime_error("Connection closed");
+            }
+        }
+        if (Buffer_.size() - Parser_.HeadSize() < MinBodySpace) {
+            // the body is read behind the head, which must not move; parse again after the growth
+            Buffer_.resize(Buffer_.size() + MinBodySpace);
+            Parser_.Reset();
+            Parser_.Parse(std::string_view(Buffer_.data() + Begin_, End_ - Begin_));
+        }
+        Begin_ += Parser_.HeadSize();
+        BodyStart_ = Begin_;
+        const auto& request = Parser_.Request();
+        Chunked_ = request.Chunked;
+        Decoder_.Reset();
+        Remaining_ = request.ContentLength;
+        BodyDone_ = !Chunked_ && Remaining_ == 0;
+        co_return true;
+    }
+
+    /// The head read by the last @ref ReadRequest().
+    const THttpRequest& Request() const {
+        return Parser_.Request();
+    }
+
+    /**
+     * @brief Returns the next piece of the request body.
+     *
+     * @return A view into the reader's buffer, valid until the next call; empty once the body is complete.
+     * @throws std::runtime_error If the connection closes within the body or the chunked coding is malformed.
+     */
+    TFuture<std::string_view> ReadBody() {
+        while (!BodyDone_) {
+            if (Begin_ == End_) {
+                // keeps the head, Request() points into it
+                Begin_ = End_ = BodyStart_;
+                if (!co_await Fill()) {
+                    throw std::runtime_error("Connection closed");
+                }
+            }
+            std::string_view available(Buffer_.data() + Begin_, End_ - Begin_);
+            if (!Chunked_) {
+                auto piece = available.substr(0, std::min<uint64_t>(Remaining_, available.size()));
+                Begin_ += piece.size();
+                Remaining_ -= piece.size();
+                BodyDone_ = Remaining_ == 0;
+                co_return piece;
+            }
+            std::string_view piece;
+            Begin_ += Decoder_.Decode(available, piece);
+            if (Decoder_.Failed()) {
+                throw std::runtime_error("Bad chunked encoding");
+            }
+            BodyDone_ = Decoder_.Done();
+            if (!piece.empty()) {
+                co_return piece;
+            }
+        }
+        co_return std::string_view();
+    }
+
+    /**
+     * @brief Appends the whole request body to @p out.
+     *
+     * @param maxSize Larger bodies throw std::runtime_error.
+     */
+    TFuture<void> ReadBody(std::string& out, size_t maxSize = 16 << 20) {
+        while (true) {
+            auto piece = co_await ReadBody();
+            if (piece.empty()) {
+                break;
+            }
+            if (out.size() + piece.size() > maxSize) {
+                throw std::runtime_error("Body too large");
+            }
+            out.append(piece);
+        }
+    }
+
+    /**
+     * @brief Returns true if bytes after the current request are buffered.
+     *
+     * Valid after the body has been read: the next request, or a part of it, has arrived.
+     */
+    bool Buffered() const {
+        return BodyDone_ && Begin_ != End_;
+    }
+
+    /**
+     * @brief Lets an idle keep-alive connection wait between requests without its buffer.
+     *
+     * When nothing of the next request is buffered, @ref ReadRequest() returns the buffer
+     * to the per-thread cache, waits with the socket's @c WaitReadable() and takes a buffer
+     * again once data arrives. See @ref TByteReader::SetHibernation().
+     */
+    void SetHibernation(bool enable = true) {
+        Hibernation_ = enable;
+    }
+
+private:
+    static constexpr size_t InitialSize = 16384;
+    static constexpr size_t MinBodySpace = 4096;
+
+    /// Reads into the free tail of the buffer, false when the peer closed the connection.
+    TFuture<bool> Fill() {
+        while (true) {
+            auto size = co_await Socket_.ReadSome(Buffer_.data() + End_, Buffer_.size() - End_);
+            if (size == 0) {
+                co_return false;
+            }
+            if (size < 0) {
+                continue; // retry
+            }
+            End_ += size;
+            co_return true;
+        }
+    }
+
+    /// Moves the unread bytes to the front, the views of the last request are gone after it.
+    void Compact() {
+        BodyStart_ = 0;
+        if (Begin_ == End_) {
+            Begin_ = End_ = 0;
+        } else if (Begin_ != 0) {
+            memmove(Buffer_.data(), Buffer_.data() + Begin_, End_ - Begin_);
+            End_ -= Begin_;
+            Begin_ = 0;
+        }
+        if (Buffer_.size() > InitialSize && End_ <= InitialSize) {
+            // a large head grew the buffer, do not keep it for the life of the connection
+            Buffer_.resize(InitialSize);
+            Buffer_.shrink_to_fit();
+        }
+    }
+
+    TSocket& Socket_;
+    THttpParser Parser_;
+    THttpChunkedDecoder Decoder_;
+    std::vector<char> Buffer_;
+    size_t Begin_ = 0;
+    size_t End_ = 0;
+    size_t BodyStart_ = 0; ///< End of the head of the current request.
+    bool Chunked_ = false;
+    uint64_t Remaining_ = 0;
+    bool BodyDone_ = true;
+    bool Hibernation_ = false;
+};
+
+/**
+ * @class THttpResponse
+ * @brief An HTTP/1.1 response written with a single vectored write.
+ *
+ * The head is formatted into one string and sent with the body, which is not copied,
+ * by @ref TByteWriter::WriteAll(). Content-Length is added from the body. Responses to
+ * pipelined requests can be collected with @ref AppendTo() and sent together.
+ */
+class THttpResponse {
+public:
+    /// @param reason The reason phrase, the standard one for @p status if empty.
+    explicit THttpResponse(int status = 200, std::string_view reason = {});
+
+    /// Adds a header field; both views must stay valid until the response is written.
+    THttpResponse& Header(std::string_view name, std::string_view value) {
+        Headers_.push_back({name, value});
+        return *this;
+    }
+
+    /// Sets the body; the view must stay valid until the response is written.
+    THttpResponse& Body(std::string_view body) {
+        Body_ = body;
+        return *this;
+    }
+
+    /// Adds "Connection: close" if false.
+    THttpResponse& KeepAlive(bool keepAlive) {
+        KeepAlive_ = keepAlive;
+        return *this;
+    }
+
+    /// Returns the status line and header fields, the empty line included.
+    std::string Head() const;
+
+    /// Appends the head and the body to @p out.
+    void AppendTo(std::string& out) const;
+
+    /// Writes the response with one vectored write.
+    template<typename TSocket>
+    TFuture<void> Write(TSocket& socket) const {
+        std::string head = Head();
+        iovec iov[] = {
+            {head.data(), head.size()},
+            {const_cast<char*>(Body_.data()), Body_.size()},
+        };
+        co_await TByteWriter(socket).WriteAll(std::span<const iovec>(iov, Body_.empty() ? 1 : 2));
+    }
+
+    /// Returns the standard reason phrase of @p status, "Unknown" if there is none.
+    static std::string_view Reason(int status);
+
+private:
+    int Status_;
+    std::string_view ReasonPhrase_;
+    std::vector<THttpHeader> Headers_;
+    std::string_view Body_;
+    bool KeepAlive_ = true;
+};
+
+} // namespace NNet
@@ -21,6 +21,7 @@ namespace NNet {
 LPFN_CONNECTEX ConnectEx;
 LPFN_ACCEPTEX AcceptEx;
 LPFN_GETACCEPTEXSOCKADDRS GetAcceptExSockaddrs;
+LPFN_TRANSMITFILE TransmitFile;
 #endif
 
 TInitializer::TInitializer() {
@@ -59,6 +60,13 @@ TInitializer::TInitializer() {
         throw std::runtime_error("Cannot query dummy socket");
     }
 
+    // optional, TIOCp sends files through a buffer without it
+    guid = WSAID_TRANSMITFILE;
+    res = WSAIoctl(sock, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &TransmitFile, sizeof(TransmitFile), &dwBytes, nullptr, nullptr);
+    if (res != 0) {
+        TransmitFile = nullptr;
+    }
+
     closesocket(sock);
 #endif
 }
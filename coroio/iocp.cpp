@@ -3,12 +3,16 @@
 #include "iocp.hpp"
 
 #include <Mswsock.h> // for ConnectEx, AcceptEx
+#include <io.h> // for _get_osfhandle
+
+#include <algorithm>
 
 namespace NNet {
 
 extern LPFN_CONNECTEX ConnectEx;
 extern LPFN_ACCEPTEX AcceptEx;
 extern LPFN_GETACCEPTEXSOCKADDRS GetAcceptExSockaddrs;
+extern LPFN_TRANSMITFILE TransmitFile;
 
 TIOCp::TIOCp()
     : Port_(CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0))
@@ -16,29 +20,56 @@ TIOCp::TIOCp()
     if (Port_ == INVALID_HANDLE_VALUE) {
         throw std::system_error(WSAGetLastError(), std::generic_category(), "CreateIoCompletionPort");
     }
+    // A completion without OVERLAPPED is a wakeup from Post()
+    Interrupter_ = [this]() { PostQueuedCompletionStatus(Port_, 0, 0, nullptr); };
+    Entries_.resize(Batch_.Get());
 }
 
 TIOCp::~TIOCp()
 {
+    for (auto& [fd, pool] : AcceptPools_) {
+        for (auto& accepted : pool.Ready) {
+            closesocket((SOCKET)accepted.Sock);
+        }
+    }
     CloseHandle(Port_);
 }
 
-TIOCp::TIO* TIOCp::NewTIO() {
-    return new (Allocator_.allocate()) TIO();
+TIOCp::TIO* TIOCp::NewTIO(int fd, THandle handle) {
+    TIO* tio = new (Allocator_.allocate()) TIO();
+    tio->handle = handle;
+    tio->fd = fd;
+    Pending_[handle.address()] = tio;
+    return tio;
 }
 
 void TIOCp::FreeTIO(TIO* tio) {
+    if (tio->handle) {
+        Pending_.erase(tio->handle.address());
+    }
     Allocator_.deallocate(tio);
 }
 
+bool TIOCp::CompletedInline(int fd, TIO* tio, DWORD size) {
+    if (!SkipPort_.Find(fd)) {
+        // the completion is queued to the port as well
+        return false;
+    }
+    Completed_.push_back({tio->handle, static_cast<int>(size)});
+    FreeTIO(tio);
+    return true;
+}
+
 void TIOCp::Recv(int fd, void* buf, int size, std::coroutine_handle<> handle)
 {
-    TIO* tio = NewTIO();
-    tio->handle = handle;
+    TIO* tio = NewTIO(fd, handle);
     WSABUF recvBuf = {(ULONG)size, (char*)buf};
     DWORD flags = 0;
     DWORD outSize = 0;
     auto ret = WSARecv((SOCKET)fd, &recvBuf, 1, &outSize, &flags, (WSAOVERLAPPED*)tio, nullptr);
+    if (ret == 0 && CompletedInline(fd, tio, outSize)) {
+        return;
+    }
     if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
         FreeTIO(tio);
         throw std::system_error(WSAGetLastError(), std::generic_category(), "WSARecv");
@@ -47,21 +78,201 @@ void TIOCp::Recv(int fd, void* buf, int size, std::coroutine_handle<> handle)
 
 void TIOCp::Send(int fd, const void* buf, int size, std::coroutine_handle<> handle)
 {
-    TIO* tio = NewTIO();
-    tio->handle = handle;
+    TIO* tio = NewTIO(fd, handle);
     WSABUF sendBuf = {(ULONG)size, (char*)buf};
     DWORD outSize = 0;
     auto ret = WSASend((SOCKET)fd, &sendBuf, 1, &outSize, 0, (WSAOVERLAPPED*)tio, nullptr);
+    if (ret == 0 && CompletedInline(fd, tio, outSize)) {
+        return;
+    }
+    if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
+        FreeTIO(tio);
+        throw std::system_error(WSAGetLastError(), std::generic_category(), "WSASend");
+    }
+}
+
+void TIOCp::SendTo(int fd, const void* buf, int size, const sockaddr* addr, socklen_t len, std::coroutine_handle<> handle)
+{
+    TIO* tio = NewTIO(fd, handle);
+    WSABUF sendBuf = {(ULONG)size, (char*)buf};
+    DWORD outSize = 0;
+    auto ret = WSASendTo((SOCKET)fd, &sendBuf, 1, &outSize, 0, addr, len, (WSAOVERLAPPED*)tio, nullptr);
+    if (ret == 0 && CompletedInline(fd, tio, outSize)) {
+        return;
+    }
+    if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
+        FreeTIO(tio);
+        throw std::system_error(WSAGetLastError(), std::generic_category(), "WSASendTo");
+    }
+}
+
+void TIOCp::RecvFrom(int fd, void* buf, int size, sockaddr* addr, socklen_t* len, std::coroutine_handle<> handle)
+{
+    TIO* tio = NewTIO(fd, handle);
+    WSABUF recvBuf = {(ULONG)size, (char*)buf};
+    DWORD flags = 0;
+    DWORD outSize = 0;
+    auto ret = WSARecvFrom((SOCKET)fd, &recvBuf, 1, &outSize, &flags, addr, len, (WSAOVERLAPPED*)tio, nullptr);
+    if (ret == 0 && CompletedInline(fd, tio, outSize)) {
+        return;
+    }
+    if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
+        FreeTIO(tio);
+        throw std::system_error(WSAGetLastError(), std::generic_category(), "WSARecvFrom");
+    }
+}
+
+void TIOCp::TransmitFile(int fd, int file, int64_t offset, int size, std::coroutine_handle<> handle)
+{
+    HANDLE fileHandle = reinterpret_cast<HANDLE>(_get_osfhandle(file));
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        throw std::system_error(EBADF, std::generic_category(), "_get_osfhandle");
+    }
+    TIO* tio = NewTIO(fd, handle);
+    tio->overlapped.Offset = static_cast<DWORD>(offset);
+    tio->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+    if (NNet::TransmitFile((SOCKET)fd, fileHandle, size, 0, (LPOVERLAPPED)tio, nullptr, 0)) {
+        // no size is returned, the range may reach past the end of the file
+        DWORD sent = 0, flags = 0;
+        WSAGetOverlappedResult((SOCKET)fd, (LPWSAOVERLAPPED)tio, &sent, FALSE, &flags);
+        CompletedInline(fd, tio, sent);
+        return;
+    }
+    if (WSAGetLastError() != WSA_IO_PENDING) {
+        FreeTIO(tio);
+        throw std::system_error(WSAGetLastError(), std::generic_category(), "TransmitFile");
+    }
+}
+
+bool TIOCp::HasTransmitFile() const
+{
+    return NNet::TransmitFile != nullptr;
+}
+
+void TIOCp::WaitHangup(int fd, std::coroutine_handle<> handle)
+{
+    TIO* tio = NewTIO(fd, handle);
+    // the byte is only peeked, the buffer of the record outlives the operation
+    WSABUF peekBuf = {1, tio->acceptBuf};
+    DWORD flags = MSG_PEEK;
+    DWORD outSize = 0;
+    auto ret = WSARecv((SOCKET)fd, &peekBuf, 1, &outSize, &flags, (WSAOVERLAPPED*)tio, nullptr);
+    if (ret == 0 && CompletedInline(fd, tio, outSize)) {
+        return;
+    }
+    if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
+        FreeTIO(tio);
+        throw std::system_error(WSAGetLastError(), std::generic_category(), "WSARecv");
+    }
+}
+
+namespace {
+
+// Winsock copies the WSABUF array before returning, so it may live on the stack
+struct TWsaBufs {
+    TWsaBufs(const iovec* iov, int count) {
+        if (count <= static_cast<int>(std::size(Inline))) {
+            Bufs = Inline;
+        } else {
+            Heap.resize(count);
+            Bufs = Heap.data();
+        }
+        for (int i = 0; i < count; i++) {
+            Bufs[i] = WSABUF{(ULONG)iov[i].iov_len, (char*)iov[i].iov_base};
+        }
+    }
+
+    WSABUF Inline[16];
+    std::vector<WSABUF> Heap;
+    WSABUF* Bufs;
+};
+
+const iovec* FirstNonEmpty(const iovec* iov, int count) {
+    for (int i = 0; i < count; i++) {
+        if (iov[i].iov_len) {
+            return &iov[i];
+        }
+    }
+    return count ? iov : nullptr;
+}
+
+} // namespace
+
+void TIOCp::RecvV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle)
+{
+    TIO* tio = NewTIO(fd, handle);
+    TWsaBufs bufs(iov, count);
+    DWORD flags = 0;
+    DWORD outSize = 0;
+    auto ret = WSARecv((SOCKET)fd, bufs.Bufs, count, &outSize, &flags, (WSAOVERLAPPED*)tio, nullptr);
+    if (ret == 0 && CompletedInline(fd, tio, outSize)) {
+        return;
+    }
     if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
         FreeTIO(tio);
         throw std::system_error(WSAGetLastError(), std::generic_category(), "WSARecv");
     }
 }
 
+void TIOCp::SendV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle)
+{
+    TIO* tio = NewTIO(fd, handle);
+    TWsaBufs bufs(iov, count);
+    DWORD outSize = 0;
+    auto ret = WSASend((SOCKET)fd, bufs.Bufs, count, &outSize, 0, (WSAOVERLAPPED*)tio, nullptr);
+    if (ret == 0 && CompletedInline(fd, tio, outSize)) {
+        return;
+    }
+    if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
+        FreeTIO(tio);
+        throw std::system_error(WSAGetLastError(), std::generic_category(), "WSASend");
+    }
+}
+
+void TIOCp::ReadV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle)
+{
+    // ReadFileScatter needs page-sized buffers, a short read is fine for ReadSomeV
+    const iovec* first = FirstNonEmpty(iov, count);
+    Read(fd, first ? first->iov_base : nullptr, first ? (int)first->iov_len : 0, handle);
+}
+
+void TIOCp::WriteV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle)
+{
+    const iovec* first = FirstNonEmpty(iov, count);
+    Write(fd, first ? first->iov_base : nullptr, first ? (int)first->iov_len : 0, handle);
+}
+
 void TIOCp::Accept(int fd, struct sockaddr* addr, socklen_t* len, std::coroutine_handle<> handle)
 {
-    TIO* tio = NewTIO();
-    tio->handle = handle;
+    if (AcceptBacklog_ > 0) {
+        auto [it, created] = AcceptPools_.try_emplace(fd);
+        auto& pool = it->second;
+        if (created) {
+            pool.Id = ++AcceptPoolId_;
+            sockaddr_storage local = {};
+            int localLen = sizeof(local);
+            if (getsockname((SOCKET)fd, (sockaddr*)&local, &localLen) == 0) {
+                pool.Family = local.ss_family;
+            }
+        }
+        if (int err = FillAcceptPool(fd, pool)) {
+            if (pool.Waiters.empty()) {
+                AcceptPools_.erase(it);
+            }
+            throw std::system_error(err, std::generic_category(), "AcceptEx");
+        }
+        // FillAcceptPool() may have accepted at once
+        if (!pool.Ready.empty()) {
+            DeliverAccept({addr, len, handle}, pool.Ready.front());
+            pool.Ready.pop_front();
+            FillAcceptPool(fd, pool);
+        } else {
+            pool.Waiters.push_back({addr, len, handle});
+        }
+        return;
+    }
+
+    TIO* tio = NewTIO(fd, handle);
     tio->addr = addr;
     tio->len = len;
     SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
@@ -86,10 +297,98 @@ void TIOCp::Accept(int fd, struct sockaddr* addr, socklen_t* len, std::coroutine
     }
 }
 
+int TIOCp::PostAccept(int fd, TAcceptPool& pool) {
+    SOCKET sock = socket(pool.Family, SOCK_STREAM, IPPROTO_TCP);
+    if (sock == INVALID_SOCKET) {
+        return WSAGetLastError();
+    }
+    u_long mode = 1;
+    if (ioctlsocket(sock, FIONBIO, &mode) != 0) {
+        int err = WSAGetLastError();
+        closesocket(sock);
+        return err;
+    }
+    TIO* tio = new (Allocator_.allocate()) TIO();
+    tio->fd = fd;
+    tio->sock = (int)sock;
+    tio->pool = pool.Id;
+
+    DWORD received = 0;
+    auto ret = AcceptEx((SOCKET)fd, sock, tio->acceptBuf, 0, AcceptAddrSize, AcceptAddrSize, &received, (WSAOVERLAPPED*)tio);
+    if (ret == FALSE && WSAGetLastError() != WSA_IO_PENDING) {
+        int err = WSAGetLastError();
+        Allocator_.deallocate(tio);
+        closesocket(sock);
+        return err;
+    }
+    pool.Posted++;
+    if (ret == TRUE && SkipPort_.Find(fd)) {
+        CompletePooledAccept(tio, true);
+    }
+    return 0;
+}
+
+int TIOCp::FillAcceptPool(int fd, TAcceptPool& pool) {
+    while (pool.Posted + static_cast<int>(pool.Ready.size()) < AcceptBacklog_) {
+        if (int err = PostAccept(fd, pool)) {
+            // the accepts already posted may still succeed
+            return pool.Posted == 0 && pool.Ready.empty() ? err : 0;
+        }
+    }
+    return 0;
+}
+
+void TIOCp::DeliverAccept(const TAcceptWaiter& waiter, const TAccepted& accepted) {
+    memcpy(waiter.Addr, &accepted.Addr, std::min(*waiter.Len, accepted.Len));
+    *waiter.Len = accepted.Len;
+    Completed_.push_back({waiter.Handle, accepted.Sock, true});
+}
+
+void TIOCp::CompletePooledAccept(TIO* tio, bool ok) {
+    int fd = tio->fd;
+    SOCKET sock = (SOCKET)tio->sock;
+    auto it = AcceptPools_.find(fd);
+    if (it == AcceptPools_.end() || it->second.Id != tio->pool) {
+        // posted for a listening socket that is gone, its fd number may be reused
+        closesocket(sock);
+        Allocator_.deallocate(tio);
+        return;
+    }
+    auto& pool = it->second;
+    pool.Posted--;
+    SOCKET listener = (SOCKET)fd;
+    if (ok && setsockopt(sock, SOL_SOCKET, SO_UPDATE_ACCEPT_CONTEXT, (char*)&listener, sizeof(listener)) == 0) {
+        TAccepted accepted = {};
+        accepted.Sock = (int)sock;
+        sockaddr* local = nullptr;
+        sockaddr* remote = nullptr;
+        int localLen = 0;
+        int remoteLen = 0;
+        GetAcceptExSockaddrs(tio->acceptBuf, 0, AcceptAddrSize, AcceptAddrSize, &local, &localLen, &remote, &remoteLen);
+        accepted.Len = std::min<int>(remoteLen, sizeof(accepted.Addr));
+        memcpy(&accepted.Addr, remote, accepted.Len);
+        if (!pool.Waiters.empty()) {
+            DeliverAccept(pool.Waiters.front(), accepted);
+            pool.Waiters.pop_front();
+        } else {
+            pool.Ready.push_back(accepted);
+        }
+    } else {
+        // e.g. reset by the peer before it was accepted
+        closesocket(sock);
+    }
+    Allocator_.deallocate(tio);
+    if (int err = FillAcceptPool(fd, pool)) {
+        for (auto& waiter : pool.Waiters) {
+            Completed_.push_back({waiter.Handle, -err});
+        }
+        pool.Waiters.clear();
+    }
+}
+
 void TIOCp::Connect(int fd, const sockaddr* addr, socklen_t len, std::coroutine_handle<> handle)
 {
-    TIO* tio = NewTIO();
-    tio->handle = handle;
+    TIO* tio = NewTIO(fd, handle);
 
     int bind_result = 0;
     if (len == sizeof(sockaddr_in)) {
@@ -114,6 +413,9 @@ void TIOCp::Connect(int fd, const sockaddr* addr, socklen_t len, std::coroutine_
     }
 
     auto ret = ConnectEx((SOCKET)fd, addr, len, nullptr, 0, nullptr, (WSAOVERLAPPED*)tio);
+    if (ret == TRUE && CompletedInline(fd, tio, 0)) {
+        return;
+    }
     if (ret == FALSE && WSAGetLastError() != ERROR_IO_PENDING) {
         FreeTIO(tio);
         throw std::system_error(WSAGetLastError(), std::generic_category(), "ConnectEx");
@@ -122,30 +424,95 @@ void TIOCp::Connect(int fd, const sockaddr* addr, socklen_t len, std::coroutine_
 
 void TIOCp::Read(int fd, void* buf, int size, std::coroutine_handle<> handle)
 {
-    TIO* tio = NewTIO();
-    tio->handle = handle;
+    // overlapped handles have no file position
+    ReadAt(fd, buf, size, 0, handle);
+}
+
+void TIOCp::Write(int fd, const void* buf, int size, std::coroutine_handle<> handle)
+{
+    WriteAt(fd, buf, size, 0, handle);
+}
+
+void TIOCp::ReadAt(int fd, void* buf, int size, int64_t offset, std::coroutine_handle<> handle)
+{
+    TIO* tio = NewTIO(fd, handle);
+    tio->overlapped.Offset = static_cast<DWORD>(offset);
+    tio->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
 
     auto ret = ReadFile(reinterpret_cast<HANDLE>(fd), buf, size, nullptr, (WSAOVERLAPPED*)tio);
-    if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
+    if (ret == FALSE && GetLastError() != ERROR_IO_PENDING) {
+        int err = GetLastError();
         FreeTIO(tio);
-        throw std::system_error(WSAGetLastError(), std::generic_category(), "ReadFile");
+        if (err == ERROR_HANDLE_EOF) {
+            Completed_.push_back({handle, 0});
+            return;
+        }
+        throw std::system_error(err, std::generic_category(), "ReadFile");
     }
 }
 
-void TIOCp::Write(int fd, const void* buf, int size, std::coroutine_handle<> handle)
+void TIOCp::WriteAt(int fd, const void* buf, int size, int64_t offset, std::coroutine_handle<> handle)
 {
-    TIO* tio = NewTIO();
-    tio->handle = handle;
+    TIO* tio = NewTIO(fd, handle);
+    tio->overlapped.Offset = static_cast<DWORD>(offset);
+    tio->overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
 
     auto ret = WriteFile(reinterpret_cast<HANDLE>(fd), buf, size, nullptr, (WSAOVERLAPPED*)tio);
-    if (ret != 0 && WSAGetLastError() != WSA_IO_PENDING) {
+    if (ret == FALSE && GetLastError() != ERROR_IO_PENDING) {
+        int err = GetLastError();
         FreeTIO(tio);
-        throw std::system_error(WSAGetLastError(), std::generic_category(), "WriteFile");
+        throw std::system_error(err, std::generic_category(), "WriteFile");
     }
 }
 
+void TIOCp::ReadAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle)
+{
+    const iovec* first = FirstNonEmpty(iov, count);
+    ReadAt(fd, first ? first->iov_base : nullptr, first ? (int)first->iov_len : 0, offset, handle);
+}
+
+void TIOCp::WriteAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle)
+{
+    const iovec* first = FirstNonEmpty(iov, count);
+    WriteAt(fd, first ? first->iov_base : nullptr, first ? (int)first->iov_len : 0, offset, handle);
+}
+
+void TIOCp::Fsync(int fd, bool dataOnly, std::coroutine_handle<> handle)
+{
+    (void)dataOnly;
+    int ret = FlushFileBuffers(reinterpret_cast<HANDLE>(fd)) ? 0 : -static_cast<int>(GetLastError());
+    Completed_.push_back({handle, ret});
+}
+
 void TIOCp::Register(int fd) {
     CreateIoCompletionPort((HANDLE)(SOCKET)fd, Port_, (ULONG_PTR)fd, 0);
+    // only IFS providers report immediate success reliably, and datagram sockets would skip
+    // the completions of ICMP errors
+    WSAPROTOCOL_INFOW info = {};
+    int len = sizeof(info);
+    if (getsockopt((SOCKET)fd, SOL_SOCKET, SO_PROTOCOL_INFOW, (char*)&info, &len) == 0
+        && info.iSocketType == SOCK_STREAM
+        && (info.dwServiceFlags1 & XP1_IFS_HANDLES)
+        && SetFileCompletionNotificationModes((HANDLE)(SOCKET)fd, FILE_SKIP_COMPLETION_PORT_ON_SUCCESS | FILE_SKIP_SET_EVENT_ON_HANDLE))
+    {
+        SkipPort_[fd] = true;
+    }
+}
+
+void TIOCp::Unregister(int fd) {
+    SkipPort_.Release(fd);
+    auto it = AcceptPools_.find(fd);
+    if (it == AcceptPools_.end()) {
+        return;
+    }
+    for (auto& accepted : it->second.Ready) {
+        closesocket((SOCKET)accepted.Sock);
+    }
+    for (auto& waiter : it->second.Waiters) {
+        Completed_.push_back({waiter.Handle, -ECONNABORTED});
+    }
+    // the posted AcceptEx fail once the socket is closed, Poll() frees them then
+    AcceptPools_.erase(it);
 }
 
 void TIOCp::Cancel([[maybe_unused]] int fd)
@@ -153,9 +520,44 @@ void TIOCp::Cancel([[maybe_unused]] int fd)
     // TODO: implement
 }
 
+void TIOCp::Cancel(THandle h)
+{
+    if (RemoveCompletion(h, Results_)) {
+        return;
+    }
+    for (size_t i = 0; i < Completed_.size(); i++) {
+        if (Completed_[i].Handle == h) {
+            if (Completed_[i].Accepted && Completed_[i].Result >= 0) {
+                closesocket((SOCKET)Completed_[i].Result);
+            }
+            Completed_.erase(Completed_.begin() + i);
+            return;
+        }
+    }
+    for (auto& [fd, pool] : AcceptPools_) {
+        auto waiter = std::find_if(pool.Waiters.begin(), pool.Waiters.end(), [h](const TAcceptWaiter& w) {
+            return w.Handle == h;
+        });
+        if (waiter != pool.Waiters.end()) {
+            pool.Waiters.erase(waiter);
+            return;
+        }
+    }
+    auto it = Pending_.find(h.address());
+    if (it == Pending_.end()) {
+        return;
+    }
+    TIO* tio = it->second;
+    Pending_.erase(it);
+    // the completion is still queued to the port, Poll() drops it
+    tio->handle = {};
+    tio->len = nullptr;
+    CancelIoEx(reinterpret_cast<HANDLE>(tio->fd), &tio->overlapped);
+}
+
 int TIOCp::Result() {
     int r = Results_.front();
-    Results_.pop();
+    Results_.pop_front();
     return r;
 }
 
@@ -167,10 +569,13 @@ long TIOCp::GetTimeoutMs() {
 void TIOCp::Poll()
 {
     Reset();
-    Entries_.resize(std::max(Allocator_.count(), 1));
 
     DWORD fired = 0;
-    auto res = GetQueuedCompletionStatusEx(Port_, &Entries_[0], Entries_.size(), &fired, GetTimeoutMs(), FALSE);
+    // results ready without a completion packet must not wait for one
+    long timeout = Completed_.empty() ? GetTimeoutMs() : 0;
+    auto pollStart = StatsStart();
+    auto res = GetQueuedCompletionStatusEx(Port_, &Entries_[0], Entries_.size(), &fired, timeout, FALSE);
+    RecordPoll(pollStart);
     if (res == FALSE && GetLastError() != WAIT_TIMEOUT) {
         throw std::system_error(GetLastError(), std::generic_category(), "GetQueuedCompletionStatusEx");
     }
@@ -179,6 +584,21 @@ void TIOCp::Poll()
 
     for (DWORD i = 0; i < fired && res == TRUE; i++) {
         TIO* event = (TIO*)Entries_[i].lpOverlapped;
+        if (!event) {
+            continue;
+        }
+        if (event->pool) {
+            CompletePooledAccept(event, Entries_[i].Internal == 0);
+            continue;
+        }
+        if (!event->handle) {
+            // cancelled, the awaitable is gone
+            if (event->addr && event->sock >= 0) {
+                closesocket(event->sock);
+            }
+            FreeTIO(event);
+            continue;
+        }
         if (event->addr) {
             sockaddr_in* remoteAddr = nullptr;
             sockaddr_in* localAddr = nullptr;
@@ -186,14 +606,24 @@ void TIOCp::Poll()
             *event->len = 0;
             GetAcceptExSockaddrs(event->addr, 0, sizeof(sockaddr_in6) + 16, sizeof(sockaddr_in6) + 16, (sockaddr**)&localAddr, &localAddrLen, (sockaddr**)&remoteAddr, event->len);
             memmove(event->addr, remoteAddr, *event->len);
-            Results_.push(event->sock);
+            Results_.push_back(event->sock);
         } else {
-            Results_.push(Entries_[i].dwNumberOfBytesTransferred);
+            Results_.push_back(Entries_[i].dwNumberOfBytesTransferred);
         }
-        ReadyEvents_.emplace_back(TEvent{-1, 0, event->handle});
+        ReadyEvents_.emplace_back(TEvent{-1, TEvent::RESULT, event->handle});
         FreeTIO(event);
     }
+    for (auto& completed : Completed_) {
+        Results_.push_back(completed.Result);
+        ReadyEvents_.emplace_back(TEvent{-1, TEvent::RESULT, completed.Handle});
+    }
+    Completed_.clear();
+    if (Batch_.Update(res == TRUE ? fired : 0)) {
+        Entries_.resize(Batch_.Get());
+        Entries_.shrink_to_fit();
+    }
 
+    ProcessPosted();
     ProcessTimers();
 }
 
@@ -1,10 +1,13 @@
 #pragma once
 
 #include "base.hpp"
+#include "fdtable.hpp"
 #include "socket.hpp"
 #include "poller.hpp"
 
+#include <deque>
 #include <stack>
+#include <unordered_map>
 
 namespace NNet {
 
@@ -83,6 +86,12 @@ private:
  * arena allocator (@ref TArenaAllocator) to preallocate IOCP event structures, avoiding per-operation
  * dynamic memory allocations required by the API.
  *
+ * Sockets are registered with FILE_SKIP_COMPLETION_PORT_ON_SUCCESS when their provider allows it:
+ * an operation that completes at once is finished without a trip through the port, and the
+ * coroutine is resumed by the next @ref Poll() without blocking. @ref SetAcceptBacklog() keeps
+ * AcceptEx calls posted on listening sockets ahead of @ref Accept(). The batch passed to
+ * GetQueuedCompletionStatusEx grows and shrinks with the completion rate (@ref TBatchSize).
+ *
  * Type aliases provided:
  * - @c TSocket is defined as NNet::TPollerDrivenSocket<TIOCp>.
  * - @c TFileHandle is defined as NNet::TPollerDrivenFileHandle<TIOCp>.
@@ -104,6 +113,8 @@ public:
     using TSocket = NNet::TPollerDrivenSocket<TIOCp>;
     /// Alias for the poller-driven file handle type.
     using TFileHandle = NNet::TPollerDrivenFileHandle<TIOCp>;
+    /// Alias for the poller-driven datagram socket type.
+    using TDatagramSocket = NNet::TPollerDrivenDatagramSocket<TIOCp>;
 
     TIOCp();
     ~TIOCp();
@@ -125,6 +136,33 @@ public:
      * @param handle The coroutine handle to resume when the operation completes.
      */
     void Write(int fd, const void* buf, int size, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a read at @p offset, the offset of the OVERLAPPED structure.
+     *
+     * @param fd   The file handle.
+     * @param buf  Buffer to store read data.
+     * @param size Number of bytes to read.
+     * @param offset The file offset of the first byte.
+     * @param handle The coroutine handle to resume when the operation completes.
+     */
+    void ReadAt(int fd, void* buf, int size, int64_t offset, std::coroutine_handle<> handle);
+    /// Posts a write at @p offset.
+    void WriteAt(int fd, const void* buf, int size, int64_t offset, std::coroutine_handle<> handle);
+    /// Same as @ref ReadAt() with the first non-empty buffer, ReadFileScatter needs page-sized buffers.
+    void ReadAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle);
+    /// Same as @ref WriteAt() with the first non-empty buffer.
+    void WriteAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle);
+    /**
+     * @brief Flushes the file with FlushFileBuffers.
+     *
+     * There is no overlapped flush: the call blocks, and the coroutine is resumed by the
+     * next @ref Poll() like an operation that completed at once.
+     *
+     * @param fd       The file handle.
+     * @param dataOnly Ignored, Windows flushes the metadata as well.
+     * @param handle   The coroutine handle to resume.
+     */
+    void Fsync(int fd, bool dataOnly, std::coroutine_handle<> handle);
     /**
      * @brief Posts an asynchronous receive operation.
      *
@@ -143,6 +181,53 @@ public:
      * @param handle The coroutine handle to resume when the operation completes.
      */
     void Send(int fd, const void* buf, int size, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a one-byte MSG_PEEK receive, completing when the peer closes or resets.
+     *
+     * IOCP has no readiness request for a hang-up alone: data arriving completes it as well,
+     * without being consumed. For the idle connections of @ref TConnectionPool, where data is
+     * not expected, both mean the connection cannot be reused.
+     *
+     * @param fd The socket descriptor.
+     * @param handle The coroutine handle to resume when the operation completes.
+     */
+    void WaitHangup(int fd, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts an overlapped WSASendTo.
+     *
+     * @param fd   The socket descriptor.
+     * @param buf  The datagram.
+     * @param size Size of the datagram.
+     * @param addr The destination, nullptr on a connected socket.
+     * @param len  Size of @p addr.
+     * @param handle The coroutine handle to resume when the operation completes.
+     */
+    void SendTo(int fd, const void* buf, int size, const sockaddr* addr, socklen_t len, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts an overlapped WSARecvFrom.
+     *
+     * @param fd   The socket descriptor.
+     * @param buf  Buffer for the datagram.
+     * @param size Size of @p buf.
+     * @param addr Receives the source; it and @p len must stay valid until completion.
+     * @param len  Size of @p addr, replaced by the size of the source.
+     * @param handle The coroutine handle to resume when the operation completes.
+     */
+    void RecvFrom(int fd, void* buf, int size, sockaddr* addr, socklen_t* len, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a TransmitFile sending @p size bytes of a file from @p offset.
+     *
+     * Requires @ref HasTransmitFile().
+     *
+     * @param fd     The socket descriptor.
+     * @param file   C runtime descriptor of the file, as for @ref TFileOps::pread().
+     * @param offset Offset of the first byte.
+     * @param size   Number of bytes to send.
+     * @param handle The coroutine handle to resume when the operation completes.
+     */
+    void TransmitFile(int fd, int file, int64_t offset, int size, std::coroutine_handle<> handle);
+    /// Returns true if the Winsock provider exposes TransmitFile.
+    bool HasTransmitFile() const;
     /**
      * @brief Posts an asynchronous accept operation.
      *
@@ -151,6 +236,10 @@ public:
      * @param len  Pointer to a variable specifying the size of the address structure.
      * @param handle The coroutine handle to resume when an incoming connection is accepted.
      */
+    void RecvV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle);
+    void SendV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle);
+    void ReadV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle);
+    void WriteV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle);
     void Accept(int fd, struct sockaddr* addr, socklen_t* len, std::coroutine_handle<> handle);
     /**
      * @brief Posts an asynchronous connect operation.
@@ -167,12 +256,46 @@ public:
      * @param fd The file descriptor.
      */
     void Cancel(int fd);
+    /**
+     * @brief Cancels the pending operation of a specific coroutine handle.
+     *
+     * Called by awaitables of @ref TPollerDrivenSocket destroyed while their coroutine waits:
+     * CancelIoEx() is applied to the OVERLAPPED of that operation only, and its completion
+     * is dropped; a completion already collected by @ref Poll() is dropped with its result.
+     *
+     * @param h The coroutine handle.
+     */
+    void Cancel(THandle h);
     /**
      * @brief Registers a file descriptor with the IOCP.
      *
      * @param fd The file descriptor to register.
      */
     void Register(int fd);
+    /**
+     * @brief Forgets a descriptor before it is closed.
+     *
+     * Called by @ref TPollerDrivenSocket::Close(). Closes the connections accepted ahead for a
+     * listening socket, and fails the coroutines still waiting in its @ref Accept().
+     *
+     * @param fd The file descriptor.
+     */
+    void Unregister(int fd);
+    /**
+     * @brief Keeps @p count AcceptEx posted on every listening socket.
+     *
+     * The first @ref Accept() on a listening socket posts @p count AcceptEx with pre-created
+     * sockets, and every completion posts a replacement. Connections that arrive while nobody
+     * accepts are kept, up to @p count, and returned by the next @ref Accept() without waiting.
+     * 0 (the default) posts one AcceptEx per @ref Accept().
+     *
+     * Takes effect for listening sockets that have not accepted yet.
+     *
+     * @param count The number of AcceptEx kept posted.
+     */
+    void SetAcceptBacklog(int count) {
+        AcceptBacklog_ = count;
+    }
     /**
      * @brief Retrieves the result of the last completed IOCP operation.
      *
@@ -187,28 +310,76 @@ public:
     void Poll();
 
 private:
+    static constexpr int AcceptAddrSize = sizeof(sockaddr_in6) + 16; ///< Per address, as AcceptEx needs.
+
     struct TIO {
         OVERLAPPED overlapped;
         THandle handle;
         struct sockaddr* addr = nullptr; // for accept
         socklen_t* len = nullptr; // for accept
         int sock = -1; // for accept
+        int fd = -1; // for CancelIoEx
+        unsigned pool = 0; // id of the TAcceptPool that posted the accept, 0 if a coroutine did
+        char acceptBuf[2 * AcceptAddrSize]; // local and remote addresses of a pooled accept
 
         TIO() {
             memset(&overlapped, 0, sizeof(overlapped));
         }
     };
 
+    /// A result ready without a completion packet, resumed by the next Poll().
+    struct TCompleted {
+        THandle Handle;
+        int Result;
+        bool Accepted = false; ///< Result is a socket to close if the waiter is cancelled.
+    };
+
+    struct TAccepted {
+        int Sock;
+        sockaddr_storage Addr;
+        socklen_t Len;
+    };
+
+    struct TAcceptWaiter {
+        sockaddr* Addr;
+        socklen_t* Len;
+        THandle Handle;
+    };
+
+    /// AcceptEx calls kept posted on a listening socket, see SetAcceptBacklog().
+    struct TAcceptPool {
+        unsigned Id = 0;
+        int Family = AF_INET;
+        int Posted = 0;
+        std::deque<TAccepted> Ready;
+        std::deque<TAcceptWaiter> Waiters;
+    };
+
     long GetTimeoutMs();
-    TIO* NewTIO();
+    TIO* NewTIO(int fd, THandle handle);
     void FreeTIO(TIO*);
+    /// Finishes an operation that succeeded at once on a socket that skips the port.
+    bool CompletedInline(int fd, TIO* tio, DWORD size);
+    /// Posts one pooled AcceptEx, returns a WSA error or 0.
+    int PostAccept(int fd, TAcceptPool& pool);
+    /// Tops the pool up to the backlog, returns an error only if nothing is posted or ready.
+    int FillAcceptPool(int fd, TAcceptPool& pool);
+    void DeliverAccept(const TAcceptWaiter& waiter, const TAccepted& accepted);
+    void CompletePooledAccept(TIO* tio, bool ok);
 
     HANDLE Port_;
 
     // Allocator to avoid dynamic memory allocation for each IOCP event structure.
     TArenaAllocator<TIO> Allocator_;
     std::vector<OVERLAPPED_ENTRY> Entries_;
-    std::queue<int> Results_;
+    TBatchSize Batch_; ///< Size of Entries_.
+    std::deque<int> Results_;
+    std::vector<TCompleted> Completed_;
+    std::unordered_map<void*, TIO*> Pending_; ///< Operations in flight by coroutine handle, see Cancel(THandle).
+    TFdTable<bool> SkipPort_; ///< Sockets registered with FILE_SKIP_COMPLETION_PORT_ON_SUCCESS.
+    std::unordered_map<int, TAcceptPool> AcceptPools_; ///< By listening socket.
+    unsigned AcceptPoolId_ = 0;
+    int AcceptBacklog_ = 0;
 };
 
 }
@@ -5,12 +5,48 @@
 
 namespace NNet {
 
+namespace {
+
+constexpr int FilterTypes[] = {TEvent::READ, TEvent::WRITE};
+constexpr size_t InitialOutEvents = 64;
+
+int Filter(int type) {
+    return type == TEvent::READ ? EVFILT_READ : EVFILT_WRITE;
+}
+
+THandle& Waiter(THandlePair& ev, int type) {
+    return type == TEvent::READ ? ev.Read : ev.Write;
+}
+
+void* Tag(uint32_t generation) {
+    return reinterpret_cast<void*>(static_cast<uintptr_t>(generation));
+}
+
+} // namespace
+
 TKqueue::TKqueue()
     : Fd_(kqueue())
+    , OutEvents_(InitialOutEvents)
 {
     if (Fd_ < 0) {
         throw std::system_error(errno, std::generic_category(), "kqueue");
     }
+
+    struct kevent kev = {};
+    EV_SET(&kev, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, nullptr);
+    if (kevent(Fd_, &kev, 1, nullptr, 0, nullptr) < 0) {
+        int err = errno;
+        close(Fd_);
+        throw std::system_error(err, std::generic_category(), "kevent");
+    }
+
+    Interrupter_ = [this]() {
+        struct kevent kev = {};
+        EV_SET(&kev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, nullptr);
+        kevent(Fd_, &kev, 1, nullptr, 0, nullptr);
+    };
+    // close() drops the filters, only the registration has to go
+    Deregister_ = [this](int fd) { InEvents_.Release(fd); };
 }
 
 TKqueue::~TKqueue()
@@ -23,43 +59,23 @@ void TKqueue::Poll()
     auto ts = GetTimeout();
 
     ChangeList_.clear();
-    if (static_cast<int>(InEvents_.size()) <= MaxFd_) {
-        InEvents_.resize(MaxFd_+1);
-    }
-    for (auto& ch : Changes_) {
-        int fd = ch.Fd;
-        struct kevent kev = {};
-        auto& ev = InEvents_[fd];
-
-        if (ch.Handle) {
-            if (ch.Type & TEvent::READ && ev.Read != ch.Handle) {
-                EV_SET(&kev, fd, EVFILT_READ, EV_ADD, 0, 0, nullptr);
-                ChangeList_.emplace_back(kev);
-                ev.Read = ch.Handle;
-            }
-            if (ch.Type & TEvent::WRITE && ev.Write != ch.Handle) {
-                EV_SET(&kev, fd, EVFILT_WRITE, EV_ADD, 0, 0, nullptr);
-                ChangeList_.emplace_back(kev);
-                ev.Write = ch.Handle;
-            }
-        } else {
-            if (ch.Type & TEvent::READ && ev.Read) {
-                EV_SET(&kev, fd, EVFILT_READ, EV_DELETE | EV_CLEAR, 0, 0, nullptr);
-                ChangeList_.emplace_back(kev);
-                ev.Read = {};
-            }
-            if (ch.Type & TEvent::WRITE && ev.Write) {
-                EV_SET(&kev, fd, EVFILT_WRITE, EV_DELETE | EV_CLEAR, 0, 0, nullptr);
-                ChangeList_.emplace_back(kev);
-                ev.Write = {};
-            }
-        }
-    }
+    ApplyChanges();
 
     Reset();
 
-    OutEvents_.resize(std::max<size_t>(1, 2*InEvents_.size()));
+    if (!Cached_.empty()) {
+        ReadyEvents_.insert(ReadyEvents_.end(), Cached_.begin(), Cached_.end());
+        Cached_.clear();
+        ts = {0, 0};
+    }
+
+    // failed changes are reported as EV_ERROR events and need room in the event list
+    if (OutEvents_.size() < ChangeList_.size()) {
+        OutEvents_.resize(ChangeList_.size());
+    }
     int nfds;
+    RecordSubmissions(ChangeList_.size());
+    auto pollStart = StatsStart();
     if ((nfds = kevent(
                 Fd_,
                 ChangeList_.data(), ChangeList_.size(),
@@ -68,35 +84,114 @@ void TKqueue::Poll()
     {
         throw std::system_error(errno, std::generic_category(), "kevent");
     }
+    RecordPoll(pollStart);
     for (int i = 0; i < nfds; i++) {
-        int fd = OutEvents_[i].ident;
-        int filter = OutEvents_[i].filter;
-        int flags = OutEvents_[i].flags;
-        if (flags & EV_DELETE) {
-            // closed socket?
+        HandleEvent(OutEvents_[i]);
+    }
+    if (nfds == static_cast<int>(OutEvents_.size())) {
+        // more events may be pending, collect them in one call next time
+        OutEvents_.resize(2 * OutEvents_.size());
+    }
+
+    ProcessPosted();
+    ProcessTimers();
+}
+
+void TKqueue::ApplyChanges()
+{
+    for (size_t i = 0; i < Changes_.size(); i++) {
+        auto& ch = Changes_[i];
+        int fd = ch.Fd;
+        auto* state = Superseded(i) ? nullptr : Registration(InEvents_, ch);
+        if (!state) {
             continue;
         }
-        // TODO: check flags & EV_ERROR && errno = OutEvents_[i].data
-        THandlePair ev = InEvents_[fd];
-        if (filter == EVFILT_READ && ev.Read) {
-            ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
-            ev.Read = {};
+        auto& ev = *state;
+        if ((ch.Type & TEvent::CANCEL) && !ResolveCancel(ch, ev)) {
+            continue;
         }
-        if (filter == EVFILT_WRITE && ev.Write) {
-            ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
-            ev.Write = {};
+        if (!ch.Handle) {
+            // an armed filter stays armed, its event is delivered once and cached
+            if (ch.Type & TEvent::READ) {
+                ev.Read = {};
+            }
+            if (ch.Type & TEvent::WRITE) {
+                ev.Write = {};
+            }
+            continue;
         }
-        if (flags & EV_EOF) {
-            if (ev.Read) {
-                ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
+
+        for (int type : FilterTypes) {
+            if (!(ch.Type & type)) {
+                continue;
+            }
+            if (ev.Ready & type) {
+                ev.Ready &= ~type;
+                Waiter(ev, type) = {};
+                Cached_.emplace_back(TEvent{fd, type, ch.Handle});
+                continue;
             }
-            if (ev.Write) {
-                ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
+            Waiter(ev, type) = ch.Handle;
+            if (ev.Enabled & type) {
+                continue;
             }
+            struct kevent kev = {};
+            if (ev.Registered & type) {
+                EV_SET(&kev, fd, Filter(type), EV_ENABLE, 0, 0, Tag(InEvents_.Generation(fd)));
+            } else {
+                EV_SET(&kev, fd, Filter(type), EV_ADD | EV_CLEAR | EV_DISPATCH, 0, 0, Tag(InEvents_.Generation(fd)));
+                ev.Registered |= type;
+            }
+            ChangeList_.emplace_back(kev);
+            ev.Enabled |= type;
         }
     }
+}
 
-    ProcessTimers();
+void TKqueue::HandleEvent(const struct kevent& kev)
+{
+    if (kev.filter == EVFILT_USER) {
+        // wakeup from Post()
+        return;
+    }
+    int fd = kev.ident;
+    int type = kev.filter == EVFILT_READ ? TEvent::READ : TEvent::WRITE;
+    auto* state = InEvents_.Find(fd);
+    if (!state || Tag(InEvents_.Generation(fd)) != kev.udata) {
+        // delivered for a closed descriptor, its fd number may be reused
+        return;
+    }
+    auto& ev = *state;
+    if (kev.flags & EV_ERROR) {
+        // a failed EV_ENABLE or EV_ADD, e.g. a descriptor closed bypassing RemoveEvent():
+        // forget the filter and let the waiter retry its syscall, the next wait adds it again
+        ev.Registered &= ~type;
+        ev.Enabled &= ~type;
+        if (auto& waiter = Waiter(ev, type)) {
+            ReadyEvents_.emplace_back(TEvent{fd, type, waiter});
+            waiter = {};
+        }
+        return;
+    }
+    ev.Enabled &= ~type; // disabled by EV_DISPATCH
+
+    int ready = type;
+    if (kev.flags & EV_EOF) {
+        // end of stream completes the waits in both directions
+        ready = TEvent::READ | TEvent::WRITE;
+    }
+    for (int t : FilterTypes) {
+        if (!(ready & t)) {
+            continue;
+        }
+        auto& waiter = Waiter(ev, t);
+        if (waiter) {
+            ReadyEvents_.emplace_back(TEvent{fd, t, waiter});
+            waiter = {};
+        } else if (t == type) {
+            ev.Ready |= t;
+        }
+    }
 }
 
 } // namespace NNet
@@ -4,6 +4,7 @@
 #include <sys/event.h>
 #include <sys/time.h>
 
+#include "fdtable.hpp"
 #include "poller.hpp"
 #include "socket.hpp"
 
@@ -17,6 +18,12 @@ namespace NNet {
  * the kqueue API available on BSD-based systems (including macOS and FreeBSD). It manages
  * events through an internal list of kevent structures.
  *
+ * EVFILT_READ and EVFILT_WRITE filters are added once per descriptor with
+ * EV_CLEAR | EV_DISPATCH and kept until the descriptor is closed
+ * (@ref TPollerBase::RemoveEvent()): the kernel disables a filter when it delivers it,
+ * and the next wait re-arms it with a single EV_ENABLE record, which goes to the kernel
+ * in the same kevent() call that collects the events.
+ *
  * The following type aliases are defined for convenience:
  *  - @c TSocket is defined as NNet::TSocket.
  *  - @c TFileHandle is defined as NNet::TFileHandle.
@@ -31,7 +38,7 @@ namespace NNet {
  *  - @c Fd_: The kqueue file descriptor.
  *  - @c InEvents_: A container of all registered events.
  *  - @c ChangeList_: A vector storing modifications (kevent changes) to be applied.
- *  - @c OutEvents_: A vector to collect events returned by kevent().
+ *  - @c OutEvents_: A vector to collect events returned by kevent(), grown when it fills up.
  */
 class TKqueue: public TPollerBase {
 public:
@@ -39,6 +46,8 @@ public:
     using TSocket = NNet::TSocket;
     /// Alias for the file handle type.
     using TFileHandle = NNet::TFileHandle;
+    /// Alias for the datagram socket type.
+    using TDatagramSocket = NNet::TDatagramSocket;
     /**
      * @brief Constructs the TKqueue instance.
      *
@@ -60,10 +69,21 @@ public:
     void Poll();
 
 private:
+    /// Per-descriptor state, filter bits are TEvent::READ and TEvent::WRITE.
+    struct TFdState: THandlePair {
+        uint8_t Registered = 0; ///< Filters added with EV_CLEAR | EV_DISPATCH.
+        uint8_t Enabled = 0; ///< Filters armed and not yet delivered.
+        uint8_t Ready = 0; ///< Filters delivered while nobody waited.
+    };
+
+    void ApplyChanges();
+    void HandleEvent(const struct kevent& kev);
+
     int Fd_; ///< The kqueue file descriptor.
-    std::vector<THandlePair> InEvents_; ///< All registered events in kqueue.
+    TFdTable<TFdState> InEvents_; ///< All registered events in kqueue.
     std::vector<struct kevent> ChangeList_; ///< List of changes (kevent modifications).
     std::vector<struct kevent> OutEvents_; ///< Events returned from kevent().
+    std::vector<TEvent> Cached_; ///< Waits completed from cached readiness, emitted after Reset().
 };
 
 } // namespace NNet
@@ -1,3 +1,9 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <utility>
+
 namespace NNet {
 
 /**
@@ -33,6 +39,12 @@ namespace NNet {
 template<typename TPoller>
 class TLoop {
 public:
+    /// Constructs the poller from @p args.
+    template<typename... TArgs>
+    explicit TLoop(TArgs&&... args)
+        : Poller_(std::forward<TArgs>(args)...)
+    { }
+
     /**
      * @brief Runs the main loop until @ref Stop() is called.
      */
@@ -43,9 +55,36 @@ public:
     }
     /**
      * @brief Stops the loop.
+     *
+     * Safe to call from another thread; a blocked poll is interrupted and the loop
+     * exits after the current @ref Step().
      */
     void Stop() {
         Running_ = false;
+        Poller_.Post([]() { });
+    }
+    /**
+     * @brief Schedules @p func to run on the loop's thread.
+     *
+     * Thread-safe, see @ref TPollerBase::Post().
+     */
+    void Post(std::function<void()> func) {
+        Poller_.Post(std::move(func));
+    }
+    /**
+     * @brief Moves the awaiting coroutine back to the loop's thread.
+     *
+     * Thread-safe, see @ref TPollerBase::SwitchTo(); typically awaited after
+     * @ref TWorkPool::Offload() once the CPU-bound part is done.
+     */
+    auto Resume() {
+        return Poller_.SwitchTo();
+    }
+    /**
+     * @brief Returns true until @ref Stop() is called.
+     */
+    bool Running() const {
+        return Running_;
     }
     /**
      * @brief Performs a single iteration of polling and waking up ready handles.
@@ -63,7 +102,7 @@ public:
 
 private:
     TPoller Poller_;
-    bool Running_ = true;
+    std::atomic<bool> Running_ = true;
 };
 
 } // namespace NNet
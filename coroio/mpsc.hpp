@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+namespace NNet {
+
+/**
+ * @class TMpscQueue
+ * @brief Unbounded lock-free multi-producer single-consumer queue.
+ *
+ * Intrusive queue with a stub node (D. Vyukov's algorithm). @ref Push() may be called
+ * from any thread concurrently; @ref Pop() must only be called by a single consumer
+ * thread (the thread running the poller that owns the queue).
+ *
+ * @tparam T Value type; must be default-constructible and movable.
+ */
+template<typename T>
+class TMpscQueue {
+public:
+    TMpscQueue()
+        : Head_(new TNode)
+        , Tail_(Head_.load(std::memory_order_relaxed))
+    { }
+
+    TMpscQueue(const TMpscQueue&) = delete;
+    TMpscQueue& operator=(const TMpscQueue&) = delete;
+
+    ~TMpscQueue() {
+        while (Pop()) { }
+        delete Tail_;
+    }
+
+    /// Enqueues @p value. Thread-safe.
+    void Push(T value) {
+        TNode* node = new TNode{std::move(value)};
+        TNode* prev = Head_.exchange(node, std::memory_order_acq_rel);
+        prev->Next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @brief Dequeues the oldest value.
+     *
+     * Returns std::nullopt if the queue is empty or a concurrent @ref Push() has not
+     * linked its node yet; in the latter case the value is returned by the next call.
+     */
+    std::optional<T> Pop() {
+        TNode* tail = Tail_;
+        TNode* next = tail->Next.load(std::memory_order_acquire);
+        if (!next) {
+            return std::nullopt;
+        }
+        Tail_ = next;
+        std::optional<T> ret(std::move(next->Value));
+        delete tail;
+        return ret;
+    }
+
+private:
+    struct TNode {
+        T Value = {};
+        std::atomic<TNode*> Next = nullptr;
+    };
+
+    std::atomic<TNode*> Head_; ///< Producers push here.
+    TNode* Tail_;              ///< Consumer pops here.
+};
+
+} // namespace NNet
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "affinity.hpp"
+#include "loop.hpp"
+
+namespace NNet {
+
+/**
+ * @struct TMultiLoopOptions
+ * @brief Placement of the threads of a @ref TMultiLoop.
+ */
+struct TMultiLoopOptions {
+    /**
+     * CPU of every loop, by index, e.g. one per physical core of a node from
+     * @ref NUtils::AllowedCpus(); empty for no pinning. Loops beyond the list are not pinned.
+     */
+    std::vector<int> Cpus = {};
+};
+
+/**
+ * @class TMultiLoop
+ * @brief Runs several independent event loops, one per thread.
+ *
+ * Every thread owns its own @ref TLoop and therefore its own poller instance
+ * (TEPoll, TUring, TKqueue, ...). Coroutines never migrate between loops: a task
+ * started with @ref Spawn() runs on the chosen loop until it finishes, so sockets
+ * and futures created inside it must stay on that loop.
+ *
+ * To spread incoming connections between the loops, start one listener per loop
+ * bound with @c reusePort (see @ref TSocket::Bind()); the kernel then balances
+ * accepts between the listeners.
+ *
+ * Every loop is created on its own thread, after the thread is pinned to its CPU of
+ * @ref TMultiLoopOptions::Cpus. The poller, and later the per-thread frame and buffer caches,
+ * are thus first touched on that CPU and placed on its NUMA node. With pinned loops,
+ * @ref TSocket::SetIncomingCpu() on each listener keeps connections on the core of their
+ * NIC receive queue.
+ *
+ * ### Example Usage
+ * @code{.cpp}
+ * TMultiLoop<TEPoll> loops(4);
+ * for (int k = 0; k < loops.Size(); k++) {
+ *     loops.Spawn(k, [&](TEPoll& poller) {
+ *         server(poller, address); // binds with reusePort = true
+ *     });
+ * }
+ * loops.Start();
+ * loops.Join(); // until someone calls loops.Stop()
+ * @endcode
+ *
+ * @tparam TPoller The poller type used by every loop.
+ */
+template<typename TPoller>
+class TMultiLoop {
+public:
+    /// A task executed on the thread of a loop.
+    using TTask = std::function<void(TPoller&)>;
+    /**
+     * @brief Creates the loop with index @p k on its thread, which runs on @p cpu (-1 if not pinned).
+     *
+     * E.g. for a @ref TUring with the submission polling thread on a sibling of @p cpu:
+     * @code{.cpp}
+     * [](int k, int cpu) {
+     *     TUringOptions options;
+     *     options.SqPoll = true;
+     *     options.SqThreadCpu = NUtils::SiblingCpu(cpu);
+     *     return std::make_unique<TLoop<TUring>>(256, options);
+     * }
+     * @endcode
+     */
+    using TLoopFactory = std::function<std::unique_ptr<TLoop<TPoller>>(int k, int cpu)>;
+
+    /**
+     * @brief Creates @p threads loops, each on its own thread.
+     *
+     * The loops run no tasks until @ref Start(). Throws what a loop's construction threw.
+     *
+     * @param threads Number of loops (and threads); 0 means hardware concurrency.
+     * @param options Placement of the threads.
+     * @param factory Creates the loops, default-constructed ones if empty.
+     */
+    TMultiLoop(int threads = 0, TMultiLoopOptions options = {}, TLoopFactory factory = {}) {
+        if (threads <= 0) {
+            threads = std::max<int>(1, std::thread::hardware_concurrency());
+        }
+        if (!factory) {
+            factory = [](int, int) { return std::make_unique<TLoop<TPoller>>(); };
+        }
+        Workers_.reserve(threads);
+        for (int i = 0; i < threads; i++) {
+            auto& worker = Workers_.emplace_back(std::make_unique<TWorker>());
+            worker->Cpu = i < static_cast<int>(options.Cpus.size()) ? options.Cpus[i] : -1;
+            worker->Thread = std::thread([this, w = worker.get(), i, factory]() {
+                Run(*w, i, factory);
+            });
+        }
+
+        std::unique_lock<std::mutex> lock(Mutex_);
+        Changed_.wait(lock, [&]() { return Created_ == threads; });
+        for (auto& worker : Workers_) {
+            if (worker->Error) {
+                auto error = worker->Error;
+                lock.unlock();
+                Stop();
+                Release();
+                JoinAll();
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    TMultiLoop(const TMultiLoop&) = delete;
+    TMultiLoop& operator=(const TMultiLoop&) = delete;
+
+    /// Stops all loops and waits for their threads.
+    ~TMultiLoop() {
+        Stop();
+        Release();
+        JoinAll();
+    }
+
+    /// Returns the number of loops.
+    int Size() const {
+        return Workers_.size();
+    }
+
+    /**
+     * @brief Provides access to the loop with index @p k.
+     *
+     * The loop itself is not thread-safe: once started, use it only from its own thread.
+     */
+    TLoop<TPoller>& Loop(int k) {
+        return *Workers_.at(k)->Loop;
+    }
+
+    /// Returns the CPU loop @p k is pinned to, -1 if it is not.
+    int Cpu(int k) const {
+        return Workers_.at(k)->Cpu;
+    }
+
+    /**
+     * @brief Schedules @p task to run on the thread of loop @p k.
+     *
+     * Thread-safe; may be called before or after @ref Start(). The task is posted
+     * to the loop's poller (see @ref TPollerBase::Post()), so a running loop picks it
+     * up immediately. The task typically starts a coroutine on the given poller and returns.
+     */
+    void Spawn(int k, TTask task) {
+        auto& poller = Loop(k).Poller();
+        poller.Post([task = std::move(task), p = &poller]() {
+            task(*p);
+        });
+    }
+
+    /// Lets the loop threads run.
+    void Start() {
+        if (Started_) {
+            throw std::runtime_error("Already started");
+        }
+        Started_ = true;
+        Release();
+    }
+
+    /**
+     * @brief Stops all loops.
+     *
+     * Safe to call from any thread, including from a coroutine running on one of the loops.
+     */
+    void Stop() {
+        for (auto& worker : Workers_) {
+            if (worker->Loop) {
+                worker->Loop->Stop();
+            }
+        }
+    }
+
+    /// Waits until all loop threads exit; returns at once if the loops were not started.
+    void Join() {
+        if (Started_) {
+            JoinAll();
+        }
+    }
+
+private:
+    struct TWorker {
+        std::unique_ptr<TLoop<TPoller>> Loop;
+        std::thread Thread;
+        int Cpu = -1;
+        std::exception_ptr Error;
+    };
+
+    void Run(TWorker& worker, int k, const TLoopFactory& factory) {
+        // pinned before the loop's memory is allocated, see the class description
+        if (worker.Cpu >= 0 && !NUtils::PinThread(worker.Cpu)) {
+            worker.Cpu = -1;
+        }
+        try {
+            worker.Loop = factory(k, worker.Cpu);
+        } catch (...) {
+            worker.Error = std::current_exception();
+        }
+        std::unique_lock<std::mutex> lock(Mutex_);
+        Created_++;
+        Changed_.notify_all();
+        Changed_.wait(lock, [this]() { return Released_; });
+        lock.unlock();
+        if (worker.Loop) {
+            worker.Loop->Loop();
+        }
+    }
+
+    /// Lets the threads waiting for @ref Start() go: into their loops, or out if stopped.
+    void Release() {
+        std::lock_guard<std::mutex> guard(Mutex_);
+        Released_ = true;
+        Changed_.notify_all();
+    }
+
+    void JoinAll() {
+        for (auto& worker : Workers_) {
+            if (worker->Thread.joinable() && worker->Thread.get_id() != std::this_thread::get_id()) {
+                worker->Thread.join();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<TWorker>> Workers_;
+    bool Started_ = false;
+    std::mutex Mutex_;
+    std::condition_variable Changed_;
+    int Created_ = 0;
+    bool Released_ = false;
+};
+
+} // namespace NNet
@@ -29,91 +29,113 @@ int ppoll(struct pollfd* fds, int nfds, const struct timespec* ts, const void* /
 
 namespace NNet {
 
-#ifdef _WIN32
 TPoll::TPoll()
+#ifdef _WIN32
     : DummySocket_(*this, PF_INET)
+#endif
 {
-    int fd = DummySocket_.Fd();
-    MaxFd_ = std::max<int>(MaxFd_, fd);
-    if (static_cast<int>(InEvents_.size()) <= MaxFd_) {
-        InEvents_.resize(MaxFd_+1, std::make_tuple(THandlePair{}, -1));
-    }
-    auto& [_, idx] = InEvents_[fd];
-    idx = Fds_.size();
+    AddInternal(Wakeup_.Fd());
+#ifdef _WIN32
+    AddInternal(DummySocket_.Fd());
+#endif
+    Interrupter_ = [this]() { Wakeup_.Notify(); };
+}
+
+void TPoll::AddInternal(int fd) {
+    InEvents_[fd].Index = Fds_.size();
     Fds_.emplace_back(pollfd{});
-    pollfd& pev = Fds_[idx];
+    pollfd& pev = Fds_.back();
     pev.fd = fd;
     pev.events |= POLLIN;
 }
+
+void TPoll::Update(int fd) {
+    auto& state = InEvents_[fd];
+    state.Touched = false;
+    short events = 0;
+    if (state.Events.Read) {
+        events |= POLLIN;
+    }
+    if (state.Events.Write) {
+        events |= POLLOUT;
+    }
+#ifdef __linux__
+    if (state.Events.RHup) {
+        events |= POLLRDHUP;
+    }
 #endif
+    if (events) {
+        if (state.Index == -1) {
+            state.Index = Fds_.size();
+            Fds_.emplace_back(pollfd{});
+            Fds_.back().fd = fd;
+        }
+        Fds_[state.Index].events = events;
+    } else if (state.Index != -1) {
+        // swap with the last entry, so the array holds live descriptors only
+        int idx = state.Index;
+        Fds_[idx] = Fds_.back();
+        InEvents_[Fds_[idx].fd].Index = idx;
+        Fds_.pop_back();
+        state.Index = -1;
+    }
+    if (!events) {
+        InEvents_.Release(fd);
+    }
+}
 
 void TPoll::Poll()
 {
     auto ts = GetTimeout();
 
-    if (static_cast<int>(InEvents_.size()) <= MaxFd_) {
-        InEvents_.resize(MaxFd_+1, std::make_tuple(THandlePair{}, -1));
-    }
-
-    for (const auto& ch : Changes_) {
-        int fd = ch.Fd;
-        auto& [ev, idx] = InEvents_[fd];
-        if (ch.Handle) {
-            if (idx == -1) {
-                idx = Fds_.size();
-                Fds_.emplace_back(pollfd{});
-            }
-            pollfd& pev = Fds_[idx];
-            pev.fd = fd;
-            if (ch.Type & TEvent::READ) {
-                pev.events |= POLLIN;
-                ev.Read = ch.Handle;
-            }
-            if (ch.Type & TEvent::WRITE) {
-                pev.events |= POLLOUT;
-                ev.Write = ch.Handle;
-            }
-#ifdef __linux__
-            if (ch.Type & TEvent::RHUP) {
-                pev.events |= POLLRDHUP;
-                ev.Write = ch.Handle;
-            }
-#endif
-        } else if (idx != -1) {
-            if (ch.Type & TEvent::READ) {
-                Fds_[idx].events &= ~POLLIN;
-                ev.Read = {};
-            }
-            if (ch.Type & TEvent::WRITE) {
-                Fds_[idx].events &= ~POLLOUT;
-                ev.Write = {};
-            }
+    for (auto& ch : Changes_) {
+        auto* found = Registration(InEvents_, ch);
+        if (!found) {
+            continue;
+        }
+        auto& state = *found;
+        auto& ev = state.Events;
+        if ((ch.Type & TEvent::CANCEL) && !ResolveCancel(ch, ev)) {
+            continue;
+        }
+        if (ch.Type & TEvent::READ) {
+            ev.Read = ch.Handle;
+        }
+        if (ch.Type & TEvent::WRITE) {
+            ev.Write = ch.Handle;
+        }
 #ifdef __linux__
-            if (ch.Type & TEvent::RHUP) {
-                Fds_[idx].events &= ~POLLRDHUP;
-                ev.RHup = {};
-            }
+        if (ch.Type & TEvent::RHUP) {
+            ev.RHup = ch.Handle;
+        }
 #endif
-            if (Fds_[idx].events == 0) {
-                std::swap(Fds_[idx], Fds_.back());
-                std::get<1>(InEvents_[Fds_[idx].fd]) = idx;
-                Fds_.back().events = 0;
-                idx = -1;
-            }
+        if (!state.Touched) {
+            state.Touched = true;
+            Touched_.emplace_back(ch.Fd);
         }
     }
 
-    while (!Fds_.empty() && !Fds_.back().events) {
-        Fds_.pop_back();
+    for (int fd : Touched_) {
+        Update(fd);
     }
+    Touched_.clear();
 
     Reset();
-    if (ppoll(Fds_.data(), Fds_.size(), &ts, nullptr) < 0) {
+    auto pollStart = StatsStart();
+    int ret = ppoll(Fds_.data(), Fds_.size(), &ts, nullptr);
+    RecordPoll(pollStart);
+    if (ret < 0) {
         throw std::system_error(errno, std::generic_category(), "poll");
     }
 
     for (auto& pev : Fds_) {
-        auto [ev, _] = InEvents_[pev.fd];
+        if (pev.fd == Wakeup_.Fd()) {
+            if (pev.revents & POLLIN) {
+                Wakeup_.Drain();
+            }
+            continue;
+        }
+        auto ev = InEvents_[pev.fd].Events;
         if (pev.revents & POLLIN) {
             ReadyEvents_.emplace_back(TEvent{(int)pev.fd, TEvent::READ, ev.Read}); ev.Read = {};
         }
@@ -144,6 +166,7 @@ void TPoll::Poll()
 #endif
     }
 
+    ProcessPosted();
     ProcessTimers();
 }
 
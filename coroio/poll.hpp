@@ -11,8 +11,10 @@
 #include <iostream>
 
 #include "base.hpp"
+#include "fdtable.hpp"
 #include "poller.hpp"
 #include "socket.hpp"
+#include "wakeup.hpp"
 
 namespace NNet {
 
@@ -22,7 +24,12 @@ namespace NNet {
  *
  * TPoll inherits from TPollerBase and implements asynchronous I/O event polling using
  * the poll() system call. It manages events via a vector of pollfd structures and an
- * internal list of event registrations (stored as tuples pairing THandlePair with an index).
+ * internal list of event registrations (a THandlePair plus the index of the descriptor's pollfd).
+ *
+ * The pollfd vector holds live descriptors only: pending changes are applied to the waiters
+ * first, then every touched descriptor gets a single pollfd update, and a descriptor nobody
+ * waits for is removed by moving the last entry into its place. poll() thus costs time
+ * proportional to the number of descriptors being waited for.
  *
  * Platform-specific notes:
  * - On Windows, a dummy socket (@c DummySocket_) is maintained to properly handle timeouts.
@@ -42,16 +49,16 @@ public:
     using TSocket = NNet::TSocket;
     /// Alias for the file handle type.
     using TFileHandle = NNet::TFileHandle;
+    /// Alias for the datagram socket type.
+    using TDatagramSocket = NNet::TDatagramSocket;
 
-#ifdef _WIN32
     /**
-     * @brief Default constructor for Windows.
+     * @brief Default constructor.
      *
-     * On Windows, additional initialization (such as setting up a dummy socket)
-     * is performed.
+     * Registers the wakeup descriptor used by @ref Post(); on Windows additionally
+     * sets up a dummy socket.
      */
     TPoll();
-#endif
 
     /**
      * @brief Polls for I/O events.
@@ -63,19 +70,32 @@ public:
     void Poll();
 
 private:
+    /// Adds a permanent POLLIN entry for a descriptor owned by the poller itself.
+    void AddInternal(int fd);
+    /// Brings the pollfd of @p fd in line with its waiters: adds, updates or swap-removes it.
+    void Update(int fd);
+
+    /// Registration of a descriptor.
+    struct TFdState {
+        THandlePair Events; ///< Waiting coroutines.
+        int Index = -1; ///< Position in Fds_, -1 if not polled.
+        bool Touched = false; ///< Listed in Touched_ during the current Poll().
+    };
+
     /**
-     * @brief Internal container for registered events.
-     *
-     * Each element is a tuple consisting of a THandlePair (an event) and an integer index
-     * representing its position in the Fds_ vector.
+     * @brief Internal container for registered events, indexed by descriptor.
      */
-    std::vector<std::tuple<THandlePair,int>> InEvents_;
+    TFdTable<TFdState> InEvents_;
+    /// Descriptors changed by the current batch of @c Changes_.
+    std::vector<int> Touched_;
     /**
      * @brief The pollfd vector used by poll().
      *
      * This vector holds the file descriptors and event masks used in the poll() call.
      */
     std::vector<pollfd> Fds_;
+    /// Interrupts poll() on Post().
+    TWakeupFd Wakeup_;
 #ifdef _WIN32
     /**
      * @brief Dummy socket used on Windows.
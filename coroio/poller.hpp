@@ -1,13 +1,21 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <queue>
 #include <assert.h>
 
 #include "base.hpp"
+#include "mpsc.hpp"
+#include "stall.hpp"
+#include "stats.hpp"
+#include "timerwheel.hpp"
 
 #ifdef Yield
 #undef Yield
@@ -38,11 +46,14 @@ namespace NNet {
  * Key methods include:
  *  - @ref AddTimer() to schedule a timer.
  *  - @ref RemoveTimer() to cancel a timer.
+ *  - @ref SetTimerWheel() to keep timers in a @ref TTimerWheel instead of a binary heap.
  *  - @ref AddRead(), @ref AddWrite(), @ref AddRemoteHup() to register I/O events.
  *  - @ref RemoveEvent() to deregister events.
  *  - @ref Sleep() and @ref Yield() to suspend execution until a specified time or until the next
  *    polling round.
  *  - @ref Wakeup() and @ref WakeupReadyHandles() to resume waiting coroutines when events occur.
+ *  - @ref Post() and @ref SwitchTo() to hand work to the poller from other threads.
+ *  - @ref Stats() and @ref SetStallDetector() to inspect the loop, if built with COROIO_STATS.
  *
  * The class also provides helper methods for computing timeout values (via @ref GetTimeout()).
  *
@@ -58,6 +69,12 @@ public:
     TPollerBase(const TPollerBase& ) = delete;
     TPollerBase& operator=(const TPollerBase& ) = delete;
 
+#ifdef COROIO_STATS
+    ~TPollerBase() {
+        SetStallDetector({}, {});
+    }
+#endif
+
     /**
      * @brief Schedules a timer.
      *
@@ -68,6 +85,9 @@ public:
      * @return A unique timer ID.
      */
     unsigned AddTimer(TTime deadline, THandle h) {
+        if (Wheel_) {
+            return Wheel_->Add(deadline, h);
+        }
         Timers_.emplace(TTimer{deadline, TimerId_, h});
         return TimerId_++;
     }
@@ -76,7 +96,7 @@ public:
      * @brief Removes or cancels a timer.
      *
      * Checks if the specified timer (by its ID) has fired based on the deadline; if not, inserts an
-     * empty timer to force removal.
+     * empty timer to force removal (or unlinks it from the timer wheel).
      *
      * @param timerId  The timer ID to remove.
      * @param deadline The associated deadline.
@@ -84,7 +104,9 @@ public:
      */
     bool RemoveTimer(unsigned timerId, TTime deadline) {
         bool fired = timerId == LastFiredTimer_;
-        if (!fired) {
+        if (!fired && Wheel_) {
+            Wheel_->Remove(timerId);
+        } else if (!fired) {
             Timers_.emplace(TTimer{deadline, timerId, {}}); // insert empty timer before existing
         }
         return fired;
@@ -120,29 +142,81 @@ public:
         MaxFd_ = std::max(MaxFd_, fd);
         Changes_.emplace_back(TEvent{fd, TEvent::RHUP, h});
     }
+    /**
+     * @brief Registers a wait for a socket error or an error queue message (EPOLLERR).
+     *
+     * Used to reap MSG_ZEROCOPY completions. Only pollers with @ref ReportsErrors()
+     * (@ref TEPoll) deliver this event.
+     *
+     * @param fd The file descriptor.
+     * @param h  The coroutine handle to resume when the error queue is readable.
+     */
+    void AddError(int fd, THandle h) {
+        MaxFd_ = std::max(MaxFd_, fd);
+        Changes_.emplace_back(TEvent{fd, TEvent::ERR, h});
+    }
+    /// Returns true if the poller delivers @ref AddError() registrations.
+    bool ReportsErrors() const {
+        return ErrorEvents_;
+    }
     /**
      * @brief Removes registered events for a specific file descriptor.
      *
-     * This method signals that events for a descriptor should be deregistered.
+     * Called by @ref TSocketBase::Close() before the descriptor is closed. Backends that
+     * set @c Deregister_ drop the registration right away, while the fd still refers to
+     * the same file, and skip the changes queued for it so far; the others queue the
+     * removal to the next poll.
      *
      * @param fd The file descriptor.
      */
     void RemoveEvent(int fd) {
         // TODO: resume waiting coroutines here
+        if (Deregister_) {
+            if (!Changes_.empty()) {
+                ClosedAt_[fd] = Changes_.size();
+            }
+            Deregister_(fd);
+            return;
+        }
+        MaxFd_ = std::max(MaxFd_, fd);
+        Changes_.emplace_back(TEvent{fd, TEvent::READ|TEvent::WRITE|TEvent::RHUP|TEvent::ERR, {}});
+    }
+    /**
+     * @brief Cancels the wait of @p h for @p type events on @p fd.
+     *
+     * Called through @ref TEventWait by awaitables destroyed while their coroutine is
+     * suspended, e.g. the unfinished futures dropped by Any(). Unlike @ref RemoveEvent(int)
+     * other waiters of the descriptor keep their registrations, and a wait that has been
+     * replaced meanwhile is left alone.
+     *
+     * @param fd   The file descriptor.
+     * @param type The TEvent types registered by @p h.
+     * @param h    The coroutine handle.
+     */
+    void RemoveEvent(int fd, int type, THandle h) {
+        RemoveEvent(h);
         MaxFd_ = std::max(MaxFd_, fd);
-        Changes_.emplace_back(TEvent{fd, TEvent::READ|TEvent::WRITE|TEvent::RHUP, {}});
+        Changes_.emplace_back(TEvent{fd, type | TEvent::CANCEL, h});
     }
     /**
-     * @brief Removes events associated with a given coroutine handle.
+     * @brief Drops the wakeups of @p h collected by the current poll.
      *
-     * This overload will be called by destructors of unfinished futures.
-     * Unimplemented.
+     * Events that are ready but not yet resumed by @ref WakeupReadyHandles() are skipped,
+     * so a coroutine destroyed by an earlier wakeup or timer of the same iteration is
+     * never resumed. The registrations themselves are removed by the other overloads
+     * or, for completion-based pollers, by their @c Cancel().
+     *
+     * Linear in the number of events of the current poll not yet resumed; once
+     * @ref WakeupReadyHandles() is done there are none and it returns at once.
      *
      * @param h The coroutine handle.
      */
-    void RemoveEvent(THandle /*h*/) {
-        // TODO: Add new vector for this type of removing
-        // Will be called in destuctor of unfinished futures
+    void RemoveEvent(THandle h) {
+        for (auto i = WakeupIndex_; i < ReadyEvents_.size(); i++) {
+            if (ReadyEvents_[i].Handle == h) {
+                ReadyEvents_[i].Handle = {};
+            }
+        }
     }
     /**
      * @brief Suspends execution until the specified time.
@@ -214,6 +288,50 @@ public:
         return Sleep(TTime{});
     }
 
+    /**
+     * @brief Schedules @p func to run on the thread driving this poller.
+     *
+     * Thread-safe. If the poller is blocked in its poll system call it is interrupted
+     * (eventfd, EVFILT_USER or PostQueuedCompletionStatus depending on the backend),
+     * so the function runs within the current poll iteration instead of after the
+     * @ref SetMaxDuration() timeout.
+     *
+     * @param func The function to execute.
+     */
+    void Post(std::function<void()> func) {
+        Posted_.Push(TPosted{std::move(func), {}});
+        Interrupt();
+    }
+    /**
+     * @brief Moves the awaiting coroutine to the thread driving this poller.
+     *
+     * Thread-safe counterpart of @ref Post() for coroutines:
+     * @code{.cpp}
+     * co_await poller.SwitchTo();
+     * // now running on the poller's thread
+     * @endcode
+     *
+     * @return An awaitable that resumes the coroutine from the poller's loop.
+     */
+    auto SwitchTo() {
+        struct TAwaitableSwitch {
+            bool await_ready() {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                poller->Posted_.Push(TPosted{{}, h});
+                poller->Interrupt();
+            }
+
+            void await_resume() { }
+
+            TPollerBase* poller;
+        };
+
+        return TAwaitableSwitch{this};
+    }
+
     /**
      * @brief Wakes up a coroutine waiting on an event.
      *
@@ -241,7 +359,7 @@ public:
         * so `Changes_` can increase by 2 (or potentially more) in a single wake-up cycle.
         */
         auto index = Changes_.size();
-        change.Handle.resume();
+        Resume(change.Handle, EStallSource::Event);
         if (change.Fd >= 0) {
             bool matched = false;
             for (; index < Changes_.size() && !matched; index++) {
@@ -259,9 +377,20 @@ public:
      * Iterates over the list of ready events and calls @ref Wakeup() on each.
      */
     void WakeupReadyHandles() {
-        for (auto&& ev : ReadyEvents_) {
-            Wakeup(std::move(ev));
+        auto start = StatsStart();
+        for (WakeupIndex_ = 0; WakeupIndex_ < ReadyEvents_.size(); ) {
+            auto& ev = ReadyEvents_[WakeupIndex_++];
+            if (ev.Handle) { // cancelled by RemoveEvent() otherwise
+                Wakeup(std::move(ev));
+            }
         }
+#ifdef COROIO_STATS
+        Stats_.Events.Add(ReadyEvents_.size());
+        Stats_.EventsPerPoll.Record(ReadyEvents_.size());
+        Stats_.WakeupTime.Record(StatsElapsed(start));
+#else
+        (void)start;
+#endif
     }
     /**
      * @brief Sets the maximum polling duration.
@@ -272,10 +401,57 @@ public:
         MaxDuration_ = maxDuration;
         MaxDurationTs_ = GetMaxDuration(MaxDuration_);
     }
+    /**
+     * @brief Selects the timer storage.
+     *
+     * By default timers are kept in a binary heap and cancelled timers leave a tombstone
+     * until their deadline. With the timer wheel insertion and cancellation are O(1),
+     * which pays off with many long-lived cancellable timers (idle or connect timeouts).
+     * Timers fire in the same order either way.
+     *
+     * Must be called before any timer is added.
+     *
+     * @param enable Use a @ref TTimerWheel if true, the binary heap otherwise.
+     */
+    void SetTimerWheel(bool enable = true) {
+        if (TimersSize() != 0) {
+            throw std::runtime_error("Cannot switch timer storage with pending timers");
+        }
+        Wheel_.reset(enable ? new TTimerWheel() : nullptr);
+    }
     /// Returns the number of scheduled timers.
-    auto TimersSize() const {
-        return Timers_.size();
+    size_t TimersSize() const {
+        return Wheel_ ? Wheel_->Size() : Timers_.size();
+    }
+#ifdef COROIO_STATS
+    /**
+     * @brief Returns the counters and histograms of this loop.
+     *
+     * Written by the poller's thread; @ref TPollerStats::Snapshot() may be taken from any thread.
+     */
+    const TPollerStats& Stats() const {
+        return Stats_;
     }
+    /**
+     * @brief Reports resumptions that keep the loop busy for too long.
+     *
+     * Every coroutine resumed by this poller (ready events, timers, posted work) is timed,
+     * and @p callback is called on the poller's thread when one runs longer than
+     * @ref TStallOptions::Threshold before it suspends again. The report names the resumed
+     * frame and the chain of coroutines awaiting it, so the stalling request can be found
+     * in production. While a detector is installed anywhere, @ref TFuture frames are
+     * registered on creation to resolve the chain.
+     *
+     * @param callback The reporter; an empty function removes the detector.
+     */
+    void SetStallDetector(TStallOptions options, TStallCallback callback) {
+        if (!StallCallback_ != !callback) {
+            NDetail::TFrameRegistry::Use(callback ? 1 : -1);
+        }
+        StallOptions_ = options;
+        StallCallback_ = std::move(callback);
+    }
+#endif
 
 protected:
     /**
@@ -284,6 +460,11 @@ protected:
      * @return A timespec representing the timeout.
      */
     timespec GetTimeout() const {
+        if (Wheel_) {
+            return Wheel_->Empty()
+                ? MaxDurationTs_
+                : GetTimespec(TClock::now(), Wheel_->NextExpiration(), MaxDuration_);
+        }
         return Timers_.empty()
             ? MaxDurationTs_
             : Timers_.top().Deadline == TTime{}
@@ -304,10 +485,156 @@ protected:
         ts.tv_nsec = p2.count();
         return ts;
     }
+    /**
+     * @brief Interrupts a blocking poll after a @ref Post().
+     *
+     * Only the first call after @ref ProcessPosted() reaches the backend-specific
+     * @c Interrupter_, subsequent calls are coalesced.
+     */
+    void Interrupt() {
+        if (!Interrupted_.exchange(true, std::memory_order_acq_rel) && Interrupter_) {
+            Interrupter_();
+        }
+    }
+    /**
+     * @brief Runs the functions and resumes the coroutines queued by @ref Post() and @ref SwitchTo().
+     *
+     * Must be called by each backend from its Poll() method on the poller's thread.
+     */
+    void ProcessPosted() {
+        Interrupted_.store(false, std::memory_order_release);
+        while (auto posted = Posted_.Pop()) {
+            if (posted->Handle) {
+                Resume(posted->Handle, EStallSource::Posted);
+            } else {
+#ifdef COROIO_STATS
+                if (StallCallback_) [[unlikely]] {
+                    Traced({}, EStallSource::Posted, posted->Func);
+                    continue;
+                }
+#endif
+                posted->Func();
+            }
+        }
+    }
+    /**
+     * @brief @ref RemoveEvent(THandle) for completion-based pollers.
+     *
+     * Their ready events flagged with TEvent::RESULT carry a value in @p results, which
+     * the resumed awaitables consume in order; the values of the dropped events are erased.
+     *
+     * @return True if a completion of @p h has been collected already.
+     */
+    template<typename TResults>
+    bool RemoveCompletion(THandle h, TResults& results) {
+        bool found = false;
+        size_t index = 0;
+        for (auto i = WakeupIndex_; i < ReadyEvents_.size(); i++) {
+            auto& ev = ReadyEvents_[i];
+            if (ev.Handle == h) {
+                if (ev.Type & TEvent::RESULT) {
+                    results.erase(results.begin() + index);
+                }
+                ev = TEvent{-1, 0, {}};
+                found = true;
+            } else if (ev.Type & TEvent::RESULT) {
+                index++;
+            }
+        }
+        return found;
+    }
+    /**
+     * @brief Turns a change queued by @ref RemoveEvent(int, int, THandle) into a plain removal.
+     *
+     * Keeps in @p ch only the types that @p ev still waits for with the handle of @p ch and
+     * clears the handle, so backends apply the change like the removal after a wakeup.
+     *
+     * @param ch The change, TEvent::CANCEL is set in its type.
+     * @param ev The current waiters of the descriptor.
+     * @return False if the wait is gone already and there is nothing to remove.
+     */
+    static bool ResolveCancel(TEvent& ch, const THandlePair& ev) {
+        int type = 0;
+        if ((ch.Type & TEvent::READ) && ev.Read == ch.Handle) {
+            type |= TEvent::READ;
+        }
+        if ((ch.Type & TEvent::WRITE) && ev.Write == ch.Handle) {
+            type |= TEvent::WRITE;
+        }
+        if ((ch.Type & TEvent::RHUP) && ev.RHup == ch.Handle) {
+            type |= TEvent::RHUP;
+        }
+        if ((ch.Type & TEvent::ERR) && ev.Err == ch.Handle) {
+            type |= TEvent::ERR;
+        }
+        ch.Type = type;
+        ch.Handle = {};
+        return type != 0;
+    }
+    /**
+     * @brief Looks up the registration a change applies to.
+     *
+     * A new wait registers the descriptor in @p table, removals and cancellations only
+     * look it up, so they never allocate an entry for a descriptor nobody waits on.
+     *
+     * @return The entry, nullptr if the change has nothing to remove.
+     */
+    template<typename TTable>
+    static auto* Registration(TTable& table, const TEvent& ch) {
+        return ch.Handle && !(ch.Type & TEvent::CANCEL) ? &table[ch.Fd] : table.Find(ch.Fd);
+    }
+    /**
+     * @brief Returns true if the descriptor of @c Changes_[index] was deregistered later.
+     *
+     * After a synchronous @ref RemoveEvent(int) the changes queued before it belong to the
+     * closed file, a reused fd number must not inherit them.
+     */
+    bool Superseded(size_t index) const {
+        if (ClosedAt_.empty()) {
+            return false;
+        }
+        auto it = ClosedAt_.find(Changes_[index].Fd);
+        return it != ClosedAt_.end() && index < it->second;
+    }
+    /// Returns the start of a measured interval, a dummy without COROIO_STATS.
+    static TTime StatsStart() {
+#ifdef COROIO_STATS
+        return TClock::now();
+#else
+        return {};
+#endif
+    }
+    /// Returns the nanoseconds since @p start.
+    static uint64_t StatsElapsed(TTime start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() - start).count();
+    }
+    /**
+     * @brief Records a poll system call that started at @p start.
+     *
+     * Called by each backend right after the call returns.
+     */
+    void RecordPoll([[maybe_unused]] TTime start) {
+#ifdef COROIO_STATS
+        Stats_.Polls.Add();
+        Stats_.PollTime.Record(StatsElapsed(start));
+#endif
+    }
+    /// Records @p count kernel registrations: epoll_ctl(2) calls, kevent(2) changes, SQEs.
+    void RecordSubmissions([[maybe_unused]] size_t count) {
+#ifdef COROIO_STATS
+        Stats_.Submissions.Add(count);
+#endif
+    }
     /// Clears the lists of ready events and pending changes.
     void Reset() {
+#ifdef COROIO_STATS
+        Stats_.Changes.Add(Changes_.size());
+        Stats_.ChangesPerPoll.Record(Changes_.size());
+#endif
         ReadyEvents_.clear();
+        WakeupIndex_ = 0;
         Changes_.clear();
+        ClosedAt_.clear();
         MaxFd_ = 0;
     }
     /**
@@ -318,6 +645,17 @@ protected:
      */
     void ProcessTimers() {
         auto now = TClock::now();
+        if (Wheel_) {
+            ProcessWheelTimers(now);
+        } else {
+            ProcessHeapTimers(now);
+        }
+#ifdef COROIO_STATS
+        Stats_.TimersTime.Record(StatsElapsed(now));
+#endif
+    }
+    /// @ref ProcessTimers() for the binary heap.
+    void ProcessHeapTimers(TTime now) {
         bool first = true;
         unsigned prevId = 0;
 
@@ -326,7 +664,8 @@ protected:
 
             if ((first || prevId != timer.Id) && timer.Handle) { // skip removed timers
                 LastFiredTimer_ = timer.Id;
-                timer.Handle.resume();
+                RecordTimer(timer.Deadline);
+                Resume(timer.Handle, EStallSource::Timer);
             }
 
             first = false;
@@ -335,16 +674,152 @@ protected:
 
         LastTimersProcessTime_ = now;
     }
+    /// Resumes @p h, timed by the stall detector if one is installed.
+    void Resume(THandle h, [[maybe_unused]] EStallSource source) {
+#ifdef COROIO_STATS
+        if (StallCallback_) [[unlikely]] {
+            Traced(h, source, [h]() { h.resume(); });
+            return;
+        }
+#endif
+        h.resume();
+    }
+#ifdef COROIO_STATS
+    template<typename TFunc>
+    void Traced(THandle h, EStallSource source, TFunc&& func) {
+        auto cpu = StallOptions_.CpuTime ? NDetail::ThreadCpuTime() : TClock::duration{};
+        auto start = TClock::now();
+        func();
+        auto duration = TClock::now() - start;
+        if (duration < StallOptions_.Threshold) {
+            return;
+        }
+        TStall stall{.Source = source, .Handle = h.address(), .Duration = duration};
+        if (StallOptions_.CpuTime) {
+            stall.CpuTime = NDetail::ThreadCpuTime() - cpu;
+        }
+        if (h) {
+            NDetail::TFrameRegistry::Get().Chain(h.address(), StallOptions_.MaxDepth, stall.Callers);
+        }
+        // the callback may replace the detector
+        auto callback = StallCallback_;
+        callback(stall);
+    }
+#endif
+    /// Records a timer about to be resumed.
+    void RecordTimer([[maybe_unused]] TTime deadline) {
+#ifdef COROIO_STATS
+        Stats_.TimersFired.Add();
+        // Yield() is not late
+        if (deadline != TTime{}) {
+            Stats_.TimerLateness.Record(StatsElapsed(deadline));
+        }
+#endif
+    }
+    /// @ref ProcessTimers() for the timer wheel.
+    void ProcessWheelTimers(TTime now) {
+        // timers added by resumed coroutines may be due as well, e.g. Yield()
+        for (Wheel_->Expire(now, ExpiredTimers_); !ExpiredTimers_.empty(); Wheel_->Expire(now, ExpiredTimers_)) {
+            for (auto id : ExpiredTimers_) {
+                TTime deadline;
+                if (auto h = Wheel_->Fire(id, &deadline)) { // skip removed timers
+                    LastFiredTimer_ = id;
+                    RecordTimer(deadline);
+                    Resume(h, EStallSource::Timer);
+                    // wheel ids are reused, RemoveTimer() is only valid from await_resume()
+                    LastFiredTimer_ = (unsigned)(-1);
+                }
+            }
+            ExpiredTimers_.clear();
+        }
+
+        LastTimersProcessTime_ = now;
+    }
 
     int MaxFd_ = 0; ///< Highest file descriptor in use.
     std::vector<TEvent> Changes_; ///< Pending changes (registered events).
     std::vector<TEvent> ReadyEvents_; ///< Events ready to wake up their coroutines.
+    size_t WakeupIndex_ = 0; ///< First entry of ReadyEvents_ not yet resumed.
     unsigned TimerId_ = 0; ///< Counter for generating unique timer IDs.
     std::priority_queue<TTimer> Timers_; ///< Priority queue for scheduled timers.
+    std::unique_ptr<TTimerWheel> Wheel_; ///< Timer wheel used instead of Timers_ if set.
+    std::vector<unsigned> ExpiredTimers_; ///< Timers collected from Wheel_ in ProcessTimers().
     TTime LastTimersProcessTime_; ///< Last time timers were processed.
     unsigned LastFiredTimer_ = (unsigned)(-1); ///< ID of the last fired timer.
     std::chrono::milliseconds MaxDuration_ = std::chrono::milliseconds(100); ///< Maximum poll duration.
     timespec MaxDurationTs_ = GetMaxDuration(MaxDuration_); ///< Max duration represented as timespec.
+    std::function<void()> Interrupter_; ///< Backend-specific wakeup of a blocking poll, set by the backend constructor.
+    std::function<void(int)> Deregister_; ///< Synchronous @ref RemoveEvent(int), set by the backend constructor.
+    std::unordered_map<int, size_t> ClosedAt_; ///< Size of Changes_ when a descriptor was deregistered.
+    bool ErrorEvents_ = false; ///< The backend delivers TEvent::ERR, see @ref AddError().
+#ifdef COROIO_STATS
+    TPollerStats Stats_; ///< Instrumentation, see @ref Stats().
+    TStallOptions StallOptions_;
+    TStallCallback StallCallback_; ///< Set by @ref SetStallDetector().
+#endif
+
+private:
+    struct TPosted {
+        std::function<void()> Func;
+        THandle Handle;
+    };
+
+    TMpscQueue<TPosted> Posted_; ///< Work posted from other threads.
+    std::atomic<bool> Interrupted_ = false; ///< True if the backend was already interrupted.
+};
+
+/**
+ * @brief A wait registered by an awaitable of a readiness-based socket.
+ *
+ * The awaitable records the wait with @ref Arm() after registering it with
+ * @ref TPollerBase::AddRead() and friends and calls @ref Disarm() from await_resume().
+ * If it is destroyed in between, i.e. together with the suspended coroutine, the wait is
+ * cancelled with @ref TPollerBase::RemoveEvent(int, int, THandle): one queued change plus
+ * a scan of the events of the current poll not yet resumed, O(ready events).
+ */
+class TEventWait {
+public:
+    TEventWait() = default;
+    TEventWait(TEventWait&& other)
+        : Poller_(other.Poller_)
+        , Fd_(other.Fd_)
+        , Type_(other.Type_)
+        , Handle_(other.Handle_)
+    {
+        other.Handle_ = {};
+    }
+    TEventWait(const TEventWait&) = delete;
+    TEventWait& operator=(const TEventWait&) = delete;
+
+    ~TEventWait() {
+        if (Handle_) {
+            Poller_->RemoveEvent(Fd_, Type_, Handle_);
+        }
+    }
+
+    /// Records the wait of @p h for @p type events on @p fd.
+    void Arm(TPollerBase* poller, int fd, int type, THandle h) {
+        Poller_ = poller;
+        Fd_ = fd;
+        Type_ = type;
+        Handle_ = h;
+    }
+
+    /// Forgets the wait once the coroutine is resumed.
+    void Disarm() {
+        Handle_ = {};
+    }
+
+    /// Returns true between @ref Arm() and @ref Disarm().
+    bool Armed() const {
+        return !!Handle_;
+    }
+
+private:
+    TPollerBase* Poller_ = nullptr;
+    int Fd_ = -1;
+    int Type_ = 0;
+    THandle Handle_;
 };
 
 } // namespace NNet
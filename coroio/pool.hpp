@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "address.hpp"
+#include "base.hpp"
+#include "corochain.hpp"
+
+namespace NNet {
+
+/**
+ * @struct TConnectionPoolOptions
+ * @brief Limits of a @ref TConnectionPool, applied per remote address.
+ */
+struct TConnectionPoolOptions {
+    size_t MinIdle = 0; ///< Idle connections re-established in background after an @c Acquire().
+    size_t MaxIdle = 8; ///< Released connections above this number are closed.
+    TClock::duration MaxIdleTime = std::chrono::seconds(60); ///< Older idle connections are not reused.
+};
+
+/**
+ * @class TConnectionPool
+ * @brief Keeps established outbound connections for reuse, keyed by remote address.
+ *
+ * @ref Acquire() returns a @ref TLease holding an idle connection to the address, or a new
+ * one made by the connector (for @ref TSslSocket the connector performs the handshake, so
+ * a reused lease skips both the TCP and the TLS round trips). A lease that is
+ * @ref TLease::Release() -d goes back to the pool; a lease destroyed without it closes its
+ * connection, because a request interrupted by an exception may have left unread data behind.
+ *
+ * Every idle connection is watched with @c Monitor(): when the peer closes it, the socket is
+ * closed at once and the entry is dropped on the next access to its address. Pollers that
+ * do not report remote hang-ups (@ref TSelect) rely on @c MaxIdleTime only.
+ *
+ * Example:
+ * @code{.cpp}
+ * TConnectionPool<TSocket> pool(poller);
+ * auto lease = co_await pool.Acquire(addr, TClock::now() + std::chrono::seconds(1));
+ * co_await TByteWriter(*lease).Write(request.data(), request.size());
+ * co_await TByteReader(*lease).Read(response.data(), response.size());
+ * lease.Release();
+ * @endcode
+ *
+ * The pool must outlive its leases and is not thread-safe.
+ *
+ * @tparam TSocket Connection type with @c Monitor(), e.g. @ref TSocket or @ref TSslSocket.
+ */
+template<typename TSocket>
+class TConnectionPool {
+public:
+    using TPoller = typename TSocket::TPoller;
+    /// Makes a connected socket, throws on failure.
+    using TConnector = std::function<TFuture<TSocket>(const TAddress& address, TTime deadline)>;
+
+    /**
+     * @class TLease
+     * @brief Exclusive use of a pooled connection.
+     */
+    class TLease {
+    public:
+        TLease() = default;
+        TLease(TLease&& other) {
+            *this = std::move(other);
+        }
+        TLease& operator=(TLease&& other) {
+            if (this != &other) {
+                Pool_ = other.Pool_;
+                Address_ = other.Address_;
+                Socket_ = std::move(other.Socket_);
+                Reused_ = other.Reused_;
+                other.Pool_ = nullptr;
+            }
+            return *this;
+        }
+
+        TSocket& operator*() {
+            return *Socket_;
+        }
+
+        TSocket* operator->() {
+            return Socket_.get();
+        }
+
+        explicit operator bool() const {
+            return !!Socket_;
+        }
+
+        /// Returns true if the connection was taken from the pool rather than established.
+        bool Reused() const {
+            return Reused_;
+        }
+
+        /// Returns the connection to the pool; the lease becomes empty.
+        void Release() {
+            if (Pool_ && Socket_) {
+                Pool_->Put(Address_, std::move(Socket_));
+            }
+            Pool_ = nullptr;
+        }
+
+    private:
+        friend class TConnectionPool;
+
+        TLease(TConnectionPool* pool, const TAddress& address, std::unique_ptr<TSocket> socket, bool reused)
+            : Pool_(pool)
+            , Address_(address)
+            , Socket_(std::move(socket))
+            , Reused_(reused)
+        { }
+
+        TConnectionPool* Pool_ = nullptr;
+        TAddress Address_;
+        std::unique_ptr<TSocket> Socket_;
+        bool Reused_ = false;
+    };
+
+    /**
+     * @brief Creates a pool connecting plain sockets with @c TSocket(poller, domain).Connect().
+     */
+    TConnectionPool(TPoller& poller, TConnectionPoolOptions options = {})
+        requires std::is_constructible_v<TSocket, TPoller&, int>
+        : TConnectionPool([&poller](const TAddress& address, TTime deadline) -> TFuture<TSocket> {
+            TSocket socket(poller, address.Domain());
+            co_await socket.Connect(address, deadline);
+            co_return std::move(socket);
+        }, options)
+    { }
+
+    /**
+     * @brief Creates a pool using a custom connector, e.g. one wrapping the socket in
+     *        @ref TSslSocket and running its handshake.
+     */
+    TConnectionPool(TConnector connector, TConnectionPoolOptions options = {})
+        : Connector_(std::move(connector))
+        , Options_(options)
+    { }
+
+    TConnectionPool(const TConnectionPool&) = delete;
+    TConnectionPool& operator=(const TConnectionPool&) = delete;
+
+    /**
+     * @brief Leases a connection to @p address.
+     *
+     * Takes the most recently released live connection or establishes a new one.
+     *
+     * @param address  Remote address.
+     * @param deadline Deadline passed to the connector when a new connection is needed.
+     * @return The lease; the connector's exception is propagated on failure.
+     */
+    TFuture<TLease> Acquire(TAddress address, TTime deadline = TTime::max()) {
+        auto& bucket = Buckets_[address];
+        auto now = TClock::now();
+        while (!bucket.Idle.empty()) {
+            auto idle = std::move(bucket.Idle.back());
+            bucket.Idle.pop_back();
+            if (idle->Socket && now - idle->Since <= Options_.MaxIdleTime) {
+                idle->Watch = {};
+                Refill(address, bucket);
+                co_return TLease(this, address, std::move(idle->Socket), true);
+            }
+        }
+        Refill(address, bucket);
+        auto socket = std::make_unique<TSocket>(co_await Connector_(address, deadline));
+        co_return TLease(this, address, std::move(socket), false);
+    }
+
+    /// Returns the number of idle connections to @p address, dead ones are not counted.
+    size_t IdleSize(const TAddress& address) const {
+        auto it = Buckets_.find(address);
+        if (it == Buckets_.end()) {
+            return 0;
+        }
+        size_t size = 0;
+        for (const auto& idle : it->second.Idle) {
+            size += !!idle->Socket;
+        }
+        return size;
+    }
+
+    /// Closes all idle connections and stops background connects.
+    void Clear() {
+        Buckets_.clear();
+    }
+
+private:
+    struct TIdle {
+        std::unique_ptr<TSocket> Socket;
+        TTime Since;
+        TFuture<void> Watch = {}; ///< Declared last: stops watching before the socket is closed.
+    };
+
+    struct TBucket {
+        std::vector<std::unique_ptr<TIdle>> Idle; ///< The most recently released is the last.
+        std::vector<TFuture<void>> Refills;
+    };
+
+    struct TAddressHash {
+        size_t operator()(const TAddress& address) const {
+            auto [addr, len] = address.RawAddr();
+            if (addr->sa_family == AF_INET) {
+                auto* in = reinterpret_cast<const sockaddr_in*>(addr);
+                return std::hash<uint64_t>()((uint64_t(in->sin_addr.s_addr) << 16) | in->sin_port);
+            }
+            auto* in6 = reinterpret_cast<const sockaddr_in6*>(addr);
+            uint64_t parts[2];
+            memcpy(parts, &in6->sin6_addr, sizeof(parts));
+            return std::hash<uint64_t>()(parts[0] ^ (parts[1] * 0x9e3779b97f4a7c15ULL) ^ in6->sin6_port);
+        }
+    };
+
+    void Put(const TAddress& address, std::unique_ptr<TSocket> socket) {
+        auto& bucket = Buckets_[address];
+        Prune(bucket);
+        if (bucket.Idle.size() >= Options_.MaxIdle) {
+            return;
+        }
+        auto idle = std::make_unique<TIdle>(TIdle{std::move(socket), TClock::now()});
+        idle->Watch = Watch(idle.get());
+        bucket.Idle.emplace_back(std::move(idle));
+    }
+
+    static TFuture<void> Watch(TIdle* idle) {
+        co_await idle->Socket->Monitor();
+        // closed by the peer while idle, the entry itself is dropped by Prune()
+        idle->Socket.reset();
+    }
+
+    void Refill(const TAddress& address, TBucket& bucket) {
+        std::erase_if(bucket.Refills, [](const auto& f) { return f.done(); });
+        for (size_t live = IdleSize(address) + bucket.Refills.size(); live < Options_.MinIdle; live++) {
+            bucket.Refills.emplace_back(Connect(address));
+        }
+    }
+
+    TFuture<void> Connect(TAddress address) {
+        try {
+            auto socket = std::make_unique<TSocket>(co_await Connector_(address, TTime::max()));
+            Put(address, std::move(socket));
+        } catch (const std::exception&) {
+            // the next Acquire() reports the error to its caller
+        }
+    }
+
+    void Prune(TBucket& bucket) {
+        auto now = TClock::now();
+        std::erase_if(bucket.Idle, [&](const auto& idle) {
+            return !idle->Socket || now - idle->Since > Options_.MaxIdleTime;
+        });
+    }
+
+    TConnector Connector_;
+    TConnectionPoolOptions Options_;
+    std::unordered_map<TAddress, TBucket, TAddressHash> Buckets_;
+};
+
+} // namespace NNet
@@ -6,6 +6,7 @@
 #ifdef __linux__
 #include "uring.hpp"
 #endif
+#include <algorithm>
 #include <string_view>
 #include <utility>
 #include <fstream>
@@ -96,62 +97,131 @@ void CreatePacket(const std::string& name, EDNSType type, char* packet, int* siz
     memcpy(p, &question.dnsclass, sizeof (question.dnsclass));
 }
 
-void ParsePacket(uint16_t* xid, std::vector<TAddress>& addresses, char* buf, ssize_t size) {
-    TDnsHeader* header = (TDnsHeader*)(&buf[0]);
-    *xid = ntohs(header->xid);
-    if ((ntohs (header->flags) & 0xf) != 0) {
-        throw std::runtime_error("Resolver Error");
+} // namespace
+
+namespace NDetail {
+
+struct TDnsResponse {
+    uint16_t Xid = 0;
+    int Rcode = 0;
+    bool Truncated = false;
+    std::vector<TAddress> Addresses;
+    std::optional<uint32_t> Ttl;         // the smallest of the answer records
+    std::optional<uint32_t> NegativeTtl; // from the SOA record of the authority section
+};
+
+} // namespace NDetail
+
+namespace {
+
+using NDetail::TDnsResponse;
+
+struct TDnsReader {
+    const uint8_t* Data;
+    size_t Size;
+    size_t Pos = 0;
+
+    void Need(size_t size) {
+        if (Pos > Size || Size - Pos < size) {
+            throw std::runtime_error("Not enough data");
+        }
     }
-    uint8_t* startOfName = (uint8_t*)(&buf[0] + sizeof (TDnsHeader));
-    uint8_t fragmentSize = 0;
-    uint8_t* p = startOfName; size -= p - (uint8_t*)buf; if (size <= 0) { throw std::runtime_error("Not enough data"); }
 
-    while (*p != 0)
-    {
-        /* Restore the dot in the name and advance to next length */
-        fragmentSize = *p + 1;
-        *p = '.';
-        p += fragmentSize; size -= fragmentSize; if (size <= 0) { throw std::runtime_error("Not enough data"); }
+    uint16_t U16() {
+        Need(2);
+        uint16_t value = (Data[Pos] << 8) | Data[Pos + 1];
+        Pos += 2;
+        return value;
     }
 
-    addresses.reserve(ntohs(header->ancount));
-    if (ntohs(header->ancount) == 0) {
-        return;
+    uint32_t U32() {
+        uint32_t high = U16();
+        return (high << 16) | U16();
     }
-    p += 5; size -= 5; if (size <= 0) { throw std::runtime_error("Not enough data"); }
-    for (int i = 0; i < ntohs (header->ancount); i++)
-    {
-        uint16_t* compression = (uint16_t*)p; p += 2; size -= 2; if (size <= 0) { throw std::runtime_error("Not enough data"); }
-        if (! ((ntohs(*compression) & 0xC000) == 0xC000)) {
-            // skip full name
-            while (*p) {
-                p++; size--; if (size <= 0) { throw std::runtime_error("Not enough data"); }
+
+    void SkipName() {
+        while (true) {
+            Need(1);
+            uint8_t len = Data[Pos];
+            if ((len & 0xC0) == 0xC0) {
+                // compression pointer ends the name
+                Need(2);
+                Pos += 2;
+                return;
+            }
+            Skip(1 + len);
+            if (len == 0) {
+                return;
             }
-            p++; size--; if (size <= 0) { throw std::runtime_error("Not enough data"); }
         }
+    }
 
-        TDnsRecordA* record = (TDnsRecordA*)p;
+    void Skip(size_t size) {
+        Need(size);
+        Pos += size;
+    }
+};
+
+TDnsResponse ParsePacket(const char* buf, ssize_t size) {
+    TDnsReader reader{reinterpret_cast<const uint8_t*>(buf), static_cast<size_t>(size)};
+    TDnsResponse response;
+    response.Xid = reader.U16();
+    uint16_t flags = reader.U16();
+    response.Rcode = flags & 0xf;
+    response.Truncated = flags & 0x0200;
+    uint16_t qdcount = reader.U16();
+    uint16_t ancount = reader.U16();
+    uint16_t nscount = reader.U16();
+    reader.U16(); // arcount
+
+    for (int i = 0; i < qdcount; i++) {
+        reader.SkipName();
+        reader.Skip(4); // QTYPE, QCLASS
+    }
 
-        auto addrLen = ntohs(record->length);
-        if (addrLen == 4) {
-            sockaddr_in addr;
-            addr.sin_port = 0,
+    for (int i = 0; i < ancount; i++) {
+        reader.SkipName();
+        uint16_t type = reader.U16();
+        reader.U16(); // CLASS
+        uint32_t ttl = reader.U32();
+        uint16_t length = reader.U16();
+        reader.Need(length);
+        const uint8_t* data = reader.Data + reader.Pos;
+        // CNAME records of the chain bound the TTL too
+        response.Ttl = std::min(response.Ttl.value_or(ttl), ttl);
+        if (type == static_cast<uint16_t>(EDNSType::A) && length == 4) {
+            sockaddr_in addr = {};
             addr.sin_family = AF_INET;
-            addr.sin_addr = *(in_addr*)(record+1);
-            addresses.emplace_back(TAddress{addr});
-        } else if (addrLen == 16) {
-            sockaddr_in6 addr;
-            addr.sin6_port = 0,
+            memcpy(&addr.sin_addr, data, 4);
+            response.Addresses.emplace_back(TAddress{addr});
+        } else if (type == static_cast<uint16_t>(EDNSType::AAAA) && length == 16) {
+            sockaddr_in6 addr = {};
             addr.sin6_family = AF_INET6;
-            addr.sin6_addr = *(in6_addr*)(record+1);
-            addresses.emplace_back(TAddress{addr});
+            memcpy(&addr.sin6_addr, data, 16);
+            response.Addresses.emplace_back(TAddress{addr});
         }
-        p += sizeof(TDnsRecordA);
-        p += addrLen;
-        size -= sizeof(TDnsRecordA); size -= addrLen; if (size < 0) { throw std::runtime_error("Not enough data"); }
+        reader.Skip(length);
     }
-}
 
+    for (int i = 0; i < nscount; i++) {
+        reader.SkipName();
+        uint16_t type = reader.U16();
+        reader.U16(); // CLASS
+        uint32_t ttl = reader.U32();
+        uint16_t length = reader.U16();
+        size_t next = reader.Pos + length;
+        reader.Need(length);
+        if (type == 6) { // SOA
+            reader.SkipName(); // MNAME
+            reader.SkipName(); // RNAME
+            reader.Skip(16);   // SERIAL, REFRESH, RETRY, EXPIRE
+            uint32_t minimum = reader.U32();
+            response.NegativeTtl = std::min(ttl, minimum);
+        }
+        reader.Pos = next;
+    }
+    return response;
+}
 } // namespace
 
 TResolvConf::TResolvConf(const std::string& fn)
@@ -189,20 +259,30 @@ TResolver<TPoller>::TResolver(TPoller& poller, EDNSType defaultType)
 
 template<typename TPoller>
 TResolver<TPoller>::TResolver(const TResolvConf& conf, TPoller& poller, EDNSType defaultType)
-    : TResolver(conf.Nameservers[0], poller, defaultType)
+    : TResolver(conf.Nameservers, poller, defaultType)
 { }
 
 template<typename TPoller>
 TResolver<TPoller>::TResolver(TAddress dnsAddr, TPoller& poller, EDNSType defaultType)
-    : DnsAddr(std::move(dnsAddr))
-    , Socket(poller, DnsAddr.Domain(), SOCK_DGRAM)
-    , Poller(poller)
+    : TResolver(std::vector<TAddress>{std::move(dnsAddr)}, poller, defaultType)
+{ }
+
+template<typename TPoller>
+TResolver<TPoller>::TResolver(std::vector<TAddress> nameservers, TPoller& poller, EDNSType defaultType)
+    : Poller(poller)
     , DefaultType(defaultType)
 {
+    if (nameservers.empty()) {
+        throw std::invalid_argument("No nameservers");
+    }
+    for (auto& address : nameservers) {
+        Servers.emplace_back(std::make_unique<TNameserver>(poller, std::move(address)));
+    }
     // Start tasks after fields initialization
-    Sender = SenderTask();
-    Receiver = ReceiverTask();
-    Timeouts = TimeoutsTask();
+    for (size_t i = 0; i < Servers.size(); i++) {
+        Servers[i]->Sender = SenderTask(*Servers[i]);
+        Servers[i]->Receiver = ReceiverTask(i);
+    }
 }
 
 template<typename TPoller>
@@ -210,86 +290,312 @@ TResolver<TPoller>::~TResolver()
 { }
 
 template<typename TPoller>
-TFuture<void> TResolver<TPoller>::SenderTask() {
-    co_await Socket.Connect(DnsAddr);
-    char buf[512];
-    while (true) {
-        while (AddResolveQueue.empty()) {
-            SenderSuspended = co_await Self();
-            co_await std::suspend_always{};
+TFuture<void> TResolver<TPoller>::SenderTask(TNameserver& server) {
+    co_await server.Socket.Connect(server.Address);
+    while (auto first = co_await server.Outgoing.Recv()) {
+        // queries queued meanwhile leave with one system call
+        std::vector<std::string> packets;
+        std::vector<TDatagram> batch;
+        packets.emplace_back(std::move(*first));
+        while (packets.size() < TDatagramSocket::MaxBatch) {
+            auto next = server.Outgoing.TryRecv();
+            if (!next) {
+                break;
+            }
+            packets.emplace_back(std::move(*next));
+        }
+        for (auto& packet : packets) {
+            batch.emplace_back(TDatagram{.Data = packet.data(), .Size = packet.size()});
+        }
+        try {
+            for (size_t sent = 0; sent < batch.size(); ) {
+                sent += co_await server.Socket.SendMany(batch.data() + sent, batch.size() - sent);
+            }
+        } catch (const std::system_error&) {
+            // e.g. ECONNREFUSED after an ICMP error, the queries retransmit
         }
-        SenderSuspended = {};
-        auto req = AddResolveQueue.front(); AddResolveQueue.pop();
-        int len;
-        memset(buf, 0, sizeof(buf));
-        Inflight[Xid] = req;
-        CreatePacket(req.Name, req.Type, buf, &len, Xid);
-        Xid = 1 + (Xid + 1) % 65535;
-        co_await TByteWriter(Socket).Write(buf, len);
     }
     co_return;
 }
 
 template<typename TPoller>
-TFuture<void> TResolver<TPoller>::TimeoutsTask() {
-    while (true) {
-        TTime now = TClock::now();
-        while (!TimeoutsQueue.empty() && TimeoutsQueue.front().first <= now) {
-            auto req = std::move(TimeoutsQueue.front().second);
-            ResumeWaiters({.Exception = std::make_exception_ptr(std::runtime_error("Timeout"))}, req);
-            TimeoutsQueue.pop();
+void TResolver<TPoller>::Send(const TResolveRequest& req, size_t index) {
+    while (Inflight.contains(Xid)) {
+        Xid = 1 + Xid % 65535;
+    }
+    char buf[512];
+    int len;
+    memset(buf, 0, sizeof(buf));
+    CreatePacket(req.Name, req.Type, buf, &len, Xid);
+    Inflight.emplace(Xid, TInflight{req, index, TClock::now()});
+    Xid = 1 + Xid % 65535;
+
+    // the sender is behind: drop the packet like a congested network would, the query retransmits
+    Servers[index]->Outgoing.TrySend(std::string(buf, len));
+}
+
+template<typename TPoller>
+TClock::duration TResolver<TPoller>::Rto(const TNameserver& server) const {
+    if (!server.Measured) {
+        return QueryOptions.InitialRto;
+    }
+    auto rto = server.Srtt + std::max<TClock::duration>(std::chrono::milliseconds(1), 4 * server.Rttvar);
+    return std::clamp(rto, QueryOptions.MinRto, QueryOptions.MaxRto);
+}
+
+template<typename TPoller>
+std::vector<size_t> TResolver<TPoller>::ServerOrder() const {
+    std::vector<size_t> order(Servers.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::vector<TClock::duration> rank(Servers.size());
+    for (size_t i = 0; i < rank.size(); i++) {
+        rank[i] = Rto(*Servers[i]) + Penalty(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return rank[a] < rank[b];
+    });
+    return order;
+}
+
+template<typename TPoller>
+TFuture<void> TResolver<TPoller>::QueryTask(TResolveRequest req) {
+    auto& query = Queries[req];
+    if (query.Order.empty()) {
+        query.Order = ServerOrder();
+    }
+    const auto& order = query.Order;
+    TTime now;
+    do {
+        size_t round = query.Attempts / order.size();
+        size_t burst = query.Attempts == 0 ? std::clamp<size_t>(QueryOptions.Parallel, 1, order.size()) : 1;
+        TClock::duration rto = {};
+        std::vector<size_t> sent;
+        for (size_t i = 0; i < burst; i++) {
+            size_t index = order[query.Attempts++ % order.size()];
+            Send(req, index);
+            rto = std::max(rto, Rto(*Servers[index]) * (1 << std::min<size_t>(round, 6)));
+            sent.emplace_back(index);
+        }
+        co_await Poller.Sleep(std::min(TClock::now() + rto, query.Deadline));
+
+        // an answer would have cancelled the task, push the silent servers down the order
+        now = TClock::now();
+        for (auto index : sent) {
+            auto& server = *Servers[index];
+            server.Penalty = std::min(std::max(Penalty(index), Rto(server)) * 2, QueryOptions.MaxRto);
+            server.PenaltyExpires = now + QueryOptions.PenaltyTime;
         }
-        co_await Poller.Sleep(now + std::chrono::milliseconds(100));
+    } while (now < query.Deadline);
+
+    Detach(req);
+    std::erase_if(Inflight, [&](const auto& inflight) { return inflight.second.Request == req; });
+    ResumeWaiters({.Exception = std::make_exception_ptr(std::runtime_error("Timeout"))}, req);
+}
+
+template<typename TPoller>
+TFuture<void> TResolver<TPoller>::TcpQueryTask(TResolveRequest req, size_t index) {
+    std::optional<TDnsResponse> response;
+    std::vector<TFuture<void>> race;
+    race.emplace_back([](TPoller& poller, TAddress address, TResolveRequest req, TTime deadline,
+                         TSemaphore& slots, std::optional<TDnsResponse>* response) -> TFuture<void>
+    {
+        try {
+            auto permit = co_await slots.Acquire();
+            TSocket socket(poller, address.Domain());
+            co_await socket.Connect(address, deadline);
+            char buf[514];
+            int len;
+            memset(buf, 0, sizeof(buf));
+            CreatePacket(req.Name, req.Type, buf + 2, &len, 1);
+            buf[0] = len >> 8;
+            buf[1] = len & 0xff;
+            co_await TByteWriter(socket).Write(buf, len + 2);
+            uint8_t prefix[2];
+            co_await TByteReader(socket).Read(prefix, sizeof(prefix));
+            std::string packet((prefix[0] << 8) | prefix[1], '\0');
+            co_await TByteReader(socket).Read(packet.data(), packet.size());
+            *response = ParsePacket(packet.data(), packet.size());
+        } catch (const std::exception&) {
+            // reported as a server failure
+        }
+    }(Poller, Servers[index]->Address, req, Queries[req].Deadline, Servers[index]->TcpSlots, &response));
+    race.emplace_back([](TPoller& poller, TTime deadline) -> TFuture<void> {
+        co_await poller.Sleep(deadline);
+    }(Poller, Queries[req].Deadline));
+    co_await Any(std::move(race));
+
+    Detach(req);
+    if (response) {
+        Complete(req, std::move(*response));
+    } else {
+        std::erase_if(Inflight, [&](const auto& inflight) { return inflight.second.Request == req; });
+        ResumeWaiters({.Exception = std::make_exception_ptr(std::runtime_error("Resolver Error"))}, req);
+    }
+}
+
+template<typename TPoller>
+void TResolver<TPoller>::Detach(const TResolveRequest& req) {
+    // called by the running task itself, it is freed by the next Query()
+    auto it = Queries.find(req);
+    Finished.emplace_back(std::move(it->second.Task));
+    Queries.erase(it);
+}
+
+template<typename TPoller>
+void TResolver<TPoller>::Complete(const TResolveRequest& req, TDnsResponse&& response) {
+    std::erase_if(Inflight, [&](const auto& inflight) { return inflight.second.Request == req; });
+
+    TResolveResult result;
+    if (response.Rcode == 0 && !response.Addresses.empty()) {
+        result.Addresses = std::move(response.Addresses);
+        auto ttl = std::chrono::duration_cast<TClock::duration>(std::chrono::seconds(*response.Ttl));
+        result.Ttl = std::clamp(ttl, CacheOptions.MinTtl, CacheOptions.MaxTtl);
+    } else if (response.Rcode == 0 || response.Rcode == 3) {
+        // NODATA or NXDOMAIN, an empty list or an error until the negative TTL expires
+        if (response.Rcode == 3) {
+            result.Exception = std::make_exception_ptr(std::runtime_error("Name not found"));
+        }
+        auto ttl = response.NegativeTtl
+            ? std::chrono::duration_cast<TClock::duration>(std::chrono::seconds(*response.NegativeTtl))
+            : CacheOptions.NegativeTtl;
+        result.Ttl = std::min(ttl, CacheOptions.MaxNegativeTtl);
+    } else {
+        result.Exception = std::make_exception_ptr(std::runtime_error("Resolver Error"));
     }
+
+    Store(req, result);
+    ResumeWaiters(std::move(result), req);
 }
 
 template<typename TPoller>
 void TResolver<TPoller>::ResumeWaiters(TResolveResult&& result, const TResolveRequest& req) {
     auto maybeWaiting = WaitingAddrs.find(req);
     if (maybeWaiting != WaitingAddrs.end()) {
-        Results[req] = std::move(result);
-        auto handles = std::move(maybeWaiting->second);
+        auto waiting = std::move(maybeWaiting->second);
         WaitingAddrs.erase(maybeWaiting);
-        for (auto h : handles) {
+        *waiting.Result = std::move(result);
+        for (auto h : waiting.Handles) {
             h.resume();
         }
     }
 }
 
 template<typename TPoller>
-TFuture<void> TResolver<TPoller>::ReceiverTask() {
-    char buf[512];
+void TResolver<TPoller>::Store(const TResolveRequest& req, const TResolveResult& result) {
+    if (result.Ttl <= TClock::duration::zero() || CacheOptions.MaxSize == 0) {
+        return;
+    }
+    auto it = CacheIndex.find(req);
+    if (it != CacheIndex.end()) {
+        Cache.erase(it->second);
+        CacheIndex.erase(it);
+    }
+    Cache.emplace_front(TCacheEntry{req, result, TClock::now() + result.Ttl});
+    CacheIndex.emplace(req, Cache.begin());
+    Evict();
+}
+
+template<typename TPoller>
+void TResolver<TPoller>::Evict() {
+    while (Cache.size() > CacheOptions.MaxSize) {
+        CacheIndex.erase(Cache.back().Request);
+        Cache.pop_back();
+    }
+}
+
+template<typename TPoller>
+void TResolver<TPoller>::SetCacheOptions(const TDnsCacheOptions& options) {
+    CacheOptions = options;
+    Evict();
+}
+
+template<typename TPoller>
+TFuture<void> TResolver<TPoller>::ReceiverTask(size_t index) {
+    auto& server = *Servers[index];
+    constexpr size_t batchSize = 8;
+    char buffers[batchSize][512];
+    TDatagram batch[batchSize];
     while (true) {
-        auto size = co_await Socket.ReadSome(buf, sizeof(buf));
-        if (size < 0) {
-            continue;
+        for (size_t i = 0; i < batchSize; i++) {
+            batch[i] = {.Data = buffers[i], .Size = sizeof(buffers[i])};
         }
-        if (size < static_cast<int>(sizeof(TDnsHeader))) {
-            continue;
-        }
-
-        std::vector<TAddress> addresses;
-        std::exception_ptr exception;
-        uint16_t xid;
+        int count;
         try {
-            ParsePacket(&xid, addresses, buf, size);
-        } catch (const std::exception& ex) {
-            exception = std::current_exception();
+            count = co_await server.Socket.RecvMany(batch, batchSize);
+        } catch (const std::system_error&) {
+            continue; // a pending ICMP error of an earlier send
+        }
+        for (int i = 0; i < count; i++) {
+            if (batch[i].Size < sizeof(TDnsHeader)) {
+                continue;
+            }
+            TDnsResponse response;
+            try {
+                response = ParsePacket(buffers[i], batch[i].Size);
+            } catch (const std::exception& ex) {
+                continue;
+            }
+            Handle(index, std::move(response));
         }
-
-        ResumeWaiters(std::move(TResolveResult {
-            .Addresses = std::move(addresses),
-            .Exception = exception
-        }), Inflight[xid]);
     }
     co_return;
 }
 
 template<typename TPoller>
-void TResolver<TPoller>::ResumeSender() {
-    if (SenderSuspended) {
-        SenderSuspended.resume();
+void TResolver<TPoller>::Handle(size_t index, TDnsResponse&& response) {
+    auto& server = *Servers[index];
+    auto inflight = Inflight.find(response.Xid);
+    if (inflight == Inflight.end() || inflight->second.Server != index) {
+        return; // a late answer to a finished query
+    }
+    auto req = std::move(inflight->second.Request);
+    auto rtt = TClock::now() - inflight->second.Sent;
+    Inflight.erase(inflight);
+
+    // every transmission has its own xid, so retransmits give unambiguous samples
+    if (server.Measured) {
+        auto delta = server.Srtt > rtt ? server.Srtt - rtt : rtt - server.Srtt;
+        server.Rttvar = (3 * server.Rttvar + delta) / 4;
+        server.Srtt = (7 * server.Srtt + rtt) / 8;
+    } else {
+        server.Srtt = rtt;
+        server.Rttvar = rtt / 2;
+        server.Measured = true;
+    }
+    server.Penalty = {};
+
+    auto query = Queries.find(req);
+    if (query == Queries.end()) {
+        return;
+    }
+    if (response.Truncated) {
+        std::erase_if(Inflight, [&](const auto& inflight) { return inflight.second.Request == req; });
+        query->second.Task = TcpQueryTask(req, index);
+        return;
+    }
+    if ((response.Rcode == 2 || response.Rcode == 5) && query->second.Attempts < Servers.size()) {
+        // SERVFAIL or REFUSED, another server may do better
+        query->second.Task = QueryTask(req);
+        return;
+    }
+
+    Queries.erase(query);
+    Complete(req, std::move(response));
+}
+
+template<typename TPoller>
+typename TResolver<TPoller>::TWaiting& TResolver<TPoller>::Query(const TResolveRequest& req) {
+    auto it = WaitingAddrs.find(req);
+    if (it == WaitingAddrs.end()) {
+        it = WaitingAddrs.emplace(req, TWaiting{}).first;
+        std::erase_if(Finished, [](const auto& task) { return task.done(); });
+        auto& query = Queries[req];
+        query.Deadline = TClock::now() + QueryOptions.Timeout;
+        query.Task = QueryTask(req);
     }
+    return it->second;
 }
 
 template<typename TPoller>
@@ -301,19 +607,47 @@ TFuture<std::vector<TAddress>> TResolver<TPoller>::Resolve(const std::string& ho
 
     TResolveRequest req = {.Name = hostname, .Type = type};
 
-    if (!WaitingAddrs.contains(req)) {
-        Results[req].Retries = 5;
-        AddResolveQueue.emplace(req);
-        TimeoutsQueue.emplace(std::make_pair(TClock::now() + std::chrono::milliseconds(2000), req));
+    auto now = TClock::now();
+    auto cached = CacheIndex.find(req);
+    if (cached != CacheIndex.end()) {
+        auto entry = cached->second;
+        if (entry->Expires > now) {
+            Cache.splice(Cache.begin(), Cache, entry);
+            // in use near the end of its TTL: refresh before it expires
+            auto left = entry->Expires - now;
+            if (left <= entry->Result.Ttl * CacheOptions.PrefetchFraction && !WaitingAddrs.contains(req)) {
+                Query(req);
+            }
+            if (entry->Result.Exception) {
+                std::rethrow_exception(entry->Result.Exception);
+            }
+            co_return entry->Result.Addresses;
+        }
+        Cache.erase(entry);
+        CacheIndex.erase(cached);
     }
-    WaitingAddrs[req].emplace_back(handle);
-    ResumeSender();
+
+    auto result = Query(req).Result;
+    WaitingAddrs[req].Handles.emplace_back(handle);
+
+    // the caller may be destroyed before the answer, e.g. by a lost Happy Eyeballs race
+    struct TGuard {
+        ~TGuard() {
+            auto it = Waiting.find(Req);
+            if (it != Waiting.end()) {
+                std::erase(it->second.Handles, Handle);
+            }
+        }
+        std::unordered_map<TResolveRequest, TWaiting, TResolveRequestHash>& Waiting;
+        const TResolveRequest& Req;
+        std::coroutine_handle<> Handle;
+    } guard{WaitingAddrs, req, handle};
+
     co_await std::suspend_always{};
-    auto& result = Results[req];
-    if (result.Exception) {
-        std::rethrow_exception(result.Exception);
+    if (result->Exception) {
+        std::rethrow_exception(result->Exception);
     }
-    co_return result.Addresses;
+    co_return result->Addresses;
 }
 
 THostPort::THostPort(const std::string& hostPort) {
@@ -321,6 +655,11 @@ THostPort::THostPort(const std::string& hostPort) {
     if (pos == std::string::npos) {
         throw std::runtime_error("Cannot parse hostPort");
     }
+    Host = hostPort.substr(0, pos);
+    if (Host.size() >= 2 && Host.front() == '[' && Host.back() == ']') {
+        Host = Host.substr(1, Host.size() - 2);
+    }
+    Port = std::stoi(hostPort.substr(pos + 1));
 }
 
 THostPort::THostPort(const std::string& host, int port)
@@ -328,19 +667,12 @@ THostPort::THostPort(const std::string& host, int port)
     , Port(port)
 { }
 
-template<typename T>
-TFuture<TAddress> THostPort::Resolve(TResolver<T>& resolver) {
+std::optional<TAddress> THostPort::Literal() const {
     char buf[16];
-    if (inet_pton(AF_INET, Host.c_str(), buf) == 1 || inet_pton(AF_INET6, Host.c_str(), buf)) {
-        co_return TAddress{Host, Port};
+    if (inet_pton(AF_INET, Host.c_str(), buf) == 1 || inet_pton(AF_INET6, Host.c_str(), buf) == 1) {
+        return TAddress{Host, Port};
     }
-
-    auto addresses = co_await resolver.Resolve(Host);
-    if (addresses.empty()) {
-        throw std::runtime_error("Empty address");
-    }
-
-    co_return addresses.front().WithPort(Port);
+    return std::nullopt;
 }
 
 template class TResolver<TPollerBase>;
@@ -1,14 +1,25 @@
 #pragma once
 
+#include <deque>
 #include <exception>
+#include <list>
+#include <memory>
+#include <optional>
+#include <system_error>
 #include <unordered_map>
 
 #include "promises.hpp"
 #include "socket.hpp"
+#include "datagram.hpp"
 #include "corochain.hpp"
+#include "sync.hpp"
 
 namespace NNet {
 
+namespace NDetail {
+struct TDnsResponse;
+} // namespace NDetail
+
 /**
  * @class TResolvConf
  * @brief Reads and stores DNS configuration from a file or an input stream.
@@ -55,6 +66,32 @@ enum class EDNSType {
     AAAA = 28, /**< IPv6 address record. */
 };
 
+/**
+ * @struct TDnsCacheOptions
+ * @brief Limits of the answer cache of @ref TResolver.
+ */
+struct TDnsCacheOptions {
+    size_t MaxSize = 4096;                                        ///< Least recently used names are evicted beyond it.
+    TClock::duration MinTtl = std::chrono::seconds(0);            ///< Lower bound of a positive answer's TTL.
+    TClock::duration MaxTtl = std::chrono::hours(1);              ///< Upper bound of a positive answer's TTL.
+    TClock::duration NegativeTtl = std::chrono::seconds(10);      ///< TTL of a negative answer without an SOA record.
+    TClock::duration MaxNegativeTtl = std::chrono::minutes(5);    ///< Upper bound of a negative answer's TTL.
+    double PrefetchFraction = 0.1; ///< A hit within this last part of the TTL refreshes the name in background.
+};
+
+/**
+ * @struct TDnsQueryOptions
+ * @brief Retransmission policy of @ref TResolver.
+ */
+struct TDnsQueryOptions {
+    TClock::duration Timeout = std::chrono::seconds(2);              ///< Time limit of a query, retransmits included.
+    TClock::duration InitialRto = std::chrono::milliseconds(500);    ///< Retransmit timeout of a server without RTT samples.
+    TClock::duration MinRto = std::chrono::milliseconds(20);         ///< Lower bound of the retransmit timeout.
+    TClock::duration MaxRto = std::chrono::seconds(1);               ///< Upper bound of the retransmit timeout.
+    TClock::duration PenaltyTime = std::chrono::seconds(30);         ///< How long a timed out server stays ranked down.
+    size_t Parallel = 1; ///< Number of the fastest servers raced by the first transmission.
+};
+
 /**
  * @class TResolver
  * @brief Resolves hostnames into IP addresses using a custom poller.
@@ -64,6 +101,23 @@ enum class EDNSType {
  * EDNSType. Internally, it uses a polling mechanism (provided by the template parameter)
  * for asynchronous operations.
  *
+ * Answers are kept in an LRU cache (see @ref TDnsCacheOptions): addresses for
+ * the smallest TTL of their records, name errors and empty answers for the
+ * TTL of the SOA record of the response, capped by its MINIMUM field (RFC 2308).
+ * A name requested shortly before its entry expires is re-queried in background,
+ * so names in constant use are never waited for after the first lookup.
+ * Timeouts and server failures are not cached.
+ *
+ * Queries go to the nameserver with the smallest smoothed RTT (RFC 6298 estimator,
+ * servers without samples keep their configuration order), or are raced across
+ * @ref TDnsQueryOptions::Parallel servers. An unanswered transmission is repeated
+ * to the next server after that server's retransmit timeout, doubled on every
+ * round. A timed out server is ranked down by a penalty, doubled on every timeout up to
+ * @ref TDnsQueryOptions::MaxRto, that is cleared by its next answer or expires after
+ * @ref TDnsQueryOptions::PenaltyTime; the RTT estimate keeps only measured samples, so
+ * a recovered server is ranked by its real RTT again. SERVFAIL and REFUSED answers move on
+ * to the next server at once, truncated answers are re-queried over TCP.
+ *
  * @tparam TPoller The type of the poller used to manage asynchronous operations.
  *
  * ### Example Usage
@@ -114,6 +168,14 @@ public:
      * @param defaultType The default DNS record type for resolution.
      */
     TResolver(TAddress dnsAddr, TPoller& poller, EDNSType defaultType = EDNSType::A);
+    /**
+     * @brief Constructs a TResolver querying several nameservers.
+     *
+     * @param nameservers Addresses of the DNS servers, the first ones are preferred until measured.
+     * @param poller Reference to a poller used for asynchronous operations.
+     * @param defaultType The default DNS record type for resolution.
+     */
+    TResolver(std::vector<TAddress> nameservers, TPoller& poller, EDNSType defaultType = EDNSType::A);
     ~TResolver();
 
     /**
@@ -131,20 +193,45 @@ public:
      */
     TFuture<std::vector<TAddress>> Resolve(const std::string& hostname, EDNSType type = EDNSType::DEFAULT);
 
+    /// Replaces the cache limits, entries beyond the new size are evicted.
+    void SetCacheOptions(const TDnsCacheOptions& options);
+
+    /// Returns the number of cached answers, expired ones included until their eviction.
+    size_t CacheSize() const {
+        return Cache.size();
+    }
+
+    /// Replaces the retransmission policy, queries in progress keep their time limit.
+    void SetQueryOptions(const TDnsQueryOptions& options) {
+        QueryOptions = options;
+    }
+
+    /// Returns the smoothed RTT of the nameserver @p index, zero until the first answer.
+    TClock::duration Srtt(size_t index) const {
+        return Servers[index]->Srtt;
+    }
+
+    /// Returns the timeout penalty of the nameserver @p index, zero once it has expired.
+    TClock::duration Penalty(size_t index) const {
+        const auto& server = *Servers[index];
+        return TClock::now() < server.PenaltyExpires ? server.Penalty : TClock::duration::zero();
+    }
+
 private:
-    TFuture<void> SenderTask();
-    TFuture<void> ReceiverTask();
-    TFuture<void> TimeoutsTask();
+    struct TResolveRequest;
+    struct TNameserver;
 
-    void ResumeSender();
+    TFuture<void> SenderTask(TNameserver& server);
+    TFuture<void> ReceiverTask(size_t index);
+    TFuture<void> QueryTask(TResolveRequest req);
+    TFuture<void> TcpQueryTask(TResolveRequest req, size_t index);
 
-    TFuture<void> Sender;
-    TFuture<void> Receiver;
-    TFuture<void> Timeouts;
-    std::coroutine_handle<> SenderSuspended;
+    void Handle(size_t index, NDetail::TDnsResponse&& response);
+    void Send(const TResolveRequest& req, size_t index);
+    void Detach(const TResolveRequest& req);
+    std::vector<size_t> ServerOrder() const;
+    TClock::duration Rto(const TNameserver& server) const;
 
-    TAddress DnsAddr;
-    TSocket Socket;
     TPoller& Poller;
     EDNSType DefaultType;
 
@@ -172,33 +259,253 @@ private:
         }
     };
 
-    std::queue<TResolveRequest> AddResolveQueue;
-    std::queue<std::pair<TTime, TResolveRequest>> TimeoutsQueue;
+    static constexpr size_t MaxTcpQueries = 4; ///< TCP fallback connections open to one server.
+
+    struct TNameserver {
+        TNameserver(TPoller& poller, TAddress address)
+            : Address(std::move(address))
+            , Socket(poller, Address.Domain())
+        { }
+
+        TAddress Address;
+        TDatagramSocket Socket;
+        TChannel<std::string, TDatagramSocket::MaxBatch * 4> Outgoing = {};
+        TSemaphore TcpSlots{MaxTcpQueries};
+        TClock::duration Srtt = {};
+        TClock::duration Rttvar = {};
+        bool Measured = false;
+        TClock::duration Penalty = {}; ///< Added to the RTO when ranking, see @ref TResolver::Penalty().
+        TTime PenaltyExpires = {};
+        // declared last: stop waiting before the socket is closed
+        TFuture<void> Sender = {};
+        TFuture<void> Receiver = {};
+    };
+
+    struct TInflight {
+        TResolveRequest Request;
+        size_t Server;
+        TTime Sent;
+    };
+
+    struct TQuery {
+        TTime Deadline;
+        size_t Attempts = 0;
+        std::vector<size_t> Order = {}; ///< Servers by their RTT when the query started.
+        TFuture<void> Task = {};
+    };
 
     struct TResolveResult {
         std::vector<TAddress> Addresses = {};
         std::exception_ptr Exception = nullptr;
-        int Retries = 0;
+        TClock::duration Ttl = {}; ///< Zero if the result must not be cached.
     };
 
+    struct TWaiting {
+        std::vector<std::coroutine_handle<>> Handles;
+        std::shared_ptr<TResolveResult> Result = std::make_shared<TResolveResult>();
+    };
+
+    struct TCacheEntry {
+        TResolveRequest Request;
+        TResolveResult Result;
+        TTime Expires;
+    };
+
+    using TCacheList = std::list<TCacheEntry>;
+
+    TWaiting& Query(const TResolveRequest& req);
+    void Complete(const TResolveRequest& req, NDetail::TDnsResponse&& response);
     void ResumeWaiters(TResolveResult&& result, const TResolveRequest& req);
+    void Store(const TResolveRequest& req, const TResolveResult& result);
+    void Evict();
+
+    TDnsCacheOptions CacheOptions;
+    TCacheList Cache; ///< The most recently used first.
+    std::unordered_map<TResolveRequest, typename TCacheList::iterator, TResolveRequestHash> CacheIndex;
+    std::unordered_map<TResolveRequest, TWaiting, TResolveRequestHash> WaitingAddrs;
+    std::unordered_map<uint16_t, TInflight> Inflight;
 
-    std::unordered_map<TResolveRequest, TResolveResult, TResolveRequestHash> Results;
-    std::unordered_map<TResolveRequest, std::vector<std::coroutine_handle<>>, TResolveRequestHash> WaitingAddrs;
-    std::unordered_map<uint64_t, TResolveRequest> Inflight;
+    TDnsQueryOptions QueryOptions;
+    std::vector<std::unique_ptr<TNameserver>> Servers;
+    // declared after the servers: running queries are cancelled first
+    std::unordered_map<TResolveRequest, TQuery, TResolveRequestHash> Queries;
+    std::vector<TFuture<void>> Finished; ///< Tasks that completed their query themselves.
 
     uint16_t Xid = 1;
 };
 
+/**
+ * @class THostPort
+ * @brief A host name or address literal with a port.
+ */
 class THostPort {
 public:
+    /// Parses "host:port" or "[v6 address]:port".
     THostPort(const std::string& hostPort);
     THostPort(const std::string& host, int port);
 
+    /// Resolves the host with the default record type of @p resolver, returns the first address.
     template<typename T>
-    TFuture<TAddress> Resolve(TResolver<T>& resolver);
+    TFuture<TAddress> Resolve(TResolver<T>& resolver) {
+        if (auto literal = Literal()) {
+            co_return *literal;
+        }
+
+        auto addresses = co_await resolver.Resolve(Host);
+        if (addresses.empty()) {
+            throw std::runtime_error("Empty address");
+        }
+
+        co_return addresses.front().WithPort(Port);
+    }
+
+    /**
+     * @brief Resolves the host and connects to it with Happy Eyeballs (RFC 8305).
+     *
+     * AAAA and A lookups run concurrently. Connecting starts when the AAAA answer
+     * arrives, or @p resolutionDelay after the A answer if AAAA is still pending.
+     * Attempts alternate between the address families, IPv6 first, a new one
+     * starting every @p attemptDelay or as soon as the previous one fails. The first
+     * established connection wins, the other attempts and lookups are cancelled.
+     *
+     * @tparam TSocket Connection type, constructed as @c TSocket(poller, domain).
+     * @param resolver Resolver, answered from its cache when possible.
+     * @param poller   Poller of the connection.
+     * @param deadline Time limit of the whole operation.
+     * @return The connected socket.
+     * @throws The last connection error, std::runtime_error if there are no addresses,
+     *         or std::system_error with std::errc::timed_out.
+     */
+    template<typename TSocket, typename T>
+    TFuture<TSocket> Connect(
+        TResolver<T>& resolver,
+        typename TSocket::TPoller& poller,
+        TTime deadline = TTime::max(),
+        TClock::duration attemptDelay = std::chrono::milliseconds(250),
+        TClock::duration resolutionDelay = std::chrono::milliseconds(50))
+    {
+        auto attempt = [](typename TSocket::TPoller& poller, TAddress address, TTime deadline) -> TFuture<TSocket> {
+            TSocket socket(poller, address.Domain());
+            co_await socket.Connect(address, deadline);
+#ifndef _WIN32
+            // a refused connect also reports writability, the next candidate must not wait for a read to fail
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(socket.Fd(), SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error != 0) {
+                throw std::system_error(error, std::generic_category(), "connect");
+            }
+#endif
+            co_return std::move(socket);
+        };
+        if (auto literal = Literal()) {
+            co_return co_await attempt(poller, *literal, deadline);
+        }
+
+        std::optional<TFuture<std::vector<TAddress>>> lookups[2] = {
+            resolver.Resolve(Host, EDNSType::AAAA),
+            resolver.Resolve(Host, EDNSType::A),
+        };
+        std::deque<TAddress> candidates[2]; // IPv6, IPv4
+        bool resolved[2] = {false, false};
+        TTime v4Resolved = TTime::max();
+        std::vector<TFuture<TSocket>> attempts;
+        int lastFamily = 1;
+        TTime nextAttempt = TTime::min();
+        std::exception_ptr error;
+
+        while (true) {
+            auto now = TClock::now();
+            for (int i = 0; i < 2; i++) {
+                if (resolved[i] || !lookups[i]->done()) {
+                    continue;
+                }
+                resolved[i] = true;
+                try {
+                    for (auto& address : lookups[i]->await_resume()) {
+                        candidates[i].emplace_back(address.WithPort(Port));
+                    }
+                } catch (const std::exception&) {
+                    error = std::current_exception();
+                }
+                lookups[i].reset();
+                if (i == 1) {
+                    v4Resolved = now;
+                }
+            }
+
+            for (auto it = attempts.begin(); it != attempts.end(); ) {
+                if (!it->done()) {
+                    ++it;
+                    continue;
+                }
+                try {
+                    co_return it->await_resume();
+                } catch (const std::exception&) {
+                    error = std::current_exception();
+                }
+                it = attempts.erase(it);
+                nextAttempt = now; // a failure starts the next attempt at once
+            }
+
+            bool haveCandidates = !candidates[0].empty() || !candidates[1].empty();
+            if (!haveCandidates && attempts.empty() && resolved[0] && resolved[1]) {
+                if (error) {
+                    std::rethrow_exception(error);
+                }
+                throw std::runtime_error("Empty address");
+            }
+            if (now >= deadline) {
+                throw std::system_error(std::make_error_code(std::errc::timed_out));
+            }
+
+            // AAAA may arrive a moment after A, give it a chance to go first
+            // v4Resolved stays TTime::max() until A is in, adding the delay to it would overflow
+            TTime start = std::max(nextAttempt, resolved[0] ? TTime::min()
+                : resolved[1] ? v4Resolved + resolutionDelay : TTime::max());
+            if (haveCandidates && now >= start) {
+                int family = (lastFamily == 1 && !candidates[0].empty()) || candidates[1].empty() ? 0 : 1;
+                attempts.emplace_back(attempt(poller, candidates[family].front(), deadline));
+                candidates[family].pop_front();
+                lastFamily = family;
+                nextAttempt = now + attemptDelay;
+                continue;
+            }
+
+            // waits for a lookup, an attempt or the next start, they go on running
+            std::vector<TFuture<void>> timer;
+            TTime wakeup = haveCandidates ? std::min(start, deadline) : deadline;
+            if (wakeup != TTime::max()) {
+                timer.emplace_back([](typename TSocket::TPoller& poller, TTime until) -> TFuture<void> {
+                    co_await poller.Sleep(until);
+                }(poller, wakeup));
+            }
+            auto self = co_await Self();
+            auto forEachPending = [&](auto&& f) {
+                for (auto& lookup : lookups) {
+                    if (lookup && !lookup->done()) {
+                        f(*lookup);
+                    }
+                }
+                for (auto& a : attempts) {
+                    if (!a.done()) {
+                        f(a);
+                    }
+                }
+                for (auto& t : timer) {
+                    if (!t.done()) {
+                        f(t);
+                    }
+                }
+            };
+            forEachPending([&](auto& future) { future.await_suspend(self); });
+            co_await std::suspend_always{};
+            forEachPending([](auto& future) { future.await_suspend(std::noop_coroutine()); });
+        }
+    }
 
 private:
+    std::optional<TAddress> Literal() const;
+
     std::string Host;
     int Port;
 };
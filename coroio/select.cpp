@@ -1,92 +1,182 @@
 // © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
 #include "select.hpp"
 
+#include <algorithm>
+#include <bit>
+
 namespace NNet {
 
+TSelect::TSelect()
+#ifdef _WIN32
+    : DummySocket_(*this, PF_INET)
+#endif
+{
 #ifdef _WIN32
-    TSelect::TSelect()
-        : DummySocket_(*this, PF_INET)
-    {
-        FD_ZERO(&ReadFds_);
-        FD_ZERO(&WriteFds_);
+    FD_ZERO(&ReadFds_);
+    FD_ZERO(&WriteFds_);
+    FD_ZERO(&ReadInterest_);
+    FD_ZERO(&WriteInterest_);
 
-        MaxFd_ = std::max<int>(MaxFd_, DummySocket_.Fd());
-    }
+    MaxFd_ = std::max<int>(MaxFd_, DummySocket_.Fd());
 #endif
+    MaxFd_ = std::max<int>(MaxFd_, Wakeup_.Fd());
+    Interrupter_ = [this]() { Wakeup_.Notify(); };
+}
 
 void TSelect::Poll() {
 #ifdef _WIN32
-    FD_SET(DummySocket_.Fd(), ReadFds());
+    FD_SET(DummySocket_.Fd(), &ReadInterest_);
 #endif
 
     auto ts = GetTimeout();
 
-    if (static_cast<int>(InEvents_.size()) <= MaxFd_) {
-        InEvents_.resize(MaxFd_+1);
+#ifndef _WIN32
+    if (MaxFd_ >= static_cast<int>(ReadInterest_.size())*Bits) {
+        size_t words = (MaxFd_+Bits)/Bits;
+        ReadFds_.resize(words);
+        WriteFds_.resize(words);
+        ReadInterest_.resize(words);
+        WriteInterest_.resize(words);
     }
 
-#ifndef _WIN32
-    constexpr int bits = sizeof(fd_mask)*8;
+    Set(ReadInterest_, Wakeup_.Fd());
 
-    if (MaxFd_ >= static_cast<int>(ReadFds_.size())*bits) {
-        ReadFds_.resize((MaxFd_+bits)/bits);
-        WriteFds_.resize((MaxFd_+bits)/bits);
+    for (auto& ch : Changes_) {
+        int fd = ch.Fd;
+        auto* state = Registration(InEvents_, ch);
+        if (!state) {
+            continue;
+        }
+        auto& ev = *state;
+        if ((ch.Type & TEvent::CANCEL) && !ResolveCancel(ch, ev)) {
+            continue;
+        }
+        if (ch.Handle) {
+            if (ch.Type & TEvent::READ) {
+                Set(ReadInterest_, fd); ev.Read = ch.Handle;
+            }
+            if (ch.Type & TEvent::WRITE) {
+                Set(WriteInterest_, fd); ev.Write = ch.Handle;
+            }
+        } else {
+            if (ch.Type & TEvent::READ) {
+                Clear(ReadInterest_, fd); ev.Read = {};
+            }
+            if (ch.Type & TEvent::WRITE) {
+                Clear(WriteInterest_, fd); ev.Write = {};
+            }
+            if (!ev.Read && !ev.Write) {
+                InEvents_.Release(fd);
+            }
+        }
     }
-#endif
 
-    for (const auto& ch : Changes_) {
+    Reset();
+
+    // pass only the words up to the highest descriptor of interest
+    size_t words = ReadInterest_.size();
+    while (words > 0 && !ReadInterest_[words-1] && !WriteInterest_[words-1]) {
+        words--;
+    }
+    int nfds = 0;
+    if (words > 0) {
+        auto top = static_cast<TWord>(ReadInterest_[words-1] | WriteInterest_[words-1]);
+        nfds = (words-1)*Bits + std::bit_width(top);
+    }
+    std::copy_n(ReadInterest_.begin(), words, ReadFds_.begin());
+    std::copy_n(WriteInterest_.begin(), words, WriteFds_.begin());
+
+    auto pollStart = StatsStart();
+    int ret = pselect(nfds, ReadFds(), WriteFds(), nullptr, &ts, nullptr);
+    RecordPoll(pollStart);
+    if (ret < 0) {
+        throw std::system_error(errno, std::generic_category(), "select");
+    }
+
+    for (size_t i = 0; i < words; i++) {
+        for (auto w = static_cast<TWord>(WriteFds_[i]); w; w &= w - 1) {
+            Ready(i*Bits + std::countr_zero(w), TEvent::WRITE);
+        }
+        for (auto w = static_cast<TWord>(ReadFds_[i]); w; w &= w - 1) {
+            Ready(i*Bits + std::countr_zero(w), TEvent::READ);
+        }
+    }
+#else
+    FD_SET(Wakeup_.Fd(), &ReadInterest_);
+
+    for (auto& ch : Changes_) {
         int fd = ch.Fd;
-        auto& ev = InEvents_[fd];
+        auto* state = Registration(InEvents_, ch);
+        if (!state) {
+            continue;
+        }
+        auto& ev = *state;
+        if ((ch.Type & TEvent::CANCEL) && !ResolveCancel(ch, ev)) {
+            continue;
+        }
         if (ch.Handle) {
             if (ch.Type & TEvent::READ) {
-                FD_SET(fd, ReadFds()); ev.Read = ch.Handle;
+                FD_SET(fd, &ReadInterest_); ev.Read = ch.Handle;
             }
             if (ch.Type & TEvent::WRITE) {
-                FD_SET(fd, WriteFds()); ev.Write = ch.Handle;
+                FD_SET(fd, &WriteInterest_); ev.Write = ch.Handle;
             }
         } else {
             if (ch.Type & TEvent::READ) {
-                FD_CLR(fd, ReadFds()); ev.Read = {};
+                FD_CLR(fd, &ReadInterest_); ev.Read = {};
             }
             if (ch.Type & TEvent::WRITE) {
-                FD_CLR(fd, WriteFds()); ev.Write = {};
+                FD_CLR(fd, &WriteInterest_); ev.Write = {};
+            }
+            if (!ev.Read && !ev.Write) {
+                InEvents_.Release(fd);
             }
         }
     }
 
     Reset();
 
-#ifdef _WIN32
+    ReadFds_ = ReadInterest_;
+    WriteFds_ = WriteInterest_;
+
     timeval tv;
     tv.tv_sec = ts.tv_sec;
     tv.tv_usec = ts.tv_nsec / 1000;
-    if (select(InEvents_.size(), ReadFds(), WriteFds(), nullptr, &tv) < 0) {
-#else
-    if (pselect(InEvents_.size(), ReadFds(), WriteFds(), nullptr, &ts, nullptr) < 0) {
-#endif
+    auto pollStart = StatsStart();
+    int ret = select(0, ReadFds(), WriteFds(), nullptr, &tv); // nfds is ignored by Winsock
+    RecordPoll(pollStart);
+    if (ret < 0) {
         throw std::system_error(errno, std::generic_category(), "select");
     }
 
-    for (int k=0; k < static_cast<int>(InEvents_.size()); ++k) {
-        auto ev = InEvents_[k];
-
-        if (FD_ISSET(k, WriteFds())) {
-            assert(ev.Write);
-            ReadyEvents_.emplace_back(TEvent{k, TEvent::WRITE, ev.Write});
-        } else if (ev.Write) {
-            // fd was cleared by select, set it
-            FD_SET(k, WriteFds());
-        }
-        if (FD_ISSET(k, ReadFds())) {
-            assert(ev.Read);
-            ReadyEvents_.emplace_back(TEvent{k, TEvent::READ, ev.Read});
-        } else if (ev.Read) {
-            // fd was cleared by select, set it
-            FD_SET(k, ReadFds());
+    // Winsock returns the ready sockets as a list instead of a bitmap
+    for (u_int i = 0; i < WriteFds_.fd_count; i++) {
+        Ready(static_cast<int>(WriteFds_.fd_array[i]), TEvent::WRITE);
+    }
+    for (u_int i = 0; i < ReadFds_.fd_count; i++) {
+        if (static_cast<int>(ReadFds_.fd_array[i]) != DummySocket_.Fd()) {
+            Ready(static_cast<int>(ReadFds_.fd_array[i]), TEvent::READ);
         }
     }
+#endif
 
+    ProcessPosted();
     ProcessTimers();
 }
 
+void TSelect::Ready(int fd, int type) {
+    if (fd == Wakeup_.Fd()) {
+        Wakeup_.Drain();
+        return;
+    }
+    auto& ev = InEvents_[fd];
+    if (type == TEvent::WRITE) {
+        assert(ev.Write);
+        ReadyEvents_.emplace_back(TEvent{fd, TEvent::WRITE, ev.Write});
+    } else {
+        assert(ev.Read);
+        ReadyEvents_.emplace_back(TEvent{fd, TEvent::READ, ev.Read});
+    }
+}
+
 } // namespace NNet
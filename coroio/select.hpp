@@ -7,9 +7,12 @@
 #endif
 #include <assert.h>
 #include <system_error>
+#include <type_traits>
 
+#include "fdtable.hpp"
 #include "poller.hpp"
 #include "socket.hpp"
+#include "wakeup.hpp"
 
 namespace NNet {
 
@@ -22,6 +25,12 @@ namespace NNet {
  * equivalent containers on non‑Windows systems) and provides helper functions for
  * obtaining pointers to the read and write fd_sets.
  *
+ * The descriptors being waited for are kept in persistent interest sets that are copied
+ * into the sets passed to select(), so an idle descriptor costs nothing per iteration.
+ * On Unix-like systems only the words up to the highest descriptor of interest are passed
+ * and the results are scanned a word at a time, skipping empty words and jumping to the set
+ * bits with count-trailing-zeros; on Windows the kernel returns the ready sockets as a list.
+ *
  * On Windows, a dummy socket is maintained to handle timeouts correctly.
  *
  * The class also defines convenient type aliases:
@@ -39,6 +48,8 @@ public:
     using TSocket = NNet::TSocket;
     /// Alias for the file handle type.
     using TFileHandle = NNet::TFileHandle;
+    /// Alias for the datagram socket type.
+    using TDatagramSocket = NNet::TDatagramSocket;
     /**
      * @brief Polls for I/O events using the select() system call.
      *
@@ -47,16 +58,31 @@ public:
      */
     void Poll();
 
-#ifdef _WIN32
     /**
-     * @brief Default constructor for Windows.
+     * @brief Default constructor.
      *
-     * On Windows, additional initialization is performed, such as preparing the dummy socket.
+     * Prepares the wakeup descriptor used by @ref Post(); on Windows additional
+     * initialization is performed, such as preparing the dummy socket.
      */
     TSelect();
-#endif
 
 private:
+#ifndef _WIN32
+    using TWord = std::make_unsigned_t<fd_mask>;
+    static constexpr int Bits = sizeof(fd_mask) * 8;
+
+    static void Set(std::vector<fd_mask>& set, int fd) {
+        set[fd / Bits] |= static_cast<fd_mask>(TWord{1} << (fd % Bits));
+    }
+
+    static void Clear(std::vector<fd_mask>& set, int fd) {
+        set[fd / Bits] &= ~static_cast<fd_mask>(TWord{1} << (fd % Bits));
+    }
+#endif
+
+    /// Queues the waiter of @p fd for @p type, or drains the wakeup descriptor.
+    void Ready(int fd, int type);
+
     /**
      * @brief Returns a pointer to the read fd_set.
      *
@@ -89,14 +115,19 @@ private:
 #endif
     }
 
-    std::vector<THandlePair> InEvents_; ///< Internal container for incoming event pairs.
+    TFdTable<THandlePair> InEvents_; ///< Internal container for incoming event pairs.
+    TWakeupFd Wakeup_; ///< Interrupts select() on Post().
 #ifdef _WIN32
     fd_set ReadFds_; ///< Native fd_set for reading on Windows.
     fd_set WriteFds_; ///< Native fd_set for wrinting on Windows.
+    fd_set ReadInterest_; ///< Sockets waited for reading.
+    fd_set WriteInterest_; ///< Sockets waited for writing.
     TSocket DummySocket_; ///< Dummy socket used for handling timeouts on Windows.
 #else
     std::vector<fd_mask> ReadFds_; ///< Underlying buffer for read fd_set on Unix-like systems.
     std::vector<fd_mask> WriteFds_; ///< Underlying buffer for write fd_set on Unix-like systems.
+    std::vector<fd_mask> ReadInterest_; ///< Descriptors waited for reading.
+    std::vector<fd_mask> WriteInterest_; ///< Descriptors waited for writing.
 #endif
 };
 
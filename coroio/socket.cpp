@@ -1,6 +1,13 @@
 // © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
 #include "socket.hpp"
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+#include <sys/uio.h>
+#endif
+
 namespace NNet {
 
 TSocketBase<void>::TSocketBase(TPollerBase& poller, int domain, int type)
@@ -76,12 +83,15 @@ TSocket& TSocket::operator=(TSocket&& other) {
         RemoteAddr_ = other.RemoteAddr_;
         LocalAddr_ = other.LocalAddr_;
         Fd_ = other.Fd_;
+        ZeroCopyThreshold_ = other.ZeroCopyThreshold_;
+        ZeroCopySent_ = other.ZeroCopySent_;
+        ZeroCopyDone_ = other.ZeroCopyDone_;
         other.Fd_ = -1;
     }
     return *this;
 }
 
-void TSocket::Bind(const TAddress& addr) {
+void TSocket::Bind(const TAddress& addr, bool reusePort) {
     if (LocalAddr_.has_value()) {
         throw std::runtime_error("Already bound");
     }
@@ -92,6 +102,19 @@ void TSocket::Bind(const TAddress& addr) {
     if (setsockopt(Fd_, SOL_SOCKET, SO_REUSEADDR, (char*) &optval, optlen) < 0) {
         throw std::system_error(errno, std::generic_category(), "setsockopt");
     }
+    if (reusePort) {
+#if defined(SO_REUSEPORT_LB)
+        if (setsockopt(Fd_, SOL_SOCKET, SO_REUSEPORT_LB, (char*) &optval, optlen) < 0) {
+            throw std::system_error(errno, std::generic_category(), "setsockopt");
+        }
+#elif defined(SO_REUSEPORT)
+        if (setsockopt(Fd_, SOL_SOCKET, SO_REUSEPORT, (char*) &optval, optlen) < 0) {
+            throw std::system_error(errno, std::generic_category(), "setsockopt");
+        }
+#else
+        throw std::runtime_error("SO_REUSEPORT is not supported");
+#endif
+    }
     if (bind(Fd_, rawaddr, len) < 0) {
         throw std::system_error(errno, std::generic_category(), "bind");
     }
@@ -115,6 +138,332 @@ int TSocket::Fd() const {
     return Fd_;
 }
 
+TFuture<TSocket> TSocket::Accept() {
+    struct TAwaitable {
+        bool await_ready() const { return false; }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            poller->AddRead(fd, h);
+            wait.Arm(poller, fd, TEvent::READ, h);
+        }
+
+        void await_resume() {
+            wait.Disarm();
+        }
+
+        TPollerBase* poller;
+        int fd;
+        TEventWait wait = {};
+    };
+
+    while (true) {
+        char clientaddr[sizeof(sockaddr_in6)];
+        socklen_t len = static_cast<socklen_t>(sizeof(sockaddr_in6));
+        int clientfd = accept(Fd_, reinterpret_cast<sockaddr*>(&clientaddr[0]), &len);
+        if (clientfd >= 0) {
+            co_return TSocket{TAddress{reinterpret_cast<sockaddr*>(&clientaddr[0]), len}, clientfd, *Poller_};
+        }
+#ifdef _WIN32
+        if (WSAGetLastError() != WSAEWOULDBLOCK) {
+            throw std::system_error(WSAGetLastError(), std::generic_category(), "accept");
+        }
+#else
+        if (!(errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+            throw std::system_error(errno, std::generic_category(), "accept");
+        }
+#endif
+        co_await TAwaitable{Poller_, Fd_};
+    }
+}
+
+bool TSocket::SetZeroCopy(size_t threshold) {
+    if (threshold == 0) {
+        ZeroCopyThreshold_ = 0;
+        return true;
+    }
+#if defined(__linux__) && defined(SO_ZEROCOPY)
+    int value = 1;
+    if (!Poller_->ReportsErrors() || setsockopt(Fd_, SOL_SOCKET, SO_ZEROCOPY, &value, sizeof(value)) < 0) {
+        return false;
+    }
+    ZeroCopyThreshold_ = threshold;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TSocket::SetIncomingCpu(int cpu) {
+#if defined(__linux__) && defined(SO_INCOMING_CPU)
+    return setsockopt(Fd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+int TSocket::IncomingCpu() const {
+#if defined(__linux__) && defined(SO_INCOMING_CPU)
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(Fd_, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) < 0) {
+        return -1;
+    }
+    return cpu;
+#else
+    return -1;
+#endif
+}
+
+TFuture<int> TSocket::WriteZeroCopy(const void* buf, size_t size) {
+#if defined(__linux__) && defined(SO_ZEROCOPY)
+    struct TAwaitable {
+        bool await_ready() const { return false; }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            if (error) {
+                poller->AddError(fd, h);
+            } else {
+                poller->AddWrite(fd, h);
+            }
+            wait.Arm(poller, fd, error ? TEvent::ERR : TEvent::WRITE, h);
+        }
+
+        void await_resume() {
+            wait.Disarm();
+        }
+
+        TPollerBase* poller;
+        int fd;
+        bool error;
+        TEventWait wait = {};
+    };
+
+    ssize_t ret;
+    while ((ret = ::send(Fd_, buf, size, MSG_ZEROCOPY)) < 0) {
+        if (errno == ENOBUFS) {
+            // optmem_max is exhausted by pinned pages, copy this time
+            co_return co_await TSocketBase::WriteSome(buf, size);
+        }
+        if (!(errno == EINTR || errno == EAGAIN)) {
+            throw std::system_error(errno, std::generic_category(), "send");
+        }
+        co_await TAwaitable{Poller_, Fd_, false};
+    }
+    uint32_t id = ZeroCopySent_++;
+    while (!ReapZeroCopy(id)) {
+        co_await TAwaitable{Poller_, Fd_, true};
+    }
+    co_return ret;
+#else
+    co_return co_await TSocketBase::WriteSome(buf, size);
+#endif
+}
+
+bool TSocket::ReapZeroCopy(uint32_t id) {
+#if defined(__linux__) && defined(SO_ZEROCOPY)
+    char control[128];
+    while (true) {
+        msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(Fd_, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                break;
+            }
+            throw std::system_error(errno, std::generic_category(), "recvmsg");
+        }
+        for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+            {
+                continue;
+            }
+            sock_extended_err err;
+            memcpy(&err, CMSG_DATA(cm), sizeof(err));
+            // a notification covers the sends [ee_info, ee_data], TCP reports them in order
+            if (err.ee_origin == SO_EE_ORIGIN_ZEROCOPY && err.ee_errno == 0
+                && static_cast<int32_t>(err.ee_data + 1 - ZeroCopyDone_) > 0)
+            {
+                ZeroCopyDone_ = err.ee_data + 1;
+            }
+        }
+    }
+    if (static_cast<int32_t>(ZeroCopyDone_ - id) > 0) {
+        return true;
+    }
+    // EPOLLERR without a notification: the connection failed
+    int error = 0;
+    socklen_t len = sizeof(error);
+    if (getsockopt(Fd_, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error != 0) {
+        throw std::system_error(error, std::generic_category(), "send");
+    }
+    return false;
+#else
+    (void)id;
+    return true;
+#endif
+}
+
+int TFileOps::pread(int fd, void* buf, size_t count, int64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return ::_read(fd, buf, static_cast<unsigned>(count));
+#else
+    return ::pread(fd, buf, count, offset);
+#endif
+}
+
+int TFileOps::pwrite(int fd, const void* buf, size_t count, int64_t offset) {
+#ifdef _WIN32
+    if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    return ::_write(fd, buf, static_cast<unsigned>(count));
+#else
+    return ::pwrite(fd, buf, count, offset);
+#endif
+}
+
+int TFileOps::preadv(int fd, const iovec* iov, int count, int64_t offset) {
+#ifdef _WIN32
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        int ret = pread(fd, iov[i].iov_base, iov[i].iov_len, offset + total);
+        if (ret < 0) {
+            return total ? total : ret;
+        }
+        total += ret;
+        if (ret < (int)iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+#else
+    return ::preadv(fd, iov, count, offset);
+#endif
+}
+
+int TFileOps::pwritev(int fd, const iovec* iov, int count, int64_t offset) {
+#ifdef _WIN32
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        int ret = pwrite(fd, iov[i].iov_base, iov[i].iov_len, offset + total);
+        if (ret < 0) {
+            return total ? total : ret;
+        }
+        total += ret;
+        if (ret < (int)iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+#else
+    return ::pwritev(fd, iov, count, offset);
+#endif
+}
+
+int TFileOps::fsync(int fd, bool dataOnly) {
+#if defined(_WIN32)
+    (void)dataOnly;
+    return ::_commit(fd);
+#elif defined(__APPLE__)
+    (void)dataOnly;
+    return ::fsync(fd);
+#else
+    return dataOnly ? ::fdatasync(fd) : ::fsync(fd);
+#endif
+}
+
+int TSocket::SendFileSome(int fd, int file, int64_t offset, size_t size) {
+#if defined(__linux__)
+    off_t off = offset;
+    return ::sendfile(fd, file, &off, size);
+#elif defined(__APPLE__) || defined(__FreeBSD__)
+    off_t sent = 0;
+#ifdef __APPLE__
+    sent = size;
+    int ret = ::sendfile(file, fd, offset, &sent, nullptr, 0);
+#else
+    int ret = ::sendfile(file, fd, offset, size, nullptr, &sent, 0);
+#endif
+    // a send interrupted by a full socket buffer fails with EAGAIN but reports progress
+    if (ret < 0 && !(sent > 0 && (errno == EAGAIN || errno == EINTR))) {
+        return -1;
+    }
+    return static_cast<int>(sent);
+#else
+    char buf[16384];
+    int n = TFileOps::pread(file, buf, std::min(size, sizeof(buf)), offset);
+    if (n <= 0) {
+        return n;
+    }
+    // bytes the socket does not take now are read again by the next call
+    return TSockOps::write(fd, buf, n);
+#endif
+}
+
+#ifdef _WIN32
+int TSockOps::readv(int fd, const iovec* iov, int count) {
+    std::vector<WSABUF> bufs(count);
+    for (int i = 0; i < count; i++) {
+        bufs[i] = WSABUF{(ULONG)iov[i].iov_len, (char*)iov[i].iov_base};
+    }
+    DWORD size = 0, flags = 0;
+    if (WSARecv((SOCKET)fd, bufs.data(), count, &size, &flags, nullptr, nullptr) != 0) {
+        return -1;
+    }
+    return size;
+}
+
+int TSockOps::writev(int fd, const iovec* iov, int count) {
+    std::vector<WSABUF> bufs(count);
+    for (int i = 0; i < count; i++) {
+        bufs[i] = WSABUF{(ULONG)iov[i].iov_len, (char*)iov[i].iov_base};
+    }
+    DWORD size = 0;
+    if (WSASend((SOCKET)fd, bufs.data(), count, &size, 0, nullptr, nullptr) != 0) {
+        return -1;
+    }
+    return size;
+}
+
+int TFileOps::readv(int fd, const iovec* iov, int count) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        int ret = ::read(fd, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return total ? total : ret;
+        }
+        total += ret;
+        if (ret < (int)iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+
+int TFileOps::writev(int fd, const iovec* iov, int count) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        int ret = ::write(fd, iov[i].iov_base, iov[i].iov_len);
+        if (ret < 0) {
+            return total ? total : ret;
+        }
+        total += ret;
+        if (ret < (int)iov[i].iov_len) {
+            break;
+        }
+    }
+    return total;
+}
+#endif
+
 TFileHandle::TFileHandle(TFileHandle&& other)
 {
     *this = std::move(other);
@@ -130,4 +479,19 @@ TFileHandle& TFileHandle::operator=(TFileHandle&& other) {
     return *this;
 }
 
+bool TFileHandle::SetDirect(bool enable) {
+#if defined(__linux__)
+    int flags = fcntl(Fd_, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    flags = enable ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(Fd_, F_SETFL, flags) == 0;
+#elif defined(__APPLE__)
+    return fcntl(Fd_, F_NOCACHE, enable ? 1 : 0) == 0;
+#else
+    return !enable;
+#endif
+}
+
 } // namespace NNet {
@@ -1,10 +1,52 @@
 // © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
 #include <string.h>
 #include <assert.h>
+#include <cstdlib>
+#include <new>
 #include "sockutils.hpp"
+#include "utils.hpp"
+
+#ifndef _WIN32
+#include <netinet/tcp.h>
+#else
+#include <malloc.h> // for _aligned_malloc
+#endif
 
 namespace NNet {
 
+namespace {
+
+// the first `scanned` bytes of the ring were searched by a previous call and hold no '\n'
+TLine PopLine(std::string_view view, size_t& rpos, size_t& size, size_t& scanned) {
+    auto end = view.substr(rpos, size);
+    auto begin = view.substr(0, size - end.size());
+
+    if (scanned < end.size()) {
+        if (auto* p = NUtils::FindByte(end.data() + scanned, end.size() - scanned, '\n')) {
+            size_t len = p - end.data() + 1;
+            rpos += len;
+            size -= len;
+            scanned = 0;
+            return TLine { end.substr(0, len), {} };
+        }
+    }
+
+    size_t from = std::max(scanned, end.size()) - end.size();
+    auto* p = NUtils::FindByte(begin.data() + from, begin.size() - from, '\n');
+    if (!p) {
+        scanned = size;
+        return {};
+    }
+
+    size_t len = p - begin.data() + 1;
+    rpos = len;
+    size -= end.size() + len;
+    scanned = 0;
+    return TLine { end, begin.substr(0, len) };
+}
+
+} // namespace
+
 TLineSplitter::TLineSplitter(int maxLen)
     : WPos(0)
     , RPos(0)
@@ -15,24 +57,7 @@ TLineSplitter::TLineSplitter(int maxLen)
 { }
 
 TLine TLineSplitter::Pop() {
-    auto end = View.substr(RPos, Size);
-    auto begin = View.substr(0, Size - end.size());
-
-    auto p1 = end.find('\n');
-    if (p1 == std::string_view::npos) {
-        auto p2 = begin.find('\n');
-        if (p2 == std::string_view::npos) {
-            return {};
-        }
-
-        RPos = p2 + 1;
-        Size -= end.size() + p2 + 1;
-        return TLine { end, begin.substr(0, p2 + 1) };
-    } else {
-        RPos += p1 + 1;
-        Size -= p1 + 1;
-        return TLine { end.substr(0, p1 + 1), {} };
-    }
+    return PopLine(View, RPos, Size, Scanned);
 }
 
 void TLineSplitter::Push(const char* buf, size_t size) {
@@ -52,29 +77,10 @@ TZeroCopyLineSplitter::TZeroCopyLineSplitter(int maxLen)
     , RPos(0)
     , Size(0)
     , Cap(maxLen * 2)
-    , Data(Cap, 0)
-    , View(Data)
 { }
 
 TLine TZeroCopyLineSplitter::Pop() {
-    auto end = View.substr(RPos, Size);
-    auto begin = View.substr(0, Size - end.size());
-
-    auto p1 = end.find('\n');
-    if (p1 == std::string_view::npos) {
-        auto p2 = begin.find('\n');
-        if (p2 == std::string_view::npos) {
-            return {};
-        }
-
-        RPos = p2 + 1;
-        Size -= end.size() + p2 + 1;
-        return TLine { end, begin.substr(0, p2 + 1) };
-    } else {
-        RPos += p1 + 1;
-        Size -= p1 + 1;
-        return TLine { end.substr(0, p1 + 1), {} };
-    }
+    return PopLine(View, RPos, Size, Scanned);
 }
 
 std::span<char> TZeroCopyLineSplitter::Acquire(size_t size) {
@@ -82,6 +88,10 @@ std::span<char> TZeroCopyLineSplitter::Acquire(size_t size) {
     if (size == 0) {
         throw std::runtime_error("Overflow");
     }
+    if (Data.empty()) {
+        Data = NUtils::AcquireBuffer(Cap);
+        View = {Data.data(), Data.size()};
+    }
     auto first = std::min(size, Cap - WPos);
     if (first) {
         return {&Data[WPos], first};
@@ -95,6 +105,15 @@ void TZeroCopyLineSplitter::Commit(size_t size) {
     Size += size;
 }
 
+void TZeroCopyLineSplitter::Release() {
+    if (Size != 0 || Data.empty()) {
+        return;
+    }
+    NUtils::ReleaseBuffer(std::move(Data));
+    View = {};
+    WPos = RPos = Scanned = 0;
+}
+
 void TZeroCopyLineSplitter::Push(const char* p, size_t len) {
     while (len != 0) {
         auto buf = Acquire(len);
@@ -105,4 +124,42 @@ void TZeroCopyLineSplitter::Push(const char* p, size_t len) {
     }
 }
 
+namespace NDetail {
+
+bool SetTcpCork(int fd, bool enable) {
+    int value = enable;
+#if defined(TCP_CORK)
+    return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0;
+#elif defined(TCP_NOPUSH)
+    return setsockopt(fd, IPPROTO_TCP, TCP_NOPUSH, &value, sizeof(value)) == 0;
+#else
+    (void)fd;
+    (void)value;
+    return false;
+#endif
+}
+
+} // namespace NDetail
+
+TAlignedBuffer::TAlignedBuffer(size_t size, size_t alignment)
+    : Size_((std::max<size_t>(size, 1) + alignment - 1) & ~(alignment - 1))
+{
+#ifdef _WIN32
+    Data_.reset(static_cast<char*>(_aligned_malloc(Size_, alignment)));
+#else
+    Data_.reset(static_cast<char*>(std::aligned_alloc(alignment, Size_)));
+#endif
+    if (!Data_) {
+        throw std::bad_alloc();
+    }
+}
+
+void TAlignedBuffer::TFree::operator()(char* p) const {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+}
+
 } // namespace NNet
@@ -3,7 +3,15 @@
 #include <assert.h>
 #include <span>
 #include <algorithm>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+#include "chain.hpp"
 #include "corochain.hpp"
+#include "socket.hpp"
 
 #ifdef min
 #undef min
@@ -89,13 +97,9 @@ struct TByteReader {
     TFuture<void> Read(void* data, size_t size) {
         char* p = static_cast<char*>(data);
 
-        if (!Buffer.empty()) {
-            size_t toCopy = std::min(size, Buffer.size());
-            std::memcpy(p, Buffer.data(), toCopy);
-            p += toCopy;
-            size -= toCopy;
-            Buffer.erase(0, toCopy);
-        }
+        size_t buffered = Buffer.Read(p, size);
+        p += buffered;
+        size -= buffered;
 
         while (size != 0) {
             auto readSize = co_await Socket.ReadSome(p, size);
@@ -113,10 +117,10 @@ struct TByteReader {
     /**
      * @brief Reads data until the given @p delimiter is encountered.
      *
-     * - Searches the internal buffer for the delimiter.
-     * - If found, returns all data up to and including the delimiter.
-     * - If not found, appends the buffered data to the result and tries reading
-     *   more data from the socket, repeating until the delimiter appears.
+     * - Receives into the internal @ref TChainBuffer and searches only the bytes
+     *   not examined yet, so the cost is linear in the length of the result.
+     * - Returns all data up to and including the delimiter; the bytes received
+     *   after it stay buffered for the next call.
      * - Throws a std::runtime_error if the socket is closed (ReadSome returns 0)
      *   before the delimiter is found.
      * - If ReadSome returns a negative value, the read is retried.
@@ -129,38 +133,83 @@ struct TByteReader {
      */
     TFuture<std::string> ReadUntil(const std::string& delimiter)
     {
-        std::string result;
-        char tempBuffer[1024];
+        size_t end = co_await FillUntil(delimiter);
+        std::string result(end, '\0');
+        Buffer.Read(result.data(), end);
+        co_return result;
+    }
+    /**
+     * @brief Same as @ref ReadUntil(const std::string&), but allocates the result from
+     *        @p resource, e.g. the @ref TArena of the request.
+     */
+    TFuture<std::pmr::string> ReadUntil(const std::string& delimiter, std::pmr::memory_resource* resource)
+    {
+        size_t end = co_await FillUntil(delimiter);
+        std::pmr::string result(end, '\0', resource);
+        Buffer.Read(result.data(), end);
+        co_return result;
+    }
+    /**
+     * @brief Same as @ref ReadUntil(const std::string&), but hands the bytes over to
+     *        @p out without copying them.
+     *
+     * The slabs holding the result are appended to @p out, e.g. to forward a request
+     * head with @ref TByteWriter::Write(TChainBuffer&).
+     *
+     * @return A TFuture yielding the number of bytes appended, the delimiter included.
+     */
+    TFuture<size_t> ReadUntil(const std::string& delimiter, TChainBuffer& out)
+    {
+        size_t end = co_await FillUntil(delimiter);
+        out.Append(Buffer.Cut(end));
+        co_return end;
+    }
+    /**
+     * @brief Lets an idle connection wait without a receive buffer.
+     *
+     * When @ref ReadUntil() has to wait and nothing is buffered, the slab and the segment
+     * list go back to the per-thread pool and the reader waits with the socket's
+     * @c WaitReadable(); the slab is taken again once data arrives. This costs one more
+     * poller wakeup per wait, so it pays off for connections that are idle most of the time,
+     * e.g. long polling. Sockets without @c WaitReadable() read as usual.
+     */
+    void SetHibernation(bool enable = true) {
+        Hibernation = enable;
+    }
 
+private:
+    /// Receives until the buffer holds @p delimiter; returns the offset just past it.
+    TFuture<size_t> FillUntil(const std::string& delimiter) {
+        size_t from = 0;
         while (true) {
-            auto pos = std::search(Buffer.begin(), Buffer.end(), delimiter.begin(), delimiter.end());
-            if (pos != Buffer.end()) {
-                size_t delimiterOffset = std::distance(Buffer.begin(), pos);
-                result.append(Buffer.substr(0, delimiterOffset + delimiter.size()));
-                Buffer.erase(0, delimiterOffset + delimiter.size());
-                co_return result;
+            auto pos = Buffer.Find(delimiter, from);
+            if (pos != TChainBuffer::npos) {
+                co_return pos + delimiter.size();
             }
+            // a match may start within the last delimiter.size()-1 bytes
+            from = Buffer.Size() >= delimiter.size() ? Buffer.Size() - delimiter.size() + 1 : 0;
 
-            result.append(Buffer);
-            Buffer.clear();
-
-            auto readSize = co_await Socket.ReadSome(tempBuffer, sizeof(tempBuffer));
+            if constexpr (requires { Socket.WaitReadable(); }) {
+                if (Hibernation && Buffer.Empty()) {
+                    Buffer.ShrinkToFit();
+                    co_await Socket.WaitReadable();
+                }
+            }
+            auto free = Buffer.Writable();
+            auto readSize = co_await Socket.ReadSome(free.data(), free.size());
             if (readSize == 0) {
                 throw std::runtime_error("Connection closed");
             }
             if (readSize < 0) {
                 continue; // retry
             }
-
-            Buffer.append(tempBuffer, readSize);
+            Buffer.Commit(readSize);
         }
-
-        co_return result;
     }
 
-private:
     TSocket& Socket;
-    std::string Buffer;
+    TChainBuffer Buffer;
+    bool Hibernation = false;
 };
 
 /**
@@ -235,10 +284,9 @@ struct TByteWriter {
         co_return;
     }
     /**
-     * @brief Writes a @c TLine object by sequentially writing its parts.
+     * @brief Writes a @c TLine object, both parts at once.
      *
-     * This method calls @ref Write(const void*, size_t) for @c line.Part1
-     * and then @c line.Part2.
+     * This method calls @ref WriteAll() for @c line.Part1 and @c line.Part2.
      *
      * @param line A structure holding the data to write in two parts.
      *
@@ -247,13 +295,253 @@ struct TByteWriter {
      * @throws std::runtime_error If the connection is closed while writing.
      */
     TFuture<void> Write(const TLine& line) {
-        co_await Write(line.Part1.data(), line.Part1.size());
-        co_await Write(line.Part2.data(), line.Part2.size());
+        iovec parts[2] = {
+            {const_cast<char*>(line.Part1.data()), line.Part1.size()},
+            {const_cast<char*>(line.Part2.data()), line.Part2.size()}
+        };
+        co_await WriteAll(parts);
         co_return;
     }
+    /**
+     * @brief Writes and consumes all bytes of @p chain.
+     *
+     * The slabs are sent straight from the chain, with one WriteSomeV() call per
+     * batch of slabs if the socket provides it.
+     *
+     * @throws std::runtime_error If the connection is closed before all bytes are written.
+     */
+    TFuture<void> Write(TChainBuffer& chain) {
+        iovec iov[16];
+        while (!chain.Empty()) {
+            int count = chain.Iov(iov, std::size(iov));
+            ssize_t writeSize;
+            if constexpr (requires(const iovec* v) { Socket.WriteSomeV(v, 1); }) {
+                writeSize = co_await Socket.WriteSomeV(iov, count);
+            } else {
+                writeSize = co_await Socket.WriteSome(iov[0].iov_base, iov[0].iov_len);
+            }
+            if (writeSize == 0) {
+                throw std::runtime_error("Connection closed");
+            }
+            if (writeSize < 0) {
+                continue; // retry
+            }
+            chain.Consume(writeSize);
+        }
+        co_return;
+    }
+    /**
+     * @brief Writes all bytes of several buffers in order.
+     *
+     * - If the socket provides WriteSomeV(), the buffers go out in as few calls as
+     *   possible (usually one) without being copied together.
+     * - Otherwise each buffer is written with @ref Write(const void*, size_t).
+     *
+     * @param iov The buffers to write; only read before the first suspension.
+     *
+     * @return A TFuture<void> that completes when all bytes have been written.
+     *
+     * @throws std::runtime_error If the connection is closed before all bytes are written.
+     */
+    TFuture<void> WriteAll(std::span<const iovec> iov) {
+        if constexpr (requires(const iovec* v) { Socket.WriteSomeV(v, 1); }) {
+            // a copy, partially written buffers are advanced in place
+            iovec inlineBufs[8];
+            std::vector<iovec> heapBufs;
+            iovec* bufs = inlineBufs;
+            if (iov.size() > std::size(inlineBufs)) {
+                heapBufs.resize(iov.size());
+                bufs = heapBufs.data();
+            }
+            std::copy(iov.begin(), iov.end(), bufs);
+
+            size_t first = 0;
+            while (first < iov.size()) {
+                if (bufs[first].iov_len == 0) {
+                    first++;
+                    continue;
+                }
+                int count = static_cast<int>(std::min<size_t>(iov.size() - first, MaxIov));
+                auto writeSize = co_await Socket.WriteSomeV(bufs + first, count);
+                if (writeSize == 0) {
+                    throw std::runtime_error("Connection closed");
+                }
+                if (writeSize < 0) {
+                    continue; // retry
+                }
+                size_t written = writeSize;
+                while (first < iov.size() && written >= bufs[first].iov_len) {
+                    written -= bufs[first].iov_len;
+                    first++;
+                }
+                if (written) {
+                    bufs[first].iov_base = static_cast<char*>(bufs[first].iov_base) + written;
+                    bufs[first].iov_len -= written;
+                }
+            }
+        } else {
+            for (const auto& buf : iov) {
+                co_await Write(buf.iov_base, buf.iov_len);
+            }
+        }
+        co_return;
+    }
+    /**
+     * @brief Sends @p size bytes of a file starting at @p offset.
+     *
+     * Calls the socket's SendFile() in a loop, advancing past partial sends.
+     *
+     * @param fileFd Descriptor of a regular file, its position is not changed.
+     * @param offset Offset of the first byte to send.
+     * @param size   Number of bytes to send.
+     *
+     * @throws std::runtime_error If the file ends before @p size bytes are sent.
+     */
+    TFuture<void> SendFile(int fileFd, int64_t offset, size_t size) {
+        while (size != 0) {
+            auto sent = co_await Socket.SendFile(fileFd, offset, size);
+            if (sent == 0) {
+                throw std::runtime_error("Unexpected end of file");
+            }
+            if (sent < 0) {
+                continue; // retry
+            }
+            offset += sent;
+            size -= sent;
+        }
+        co_return;
+    }
+
+private:
+    static constexpr size_t MaxIov = 1024; ///< IOV_MAX on Linux and the BSDs.
+
+    TSocket& Socket;
+};
+
+namespace NDetail {
+
+/// Sets or clears TCP_CORK (TCP_NOPUSH on the BSDs); returns false if unsupported.
+bool SetTcpCork(int fd, bool enable);
+
+} // namespace NDetail
+
+/**
+ * @struct TBufferedWriterOptions
+ * @brief Settings of a @ref TBufferedWriter.
+ */
+struct TBufferedWriterOptions {
+    size_t Limit = 16384; ///< Buffered bytes that trigger a flush; larger writes bypass the buffer.
+    /**
+     * @brief Corks the TCP socket between flushes.
+     *
+     * TCP_CORK (TCP_NOPUSH on the BSDs) is set before the first write after a @ref
+     * TBufferedWriter::Flush() and cleared by the next one, so the full segments of the
+     * flushes triggered by @c Limit go out while the short tail waits for the explicit flush,
+     * as if the writes were sent with MSG_MORE.
+     */
+    bool Cork = false;
+};
+
+/**
+ * @class TBufferedWriter
+ * @brief Coalesces small writes to a socket-like object.
+ *
+ * @ref Write() appends to a @ref TChainBuffer in pooled slabs and sends nothing until
+ * @c Limit bytes are buffered, @ref Flush() is called, or data is read through the writer:
+ * @ref ReadSome() flushes first, so a request written field by field leaves in one
+ * vectored call just before the coroutine waits for the response. Pass the writer to
+ * @ref TByteReader or @ref TLineReader instead of the socket to get that behavior.
+ *
+ * Bytes still buffered when the writer is destroyed are dropped.
+ *
+ * Example:
+ * @code{.cpp}
+ * TBufferedWriter writer(socket);
+ * TByteReader reader(writer); // reads through the writer flush it
+ * for (const auto& request : batch) {
+ *     co_await writer.Write(request.Header.data(), request.Header.size());
+ *     co_await writer.Write(request.Body.data(), request.Body.size());
+ * }
+ * co_await reader.Read(response.data(), response.size());
+ * @endcode
+ *
+ * @tparam TSocket The socket type; it must provide @c WriteSome() and @c ReadSome().
+ */
+template<typename TSocket>
+class TBufferedWriter {
+public:
+    TBufferedWriter(TSocket& socket, TBufferedWriterOptions options = {})
+        : Socket(socket)
+        , Options(options)
+    { }
+
+    /**
+     * @brief Buffers @p size bytes, flushing if @c Limit is reached.
+     *
+     * A write of at least @c Limit bytes is sent directly after the buffered bytes.
+     */
+    TFuture<void> Write(const void* data, size_t size) {
+        Cork();
+        if (size >= Options.Limit) {
+            co_await FlushBuffer();
+            co_await TByteWriter(Socket).Write(data, size);
+            co_return;
+        }
+        Buffer.Append(data, size);
+        if (Buffer.Size() >= Options.Limit) {
+            co_await FlushBuffer();
+        }
+    }
+
+    /// Sends the buffered bytes and, if corked, pushes out the last partial segment.
+    TFuture<void> Flush() {
+        co_await FlushBuffer();
+        if constexpr (requires { Socket.Fd(); }) {
+            if (Corked) {
+                Corked = false;
+                NDetail::SetTcpCork(Socket.Fd(), false);
+            }
+        }
+    }
+
+    /// Same as @ref Write(), returns @p size; lets the writer stand for the socket.
+    TFuture<ssize_t> WriteSome(const void* data, size_t size) {
+        co_await Write(data, size);
+        co_return size;
+    }
+
+    /// Flushes the buffered bytes, then reads from the socket.
+    TFuture<ssize_t> ReadSome(void* data, size_t size) {
+        if (!Buffer.Empty() || Corked) {
+            co_await Flush();
+        }
+        co_return co_await Socket.ReadSome(data, size);
+    }
+
+    /// Returns the number of bytes waiting for a flush.
+    size_t Buffered() const {
+        return Buffer.Size();
+    }
 
 private:
+    void Cork() {
+        if constexpr (requires { Socket.Fd(); }) {
+            if (Options.Cork && !Corked) {
+                Corked = NDetail::SetTcpCork(Socket.Fd(), true);
+            }
+        }
+    }
+
+    TFuture<void> FlushBuffer() {
+        if (!Buffer.Empty()) {
+            co_await TByteWriter(Socket).Write(Buffer);
+        }
+    }
+
     TSocket& Socket;
+    TBufferedWriterOptions Options;
+    TChainBuffer Buffer;
+    bool Corked = false;
 };
 
 /**
@@ -422,6 +710,7 @@ private:
     size_t RPos;
     size_t Size;
     size_t Cap;
+    size_t Scanned = 0; ///< Bytes after RPos known to hold no line end.
     std::string Data;
     std::string_view View;
 };
@@ -537,13 +826,25 @@ public:
      * @param len Number of bytes to copy.
      */
     void Push(const char* p, size_t len);
+    /// Returns true if no bytes are buffered.
+    bool Empty() const {
+        return Size == 0;
+    }
+    /**
+     * @brief Returns the ring to the per-thread cache if no bytes are buffered.
+     *
+     * The ring is taken again by the next @ref Acquire(). It is also taken lazily
+     * by the first one, so an unused splitter holds no storage.
+     */
+    void Release();
 
 private:
     size_t WPos;
     size_t RPos;
     size_t Size;
     size_t Cap;
-    std::string Data;
+    size_t Scanned = 0; ///< Bytes after RPos known to hold no line end.
+    std::vector<char> Data;
     std::string_view View;
 };
 /**
@@ -612,6 +913,12 @@ struct TLineReader {
     TFuture<TLine> Read() {
         auto line = Splitter.Pop();
         while (!line) {
+            if constexpr (requires { Socket.WaitReadable(); }) {
+                if (Hibernation && Splitter.Empty()) {
+                    Splitter.Release();
+                    co_await Socket.WaitReadable();
+                }
+            }
             auto buf = Splitter.Acquire(ChunkSize);
             auto size = co_await Socket.ReadSome(buf.data(), buf.size());
             if (size < 0) {
@@ -625,11 +932,182 @@ struct TLineReader {
         }
         co_return line;
     }
+    /**
+     * @brief Lets an idle connection wait without its ring, see
+     *        @ref TByteReader::SetHibernation().
+     */
+    void SetHibernation(bool enable = true) {
+        Hibernation = enable;
+    }
 
 private:
     TSocket& Socket;
     TZeroCopyLineSplitter Splitter;
     int ChunkSize;
+    bool Hibernation = false;
+};
+
+/**
+ * @class TAlignedBuffer
+ * @brief A buffer whose address and size are multiples of an alignment, for direct I/O.
+ *
+ * Reads and writes of a file with @ref TFileHandle::SetDirect() enabled must use buffers,
+ * offsets and sizes aligned to the logical block size of the device. 4096 covers the
+ * devices in use today.
+ */
+class TAlignedBuffer {
+public:
+    static constexpr size_t DefaultAlignment = 4096;
+
+    TAlignedBuffer() = default;
+    /**
+     * @param size      Requested size, rounded up to a multiple of @p alignment.
+     * @param alignment A power of 2.
+     */
+    explicit TAlignedBuffer(size_t size, size_t alignment = DefaultAlignment);
+
+    char* Data() {
+        return Data_.get();
+    }
+
+    const char* Data() const {
+        return Data_.get();
+    }
+
+    size_t Size() const {
+        return Size_;
+    }
+
+private:
+    struct TFree {
+        void operator()(char* p) const;
+    };
+
+    std::unique_ptr<char, TFree> Data_;
+    size_t Size_ = 0;
+};
+
+/**
+ * @class TReadAhead
+ * @brief Reads a file sequentially with several reads in flight.
+ *
+ * The constructor issues @c depth reads of @c chunk bytes at consecutive offsets with
+ * @c ReadAt(); every chunk returned by @ref Next() issues the next one, so with a poller
+ * submitting file reads to the kernel (@ref TUring) the device always has @c depth
+ * requests queued while the caller processes the data. With the other pollers the reads
+ * are done in place and the pipeline costs nothing.
+ *
+ * The buffers are @ref TAlignedBuffer, so the reader works on a file with
+ * @ref TFileHandle::SetDirect() enabled as long as the start offset is aligned.
+ * The file must outlive the reader, which must not be moved.
+ *
+ * @tparam TFile A file handle type with @c ReadAt(offset, buf, size), e.g. @c TPoller::TFileHandle.
+ *
+ * ### Example Usage
+ * @code{.cpp}
+ * TReadAhead reader(file, 0);
+ * while (true) {
+ *     auto chunk = co_await reader.Next();
+ *     if (chunk.empty()) {
+ *         break;
+ *     }
+ *     co_await TByteWriter(socket).Write(chunk.data(), chunk.size());
+ * }
+ * @endcode
+ */
+template<typename TFile>
+class TReadAhead {
+public:
+    /**
+     * @param file   The file to read.
+     * @param offset Offset of the first byte.
+     * @param chunk  Size of a read, rounded up to a multiple of @ref TAlignedBuffer::DefaultAlignment.
+     * @param depth  Number of reads kept in flight.
+     */
+    TReadAhead(TFile& file, int64_t offset, size_t chunk = 65536, int depth = 4)
+        : File_(file)
+        , Offset_(offset)
+        , NextRead_(offset)
+        , Chunk_(TAlignedBuffer(chunk).Size())
+    {
+        for (int i = 0; i < std::max(depth, 1); i++) {
+            Issue();
+        }
+    }
+
+    TReadAhead(const TReadAhead&) = delete;
+    TReadAhead& operator=(const TReadAhead&) = delete;
+
+    /**
+     * @brief Returns the next chunk of the file.
+     *
+     * A read shorter than the chunk marks the end of the file: the reads issued behind it
+     * are drained and nothing more is read. Tail a growing file with a new reader at @ref Offset().
+     *
+     * @return The data, valid until the next call; empty at the end of the file.
+     * @throws std::system_error If a read fails.
+     */
+    TFuture<std::span<const char>> Next() {
+        if (Current_.Data()) {
+            Free_.emplace_back(std::move(Current_));
+        }
+        while (!Inflight_.empty()) {
+            auto chunk = std::move(Inflight_.front());
+            Inflight_.pop_front();
+            size_t size = co_await chunk.Read;
+            if (Eof_ || size == 0) {
+                Eof_ = true;
+                Free_.emplace_back(std::move(chunk.Buffer));
+                continue;
+            }
+            if (size < Chunk_) {
+                Eof_ = true;
+            } else {
+                Issue();
+            }
+            Offset_ += size;
+            Current_ = std::move(chunk.Buffer);
+            co_return std::span<const char>(Current_.Data(), size);
+        }
+        co_return std::span<const char>();
+    }
+
+    /// Returns the offset following the last chunk returned by @ref Next().
+    int64_t Offset() const {
+        return Offset_;
+    }
+
+private:
+    struct TChunk {
+        TAlignedBuffer Buffer;
+        TFuture<int> Read; ///< Destroyed first, which cancels the read before the buffer goes.
+    };
+
+    void Issue() {
+        TAlignedBuffer buffer;
+        if (Free_.empty()) {
+            buffer = TAlignedBuffer(Chunk_);
+        } else {
+            buffer = std::move(Free_.back());
+            Free_.pop_back();
+        }
+        char* data = buffer.Data();
+        Inflight_.emplace_back(TChunk{std::move(buffer), ReadChunk(NextRead_, data)});
+        NextRead_ += Chunk_;
+    }
+
+    TFuture<int> ReadChunk(int64_t offset, char* data) {
+        co_return co_await File_.ReadAt(offset, data, Chunk_);
+    }
+
+    TFile& File_;
+    int64_t Offset_;
+    int64_t NextRead_;
+    size_t Chunk_;
+    bool Eof_ = false;
+    std::deque<TChunk> Inflight_;
+    std::vector<TAlignedBuffer> Free_;
+    TAlignedBuffer Current_;
 };
 
 } // namespace NNet {
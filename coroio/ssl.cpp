@@ -1,13 +1,389 @@
 // © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
 #include "ssl.hpp"
+#include "utils.hpp"
 
 #ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define COROIO_KTLS
+#include <linux/tls.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 #include <assert.h>
 
 namespace NNet {
 
-TSslContext::TSslContext() {
+/**
+ * The callbacks below run inside SSL_do_handshake(), on the threads of a
+ * TSslHandshakeOffload pool or of several loops sharing the context, so
+ * everything here is accessed under Mutex.
+ */
+struct TSslContext::TSessionState {
+    std::mutex Mutex;
+    std::deque<TSslTicketKey> TicketKeys; ///< The current key is the first.
+    using TSessionList = std::list<std::pair<std::string, SSL_SESSION*>>;
+    TSessionList Sessions; ///< The most recently used first.
+    std::unordered_map<std::string, TSessionList::iterator> SessionIndex;
+    TSslSessionStats Stats;
+
+    ~TSessionState() {
+        for (auto& [_, session] : Sessions) {
+            SSL_SESSION_free(session);
+        }
+    }
+
+    /// Caches @p session under @p key, evicting the least recently used one when full.
+    void Store(const std::string& key, SSL_SESSION* session) {
+        auto [it, inserted] = SessionIndex.emplace(key, TSessionList::iterator{});
+        if (!inserted) {
+            SSL_SESSION_free(it->second->second);
+            it->second->second = session;
+            Sessions.splice(Sessions.begin(), Sessions, it->second);
+            return;
+        }
+        Sessions.emplace_front(key, session);
+        it->second = Sessions.begin();
+        if (Sessions.size() > TSslContext::MaxCachedSessions) {
+            SSL_SESSION_free(Sessions.back().second);
+            SessionIndex.erase(Sessions.back().first);
+            Sessions.pop_back();
+        }
+    }
+
+    /// Returns the session cached under @p key, nullptr if none, and marks it used.
+    SSL_SESSION* Find(const std::string& key) {
+        auto it = SessionIndex.find(key);
+        if (it == SessionIndex.end()) {
+            return nullptr;
+        }
+        Sessions.splice(Sessions.begin(), Sessions, it->second);
+        return it->second->second;
+    }
+};
+
+namespace {
+
+TSslContext::TSessionState* StateOf(SSL* ssl);
+
+void FreeSessionKey(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*) {
+    delete static_cast<std::string*>(ptr);
+}
+
+int SessionKeyIndex() {
+    static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, FreeSessionKey);
+    return index;
+}
+
+int NewSession(SSL* ssl, SSL_SESSION* session) {
+    auto* key = static_cast<std::string*>(SSL_get_ex_data(ssl, SessionKeyIndex()));
+    auto* state = StateOf(ssl);
+    if (!key || !state || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+    // a copy: OpenSSL marks the session of a connection freed without close_notify as not resumable
+    session = SSL_SESSION_dup(session);
+    if (!session) {
+        return 0;
+    }
+    std::lock_guard guard(state->Mutex);
+    state->Store(*key, session);
+    return 0;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+using TMacCtx = EVP_MAC_CTX;
+
+bool InitMac(TMacCtx* ctx, const TSslTicketKey& key) {
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, const_cast<unsigned char*>(key.HmacKey), sizeof(key.HmacKey)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("sha256"), 0),
+        OSSL_PARAM_construct_end()
+    };
+    return EVP_MAC_CTX_set_params(ctx, params) == 1;
+}
+#else
+using TMacCtx = HMAC_CTX;
+
+bool InitMac(TMacCtx* ctx, const TSslTicketKey& key) {
+    return HMAC_Init_ex(ctx, key.HmacKey, sizeof(key.HmacKey), EVP_sha256(), nullptr) == 1;
+}
+#endif
+
+int TicketKeyCallback(SSL* ssl, unsigned char* name, unsigned char* iv, EVP_CIPHER_CTX* cipher, TMacCtx* mac, int enc) {
+    auto* state = StateOf(ssl);
+    if (!state) {
+        return -1;
+    }
+    std::lock_guard guard(state->Mutex);
+    if (state->TicketKeys.empty()) {
+        return -1;
+    }
+    const auto& keys = state->TicketKeys;
+    auto key = keys.begin();
+    if (enc) {
+        memcpy(name, key->Name, sizeof(key->Name));
+        if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+            return -1;
+        }
+    } else {
+        key = std::find_if(keys.begin(), keys.end(), [&](const auto& k) {
+            return memcmp(name, k.Name, sizeof(k.Name)) == 0;
+        });
+        if (key == keys.end()) {
+            return 0; // unknown or expired key: full handshake
+        }
+    }
+    if (!InitMac(mac, *key) || EVP_CipherInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key->AesKey, iv, enc) != 1) {
+        return -1;
+    }
+    // a ticket of an older key is accepted and renewed
+    return (!enc && key != keys.begin()) ? 2 : 1;
+}
+
+TSslContext::TSessionState* StateOf(SSL* ssl) {
+    return static_cast<TSslContext::TSessionState*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+}
+
+std::string SessionKey(SSL* ssl, const TAddress& address) {
+    const char* host = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!host) {
+        return address.ToString();
+    }
+    auto [addr, len] = address.RawAddr();
+    int port = addr->sa_family == AF_INET
+        ? ntohs(reinterpret_cast<const sockaddr_in*>(addr)->sin_port)
+        : ntohs(reinterpret_cast<const sockaddr_in6*>(addr)->sin6_port);
+    return std::string(host) + ":" + std::to_string(port);
+}
+
+#ifdef COROIO_KTLS
+// Controls libssl sends to a BIO able to offload records to the kernel, private to
+// OpenSSL (listed in a comment of <openssl/bio.h>)
+constexpr int BioCtrlSetKtls = 72;
+constexpr int BioCtrlSetKtlsCtrlMsg = 74;
+constexpr int BioCtrlClearKtlsCtrlMsg = 75;
+
+int SendControlRecord(TSslBuffers* buffers, const char* data, int size) {
+    char control[CMSG_SPACE(sizeof(unsigned char))] = {};
+    iovec iov{const_cast<char*>(data), static_cast<size_t>(size)};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(cmsg) = static_cast<unsigned char>(buffers->ControlType);
+    return sendmsg(buffers->Fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+bool StartKtlsSend(TSslBuffers* buffers, void* info) {
+    socklen_t size;
+    switch (static_cast<tls_crypto_info*>(info)->cipher_type) {
+    case TLS_CIPHER_AES_GCM_128:
+        size = sizeof(tls12_crypto_info_aes_gcm_128);
+        break;
+    case TLS_CIPHER_AES_GCM_256:
+        size = sizeof(tls12_crypto_info_aes_gcm_256);
+        break;
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS_CIPHER_CHACHA20_POLY1305:
+        size = sizeof(tls12_crypto_info_chacha20_poly1305);
+        break;
+#endif
+    default:
+        return false;
+    }
+    // records already encrypted in userspace must leave before the kernel takes over
+    auto& out = buffers->Out;
+    while (!out.Empty()) {
+        auto block = out.Readable();
+        auto n = send(buffers->Fd, block.data(), block.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        out.Consume(n);
+    }
+    if (setsockopt(buffers->Fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0 && errno != EEXIST) {
+        return false;
+    }
+    return setsockopt(buffers->Fd, SOL_TLS, TLS_TX, info, size) == 0;
+}
+#endif
+
+int RingWrite(BIO* bio, const char* data, int size) {
+    BIO_clear_retry_flags(bio);
+    auto* buffers = static_cast<TSslBuffers*>(BIO_get_data(bio));
+#ifdef COROIO_KTLS
+    if (buffers->KtlsSend && buffers->ControlType) {
+        // alerts and post-handshake messages need their record type passed to the kernel
+        int n = SendControlRecord(buffers, data, size);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            BIO_set_retry_write(bio);
+        }
+        return n;
+    }
+#endif
+    buffers->Out.Write(data, size);
+    return size;
+}
+
+int RingRead(BIO* bio, char* data, int size) {
+    BIO_clear_retry_flags(bio);
+    auto n = static_cast<TSslBuffers*>(BIO_get_data(bio))->In.Read(data, size);
+    if (n == 0) {
+        BIO_set_retry_read(bio);
+        return -1;
+    }
+    return n;
+}
+
+long RingCtrl(BIO* bio, int cmd, [[maybe_unused]] long larg, [[maybe_unused]] void* parg) {
+    auto* buffers = static_cast<TSslBuffers*>(BIO_get_data(bio));
+    switch (cmd) {
+    case BIO_CTRL_FLUSH:
+        return 1;
+    case BIO_CTRL_PENDING:
+        return buffers->In.Size();
+    case BIO_CTRL_WPENDING:
+        return buffers->Out.Size();
+#ifdef COROIO_KTLS
+    case BIO_CTRL_GET_KTLS_SEND:
+        return buffers->KtlsSend;
+    case BioCtrlSetKtls:
+        // larg is non-zero for the sending direction; receiving stays in userspace
+        if (!larg || buffers->Fd < 0 || buffers->KtlsSend || !StartKtlsSend(buffers, parg)) {
+            return 0;
+        }
+        buffers->KtlsSend = true;
+        return 1;
+    case BioCtrlSetKtlsCtrlMsg:
+        buffers->ControlType = larg;
+        return 0;
+    case BioCtrlClearKtlsCtrlMsg:
+        buffers->ControlType = 0;
+        return 0;
+#endif
+    default:
+        return 0;
+    }
+}
+
+int RingCreate(BIO* bio) {
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+BIO_METHOD* RingMethod() {
+    static BIO_METHOD* method = [] {
+        auto* method = BIO_meth_new(BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "coroio ring buffer");
+        BIO_meth_set_write(method, RingWrite);
+        BIO_meth_set_read(method, RingRead);
+        BIO_meth_set_ctrl(method, RingCtrl);
+        BIO_meth_set_create(method, RingCreate);
+        return method;
+    }();
+    return method;
+}
+
+} // namespace
+
+TSslRingBuffer::TSslRingBuffer(size_t capacity)
+    : Capacity_(std::bit_ceil(capacity))
+{ }
+
+void TSslRingBuffer::Reserve(size_t size) {
+    if (Data_.size() - Size() >= size) {
+        return;
+    }
+    auto data = NUtils::AcquireBuffer(std::max(Capacity_, std::bit_ceil(Size() + size)));
+    Tail_ = Read(data.data(), Size());
+    Head_ = 0;
+    Data_.swap(data);
+    NUtils::ReleaseBuffer(std::move(data));
+}
+
+void TSslRingBuffer::Release() {
+    if (Empty()) {
+        NUtils::ReleaseBuffer(std::move(Data_));
+        Head_ = Tail_ = 0;
+    }
+}
+
+size_t TSslRingBuffer::Read(void* data, size_t size) {
+    size_t total = 0;
+    char* p = static_cast<char*>(data);
+    while (total < size && !Empty()) {
+        auto block = Readable();
+        size_t n = std::min(block.size(), size - total);
+        memcpy(p + total, block.data(), n);
+        total += n;
+        Consume(n);
+    }
+    return total;
+}
+
+void TSslRingBuffer::Write(const void* data, size_t size) {
+    Reserve(size);
+    const char* p = static_cast<const char*>(data);
+    while (size != 0) {
+        auto block = Writable();
+        size_t n = std::min(block.size(), size);
+        memcpy(block.data(), p, n);
+        Commit(n);
+        p += n;
+        size -= n;
+    }
+}
+
+BIO* TSslBuffers::NewBio(TSslBuffers* buffers) {
+    BIO* bio = BIO_new(RingMethod());
+    if (!bio) {
+        throw std::runtime_error("BIO_new failed");
+    }
+    BIO_set_data(bio, buffers);
+    return bio;
+}
+
+TSslTicketKey TSslTicketKey::Random() {
+    TSslTicketKey key;
+    if (RAND_bytes(reinterpret_cast<unsigned char*>(&key), sizeof(key)) != 1) {
+        throw std::runtime_error("RAND_bytes failed");
+    }
+    return key;
+}
+
+TSslContext::TSslContext(TSslContext&& other)
+    : Ctx(other.Ctx)
+    , LogFunc(other.LogFunc)
+    , State_(std::move(other.State_))
+{
+    other.Ctx = nullptr;
+}
+
+TSslContext::TSslContext()
+    : State_(std::make_unique<TSessionState>())
+{
     static int init = 0;
     if (!init) {
         SSL_library_init();
@@ -22,11 +398,82 @@ TSslContext::~TSslContext() {
     SSL_CTX_free(Ctx);
 }
 
+void TSslContext::InitServer() {
+    SSL_CTX_set_app_data(Ctx, State_.get());
+    // resumption is refused without it once peer certificates are verified
+    static const unsigned char sessionIdContext[] = "coroio";
+    SSL_CTX_set_session_id_context(Ctx, sessionIdContext, sizeof(sessionIdContext) - 1);
+    RotateTicketKey();
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(Ctx, TicketKeyCallback);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(Ctx, TicketKeyCallback);
+#endif
+}
+
+void TSslContext::InitClient() {
+    SSL_CTX_set_app_data(Ctx, State_.get());
+    SSL_CTX_set_session_cache_mode(Ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(Ctx, NewSession);
+}
+
+void TSslContext::RotateTicketKey() {
+    RotateTicketKey(TSslTicketKey::Random());
+}
+
+void TSslContext::RotateTicketKey(const TSslTicketKey& key) {
+    std::lock_guard guard(State_->Mutex);
+    auto& keys = State_->TicketKeys;
+    keys.emplace_front(key);
+    if (keys.size() > MaxTicketKeys) {
+        keys.pop_back();
+    }
+}
+
+std::vector<TSslTicketKey> TSslContext::TicketKeys() const {
+    std::lock_guard guard(State_->Mutex);
+    return {State_->TicketKeys.begin(), State_->TicketKeys.end()};
+}
+
+TSslSessionStats TSslContext::SessionStats() const {
+    std::lock_guard guard(State_->Mutex);
+    return State_->Stats;
+}
+
+void TSslContext::ResumeSession(SSL* ssl, const TAddress& address) {
+    auto key = SessionKey(ssl, address);
+    SSL_SESSION* session = nullptr;
+    {
+        std::lock_guard guard(State_->Mutex);
+        if (auto* cached = State_->Find(key)) {
+            // the cached copy is never bound to a connection, see NewSession()
+            session = SSL_SESSION_dup(cached);
+        }
+    }
+    if (session) {
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+    auto* prev = static_cast<std::string*>(SSL_get_ex_data(ssl, SessionKeyIndex()));
+    SSL_set_ex_data(ssl, SessionKeyIndex(), new std::string(std::move(key)));
+    delete prev;
+}
+
+void TSslContext::CountHandshake(SSL* ssl) {
+    std::lock_guard guard(State_->Mutex);
+    if (SSL_session_reused(ssl)) {
+        State_->Stats.Hits++;
+    } else {
+        State_->Stats.Misses++;
+    }
+}
+
 TSslContext TSslContext::Client(const std::function<void(const char*)>& logFunc) {
     TSslContext ctx;
     ctx.Ctx = SSL_CTX_new(TLS_client_method());
     SSL_CTX_set_options(ctx.Ctx, SSL_OP_ALL|SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
     ctx.LogFunc = logFunc;
+    ctx.InitClient();
     return ctx;
 }
 
@@ -35,6 +482,7 @@ TSslContext TSslContext::Server(const char* certfile, const char* keyfile, const
     ctx.Ctx = SSL_CTX_new(TLS_server_method());
     SSL_CTX_set_options(ctx.Ctx, SSL_OP_ALL|SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
     ctx.LogFunc = logFunc;
+    ctx.InitServer();
 
     if (SSL_CTX_use_certificate_file(ctx.Ctx, certfile,  SSL_FILETYPE_PEM) != 1) {
         throw std::runtime_error("SSL_CTX_use_certificate_file failed");
@@ -56,6 +504,7 @@ TSslContext TSslContext::ServerFromMem(const void* certMem, const void* keyMem,
     ctx.Ctx = SSL_CTX_new(TLS_server_method());
     SSL_CTX_set_options(ctx.Ctx, SSL_OP_ALL|SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
     ctx.LogFunc = logFunc;
+    ctx.InitServer();
 
     auto cbio = std::shared_ptr<BIO>(BIO_new_mem_buf(certMem, -1), BIO_free);
     auto cert = std::shared_ptr<X509>(PEM_read_bio_X509(cbio.get(), NULL, 0, nullptr), X509_free);
@@ -8,17 +8,49 @@
 #include <openssl/pem.h>
 #include <openssl/ssl.h>
 
+#include <algorithm>
 #include <stdexcept>
 #include <functional>
+#include <memory>
+#include <span>
+#include <vector>
 
 #include "base.hpp"
 #include "corochain.hpp"
 #include "sockutils.hpp"
 #include "promises.hpp"
 #include "socket.hpp"
+#include "sync.hpp"
+#include "workpool.hpp"
 
 namespace NNet {
 
+/**
+ * @struct TSslTicketKey
+ * @brief Key material protecting server-side TLS session tickets.
+ *
+ * Servers sharing a key resume each other's sessions, see @ref TSslContext::RotateTicketKey().
+ */
+struct TSslTicketKey {
+    unsigned char Name[16]; ///< Sent in clear with the ticket to select the key.
+    unsigned char AesKey[32];
+    unsigned char HmacKey[32];
+
+    /// Returns a key made of random bytes.
+    static TSslTicketKey Random();
+};
+
+/**
+ * @struct TSslSessionStats
+ * @brief Handshake counters of a @ref TSslContext.
+ */
+struct TSslSessionStats {
+    uint64_t Hits = 0; ///< Handshakes that resumed a session.
+    uint64_t Misses = 0; ///< Full handshakes.
+};
+
+template<typename TSocket> class TSslSocket;
+
 /**
  * @struct TSslContext
  * @brief Encapsulates an OpenSSL context (SSL_CTX) with optional logging.
@@ -32,6 +64,14 @@ namespace NNet {
  *  - Use @ref Server() to create a server context using certificate and key files.
  *  - Use @ref ServerFromMem() to create a server context from in-memory certificate and key data.
  *
+ * Sessions are resumed in both modes:
+ *  - a client context caches the last resumable session per "host:port" (the SNI host name
+ *    if set, the address otherwise) and offers it on the next @ref TSslSocket::Connect();
+ *  - a server context issues session tickets encrypted with its own keys, which can be
+ *    rotated or shared between processes with @ref RotateTicketKey().
+ *
+ * @ref SessionStats() counts resumed and full handshakes.
+ *
  * The context is movable but not copyable. Upon destruction, any associated resources
  * are released.
  */
@@ -39,13 +79,10 @@ struct TSslContext {
     SSL_CTX* Ctx; ///< The underlying OpenSSL context.
     std::function<void(const char*)> LogFunc = {}; ///< Optional logging callback.
 
-    TSslContext(TSslContext&& other)
-        : Ctx(other.Ctx)
-        , LogFunc(other.LogFunc)
-    {
-        other.Ctx = nullptr;
-    }
+    static constexpr size_t MaxTicketKeys = 3; ///< The current key and the ones still accepted.
+    static constexpr size_t MaxCachedSessions = 1024; ///< Client cache size, the least recently used session is evicted.
 
+    TSslContext(TSslContext&& other);
     ~TSslContext();
 
     /**
@@ -74,8 +111,150 @@ struct TSslContext {
      */
     static TSslContext ServerFromMem(const void* certfile, const void* keyfile, const std::function<void(const char*)>& logFunc = {});
 
+    /**
+     * @brief Makes a random key the current ticket key of a server context.
+     *
+     * Tickets issued with the previous @c MaxTicketKeys-1 keys are still accepted and
+     * reissued with the current one; older tickets fall back to a full handshake.
+     */
+    void RotateTicketKey();
+    /**
+     * @brief Makes @p key the current ticket key of a server context.
+     *
+     * Use the same sequence of keys on all servers behind one name to resume
+     * sessions established with any of them.
+     */
+    void RotateTicketKey(const TSslTicketKey& key);
+    /**
+     * @brief Returns the ticket keys of a server context, the current one first.
+     *
+     * Rotating them into another context oldest first, e.g. in the process taking over
+     * after a restart (@ref THandoffChannel), makes it accept the tickets issued here.
+     */
+    std::vector<TSslTicketKey> TicketKeys() const;
+    /// Returns the handshake counters.
+    TSslSessionStats SessionStats() const;
+
+    struct TSessionState; ///< Ticket keys, cached sessions and counters, opaque.
+
 private:
+    template<typename TSocket> friend class TSslSocket;
+
     TSslContext();
+    void InitServer();
+    void InitClient();
+    /// Offers the cached session of @p address and remembers the key for new tickets.
+    void ResumeSession(SSL* ssl, const TAddress& address);
+    /// Updates the counters after a successful handshake.
+    void CountHandshake(SSL* ssl);
+
+    std::unique_ptr<TSessionState> State_;
+};
+
+/**
+ * @class TSslRingBuffer
+ * @brief Byte ring holding the ciphertext of a @ref TSslSocket.
+ *
+ * The capacity is a power of two. @ref Readable() and @ref Writable() expose contiguous
+ * blocks so the socket sends from and receives into the ring directly.
+ */
+class TSslRingBuffer {
+public:
+    /// The storage of @p capacity bytes is allocated by the first @ref Reserve().
+    explicit TSslRingBuffer(size_t capacity);
+
+    size_t Size() const {
+        return Tail_ - Head_;
+    }
+
+    bool Empty() const {
+        return Head_ == Tail_;
+    }
+
+    /// Returns the stored bytes up to the end of the storage.
+    std::span<char> Readable() {
+        size_t start = Head_ & (Data_.size() - 1);
+        return {Data_.data() + start, std::min(Size(), Data_.size() - start)};
+    }
+
+    /// Returns the free space after the stored bytes up to the end of the storage.
+    std::span<char> Writable() {
+        size_t start = Tail_ & (Data_.size() - 1);
+        return {Data_.data() + start, std::min(Data_.size() - Size(), Data_.size() - start)};
+    }
+
+    /// Drops @p size bytes from the front.
+    void Consume(size_t size) {
+        Head_ += size;
+        if (Head_ == Tail_) {
+            // keeps the next blocks contiguous
+            Head_ = Tail_ = 0;
+        }
+    }
+
+    /// Appends @p size bytes written into @ref Writable().
+    void Commit(size_t size) {
+        Tail_ += size;
+    }
+
+    /// Makes room for at least @p size more bytes.
+    void Reserve(size_t size);
+    /// Copies out and drops up to @p size bytes, returns their number.
+    size_t Read(void* data, size_t size);
+    /// Appends @p size bytes, growing the ring if needed.
+    void Write(const void* data, size_t size);
+    /// Returns the storage of an empty ring to the per-thread cache until the next @ref Reserve().
+    void Release();
+
+private:
+    size_t Capacity_;
+    std::vector<char> Data_;
+    size_t Head_ = 0;
+    size_t Tail_ = 0;
+};
+
+/**
+ * @struct TSslBuffers
+ * @brief Transport of a @ref TSslSocket: the SSL engine's BIO reads records from @c In
+ *        and writes them to @c Out.
+ */
+struct TSslBuffers {
+    static constexpr size_t InitialSize = 32768; ///< Fits a full TLS record with overhead.
+
+    TSslRingBuffer In{InitialSize};
+    TSslRingBuffer Out{InitialSize};
+
+    int Fd = -1; ///< Socket to install kernel TLS keys on, -1 if kernel TLS was not requested.
+    bool KtlsSend = false; ///< The kernel encrypts what is sent on @c Fd.
+    int ControlType = 0; ///< Record type of the next non-data record in kernel TLS mode.
+
+    /// Creates a BIO over @p buffers; the buffers must outlive it.
+    static BIO* NewBio(TSslBuffers* buffers);
+};
+
+/**
+ * @class TSslHandshakeOffload
+ * @brief Runs the CPU-heavy steps of TLS handshakes on a @ref TWorkPool.
+ *
+ * A full handshake signs with the server key and computes the ECDHE secret, about a
+ * millisecond of CPU for RSA-2048; a reconnect storm of such steps run inline stalls every
+ * other socket of the loop. A @ref TSslSocket given an offload runs each SSL_do_handshake()
+ * on the pool and returns to its loop for the I/O in between.
+ *
+ * At most @p maxConcurrent steps of the loop's handshakes are on the pool at a time, the
+ * others wait in FIFO order, so the pool keeps room for other work. Uses a @ref TSemaphore,
+ * so an offload serves the sockets of one loop; make one per loop sharing the pool.
+ * The session cache and ticket keys of a @ref TSslContext are locked, so the context may
+ * be shared by the pool threads and by several loops.
+ */
+struct TSslHandshakeOffload {
+    TSslHandshakeOffload(TWorkPool& pool, size_t maxConcurrent = 16)
+        : Pool(pool)
+        , Slots(maxConcurrent)
+    { }
+
+    TWorkPool& Pool;
+    TSemaphore Slots;
 };
 
 /**
@@ -84,7 +263,9 @@ private:
  *
  * TSslSocket wraps an existing connection (of type @c TSocket) with SSL/TLS functionality.
  * It creates a new SSL instance (via @c SSL_new()) using the provided TSslContext,
- * and sets up memory BIOs for reading (Rbio) and writing (Wbio).
+ * and connects it to the socket through a BIO over @ref TSslBuffers: records are encrypted
+ * into the ring the socket sends from and decrypted from the ring the socket receives into,
+ * so the ciphertext is copied once per direction and a record takes one send.
  *
  * The class provides asynchronous operations for both server and client handshakes:
  *  - @ref AcceptHandshake() is used in server mode.
@@ -96,6 +277,8 @@ private:
  *
  * Additionally, TSslSocket allows setting the TLS SNI (via @ref SslSetTlsExtHostName).
  *
+ * The handshake computations can be moved off the loop with @ref SetHandshakeOffload().
+ *
  * @tparam TSocket The underlying socket type over which SSL/TLS is layered.
  */
 template<typename TSocket>
@@ -106,8 +289,8 @@ public:
     /**
      * @brief Constructs a TSslSocket from an underlying socket and an SSL context.
      *
-     * Creates a new SSL instance using the provided context, sets up memory BIOs for
-     * I/O, and configures SSL for partial writes.
+     * Creates a new SSL instance using the provided context, sets up the ring buffer BIO
+     * for I/O, and configures SSL for partial writes.
      *
      * @param socket An rvalue reference to the underlying connection handle.
      * @param ctx    Reference to the TSslContext to use.
@@ -116,10 +299,10 @@ public:
         : Socket(std::move(socket))
         , Ctx(&ctx)
         , Ssl(SSL_new(Ctx->Ctx))
-        , Rbio(BIO_new(BIO_s_mem()))
-        , Wbio(BIO_new(BIO_s_mem()))
+        , Buffers(std::make_unique<TSslBuffers>())
     {
-        SSL_set_bio(Ssl, Rbio, Wbio);
+        BIO* bio = TSslBuffers::NewBio(Buffers.get());
+        SSL_set_bio(Ssl, bio, bio);
         SSL_set_mode(Ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
         SSL_set_mode(Ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
     }
@@ -134,11 +317,11 @@ public:
             Socket = std::move(other.Socket);
             Ctx = other.Ctx;
             Ssl = other.Ssl;
-            Rbio = other.Rbio;
-            Wbio = other.Wbio;
+            Buffers = std::move(other.Buffers);
             Handshake = other.Handshake;
+            Hibernation = other.Hibernation;
+            Offload = other.Offload;
             other.Ssl = nullptr;
-            other.Rbio = other.Wbio = nullptr;
             other.Handshake = nullptr;
         }
         return *this;
@@ -160,6 +343,56 @@ public:
         if (Handshake) { Handshake.destroy(); }
     }
 
+    /**
+     * @brief Requests kernel TLS for the sending direction (Linux, OpenSSL 3).
+     *
+     * Must be called before the handshake. If the kernel supports the negotiated cipher,
+     * the keys are installed on the socket when the handshake switches to them, and
+     * @ref WriteSome() then sends plaintext through the underlying socket (including its
+     * zero-copy mode); the kernel builds and encrypts the records. Otherwise, and on other
+     * platforms, records are encrypted in userspace as usual. Received records are always
+     * decrypted by OpenSSL.
+     */
+    void EnableKtls() {
+#ifdef SSL_OP_ENABLE_KTLS
+        SSL_set_options(Ssl, SSL_OP_ENABLE_KTLS);
+        Buffers->Fd = Socket.Fd();
+#endif
+    }
+
+    /// Returns true once the kernel encrypts the records sent by @ref WriteSome().
+    bool KtlsSend() const {
+        return Buffers && Buffers->KtlsSend;
+    }
+
+    /**
+     * @brief Lets an idle connection wait without its buffers.
+     *
+     * Enables @c SSL_MODE_RELEASE_BUFFERS, so OpenSSL frees its record buffers once they
+     * are empty, and when a read has to wait with no ciphertext buffered, the rings go back
+     * to the per-thread cache and the socket waits with @ref WaitReadable(); they are taken
+     * again once data arrives. Costs an allocation, or a cache hit, per wakeup and one more
+     * poller wakeup per wait; meant for mostly idle connections.
+     */
+    void SetHibernation(bool enable = true) {
+        Hibernation = enable;
+        if (enable) {
+            SSL_set_mode(Ssl, SSL_MODE_RELEASE_BUFFERS);
+        } else {
+            SSL_clear_mode(Ssl, SSL_MODE_RELEASE_BUFFERS);
+        }
+    }
+
+    /**
+     * @brief Runs the handshake steps on the pool of @p offload, nullptr to run them inline.
+     *
+     * Sockets made by @ref Accept() inherit the offload. The handshake must not be cancelled
+     * (its coroutine destroyed) while a step is on the pool.
+     */
+    void SetHandshakeOffload(TSslHandshakeOffload* offload) {
+        Offload = offload;
+    }
+
     /**
      * @brief Sets the TLS SNI (Server Name Indication) extension host name.
      *
@@ -182,6 +415,7 @@ public:
     TFuture<TSslSocket<TSocket>> Accept() {
         auto underlying = std::move(co_await Socket.Accept());
         auto socket = TSslSocket(std::move(underlying), *Ctx);
+        socket.SetHandshakeOffload(Offload);
         co_await socket.AcceptHandshake();
         co_return std::move(socket);
     }
@@ -212,6 +446,7 @@ public:
         assert(!Handshake);
         co_await Socket.Connect(address, deadline);
         SSL_set_connect_state(Ssl);
+        Ctx->ResumeSession(Ssl, address);
         co_return co_await DoHandshake();
     }
 
@@ -254,6 +489,17 @@ public:
     TFuture<ssize_t> WriteSome(const void* data, size_t size) {
         co_await WaitHandshake();
 
+        if (Buffers->KtlsSend) {
+            auto& out = Buffers->Out;
+            while (!out.Empty()) {
+                auto block = out.Readable();
+                co_await TByteWriter(Socket).Write(block.data(), block.size());
+                out.Consume(block.size());
+            }
+            co_await TByteWriter(Socket).Write(data, size);
+            co_return size;
+        }
+
         auto r = size;
         const char* p = (const char*)data;
         while (size != 0) {
@@ -274,6 +520,43 @@ public:
         co_return r;
     }
 
+    /**
+     * @brief Asynchronously sends part of a file over the SSL connection.
+     *
+     * With kernel TLS (@ref EnableKtls()) the pending records are flushed and the range goes
+     * through the underlying socket's @c SendFile(): the kernel reads, encrypts and transmits
+     * the pages without copying them to userspace. Otherwise up to one record of the file is
+     * read and written with @ref WriteSome().
+     *
+     * @param fileFd Descriptor of a regular file, its position is not changed.
+     * @param offset Offset of the first byte to send.
+     * @param size   Number of bytes to send.
+     * @return A TFuture yielding the number of bytes sent, 0 at the end of the file.
+     */
+    TFuture<ssize_t> SendFile(int fileFd, int64_t offset, size_t size) {
+        co_await WaitHandshake();
+
+        if (Buffers->KtlsSend) {
+            auto& out = Buffers->Out;
+            while (!out.Empty()) {
+                auto block = out.Readable();
+                co_await TByteWriter(Socket).Write(block.data(), block.size());
+                out.Consume(block.size());
+            }
+            co_return co_await Socket.SendFile(fileFd, offset, size);
+        }
+
+        char buffer[16384]; // the largest TLS record
+        int n = TFileOps::pread(fileFd, buffer, std::min(size, sizeof(buffer)), offset);
+        if (n < 0) {
+            throw std::system_error(errno, std::generic_category(), "pread");
+        }
+        if (n == 0) {
+            co_return 0;
+        }
+        co_return co_await WriteSome(buffer, n);
+    }
+
     /**
      * @brief Returns the underlying poller.
      *
@@ -283,30 +566,60 @@ public:
         return Socket.Poller();
     }
 
+    /**
+     * @brief Monitors the underlying connection for remote hang-up.
+     *
+     * @return The awaitable of the underlying socket's @c Monitor().
+     */
+    auto Monitor() {
+        return Socket.Monitor();
+    }
+
+    /**
+     * @brief Waits until @ref ReadSome() has something to decrypt, without reading.
+     *
+     * Completes at once if OpenSSL or the receive ring holds unread bytes; otherwise waits on
+     * the underlying socket, with the rings released if hibernation is enabled. A wakeup may
+     * bring a partial record only, then @ref ReadSome() waits for the rest.
+     */
+    TFuture<void> WaitReadable() requires requires (TSocket& socket) { socket.WaitReadable(); } {
+        co_await WaitHandshake();
+        if (SSL_has_pending(Ssl) || !Buffers->In.Empty()) {
+            co_return;
+        }
+        if (Hibernation && Buffers->Out.Empty()) {
+            Buffers->In.Release();
+            Buffers->Out.Release();
+        }
+        co_await Socket.WaitReadable();
+    }
+
 private:
     TFuture<void> DoIO() {
-        char buf[1024];
-        int n;
-        while ((n = BIO_read(Wbio, buf, sizeof(buf))) > 0) {
-            co_await TByteWriter(Socket).Write(buf, n);
-        }
-        if (n < 0 && !BIO_should_retry(Wbio)) {
-            throw std::runtime_error("Cannot read Wbio");
+        auto& out = Buffers->Out;
+        while (!out.Empty()) {
+            auto block = out.Readable();
+            co_await TByteWriter(Socket).Write(block.data(), block.size());
+            out.Consume(block.size());
         }
 
-        if (SSL_get_error(Ssl, n) == SSL_ERROR_WANT_READ) {
-            auto size = co_await Socket.ReadSome(buf, sizeof(buf));
+        if (SSL_want_read(Ssl)) {
+            auto& in = Buffers->In;
+            if constexpr (requires { Socket.WaitReadable(); }) {
+                if (Hibernation && in.Empty()) {
+                    in.Release();
+                    out.Release();
+                    co_await Socket.WaitReadable();
+                }
+            }
+            in.Reserve(1);
+            auto block = in.Writable();
+            auto size = co_await Socket.ReadSome(block.data(), block.size());
             if (size == 0) {
                 throw std::runtime_error("Connection closed");
             }
-            const char* p = buf;
-            while (size != 0) {
-                auto n = BIO_write(Rbio, p, size);
-                if (n <= 0) {
-                    throw std::runtime_error("Cannot write Rbio");
-                }
-                size -= n;
-                p += n;
+            if (size > 0) {
+                in.Commit(size);
             }
         }
 
@@ -314,19 +627,22 @@ private:
     }
 
     TFuture<void> DoHandshake() {
-        int r;
         LogState();
-        while ((r = SSL_do_handshake(Ssl)) != 1) {
+        while (true) {
+            int status = Offload ? co_await OffloadedHandshakeStep() : HandshakeStep();
+            if (status == SSL_ERROR_NONE) {
+                break;
+            }
             LogState();
-            int status = SSL_get_error(Ssl, r);
             if (status == SSL_ERROR_WANT_READ || status == SSL_ERROR_WANT_WRITE) {
                 co_await DoIO();
             } else {
-                throw std::runtime_error("SSL error: " + std::to_string(r));
+                throw std::runtime_error("SSL error: " + std::to_string(status));
             }
         }
 
         LogState();
+        Ctx->CountHandshake(Ssl);
 
         co_await DoIO();
 
@@ -342,6 +658,23 @@ private:
         co_return;
     }
 
+    /// Returns the SSL_get_error() status of one SSL_do_handshake(), SSL_ERROR_NONE once done.
+    int HandshakeStep() {
+        int r = SSL_do_handshake(Ssl);
+        return r == 1 ? SSL_ERROR_NONE : SSL_get_error(Ssl, r);
+    }
+
+    TFuture<int> OffloadedHandshakeStep() {
+        auto permit = co_await Offload->Slots.Acquire();
+        auto* poller = Socket.Poller();
+        co_await Offload->Pool.Offload();
+        int status = HandshakeStep();
+        // the error queue is per thread, do not leave it to an unrelated socket of the worker
+        ERR_clear_error();
+        co_await poller->SwitchTo();
+        co_return status;
+    }
+
     void StartHandshake() {
         assert(!Handshake);
         Handshake = RunHandshake();
@@ -394,13 +727,14 @@ private:
     TSslContext* Ctx = nullptr;
 
     SSL* Ssl = nullptr;
-    BIO* Rbio = nullptr;
-    BIO* Wbio = nullptr;
+    std::unique_ptr<TSslBuffers> Buffers; ///< Heap allocated: the BIO keeps a pointer to it.
 
     const char* LastState = nullptr;
 
     std::coroutine_handle<> Handshake;
     std::vector<std::coroutine_handle<>> Waiters;
+    bool Hibernation = false;
+    TSslHandshakeOffload* Offload = nullptr;
 };
 
 } // namespace NNet
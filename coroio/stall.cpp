@@ -0,0 +1,57 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "stall.hpp"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+namespace NNet {
+
+namespace NDetail {
+
+TFrameRegistry& TFrameRegistry::Get() {
+    // never destroyed: frames may outlive static destruction
+    static auto* registry = new TFrameRegistry;
+    return *registry;
+}
+
+void TFrameRegistry::Add(void* frame, std::coroutine_handle<>* caller) {
+    auto& shard = ShardOf(frame);
+    std::lock_guard lock(shard.Mutex);
+    shard.Frames[frame] = caller;
+}
+
+void TFrameRegistry::Remove(void* frame) {
+    auto& shard = ShardOf(frame);
+    std::lock_guard lock(shard.Mutex);
+    shard.Frames.erase(frame);
+}
+
+void TFrameRegistry::Chain(void* frame, size_t depth, std::vector<void*>& chain) {
+    void* noop = std::noop_coroutine().address();
+    while (frame && frame != noop && chain.size() < depth) {
+        chain.push_back(frame);
+        auto& shard = ShardOf(frame);
+        std::lock_guard lock(shard.Mutex);
+        auto it = shard.Frames.find(frame);
+        if (it == shard.Frames.end()) {
+            break;
+        }
+        frame = it->second->address();
+    }
+}
+
+TClock::duration ThreadCpuTime() {
+#ifdef _WIN32
+    return {};
+#else
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::duration_cast<TClock::duration>(
+        std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec));
+#endif
+}
+
+} // namespace NDetail
+
+} // namespace NNet
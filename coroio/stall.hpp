@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "base.hpp"
+
+namespace NNet {
+
+/// What resumed a coroutine reported by the stall detector.
+enum class EStallSource {
+    Event,  ///< A ready descriptor or a completion.
+    Timer,  ///< An expired timer.
+    Posted, ///< @ref TPollerBase::Post() or @ref TPollerBase::SwitchTo().
+};
+
+/// A resumption that kept the loop busy longer than @ref TStallOptions::Threshold.
+struct TStall {
+    EStallSource Source = EStallSource::Event;
+    void* Handle = nullptr; ///< Address of the resumed coroutine frame, null for a posted function.
+    /**
+     * @brief The chain of awaiting coroutines, innermost first, starting with @c Handle.
+     *
+     * Filled for @ref TFuture coroutines whose frame is still alive after the stall,
+     * i.e. the usual case of a coroutine that computed for a long time and then awaited
+     * again.
+     */
+    std::vector<void*> Callers = {};
+    TClock::duration Duration = {};
+    TClock::duration CpuTime = {}; ///< Thread CPU time of the resumption, if measured.
+};
+
+/// Settings of @ref TPollerBase::SetStallDetector().
+struct TStallOptions {
+    TClock::duration Threshold = std::chrono::milliseconds(50);
+    bool CpuTime = false;  ///< Also measure thread CPU time, costs two clock_gettime(2) calls per resumption.
+    size_t MaxDepth = 16;  ///< Upper bound of @ref TStall::Callers.
+};
+
+using TStallCallback = std::function<void(const TStall&)>;
+
+namespace NDetail {
+
+/**
+ * @brief Registry of live @ref TFuture frames and their caller slots.
+ *
+ * Frames are only registered while some stall detector is installed, so the cost of
+ * a coroutine creation otherwise is one relaxed load. Sharded by frame address, as
+ * frames of several loops are created concurrently and may be destroyed on another
+ * thread than the one that created them.
+ */
+class TFrameRegistry {
+public:
+    static TFrameRegistry& Get();
+
+    static bool Enabled() {
+        return Users_.load(std::memory_order_relaxed) > 0;
+    }
+
+    static void Use(int delta) {
+        Users_.fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    void Add(void* frame, std::coroutine_handle<>* caller);
+    void Remove(void* frame);
+    /// Appends @p frame and its live callers to @p chain, at most @p depth entries.
+    void Chain(void* frame, size_t depth, std::vector<void*>& chain);
+
+private:
+    static constexpr size_t Shards = 16;
+
+    struct TShard {
+        std::mutex Mutex;
+        std::unordered_map<void*, std::coroutine_handle<>*> Frames;
+    };
+
+    TShard& ShardOf(void* frame) {
+        return Shards_[(reinterpret_cast<uintptr_t>(frame) >> 6) % Shards];
+    }
+
+    std::array<TShard, Shards> Shards_;
+    static inline std::atomic<int> Users_ = 0;
+};
+
+/// Returns the CPU time consumed by the calling thread.
+TClock::duration ThreadCpuTime();
+
+} // namespace NDetail
+
+} // namespace NNet
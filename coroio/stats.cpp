@@ -0,0 +1,84 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "stats.hpp"
+
+#include <bit>
+#include <cmath>
+
+namespace NNet {
+
+uint64_t THistogramSnapshot::Percentile(double percentile) const {
+    if (Count == 0) {
+        return 0;
+    }
+    auto rank = static_cast<uint64_t>(std::ceil(percentile / 100 * Count));
+    rank = rank == 0 ? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < Counts.size(); i++) {
+        seen += Counts[i];
+        if (seen >= rank) {
+            auto value = THistogram::UpperBound(i);
+            return value > Max ? Max : value;
+        }
+    }
+    return Max;
+}
+
+THistogram::THistogram()
+    : Counts_(Buckets)
+{ }
+
+size_t THistogram::Index(uint64_t value) {
+    if (value < SubCount) {
+        return value;
+    }
+    int shift = std::bit_width(value) - 1 - SubBits;
+    return (shift + 1) * SubCount + ((value >> shift) & (SubCount - 1));
+}
+
+uint64_t THistogram::LowerBound(size_t index) {
+    if (index < SubCount) {
+        return index;
+    }
+    int shift = index / SubCount - 1;
+    return (SubCount + index % SubCount) << shift;
+}
+
+uint64_t THistogram::UpperBound(size_t index) {
+    if (index < SubCount) {
+        return index;
+    }
+    int shift = index / SubCount - 1;
+    return LowerBound(index) + ((uint64_t(1) << shift) - 1);
+}
+
+THistogramSnapshot THistogram::Snapshot() const {
+    THistogramSnapshot snapshot;
+    snapshot.Counts.reserve(Buckets);
+    for (const auto& count : Counts_) {
+        snapshot.Counts.push_back(count.load(std::memory_order_relaxed));
+        snapshot.Count += snapshot.Counts.back();
+    }
+    snapshot.Sum = Sum_.Get();
+    auto min = Min_.load(std::memory_order_relaxed);
+    snapshot.Min = snapshot.Count ? min : 0;
+    snapshot.Max = Max_.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+TPollerStatsSnapshot TPollerStats::Snapshot() const {
+    return {
+        .Polls = Polls.Get(),
+        .Events = Events.Get(),
+        .Changes = Changes.Get(),
+        .Submissions = Submissions.Get(),
+        .TimersFired = TimersFired.Get(),
+        .EventsPerPoll = EventsPerPoll.Snapshot(),
+        .ChangesPerPoll = ChangesPerPoll.Snapshot(),
+        .PollTime = PollTime.Snapshot(),
+        .WakeupTime = WakeupTime.Snapshot(),
+        .TimersTime = TimersTime.Snapshot(),
+        .TimerLateness = TimerLateness.Snapshot(),
+    };
+}
+
+} // namespace NNet
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace NNet {
+
+/**
+ * @brief Counter written by one thread and read by any.
+ *
+ * Increments are a relaxed load and store instead of a locked add: only the owning
+ * poller thread writes.
+ */
+class TStatsCounter {
+public:
+    void Add(uint64_t n = 1) {
+        Value_.store(Value_.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t Get() const {
+        return Value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> Value_ = 0;
+};
+
+/// Copy of a @ref THistogram taken with @ref THistogram::Snapshot().
+struct THistogramSnapshot {
+    std::vector<uint64_t> Counts = {}; ///< Per bucket, see @ref THistogram::LowerBound().
+    uint64_t Count = 0;
+    uint64_t Sum = 0;
+    uint64_t Min = 0;
+    uint64_t Max = 0;
+
+    double Mean() const {
+        return Count ? static_cast<double>(Sum) / Count : 0;
+    }
+
+    /**
+     * @brief Returns the value at @p percentile (0 to 100).
+     *
+     * The result is the highest value of the bucket holding the percentile, so it is
+     * at most 1/16 above the recorded value.
+     */
+    uint64_t Percentile(double percentile) const;
+};
+
+/**
+ * @class THistogram
+ * @brief HDR-style histogram of unsigned 64-bit values.
+ *
+ * Values below 16 get a bucket each; above, every power of two is split into 16
+ * buckets, which bounds the relative error by 1/16 over the whole range with 976
+ * buckets. Recording is a few instructions and no allocation, so loops can record
+ * every iteration.
+ *
+ * Written by one thread, @ref Snapshot() may be called from any thread; a snapshot
+ * taken concurrently with @ref Record() may miss the values being recorded.
+ */
+class THistogram {
+public:
+    static constexpr int SubBits = 4;
+    static constexpr size_t SubCount = size_t(1) << SubBits;
+    static constexpr size_t Buckets = (64 - SubBits + 1) * SubCount;
+
+    THistogram();
+
+    void Record(uint64_t value) {
+        auto& bucket = Counts_[Index(value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        Sum_.Add(value);
+        if (value < Min_.load(std::memory_order_relaxed)) {
+            Min_.store(value, std::memory_order_relaxed);
+        }
+        if (value > Max_.load(std::memory_order_relaxed)) {
+            Max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    THistogramSnapshot Snapshot() const;
+
+    /// Returns the bucket of @p value.
+    static size_t Index(uint64_t value);
+    /// Returns the lowest value of the bucket @p index.
+    static uint64_t LowerBound(size_t index);
+    /// Returns the highest value of the bucket @p index.
+    static uint64_t UpperBound(size_t index);
+
+private:
+    std::vector<std::atomic<uint64_t>> Counts_;
+    TStatsCounter Sum_;
+    std::atomic<uint64_t> Min_ = UINT64_MAX;
+    std::atomic<uint64_t> Max_ = 0;
+};
+
+/// Copy of @ref TPollerStats taken with @ref TPollerStats::Snapshot().
+struct TPollerStatsSnapshot {
+    uint64_t Polls = 0;
+    uint64_t Events = 0;
+    uint64_t Changes = 0;
+    uint64_t Submissions = 0;
+    uint64_t TimersFired = 0;
+    THistogramSnapshot EventsPerPoll = {};
+    THistogramSnapshot ChangesPerPoll = {};
+    THistogramSnapshot PollTime = {};
+    THistogramSnapshot WakeupTime = {};
+    THistogramSnapshot TimersTime = {};
+    THistogramSnapshot TimerLateness = {};
+};
+
+/**
+ * @brief Instrumentation of an event loop, see @ref TPollerBase::Stats().
+ *
+ * Times are in nanoseconds.
+ */
+struct TPollerStats {
+    TStatsCounter Polls;          ///< Poll system calls.
+    TStatsCounter Events;         ///< Ready events resumed.
+    TStatsCounter Changes;        ///< Entries of the change list applied.
+    TStatsCounter Submissions;    ///< epoll_ctl(2) calls, kevent(2) changes or io_uring SQEs.
+    TStatsCounter TimersFired;
+    THistogram EventsPerPoll;     ///< Ready events per iteration.
+    THistogram ChangesPerPoll;    ///< Change list size per iteration.
+    THistogram PollTime;          ///< Time in the poll system call.
+    THistogram WakeupTime;        ///< Time resuming the ready events.
+    THistogram TimersTime;        ///< Time processing due timers.
+    THistogram TimerLateness;     ///< Delay between a deadline and the resumption of its timer.
+
+    TPollerStatsSnapshot Snapshot() const;
+};
+
+} // namespace NNet
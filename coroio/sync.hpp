@@ -0,0 +1,650 @@
+#pragma once
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "poller.hpp"
+
+namespace NNet {
+
+namespace NDetail {
+
+/// Link of a coroutine waiting in a @ref TWaitQueue.
+struct TWaitNode {
+    TWaitNode* Prev = nullptr;
+    TWaitNode* Next = nullptr;
+    bool Linked = false;
+};
+
+/**
+ * @brief Intrusive FIFO of waiting coroutines.
+ *
+ * Nodes live in the awaitables, so waiting allocates nothing and an awaitable destroyed
+ * with its coroutine unlinks itself in O(1).
+ */
+class TWaitQueue {
+public:
+    bool Empty() const {
+        return Head_ == nullptr;
+    }
+
+    void Push(TWaitNode* node) {
+        node->Prev = Tail_;
+        node->Next = nullptr;
+        node->Linked = true;
+        if (Tail_) {
+            Tail_->Next = node;
+        } else {
+            Head_ = node;
+        }
+        Tail_ = node;
+    }
+
+    TWaitNode* Pop() {
+        auto* node = Head_;
+        if (node) {
+            Remove(node);
+        }
+        return node;
+    }
+
+    void Remove(TWaitNode* node) {
+        if (!node->Linked) {
+            return;
+        }
+        (node->Prev ? node->Prev->Next : Head_) = node->Next;
+        (node->Next ? node->Next->Prev : Tail_) = node->Prev;
+        node->Prev = node->Next = nullptr;
+        node->Linked = false;
+    }
+
+private:
+    TWaitNode* Head_ = nullptr;
+    TWaitNode* Tail_ = nullptr;
+};
+
+/**
+ * @brief State of a bounded channel without locking or resuming.
+ *
+ * Values are handed directly to a waiting receiver, and a receiver freeing a slot
+ * moves the value of the first waiting sender into it. The operations return the
+ * waiter to wake, the channel decides how to resume it.
+ */
+template<typename T, size_t N>
+class TChannelCore {
+    static_assert(N > 0, "Channel capacity must be positive");
+
+public:
+    struct TWaiter : TWaitNode {
+        THandle Handle = {};
+        TPollerBase* Poller = nullptr;
+        std::optional<T> Value = {}; ///< The value to send or the value received.
+        bool Ok = false;
+    };
+
+    /// Stores @p value, moving from it, unless the channel is full or closed.
+    bool Put(T& value, TWaiter*& woken) {
+        if (Closed_) {
+            return false;
+        }
+        if (auto* receiver = static_cast<TWaiter*>(Receivers_.Pop())) {
+            receiver->Value.emplace(std::move(value));
+            receiver->Ok = true;
+            woken = receiver;
+            return true;
+        }
+        if (Count_ == N) {
+            return false;
+        }
+        Items_[(Head_ + Count_) % N].emplace(std::move(value));
+        Count_++;
+        return true;
+    }
+
+    /// Removes the oldest value, refilling its slot from a waiting sender.
+    std::optional<T> Take(TWaiter*& woken) {
+        if (Count_ == 0) {
+            return std::nullopt;
+        }
+        std::optional<T> result = std::move(Items_[Head_]);
+        Items_[Head_].reset();
+        Head_ = (Head_ + 1) % N;
+        Count_--;
+        if (auto* sender = static_cast<TWaiter*>(Senders_.Pop())) {
+            Items_[(Head_ + Count_) % N] = std::move(sender->Value);
+            sender->Value.reset();
+            Count_++;
+            sender->Ok = true;
+            woken = sender;
+        }
+        return result;
+    }
+
+    void Wait(TWaiter* waiter, bool send) {
+        (send ? Senders_ : Receivers_).Push(waiter);
+    }
+
+    void Cancel(TWaiter* waiter, bool send) {
+        (send ? Senders_ : Receivers_).Remove(waiter);
+    }
+
+    /// Marks the channel closed and passes every waiter to @p wake.
+    template<typename TWake>
+    void Close(TWake&& wake) {
+        Closed_ = true;
+        while (auto* receiver = Receivers_.Pop()) {
+            wake(static_cast<TWaiter*>(receiver));
+        }
+        while (auto* sender = Senders_.Pop()) {
+            wake(static_cast<TWaiter*>(sender));
+        }
+    }
+
+    bool Closed() const {
+        return Closed_;
+    }
+
+    size_t Size() const {
+        return Count_;
+    }
+
+private:
+    std::array<std::optional<T>, N> Items_ = {};
+    size_t Head_ = 0;
+    size_t Count_ = 0;
+    bool Closed_ = false;
+    TWaitQueue Senders_;
+    TWaitQueue Receivers_;
+};
+
+} // namespace NDetail
+
+/**
+ * @class TChannel
+ * @brief Bounded FIFO channel between coroutines of one thread.
+ *
+ * Values are kept in a ring buffer of @p N slots. @ref Send() suspends while the
+ * channel is full and @ref Recv() while it is empty, so a slow consumer holds its
+ * producers back instead of letting a queue grow. A waiter is resumed directly by the
+ * operation that unblocks it, and a suspended @ref Send() or @ref Recv() may be
+ * cancelled by destroying its coroutine.
+ *
+ * After @ref Close() the remaining values can still be received, then @ref Recv()
+ * returns std::nullopt; @ref Send() returns false.
+ *
+ * Example:
+ * @code{.cpp}
+ * TChannel<std::string, 64> lines;
+ * TFuture<void> producer = [&]() -> TFuture<void> {
+ *     while (auto line = co_await reader.Read()) {
+ *         co_await lines.Send(std::string(line.Part1) + std::string(line.Part2));
+ *     }
+ *     lines.Close();
+ * }();
+ * while (auto line = co_await lines.Recv()) {
+ *     co_await Process(*line);
+ * }
+ * @endcode
+ *
+ * @tparam T Value type; must be movable.
+ * @tparam N Capacity.
+ */
+template<typename T, size_t N>
+class TChannel {
+public:
+    TChannel() = default;
+    TChannel(const TChannel&) = delete;
+    TChannel& operator=(const TChannel&) = delete;
+
+    /**
+     * @brief Sends @p value, waiting for a free slot.
+     *
+     * @return An awaitable returning false if the channel is closed.
+     */
+    auto Send(T value) {
+        struct TAwaitableSend {
+            TAwaitableSend(TChannel* channel, T&& value)
+                : Channel(channel)
+            {
+                Waiter.Value.emplace(std::move(value));
+            }
+
+            TAwaitableSend(const TAwaitableSend&) = delete;
+            TAwaitableSend& operator=(const TAwaitableSend&) = delete;
+
+            ~TAwaitableSend() {
+                Channel->Core_.Cancel(&Waiter, true);
+            }
+
+            bool await_ready() {
+                typename TCore::TWaiter* woken = nullptr;
+                Waiter.Ok = Channel->Core_.Put(*Waiter.Value, woken);
+                Resume(woken);
+                return Waiter.Ok || Channel->Core_.Closed();
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                Waiter.Handle = h;
+                Channel->Core_.Wait(&Waiter, true);
+            }
+
+            bool await_resume() {
+                return Waiter.Ok;
+            }
+
+            TChannel* Channel;
+            typename TCore::TWaiter Waiter;
+        };
+        return TAwaitableSend{this, std::move(value)};
+    }
+
+    /**
+     * @brief Receives the oldest value, waiting for one.
+     *
+     * @return An awaitable returning std::nullopt once the channel is closed and drained.
+     */
+    auto Recv() {
+        struct TAwaitableRecv {
+            TAwaitableRecv(TChannel* channel)
+                : Channel(channel)
+            { }
+
+            TAwaitableRecv(const TAwaitableRecv&) = delete;
+            TAwaitableRecv& operator=(const TAwaitableRecv&) = delete;
+
+            ~TAwaitableRecv() {
+                Channel->Core_.Cancel(&Waiter, false);
+            }
+
+            bool await_ready() {
+                typename TCore::TWaiter* woken = nullptr;
+                Waiter.Value = Channel->Core_.Take(woken);
+                Resume(woken);
+                return Waiter.Value || Channel->Core_.Closed();
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                Waiter.Handle = h;
+                Channel->Core_.Wait(&Waiter, false);
+            }
+
+            std::optional<T> await_resume() {
+                return std::move(Waiter.Value);
+            }
+
+            TChannel* Channel;
+            typename TCore::TWaiter Waiter;
+        };
+        return TAwaitableRecv{this};
+    }
+
+    /// Sends @p value without waiting, moving from it only on success.
+    bool TrySend(T&& value) {
+        typename TCore::TWaiter* woken = nullptr;
+        bool ok = Core_.Put(value, woken);
+        Resume(woken);
+        return ok;
+    }
+
+    /// Receives a value without waiting.
+    std::optional<T> TryRecv() {
+        typename TCore::TWaiter* woken = nullptr;
+        auto value = Core_.Take(woken);
+        Resume(woken);
+        return value;
+    }
+
+    /// Closes the channel and resumes all waiters.
+    void Close() {
+        std::vector<THandle> handles;
+        Core_.Close([&](auto* waiter) { handles.push_back(waiter->Handle); });
+        for (auto h : handles) {
+            h.resume();
+        }
+    }
+
+    bool Closed() const {
+        return Core_.Closed();
+    }
+
+    /// Returns the number of buffered values.
+    size_t Size() const {
+        return Core_.Size();
+    }
+
+    static constexpr size_t Capacity() {
+        return N;
+    }
+
+private:
+    using TCore = NDetail::TChannelCore<T, N>;
+
+    static void Resume(typename TCore::TWaiter* woken) {
+        if (woken) {
+            woken->Handle.resume();
+        }
+    }
+
+    TCore Core_;
+};
+
+/**
+ * @class TSharedChannel
+ * @brief Bounded FIFO channel between coroutines of different loops.
+ *
+ * Same semantics as @ref TChannel, with the state protected by a mutex. A waiter names
+ * the poller it runs on and is resumed through @ref TPollerBase::Post() of that poller,
+ * so every coroutine keeps running on its own loop. @ref TrySend() and
+ * @ref TryRecv() may be called from any thread.
+ *
+ * Unlike @ref TChannel, a suspended @ref Send() or @ref Recv() must not be cancelled:
+ * its wakeup may already be posted to the other loop.
+ *
+ * @tparam T Value type; must be movable.
+ * @tparam N Capacity.
+ */
+template<typename T, size_t N>
+class TSharedChannel {
+public:
+    TSharedChannel() = default;
+    TSharedChannel(const TSharedChannel&) = delete;
+    TSharedChannel& operator=(const TSharedChannel&) = delete;
+
+    /**
+     * @brief Sends @p value from a coroutine running on @p poller, waiting for a free slot.
+     *
+     * @return An awaitable returning false if the channel is closed.
+     */
+    auto Send(TPollerBase& poller, T value) {
+        struct TAwaitableSend {
+            TAwaitableSend(TSharedChannel* channel, TPollerBase* poller, T&& value)
+                : Channel(channel)
+            {
+                Waiter.Poller = poller;
+                Waiter.Value.emplace(std::move(value));
+            }
+
+            TAwaitableSend(const TAwaitableSend&) = delete;
+            TAwaitableSend& operator=(const TAwaitableSend&) = delete;
+
+            bool await_ready() {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<> h) {
+                typename TCore::TWaiter* woken = nullptr;
+                {
+                    std::lock_guard lock(Channel->Mutex_);
+                    Waiter.Ok = Channel->Core_.Put(*Waiter.Value, woken);
+                    if (!Waiter.Ok && !Channel->Core_.Closed()) {
+                        Waiter.Handle = h;
+                        Channel->Core_.Wait(&Waiter, true);
+                        return true;
+                    }
+                }
+                Wake(woken);
+                return false;
+            }
+
+            bool await_resume() {
+                return Waiter.Ok;
+            }
+
+            TSharedChannel* Channel;
+            typename TCore::TWaiter Waiter;
+        };
+        return TAwaitableSend{this, &poller, std::move(value)};
+    }
+
+    /**
+     * @brief Receives the oldest value from a coroutine running on @p poller, waiting for one.
+     *
+     * @return An awaitable returning std::nullopt once the channel is closed and drained.
+     */
+    auto Recv(TPollerBase& poller) {
+        struct TAwaitableRecv {
+            TAwaitableRecv(TSharedChannel* channel, TPollerBase* poller)
+                : Channel(channel)
+            {
+                Waiter.Poller = poller;
+            }
+
+            TAwaitableRecv(const TAwaitableRecv&) = delete;
+            TAwaitableRecv& operator=(const TAwaitableRecv&) = delete;
+
+            bool await_ready() {
+                return false;
+            }
+
+            bool await_suspend(std::coroutine_handle<> h) {
+                typename TCore::TWaiter* woken = nullptr;
+                {
+                    std::lock_guard lock(Channel->Mutex_);
+                    Waiter.Value = Channel->Core_.Take(woken);
+                    if (!Waiter.Value && !Channel->Core_.Closed()) {
+                        Waiter.Handle = h;
+                        Channel->Core_.Wait(&Waiter, false);
+                        return true;
+                    }
+                }
+                Wake(woken);
+                return false;
+            }
+
+            std::optional<T> await_resume() {
+                return std::move(Waiter.Value);
+            }
+
+            TSharedChannel* Channel;
+            typename TCore::TWaiter Waiter;
+        };
+        return TAwaitableRecv{this, &poller};
+    }
+
+    /// Sends @p value without waiting, moving from it only on success. Thread-safe.
+    bool TrySend(T&& value) {
+        typename TCore::TWaiter* woken = nullptr;
+        bool ok;
+        {
+            std::lock_guard lock(Mutex_);
+            ok = Core_.Put(value, woken);
+        }
+        Wake(woken);
+        return ok;
+    }
+
+    /// Receives a value without waiting. Thread-safe.
+    std::optional<T> TryRecv() {
+        typename TCore::TWaiter* woken = nullptr;
+        std::optional<T> value;
+        {
+            std::lock_guard lock(Mutex_);
+            value = Core_.Take(woken);
+        }
+        Wake(woken);
+        return value;
+    }
+
+    /// Closes the channel and wakes all waiters. Thread-safe.
+    void Close() {
+        std::vector<typename TCore::TWaiter*> woken;
+        {
+            std::lock_guard lock(Mutex_);
+            Core_.Close([&](auto* waiter) { woken.push_back(waiter); });
+        }
+        for (auto* waiter : woken) {
+            Wake(waiter);
+        }
+    }
+
+    bool Closed() const {
+        std::lock_guard lock(Mutex_);
+        return Core_.Closed();
+    }
+
+    /// Returns the number of buffered values.
+    size_t Size() const {
+        std::lock_guard lock(Mutex_);
+        return Core_.Size();
+    }
+
+    static constexpr size_t Capacity() {
+        return N;
+    }
+
+private:
+    using TCore = NDetail::TChannelCore<T, N>;
+
+    // the waiter is unlinked, its coroutine stays suspended until the posted resume runs
+    static void Wake(typename TCore::TWaiter* woken) {
+        if (woken) {
+            woken->Poller->Post([h = woken->Handle]() { h.resume(); });
+        }
+    }
+
+    mutable std::mutex Mutex_;
+    TCore Core_;
+};
+
+/**
+ * @class TSemaphore
+ * @brief Counting semaphore for coroutines of one thread.
+ *
+ * Caps the number of coroutines inside a section, e.g. the requests in flight to one
+ * upstream. @ref Acquire() waits for a permit and returns it as a @ref TPermit that
+ * gives it back when destroyed. Waiters get permits in FIFO order, and a waiting
+ * @ref Acquire() may be cancelled by destroying its coroutine.
+ *
+ * Example:
+ * @code{.cpp}
+ * TSemaphore inflight(16);
+ * TFuture<TResponse> Call(TRequest request) {
+ *     auto permit = co_await inflight.Acquire();
+ *     co_return co_await Upstream.Send(request);
+ * }
+ * @endcode
+ */
+class TSemaphore {
+public:
+    /// Permit of a @ref TSemaphore, released on destruction.
+    class [[nodiscard]] TPermit {
+    public:
+        TPermit() = default;
+
+        explicit TPermit(TSemaphore* semaphore)
+            : Semaphore_(semaphore)
+        { }
+
+        TPermit(TPermit&& other) noexcept
+            : Semaphore_(std::exchange(other.Semaphore_, nullptr))
+        { }
+
+        TPermit& operator=(TPermit&& other) noexcept {
+            if (this != &other) {
+                Release();
+                Semaphore_ = std::exchange(other.Semaphore_, nullptr);
+            }
+            return *this;
+        }
+
+        ~TPermit() {
+            Release();
+        }
+
+        /// Returns the permit before the destruction.
+        void Release() {
+            if (auto* semaphore = std::exchange(Semaphore_, nullptr)) {
+                semaphore->Release();
+            }
+        }
+
+        explicit operator bool() const {
+            return Semaphore_ != nullptr;
+        }
+
+    private:
+        TSemaphore* Semaphore_ = nullptr;
+    };
+
+    explicit TSemaphore(size_t count)
+        : Count_(count)
+    { }
+
+    TSemaphore(const TSemaphore&) = delete;
+    TSemaphore& operator=(const TSemaphore&) = delete;
+
+    /// Waits for a permit.
+    auto Acquire() {
+        struct TAwaitableAcquire {
+            TAwaitableAcquire(TSemaphore* semaphore)
+                : Semaphore(semaphore)
+            { }
+
+            TAwaitableAcquire(const TAwaitableAcquire&) = delete;
+            TAwaitableAcquire& operator=(const TAwaitableAcquire&) = delete;
+
+            ~TAwaitableAcquire() {
+                Semaphore->Waiters_.Remove(&Waiter);
+            }
+
+            bool await_ready() {
+                if (Semaphore->Count_ > 0) {
+                    Semaphore->Count_--;
+                    return true;
+                }
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                Waiter.Handle = h;
+                Semaphore->Waiters_.Push(&Waiter);
+            }
+
+            TPermit await_resume() {
+                return TPermit(Semaphore);
+            }
+
+            TSemaphore* Semaphore;
+            TWaiter Waiter = {};
+        };
+        return TAwaitableAcquire{this};
+    }
+
+    /// Takes a permit without waiting, an empty one if none is available.
+    TPermit TryAcquire() {
+        if (Count_ == 0) {
+            return {};
+        }
+        Count_--;
+        return TPermit(this);
+    }
+
+    /// Returns the number of free permits.
+    size_t Available() const {
+        return Count_;
+    }
+
+private:
+    struct TWaiter : NDetail::TWaitNode {
+        THandle Handle = {};
+    };
+
+    // the permit passes straight to the first waiter
+    void Release() {
+        if (auto* waiter = static_cast<TWaiter*>(Waiters_.Pop())) {
+            waiter->Handle.resume();
+            return;
+        }
+        Count_++;
+    }
+
+    size_t Count_;
+    NDetail::TWaitQueue Waiters_;
+};
+
+} // namespace NNet
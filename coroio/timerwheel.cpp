@@ -0,0 +1,210 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "timerwheel.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace NNet {
+
+TTimerWheel::TTimerWheel(TClock::duration tick)
+    : Start_(TClock::now())
+    , Tick_(tick)
+{
+    if (Tick_ <= TClock::duration::zero()) {
+        throw std::invalid_argument("Tick must be positive");
+    }
+    for (auto& level : Slots_) {
+        level.fill(Nil);
+    }
+}
+
+unsigned TTimerWheel::Add(TTime deadline, THandle h) {
+    uint32_t index;
+    if (!FreeNodes_.empty()) {
+        index = FreeNodes_.back();
+        FreeNodes_.pop_back();
+    } else {
+        // the last index is reserved: together with the last generation it would be ~0u
+        if (Nodes_.size() >= (1u << IndexBits) - 1) {
+            throw std::runtime_error("Too many timers");
+        }
+        index = Nodes_.size();
+        Nodes_.emplace_back();
+    }
+    auto& node = Nodes_[index];
+    node.Deadline = deadline;
+    node.Seq = Seq_++;
+    node.Handle = h;
+    node.Live = true;
+    Link(index);
+    Size_++;
+    return Id(index);
+}
+
+bool TTimerWheel::Remove(unsigned id) {
+    auto* node = Find(id);
+    if (!node) {
+        return false;
+    }
+    uint32_t index = id & ((1u << IndexBits) - 1);
+    if (node->Level != Detached) {
+        Unlink(index);
+    }
+    Free(index);
+    return true;
+}
+
+THandle TTimerWheel::Fire(unsigned id, TTime* deadline) {
+    auto* node = Find(id);
+    if (!node || node->Level != Detached) {
+        return {};
+    }
+    THandle h = node->Handle;
+    if (deadline) {
+        *deadline = node->Deadline;
+    }
+    Free(id & ((1u << IndexBits) - 1));
+    return h;
+}
+
+void TTimerWheel::Expire(TTime now, std::vector<unsigned>& expired) {
+    uint64_t target = TickOf(now);
+    auto first = expired.size();
+    int level, slot;
+    while (NextSlot(level, slot)) {
+        uint64_t start = SlotStart(level, slot);
+        if (start > target) {
+            break;
+        }
+        Elapsed_ = start;
+
+        uint32_t index = Slots_[level][slot];
+        Slots_[level][slot] = Nil;
+        Occupied_[level] &= ~(1ULL << slot);
+
+        while (index != Nil) {
+            auto& node = Nodes_[index];
+            uint32_t next = node.Next;
+            node.Level = Detached;
+            if (level == 0 && node.Deadline <= now) {
+                expired.emplace_back(Id(index));
+            } else {
+                // cascade down, or keep a level-0 timer due later within the current tick
+                Link(index);
+            }
+            index = next;
+        }
+
+        if (level == 0 && start == target) {
+            break;
+        }
+    }
+    Elapsed_ = std::max(Elapsed_, target);
+
+    std::sort(expired.begin() + first, expired.end(), [&](unsigned a, unsigned b) {
+        const auto& l = Nodes_[a & ((1u << IndexBits) - 1)];
+        const auto& r = Nodes_[b & ((1u << IndexBits) - 1)];
+        return std::tie(l.Deadline, l.Seq) < std::tie(r.Deadline, r.Seq);
+    });
+}
+
+TTime TTimerWheel::NextExpiration() const {
+    int level, slot;
+    if (!NextSlot(level, slot)) {
+        return TTime::max();
+    }
+    if (level > 0) {
+        return Start_ + Tick_ * SlotStart(level, slot);
+    }
+    TTime deadline = TTime::max();
+    for (uint32_t index = Slots_[level][slot]; index != Nil; index = Nodes_[index].Next) {
+        deadline = std::min(deadline, Nodes_[index].Deadline);
+    }
+    return deadline;
+}
+
+uint64_t TTimerWheel::TickOf(TTime t) const {
+    if (t <= Start_) {
+        return 0;
+    }
+    return (t - Start_) / Tick_;
+}
+
+uint64_t TTimerWheel::SlotStart(int level, int slot) const {
+    uint64_t shift = LevelBits * level;
+    uint64_t base = Elapsed_ & ~((1ULL << (shift + LevelBits)) - 1);
+    return base + (static_cast<uint64_t>(slot) << shift);
+}
+
+bool TTimerWheel::NextSlot(int& level, int& slot) const {
+    for (level = 0; level < Levels; level++) {
+        if (Occupied_[level]) {
+            // all slots below the current one are empty: they would belong to a higher level
+            slot = std::countr_zero(Occupied_[level]);
+            return true;
+        }
+    }
+    return false;
+}
+
+TTimerWheel::TNode* TTimerWheel::Find(unsigned id) {
+    uint32_t index = id & ((1u << IndexBits) - 1);
+    if (index >= Nodes_.size()) {
+        return nullptr;
+    }
+    auto& node = Nodes_[index];
+    if (!node.Live || node.Generation != static_cast<uint8_t>(id >> IndexBits)) {
+        return nullptr;
+    }
+    return &node;
+}
+
+void TTimerWheel::Link(uint32_t index) {
+    constexpr uint64_t horizon = (1ULL << (LevelBits * Levels)) - 1;
+    auto& node = Nodes_[index];
+    uint64_t tick = std::max(TickOf(node.Deadline), Elapsed_);
+    if ((tick ^ Elapsed_) > horizon) {
+        // too far away, park in the last slot and re-link on cascade
+        tick = Elapsed_ | horizon;
+    }
+    uint64_t masked = (tick ^ Elapsed_) | (SlotsPerLevel - 1);
+    int level = (63 - std::countl_zero(masked)) / LevelBits;
+    int slot = (tick >> (LevelBits * level)) & (SlotsPerLevel - 1);
+
+    node.Level = level;
+    node.Slot = slot;
+    node.Prev = Nil;
+    node.Next = Slots_[level][slot];
+    if (node.Next != Nil) {
+        Nodes_[node.Next].Prev = index;
+    }
+    Slots_[level][slot] = index;
+    Occupied_[level] |= 1ULL << slot;
+}
+
+void TTimerWheel::Unlink(uint32_t index) {
+    auto& node = Nodes_[index];
+    if (node.Prev != Nil) {
+        Nodes_[node.Prev].Next = node.Next;
+    } else {
+        Slots_[node.Level][node.Slot] = node.Next;
+        if (node.Next == Nil) {
+            Occupied_[node.Level] &= ~(1ULL << node.Slot);
+        }
+    }
+    if (node.Next != Nil) {
+        Nodes_[node.Next].Prev = node.Prev;
+    }
+    node.Level = Detached;
+}
+
+void TTimerWheel::Free(uint32_t index) {
+    auto& node = Nodes_[index];
+    node.Live = false;
+    node.Handle = {};
+    node.Generation++;
+    FreeNodes_.emplace_back(index);
+    Size_--;
+}
+
+} // namespace NNet
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "base.hpp"
+
+namespace NNet {
+
+/**
+ * @class TTimerWheel
+ * @brief Hierarchical timer wheel with O(1) insertion and cancellation.
+ *
+ * Alternative timer storage for @ref TPollerBase (see @ref TPollerBase::SetTimerWheel()).
+ * Timers live in @c Levels levels of 64 slots; a slot of level @c L covers @c 64^L ticks.
+ * A timer is placed on the level of the highest 6-bit group in which its expiration tick
+ * differs from the current tick, so every timer of a lower level expires before any timer
+ * of a higher level. Slots of higher levels are cascaded down when the wheel reaches them.
+ *
+ * Timer ids encode the slot of the node in the internal node pool plus a generation
+ * counter, so @ref Remove() unlinks the node without searching.
+ *
+ * Deadlines are stored exactly: a timer never fires before its deadline, the tick size
+ * only bounds the size of a level-0 slot.
+ */
+class TTimerWheel {
+public:
+    /**
+     * @brief Creates an empty wheel.
+     *
+     * @param tick Duration of a level-0 slot.
+     */
+    TTimerWheel(TClock::duration tick = std::chrono::milliseconds(1));
+
+    /**
+     * @brief Schedules a timer.
+     *
+     * @return The timer id, valid until the timer fires or is removed.
+     */
+    unsigned Add(TTime deadline, THandle h);
+    /**
+     * @brief Cancels a timer.
+     *
+     * @return True if the timer was pending; false if it already fired or was removed.
+     */
+    bool Remove(unsigned id);
+    /**
+     * @brief Collects timers with deadline <= @p now.
+     *
+     * Appends their ids to @p expired ordered by deadline and insertion order. The timers
+     * stay pending until @ref Fire() is called, so they still can be cancelled by the
+     * coroutines resumed before them.
+     */
+    void Expire(TTime now, std::vector<unsigned>& expired);
+    /**
+     * @brief Releases an expired timer.
+     *
+     * @param deadline If set, receives the deadline of the timer.
+     * @return Its coroutine handle or an empty handle if the timer was removed meanwhile.
+     */
+    THandle Fire(unsigned id, TTime* deadline = nullptr);
+    /**
+     * @brief Returns a time point not later than the earliest deadline.
+     *
+     * Exact for timers of level 0; for higher levels it is the start of the slot that has
+     * to be cascaded next. Returns TTime::max() if the wheel is empty.
+     */
+    TTime NextExpiration() const;
+
+    /// Returns the number of pending timers.
+    size_t Size() const {
+        return Size_;
+    }
+
+    /// Returns true if there are no pending timers.
+    bool Empty() const {
+        return Size_ == 0;
+    }
+
+private:
+    static constexpr int LevelBits = 6;
+    static constexpr int SlotsPerLevel = 1 << LevelBits;
+    static constexpr int Levels = 6;
+    static constexpr int IndexBits = 24;
+    static constexpr uint32_t Nil = static_cast<uint32_t>(-1);
+    static constexpr uint8_t Detached = 0xff;
+
+    struct TNode {
+        TTime Deadline;
+        uint64_t Seq = 0;
+        THandle Handle;
+        uint32_t Prev = Nil;
+        uint32_t Next = Nil;
+        uint8_t Level = Detached;
+        uint8_t Slot = 0;
+        uint8_t Generation = 0;
+        bool Live = false;
+    };
+
+    uint64_t TickOf(TTime t) const;
+    uint64_t SlotStart(int level, int slot) const;
+    bool NextSlot(int& level, int& slot) const;
+    TNode* Find(unsigned id);
+    void Link(uint32_t index);
+    void Unlink(uint32_t index);
+    void Free(uint32_t index);
+
+    unsigned Id(uint32_t index) const {
+        return index | (static_cast<unsigned>(Nodes_[index].Generation) << IndexBits);
+    }
+
+    TTime Start_;
+    TClock::duration Tick_;
+    uint64_t Elapsed_ = 0; ///< Current tick.
+    uint64_t Seq_ = 0; ///< Insertion counter, orders timers with equal deadlines.
+    size_t Size_ = 0;
+    std::vector<TNode> Nodes_;
+    std::vector<uint32_t> FreeNodes_;
+    std::array<std::array<uint32_t, SlotsPerLevel>, Levels> Slots_;
+    std::array<uint64_t, Levels> Occupied_ = {}; ///< Bitmap of non-empty slots per level.
+};
+
+} // namespace NNet
@@ -2,14 +2,19 @@
 #ifdef __linux__
 #include "uring.hpp"
 
+#include <algorithm>
+
+#include <fcntl.h>
+#include <poll.h>
+
 #ifdef HAVE_URING
 
 namespace NNet {
 
-TUring::TUring(int queueSize)
+TUring::TUring(int queueSize, const TUringOptions& options)
     : RingFd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
     , EpollFd_(epoll_create1(EPOLL_CLOEXEC))
-    , Buffer_(32768)
+    , Buffer_(FixedBufferCount * FixedBufferSize + ProvidedBufferCount * ProvidedBufferSize)
 {
     int err;
     if (RingFd_ < 0) {
@@ -18,10 +23,54 @@ TUring::TUring(int queueSize)
     if (EpollFd_ < 0) {
         throw std::system_error(errno, std::generic_category(), "epoll_create1");
     }
-    if ((err = io_uring_queue_init(queueSize, &Ring_, 0)) < 0) {
+    unsigned optional = 0;
+#ifdef IORING_SETUP_COOP_TASKRUN
+    if (options.CoopTaskRun && !options.SqPoll) {
+        optional |= IORING_SETUP_COOP_TASKRUN;
+    }
+#endif
+#ifdef IORING_SETUP_SINGLE_ISSUER
+    if (options.SingleIssuer) {
+        optional |= IORING_SETUP_SINGLE_ISSUER;
+    }
+#endif
+    auto init = [&](unsigned flags) {
+        io_uring_params params = {};
+        params.flags = flags;
+        if (options.SqPoll) {
+            params.flags |= IORING_SETUP_SQPOLL;
+            params.sq_thread_idle = options.SqThreadIdleMs;
+            if (options.SqThreadCpu >= 0) {
+                params.flags |= IORING_SETUP_SQ_AFF;
+                params.sq_thread_cpu = options.SqThreadCpu;
+            }
+        }
+        return io_uring_queue_init_params(queueSize, &Ring_, &params);
+    };
+    err = init(optional);
+    if (err == -EINVAL && optional) {
+        // kernels before 5.19/6.0 reject the flags they do not know
+        err = init(0);
+    }
+    if (err < 0) {
         throw std::system_error(-err, std::generic_category(), "io_uring_queue_init");
     }
 
+    SetupBuffers();
+#ifdef IO_URING_VERSION_MAJOR
+    if (auto* probe = io_uring_get_probe_ring(&Ring_)) {
+        Splice_ = io_uring_opcode_supported(probe, IORING_OP_SPLICE);
+        io_uring_free_probe(probe);
+    }
+#endif
+
+    ArmWakeup();
+    Submit();
+    Interrupter_ = [this]() { eventfd_write(RingFd_, 1); };
+    // queued before close(), so it can only match operations on the file being closed and
+    // never those submitted later for a socket that reuses the fd number
+    Deregister_ = [this](int fd) { Cancel(fd); };
+
 //        if ((err = io_uring_register_eventfd(&Ring_, RingFd_)) < 0) {
 //            throw std::system_error(-err, std::generic_category(), "io_uring_register_eventfd");
 //        }
@@ -32,58 +81,489 @@ TUring::TUring(int queueSize)
 //        if (epoll_ctl(EpollFd_, EPOLL_CTL_ADD, eev.data.fd, &eev) < 0) {
 //            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
 //        }
-
-//        iovec iov = {.iov_base = Buffer_.data(), .iov_len = Buffer_.size() };
-//        if ((err = io_uring_register_buffers(&Ring_, &iov, 1)) < 0) {
-//            throw std::system_error(-err, std::generic_category(), "io_uring_register_buffers");
-//        }
 }
 
 TUring::~TUring() {
+#ifdef IO_URING_VERSION_MAJOR
+    if (BufRing_) {
+        io_uring_free_buf_ring(&Ring_, BufRing_, ProvidedBufferCount, BufferGroup);
+    }
+#endif
     io_uring_queue_exit(&Ring_);
+    for (auto& fds : FreePipes_) {
+        close(fds[0]);
+        close(fds[1]);
+    }
     close(RingFd_);
     close(EpollFd_);
 }
 
+void TUring::SetupBuffers() {
+    // Both pools are optional: old kernels or a low RLIMIT_MEMLOCK only cost the fast path
+    std::vector<iovec> iovs(FixedBufferCount);
+    for (int i = 0; i < FixedBufferCount; i++) {
+        iovs[i].iov_base = Buffer_.data() + i * FixedBufferSize;
+        iovs[i].iov_len = FixedBufferSize;
+    }
+    if (io_uring_register_buffers(&Ring_, iovs.data(), iovs.size()) == 0) {
+        FixedBase_ = Buffer_.data();
+        for (int i = FixedBufferCount - 1; i >= 0; i--) {
+            FreeFixed_.emplace_back(i);
+        }
+    }
+
+#ifdef IO_URING_VERSION_MAJOR
+    int err = 0;
+    BufRing_ = io_uring_setup_buf_ring(&Ring_, ProvidedBufferCount, BufferGroup, 0, &err);
+    if (BufRing_) {
+        ProvidedBase_ = Buffer_.data() + FixedBufferCount * FixedBufferSize;
+        int mask = io_uring_buf_ring_mask(ProvidedBufferCount);
+        for (int i = 0; i < ProvidedBufferCount; i++) {
+            io_uring_buf_ring_add(BufRing_, ProvidedBase_ + i * ProvidedBufferSize, ProvidedBufferSize, i, mask, i);
+        }
+        io_uring_buf_ring_advance(BufRing_, ProvidedBufferCount);
+    }
+
+    // slots are filled by Register(), kernels before 5.19 keep using the fd table
+    if (io_uring_register_files_sparse(&Ring_, FixedFileCount) == 0) {
+        FixedFiles_ = true;
+        for (int i = FixedFileCount - 1; i >= 0; i--) {
+            FreeFileSlots_.emplace_back(i);
+        }
+    }
+#endif
+}
+
+void* TUring::NewOp(std::coroutine_handle<> handle, int fd, void* buf, int size, int fixedSlot) {
+    uint32_t index;
+    if (!FreeOps_.empty()) {
+        index = FreeOps_.back();
+        FreeOps_.pop_back();
+    } else {
+        index = Ops_.size();
+        Ops_.emplace_back();
+    }
+    Ops_[index] = TOp{handle, fd, buf, size, fixedSlot};
+    if (handle) {
+        HandleOps_[handle.address()] = index;
+    }
+    return reinterpret_cast<void*>((static_cast<uintptr_t>(index) << 1) | 1);
+}
+
+void TUring::ReleaseHandle(uint32_t index) {
+    auto& op = Ops_[index];
+    if (!op.Handle) {
+        return;
+    }
+    auto it = HandleOps_.find(op.Handle.address());
+    if (it != HandleOps_.end() && it->second == index) {
+        HandleOps_.erase(it);
+    }
+    op.Handle = {};
+}
+
+void TUring::CompleteOp(uint32_t index, int res, unsigned flags) {
+    auto& op = Ops_[index];
+    if (op.FixedSlot >= 0) {
+        FreeFixed_.emplace_back(op.FixedSlot);
+    }
+#ifdef IO_URING_VERSION_MAJOR
+    if (flags & IORING_CQE_F_BUFFER) {
+        int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        char* data = ProvidedBase_ + bid * ProvidedBufferSize;
+        if (res > 0 && op.Buf) {
+            memcpy(op.Buf, data, res);
+        }
+        io_uring_buf_ring_add(BufRing_, data, ProvidedBufferSize, bid, io_uring_buf_ring_mask(ProvidedBufferCount), 0);
+        io_uring_buf_ring_advance(BufRing_, 1);
+    }
+#else
+    (void)res; (void)flags;
+#endif
+    ReleaseHandle(index);
+    FreeOps_.emplace_back(index);
+}
+
+void TUring::CompleteMultishot(uint32_t index, int res, unsigned flags) {
+    auto& op = Ops_[index];
+    auto* state = op.State;
+#ifdef IO_URING_VERSION_MAJOR
+    bool more = flags & IORING_CQE_F_MORE;
+#else
+    bool more = false;
+#endif
+    int fd = op.Fd;
+    bool recv = op.Stream == TOp::Recv;
+
+    if (!recv) {
+        if (state) {
+            state->Accepted.push(res);
+        } else if (res >= 0) {
+            close(res);
+        }
+    } else {
+#ifdef IO_URING_VERSION_MAJOR
+        if (flags & IORING_CQE_F_BUFFER) {
+            int bid = flags >> IORING_CQE_BUFFER_SHIFT;
+            char* data = ProvidedBase_ + bid * ProvidedBufferSize;
+            if (state && res > 0) {
+                state->Data.append(data, res);
+            }
+            io_uring_buf_ring_add(BufRing_, data, ProvidedBufferSize, bid, io_uring_buf_ring_mask(ProvidedBufferCount), 0);
+            io_uring_buf_ring_advance(BufRing_, 1);
+        }
+#endif
+        if (state && res == 0) {
+            state->Eof = true;
+        } else if (state && res < 0 && res != -ENOBUFS && !(res == -ECANCELED && state->Paused)) {
+            state->Error = -res;
+        }
+    }
+
+    if (!more) {
+        ReleaseHandle(index);
+        op.State = nullptr;
+        op.Stream = TOp::None;
+        FreeOps_.emplace_back(index);
+        if (state) {
+            state->Armed = false;
+            state->Paused = false;
+        }
+    } else if (recv && state && !state->Paused && state->Data.size() - state->Offset > MaxStreamBuffered) {
+        state->Paused = true;
+        CancelOp(index);
+    }
+
+    if (!state || !state->Waiter) {
+        return;
+    }
+    bool ready = recv
+        ? state->Data.size() > state->Offset || state->Eof || state->Error
+        : !state->Accepted.empty();
+    if (ready) {
+        ReadyEvents_.emplace_back(TEvent{-1, 0, state->Waiter});
+        state->Waiter = {};
+    } else if (!state->Armed) {
+        // the ring ran out of buffers, the consumer is still waiting
+        RecvMultishot(fd, state);
+    }
+}
+
+void TUring::CancelOp(uint32_t index) {
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_cancel(sqe, reinterpret_cast<void*>((static_cast<uintptr_t>(index) << 1) | 1), 0);
+    io_uring_sqe_set_data(sqe, nullptr);
+}
+
+void TUring::ArmWakeup() {
+    struct io_uring_sqe *sqe = GetSqe();
+    // RingFd_ is non-blocking, so wait for readiness instead of queueing a read
+    io_uring_prep_poll_add(sqe, RingFd_, POLLIN);
+    io_uring_sqe_set_data(sqe, &WakeupValue_);
+}
+
 void TUring::Read(int fd, void* buf, int size, std::coroutine_handle<> handle) {
+    ReadAt(fd, buf, size, CurrentPosition, handle);
+}
+
+void TUring::Write(int fd, const void* buf, int size, std::coroutine_handle<> handle) {
+    WriteAt(fd, buf, size, CurrentPosition, handle);
+}
+
+void TUring::ReadV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle) {
+    ReadAtV(fd, iov, count, CurrentPosition, handle);
+}
+
+void TUring::WriteV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle) {
+    WriteAtV(fd, iov, count, CurrentPosition, handle);
+}
+
+void TUring::ReadAt(int fd, void* buf, int size, int64_t offset, std::coroutine_handle<> handle) {
     struct io_uring_sqe *sqe = GetSqe();
-    io_uring_prep_read(sqe, fd, buf, size, 0);
-    //io_uring_prep_read_fixed(sqe, fd, Buffer_.data(), size, 0, 0);
+    io_uring_prep_read(sqe, fd, buf, size, offset);
+    UseFixedFile(sqe, fd);
     io_uring_sqe_set_data(sqe, handle.address());
 }
 
-void TUring::Write(int fd, const void* buf, int size, std::coroutine_handle<> handle) {
+void TUring::WriteAt(int fd, const void* buf, int size, int64_t offset, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    if (size <= FixedBufferSize && !FreeFixed_.empty()) {
+        int slot = FreeFixed_.back(); FreeFixed_.pop_back();
+        char* data = FixedBase_ + slot * FixedBufferSize;
+        memcpy(data, buf, size);
+        io_uring_prep_write_fixed(sqe, fd, data, size, offset, slot);
+        UseFixedFile(sqe, fd);
+        io_uring_sqe_set_data(sqe, NewOp(handle, fd, nullptr, size, slot));
+    } else {
+        io_uring_prep_write(sqe, fd, buf, size, offset);
+        UseFixedFile(sqe, fd);
+        io_uring_sqe_set_data(sqe, handle.address());
+    }
+}
+
+void TUring::ReadAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_readv(sqe, fd, iov, count, offset);
+    UseFixedFile(sqe, fd);
+    io_uring_sqe_set_data(sqe, handle.address());
+}
+
+void TUring::WriteAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_writev(sqe, fd, iov, count, offset);
+    UseFixedFile(sqe, fd);
+    io_uring_sqe_set_data(sqe, handle.address());
+}
+
+void TUring::Fsync(int fd, bool dataOnly, std::coroutine_handle<> handle) {
     struct io_uring_sqe *sqe = GetSqe();
-    io_uring_prep_write(sqe, fd, buf, size, 0);
-    //memcpy(Buffer_.data(), buf, size);
-    //io_uring_prep_write_fixed(sqe, fd, Buffer_.data(), size, 0, 0);
+    io_uring_prep_fsync(sqe, fd, dataOnly ? IORING_FSYNC_DATASYNC : 0);
+    UseFixedFile(sqe, fd);
     io_uring_sqe_set_data(sqe, handle.address());
 }
 
 void TUring::Recv(int fd, void* buf, int size, std::coroutine_handle<> handle) {
     struct io_uring_sqe *sqe = GetSqe();
-    io_uring_prep_recv(sqe, fd, buf, size, 0);
+    if (BufRing_) {
+        // the kernel picks a buffer of the group when data arrives, see CompleteOp()
+        io_uring_prep_recv(sqe, fd, nullptr, std::min(size, ProvidedBufferSize), 0);
+        UseFixedFile(sqe, fd);
+        sqe->flags |= IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BufferGroup;
+        io_uring_sqe_set_data(sqe, NewOp(handle, fd, buf, size, -1));
+    } else {
+        io_uring_prep_recv(sqe, fd, buf, size, 0);
+        UseFixedFile(sqe, fd);
+        io_uring_sqe_set_data(sqe, handle.address());
+    }
+}
+
+void TUring::WaitReadable(int fd, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_poll_add(sqe, fd, POLLIN);
+    UseFixedFile(sqe, fd);
+    io_uring_sqe_set_data(sqe, handle.address());
+}
+
+void TUring::WaitHangup(int fd, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    // POLLHUP and POLLERR are always reported
+    io_uring_prep_poll_add(sqe, fd, POLLRDHUP);
+    UseFixedFile(sqe, fd);
     io_uring_sqe_set_data(sqe, handle.address());
 }
 
 void TUring::Send(int fd, const void* buf, int size, std::coroutine_handle<> handle) {
+    if (size <= FixedBufferSize && !FreeFixed_.empty()) {
+        // write(2) on a socket is send(2) without flags
+        Write(fd, buf, size, handle);
+        return;
+    }
     struct io_uring_sqe *sqe = GetSqe();
     io_uring_prep_send(sqe, fd, buf, size, 0);
+    UseFixedFile(sqe, fd);
     io_uring_sqe_set_data(sqe, handle.address());
 }
 
+void TUring::SendZeroCopy(int fd, const void* buf, int size, std::coroutine_handle<> handle) {
+#ifdef IO_URING_VERSION_MAJOR
+    if (ZeroCopy_) {
+        struct io_uring_sqe *sqe = GetSqe();
+        io_uring_prep_send_zc(sqe, fd, buf, size, 0, 0);
+        UseFixedFile(sqe, fd);
+        void* tag = NewOp(handle, fd, const_cast<void*>(buf), size, -1);
+        Ops_[reinterpret_cast<uintptr_t>(tag) >> 1].ZeroCopy = true;
+        io_uring_sqe_set_data(sqe, tag);
+        return;
+    }
+#endif
+    Send(fd, buf, size, handle);
+}
+
+void TUring::SendMsg(int fd, const msghdr* msg, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_sendmsg(sqe, fd, msg, 0);
+    UseFixedFile(sqe, fd);
+    io_uring_sqe_set_data(sqe, handle.address());
+}
+
+void TUring::RecvMsg(int fd, msghdr* msg, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_recvmsg(sqe, fd, msg, 0);
+    UseFixedFile(sqe, fd);
+    io_uring_sqe_set_data(sqe, handle.address());
+}
+
+void TUring::Splice(int in, int64_t inOffset, int out, int size, std::coroutine_handle<> handle) {
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_splice(sqe, in, inOffset, out, -1, size, SPLICE_F_MOVE);
+    // IOSQE_FIXED_FILE applies to the destination of a splice
+    UseFixedFile(sqe, out);
+    io_uring_sqe_set_data(sqe, handle.address());
+}
+
+TUring::TPipe::TPipe(TUring& poller)
+    : Poller_(&poller)
+{
+    if (!poller.FreePipes_.empty()) {
+        Fds_ = poller.FreePipes_.back();
+        poller.FreePipes_.pop_back();
+    } else if (pipe2(Fds_.data(), O_CLOEXEC) < 0) {
+        throw std::system_error(errno, std::generic_category(), "pipe2");
+    }
+}
+
+TUring::TPipe::~TPipe() {
+    if (Empty_ && Poller_->FreePipes_.size() < MaxFreePipes) {
+        Poller_->FreePipes_.push_back(Fds_);
+        return;
+    }
+    // closing is safe with a splice in flight, the kernel holds its own reference
+    close(Fds_[0]);
+    close(Fds_[1]);
+}
+
+bool TUring::CompleteZeroCopy(uint32_t index, int res, unsigned flags) {
+    auto& op = Ops_[index];
+#ifdef IO_URING_VERSION_MAJOR
+    if (flags & IORING_CQE_F_NOTIF) {
+        // the kernel released the buffer
+        res = op.Result;
+    } else if (flags & IORING_CQE_F_MORE) {
+        // bytes sent, the notification follows
+        op.Result = res;
+        return false;
+    }
+#else
+    (void)flags;
+#endif
+    TOp done = op;
+    ReleaseHandle(index);
+    op.ZeroCopy = false;
+    FreeOps_.emplace_back(index);
+    if (res == -EINVAL || res == -EOPNOTSUPP) {
+        // IORING_OP_SEND_ZC is unknown to this kernel or unsupported by the socket
+        ZeroCopy_ = false;
+        if (done.Handle) {
+            Send(done.Fd, done.Buf, done.Size, done.Handle);
+        }
+        return false;
+    }
+    if (done.Handle) {
+        Results_.push_back(res);
+        ReadyEvents_.emplace_back(TEvent{-1, TEvent::RESULT, done.Handle});
+    }
+    return true;
+}
+
 void TUring::Accept(int fd, sockaddr* addr, socklen_t* len, std::coroutine_handle<> handle) {
     struct io_uring_sqe *sqe = GetSqe();
     io_uring_prep_accept(sqe, fd, addr, len, 0);
+    UseFixedFile(sqe, fd);
     io_uring_sqe_set_data(sqe, handle.address());
 }
 
+void TUring::AcceptMultishot(int fd, TUringMultishot* state) {
+    struct io_uring_sqe *sqe = GetSqe();
+#ifdef IO_URING_VERSION_MAJOR
+    io_uring_prep_multishot_accept(sqe, fd, nullptr, nullptr, SOCK_CLOEXEC);
+    UseFixedFile(sqe, fd);
+#else
+    // without IORING_CQE_F_MORE the stream re-arms on the next TUringAcceptStream::Next()
+    io_uring_prep_accept(sqe, fd, nullptr, nullptr, SOCK_CLOEXEC);
+    UseFixedFile(sqe, fd);
+#endif
+    void* tag = NewOp({}, fd, nullptr, 0, -1);
+    io_uring_sqe_set_data(sqe, tag);
+    state->Op = reinterpret_cast<uintptr_t>(tag) >> 1;
+    Ops_[state->Op].Stream = TOp::Accept;
+    Ops_[state->Op].State = state;
+    state->Armed = true;
+}
+
+void TUring::RecvMultishot(int fd, TUringMultishot* state) {
+#ifdef IO_URING_VERSION_MAJOR
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+    UseFixedFile(sqe, fd);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BufferGroup;
+    void* tag = NewOp({}, fd, nullptr, 0, -1);
+    io_uring_sqe_set_data(sqe, tag);
+    state->Op = reinterpret_cast<uintptr_t>(tag) >> 1;
+    Ops_[state->Op].Stream = TOp::Recv;
+    Ops_[state->Op].State = state;
+    state->Armed = true;
+#else
+    (void)fd; (void)state;
+    throw std::runtime_error("Multishot receive is not supported");
+#endif
+}
+
+void TUring::CancelMultishot(TUringMultishot* state) {
+    state->Waiter = {};
+    if (!state->Armed) {
+        return;
+    }
+    Ops_[state->Op].State = nullptr;
+    CancelOp(state->Op);
+    state->Armed = false;
+}
+
 void TUring::Connect(int fd, const sockaddr* addr, socklen_t len, std::coroutine_handle<> handle) {
     struct io_uring_sqe *sqe = GetSqe();
     io_uring_prep_connect(sqe, fd, addr, len);
+    UseFixedFile(sqe, fd);
     io_uring_sqe_set_data(sqe, handle.address());
 }
 
+void TUring::Connect(int fd, const sockaddr* addr, socklen_t len, std::coroutine_handle<> handle, TTime deadline) {
+    if (deadline == TTime::max()) {
+        Connect(fd, addr, len, handle);
+        return;
+    }
+    Reserve(2);
+    Connect(fd, addr, len, handle);
+    LinkTimeout(deadline);
+}
+
+void TUring::SendThenRecv(int fd, const void* out, int outSize, void* in, int inSize, int* sent,
+                          std::coroutine_handle<> handle, TTime deadline)
+{
+    Reserve(deadline == TTime::max() ? 2 : 3);
+    struct io_uring_sqe *sqe = GetSqe();
+    // a short send would let the receive start early, MSG_WAITALL turns it into a failure
+    io_uring_prep_send(sqe, fd, out, outSize, MSG_WAITALL);
+    UseFixedFile(sqe, fd);
+    void* tag = NewOp({}, fd, nullptr, 0, -1);
+    Ops_[reinterpret_cast<uintptr_t>(tag) >> 1].Status = sent;
+    io_uring_sqe_set_data(sqe, tag);
+    Link();
+
+    // the caller's buffer is busy anyway, a provided buffer would only add a copy
+    sqe = GetSqe();
+    io_uring_prep_recv(sqe, fd, in, inSize, 0);
+    UseFixedFile(sqe, fd);
+    io_uring_sqe_set_data(sqe, handle.address());
+    if (deadline != TTime::max()) {
+        LinkTimeout(deadline);
+    }
+}
+
+void TUring::LinkTimeout(TTime deadline) {
+    Link();
+    auto timeout = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::max(deadline - TClock::now(), TClock::duration::zero())).count();
+    void* tag = NewOp({}, -1, nullptr, 0, -1);
+    auto& op = Ops_[reinterpret_cast<uintptr_t>(tag) >> 1];
+    op.LinkTimeout = true;
+    op.Timeout.tv_sec = timeout / 1000000000;
+    op.Timeout.tv_nsec = timeout % 1000000000;
+    struct io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_link_timeout(sqe, &op.Timeout, 0);
+    io_uring_sqe_set_data(sqe, tag);
+}
+
 void TUring::Cancel(int fd) {
     struct io_uring_sqe *sqe = GetSqe();
     // io_uring_prep_cancel_fd(sqe, fd, 0);
@@ -93,12 +573,66 @@ void TUring::Cancel(int fd) {
 }
 
 void TUring::Cancel(std::coroutine_handle<> h) {
+    if (RemoveCompletion(h, Results_)) {
+        return;
+    }
+    if (auto it = HandleOps_.find(h.address()); it != HandleOps_.end()) {
+        uint32_t index = it->second;
+        auto& op = Ops_[index];
+        // the completion frees the record without touching the caller's memory
+        ReleaseHandle(index);
+        op.Buf = nullptr;
+        op.Status = nullptr;
+        CancelOp(index);
+        return;
+    }
+    // the user_data of the submission is the handle itself
     struct io_uring_sqe *sqe = GetSqe();
     io_uring_prep_cancel(sqe, h.address(), 0);
+    io_uring_sqe_set_data(sqe, nullptr);
+    Cancelled_.insert(h.address());
 }
 
-void TUring::Register(int) {
+void TUring::Register(int fd) {
+#ifdef IO_URING_VERSION_MAJOR
+    if (!FixedFiles_ || fd < 0) {
+        return;
+    }
+    if (fd >= static_cast<int>(FileSlots_.size())) {
+        FileSlots_.resize(fd + 1, -1);
+    }
+    int slot = FileSlots_[fd];
+    if (slot < 0) {
+        if (FreeFileSlots_.empty()) {
+            return;
+        }
+        slot = FreeFileSlots_.back();
+    }
+    if (io_uring_register_files_update(&Ring_, slot, &fd, 1) != 1) {
+        return;
+    }
+    if (FileSlots_[fd] < 0) {
+        FreeFileSlots_.pop_back();
+        FileSlots_[fd] = slot;
+    }
+#else
+    (void)fd;
+#endif
+}
 
+void TUring::Unregister(int fd) {
+#ifdef IO_URING_VERSION_MAJOR
+    if (fd < 0 || fd >= static_cast<int>(FileSlots_.size()) || FileSlots_[fd] < 0) {
+        return;
+    }
+    int slot = FileSlots_[fd];
+    int empty = -1;
+    io_uring_register_files_update(&Ring_, slot, &empty, 1);
+    FileSlots_[fd] = -1;
+    FreeFileSlots_.emplace_back(slot);
+#else
+    (void)fd;
+#endif
 }
 
 int TUring::Wait(timespec ts) {
@@ -106,12 +640,8 @@ int TUring::Wait(timespec ts) {
     unsigned head;
     int err;
 
-    for (auto& ev : Changes_) {
-        assert(ev.Type == (TEvent::READ|TEvent::WRITE|TEvent::RHUP));
-        assert(!ev.Handle);
-        Cancel(ev.Fd);
-    }
-
+    // closes are cancelled by Deregister_, nothing else is queued
+    assert(Changes_.empty());
     Reset();
 
 //        int nfds = 0;
@@ -130,34 +660,90 @@ int TUring::Wait(timespec ts) {
 //        }
 
     struct __kernel_timespec kts = {ts.tv_sec, ts.tv_nsec};
-//        if ((err = io_uring_submit_and_wait_timeout(&Ring_, &cqe, 1, &ts, nullptr)) < 0) {
-//            if (-err != ETIME) {
-//                throw std::system_error(-err, std::generic_category(), "io_uring_wait_cqe_timeout");
-//            }
-//        }
-
-    Submit();
-
-    if ((err = io_uring_wait_cqe_timeout(&Ring_, &cqe, &kts)) < 0) {
-        if (-err != ETIME) {
-            throw std::system_error(-err, std::generic_category(), "io_uring_wait_cqe_timeout");
+    if (io_uring_cq_ready(&Ring_) > 0) {
+        // completions are already there, only flush the new submissions
+        // (no syscall at all with SQPOLL or an empty submission queue)
+        Submit();
+    } else {
+        RecordSubmissions(io_uring_sq_ready(&Ring_));
+        auto pollStart = StatsStart();
+        err = io_uring_submit_and_wait_timeout(&Ring_, &cqe, 1, &kts, nullptr);
+        RecordPoll(pollStart);
+        if (err < 0 && -err != ETIME && -err != EINTR) {
+            throw std::system_error(-err, std::generic_category(), "io_uring_submit_and_wait_timeout");
         }
     }
 
     assert(Results_.empty());
 
     int completed = 0;
+    int seen = 0;
+    bool rearm = false;
     io_uring_for_each_cqe(&Ring_, head, cqe) {
-        completed ++;
+        seen ++;
         void* data = reinterpret_cast<void*>(cqe->user_data);
-        if (data != nullptr) {
-            Results_.push(cqe->res);
-            ReadyEvents_.emplace_back(TEvent{-1, 0, std::coroutine_handle<>::from_address(data)});
+        if (data == &WakeupValue_) {
+            rearm = true;
+            continue;
+        }
+        completed ++;
+        auto tag = reinterpret_cast<uintptr_t>(data);
+        if (tag & 1) {
+            uint32_t index = tag >> 1;
+            if (Ops_[index].Stream != TOp::None) {
+                CompleteMultishot(index, cqe->res, cqe->flags);
+                continue;
+            }
+            if (Ops_[index].LinkTimeout) {
+                // -ETIME if it cancelled the operation, -ECANCELED or -ENOENT otherwise
+                CompleteOp(index, cqe->res, cqe->flags);
+                completed --;
+                continue;
+            }
+            if (Ops_[index].ZeroCopy) {
+                if (!CompleteZeroCopy(index, cqe->res, cqe->flags)) {
+                    completed --;
+                }
+                continue;
+            }
+            TOp op = Ops_[index];
+            int res = cqe->res;
+            CompleteOp(index, res, cqe->flags);
+            if (res == -ENOBUFS && op.Handle) {
+                // provided buffers exhausted, retry into the caller's buffer
+                struct io_uring_sqe *sqe = GetSqe();
+                io_uring_prep_recv(sqe, op.Fd, op.Buf, op.Size, 0);
+                UseFixedFile(sqe, op.Fd);
+                io_uring_sqe_set_data(sqe, op.Handle.address());
+                completed --;
+                continue;
+            }
+            if (op.Status) {
+                *op.Status = res;
+            }
+            if (op.Handle) {
+                Results_.push_back(res);
+                ReadyEvents_.emplace_back(TEvent{-1, TEvent::RESULT, op.Handle});
+            }
+        } else if (data != nullptr) {
+            if (!Cancelled_.empty() && Cancelled_.erase(data)) {
+                // the coroutine is gone, see Cancel()
+                completed --;
+                continue;
+            }
+            Results_.push_back(cqe->res);
+            ReadyEvents_.emplace_back(TEvent{-1, TEvent::RESULT, std::coroutine_handle<>::from_address(data)});
         }
     }
 
-    io_uring_cq_advance(&Ring_, completed);
+    io_uring_cq_advance(&Ring_, seen);
+
+    if (rearm) {
+        eventfd_read(RingFd_, &WakeupValue_);
+        ArmWakeup();
+    }
 
+    ProcessPosted();
     ProcessTimers();
 
     return completed;
@@ -165,17 +751,66 @@ int TUring::Wait(timespec ts) {
 
 int TUring::Result() {
     int r = Results_.front();
-    Results_.pop();
+    Results_.pop_front();
     return r;
 }
 
 void TUring::Submit() {
     int err;
+    RecordSubmissions(io_uring_sq_ready(&Ring_));
     if ((err = io_uring_submit(&Ring_) < 0)) {
         throw std::system_error(-err, std::generic_category(), "io_uring_submit");
     }
 }
 
+TUringAcceptStream::~TUringAcceptStream() {
+    Poller_->CancelMultishot(&State_);
+    while (!State_.Accepted.empty()) {
+        if (State_.Accepted.front() >= 0) {
+            close(State_.Accepted.front());
+        }
+        State_.Accepted.pop();
+    }
+}
+
+TUring::TSocket TUringAcceptStream::Pop() {
+    int fd = State_.Accepted.front();
+    State_.Accepted.pop();
+    if (fd < 0) {
+        throw std::system_error(-fd, std::generic_category(), "accept");
+    }
+    sockaddr_storage addr;
+    socklen_t len = sizeof(addr);
+    if (getpeername(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "getpeername");
+    }
+    return TUring::TSocket{TAddress{reinterpret_cast<sockaddr*>(&addr), len}, fd, *Poller_};
+}
+
+TUringRecvStream::~TUringRecvStream() {
+    Poller_->CancelMultishot(&State_);
+}
+
+ssize_t TUringRecvStream::Pop(void* buf, size_t size) {
+    size_t available = State_.Data.size() - State_.Offset;
+    if (available > 0) {
+        size_t n = std::min(size, available);
+        memcpy(buf, State_.Data.data() + State_.Offset, n);
+        State_.Offset += n;
+        if (State_.Offset == State_.Data.size()) {
+            State_.Data.clear();
+            State_.Offset = 0;
+        }
+        return n;
+    }
+    if (State_.Error) {
+        throw std::system_error(State_.Error, std::generic_category(), "recv");
+    }
+    return 0;
+}
+
 } // namespace NNet
 
 #endif // HAVE_URING
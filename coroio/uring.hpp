@@ -11,16 +11,62 @@
 #include <assert.h>
 #include <sys/eventfd.h>
 #include <sys/epoll.h>
+#include <poll.h>
 
 #include <system_error>
 #include <iostream>
 #include <tuple>
 #include <vector>
+#include <deque>
 #include <coroutine>
 #include <queue>
+#include <cstring>
+#include <climits>
+#include <string>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace NNet {
 
+class TUringAcceptStream;
+class TUringRecvStream;
+
+/**
+ * @brief Consumer side of a multishot operation, see @ref TUringAcceptStream and @ref TUringRecvStream.
+ */
+struct TUringMultishot {
+    std::queue<int> Accepted; ///< Accepted descriptors, or negative errno values.
+    std::string Data; ///< Received bytes not consumed yet, starting at @c Offset.
+    size_t Offset = 0;
+    std::coroutine_handle<> Waiter; ///< Coroutine waiting for the next completion.
+    int Error = 0; ///< errno of a failed receive.
+    bool Eof = false; ///< The peer closed the connection.
+    bool Armed = false; ///< A submission is in flight.
+    bool Paused = false; ///< The submission is being cancelled because too much data is buffered.
+    uint32_t Op = 0; ///< Operation record of the submission while @c Armed.
+};
+
+/**
+ * @brief Ring setup flags of @ref TUring.
+ *
+ * All options are off by default, which matches a plain io_uring_queue_init().
+ */
+struct TUringOptions {
+    /// Let a kernel thread poll the submission queue (IORING_SETUP_SQPOLL): submissions need no syscall.
+    bool SqPoll = false;
+    /// CPU the submission polling thread is pinned to, -1 for no affinity. Used only with @c SqPoll.
+    int SqThreadCpu = -1;
+    /// Idle time after which the submission polling thread sleeps until the next submission.
+    unsigned SqThreadIdleMs = 1000;
+    /// Run completion task work on the next ring entry instead of interrupting the thread
+    /// (IORING_SETUP_COOP_TASKRUN). Ignored with @c SqPoll, which has no such interrupts.
+    bool CoopTaskRun = false;
+    /// Promise that only the creating thread submits (IORING_SETUP_SINGLE_ISSUER).
+    /// @ref TPollerBase::Post() from other threads is fine, it only writes the wakeup eventfd.
+    bool SingleIssuer = false;
+};
+
 /**
  * @class TUring
  * @brief Poller implementation based on io_uring.
@@ -30,6 +76,19 @@ namespace NNet {
  *
  * Key features:
  * - Uses io_uring to queue and submit asynchronous I/O operations.
+ * - @ref Recv() uses a provided buffer ring: the kernel picks a buffer from a shared pool
+ *   when data arrives, so idle sockets keep no buffer busy; the data is copied into the
+ *   caller's buffer on completion and the receive size is capped by the pool buffer size.
+ * - @ref Write() and @ref Send() copy up to 16 KiB into a registered (fixed) buffer and
+ *   use IORING_OP_WRITE_FIXED, so pages are not pinned per operation.
+ * - Both fall back to the plain operations if the kernel lacks support or the pools are exhausted.
+ * - @ref SendZeroCopy() sends large buffers with IORING_OP_SEND_ZC, see @ref TPollerDrivenSocket::SetZeroCopy().
+ * - @ref Wait() submits and waits with a single io_uring_enter; with @ref TUringOptions::SqPoll
+ *   an iteration that finds completions ready makes no syscall at all.
+ * - @ref Register() puts sockets into the registered file table, so submissions on them skip
+ *   the per-operation file table lookup and reference counting.
+ * - @ref Link() and @ref LinkTimeout() chain dependent submissions (IOSQE_IO_LINK,
+ *   IORING_OP_LINK_TIMEOUT), e.g. @ref SendThenRecv() for a request/response round trip.
  * - Provides operations such as @ref Read(), @ref Write(), @ref Recv(), @ref Send(), @ref Accept() and @ref Connect().
  * - Offers additional methods for cancelling pending operations, registering file descriptors, waiting for completions,
  *   and submitting queued requests.
@@ -37,6 +96,8 @@ namespace NNet {
  * Type aliases:
  *  - @c TSocket is defined as NNet::TPollerDrivenSocket<TUring>.
  *  - @c TFileHandle is defined as NNet::TPollerDrivenFileHandle<TUring>.
+ *  - @c TAcceptStream and @c TRecvStream are the streams returned by
+ *    @ref TPollerDrivenSocket::AcceptStream() and @ref TPollerDrivenSocket::RecvStream().
  *
  * Example usage:
  * @code{.cpp}
@@ -66,12 +127,20 @@ public:
     using TSocket = NNet::TPollerDrivenSocket<TUring>;
     /// Alias for the poller-driven file handle type.
     using TFileHandle = NNet::TPollerDrivenFileHandle<TUring>;
+    /// Alias for the poller-driven datagram socket type.
+    using TDatagramSocket = NNet::TPollerDrivenDatagramSocket<TUring>;
+    /// Alias for the multishot accept stream.
+    using TAcceptStream = TUringAcceptStream;
+    /// Alias for the multishot receive stream.
+    using TRecvStream = TUringRecvStream;
     /**
      * @brief Constructs a TUring instance.
      *
      * @param queueSize The desired size of the io_uring submission queue (default is 256).
+     * @param options   Ring setup flags. COOP_TASKRUN and SINGLE_ISSUER are dropped silently
+     *                  on kernels that do not know them; a failing SQPOLL setup throws.
      */
-    TUring(int queueSize = 256);
+    TUring(int queueSize = 256, const TUringOptions& options = {});
     /// Destructor cleans up the io_uring and related resources.
     ~TUring();
     /**
@@ -92,6 +161,58 @@ public:
      * @param handle Coroutine handle to resume upon completion.
      */
     void Write(int fd, const void* buf, int size, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a vectored read (IORING_OP_READV).
+     *
+     * @param fd The file descriptor.
+     * @param iov Buffers to fill; the array must stay valid until completion.
+     * @param count Number of buffers.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void ReadV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a vectored write (IORING_OP_WRITEV).
+     *
+     * @param fd The file descriptor.
+     * @param iov Buffers to write; the array must stay valid until completion.
+     * @param count Number of buffers.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void WriteV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a read at @p offset that leaves the file position alone, pread(2).
+     *
+     * @ref Read() and the other operations without an offset use the file position, as read(2).
+     *
+     * @param fd The file descriptor.
+     * @param buf Buffer where data is to be stored.
+     * @param size Number of bytes to read.
+     * @param offset The file offset of the first byte.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void ReadAt(int fd, void* buf, int size, int64_t offset, std::coroutine_handle<> handle);
+    /// Posts a write at @p offset, pwrite(2); small writes go through a registered buffer like @ref Write().
+    void WriteAt(int fd, const void* buf, int size, int64_t offset, std::coroutine_handle<> handle);
+    /// Posts a vectored read at @p offset, preadv(2).
+    void ReadAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle);
+    /// Posts a vectored write at @p offset, pwritev(2).
+    void WriteAtV(int fd, const iovec* iov, int count, int64_t offset, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts an fsync(2) (IORING_OP_FSYNC).
+     *
+     * @param fd The file descriptor.
+     * @param dataOnly fdatasync(2) if true.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void Fsync(int fd, bool dataOnly, std::coroutine_handle<> handle);
+    /// Same as @ref ReadV(): readv(2) on a socket is recvmsg(2) without flags.
+    void RecvV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle) {
+        ReadV(fd, iov, count, handle);
+    }
+    /// Same as @ref WriteV(): writev(2) on a socket is sendmsg(2) without flags.
+    void SendV(int fd, const iovec* iov, int count, std::coroutine_handle<> handle) {
+        WriteV(fd, iov, count, handle);
+    }
     /**
      * @brief Posts an asynchronous receive operation.
      *
@@ -101,6 +222,22 @@ public:
      * @param handle Coroutine handle to resume upon completion.
      */
     void Recv(int fd, void* buf, int size, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a poll request completing once @p fd is readable.
+     *
+     * @param fd The socket descriptor.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void WaitReadable(int fd, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a poll request completing once the peer of @p fd hangs up (POLLRDHUP).
+     *
+     * Data arriving meanwhile does not complete it.
+     *
+     * @param fd The socket descriptor.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void WaitHangup(int fd, std::coroutine_handle<> handle);
     /**
      * @brief Posts an asynchronous send operation.
      *
@@ -110,6 +247,86 @@ public:
      * @param handle Coroutine handle to resume upon completion.
      */
     void Send(int fd, const void* buf, int size, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a zero-copy send (IORING_OP_SEND_ZC).
+     *
+     * The kernel transmits from @p buf directly; @p handle is resumed with the number of bytes
+     * sent only after the notification that the buffer is released. Falls back to @ref Send()
+     * if the kernel does not support zero-copy sends.
+     *
+     * @param fd The file descriptor.
+     * @param buf Buffer containing data to send; must stay intact until completion.
+     * @param size Number of bytes to send.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void SendZeroCopy(int fd, const void* buf, int size, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a sendmsg(2) (IORING_OP_SENDMSG), e.g. a datagram with its address.
+     *
+     * @param fd The socket descriptor.
+     * @param msg The message; it and what it points to must stay valid until completion.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void SendMsg(int fd, const msghdr* msg, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a recvmsg(2) (IORING_OP_RECVMSG).
+     *
+     * @param fd The socket descriptor.
+     * @param msg The message, updated by the kernel on completion like recvmsg(2) does.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void RecvMsg(int fd, msghdr* msg, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a splice(2) (IORING_OP_SPLICE) moving @p size bytes from @p in to @p out.
+     *
+     * One side must be a pipe. Requires @ref HasSplice().
+     *
+     * @param in The source descriptor.
+     * @param inOffset Offset in @p in, -1 for a pipe.
+     * @param out The destination descriptor.
+     * @param size Number of bytes to move.
+     * @param handle Coroutine handle to resume upon completion.
+     */
+    void Splice(int in, int64_t inOffset, int out, int size, std::coroutine_handle<> handle);
+    /// Returns true if the kernel knows IORING_OP_SPLICE.
+    bool HasSplice() const {
+        return Splice_;
+    }
+    /// Bytes moved by one file to socket splice, the default capacity of a pipe.
+    static constexpr int SpliceChunk = 64 * 1024;
+
+    /**
+     * @class TPipe
+     * @brief A pipe carrying the data of a splice from a file to a socket.
+     *
+     * Taken from the cache of the poller; goes back to it if @ref SetEmpty() was called,
+     * otherwise bytes may be left in it and it is closed.
+     */
+    class TPipe {
+    public:
+        explicit TPipe(TUring& poller);
+        TPipe(const TPipe&) = delete;
+        TPipe& operator=(const TPipe&) = delete;
+        ~TPipe();
+
+        int ReadFd() const {
+            return Fds_[0];
+        }
+
+        int WriteFd() const {
+            return Fds_[1];
+        }
+
+        /// Marks the pipe as drained, it may be reused.
+        void SetEmpty() {
+            Empty_ = true;
+        }
+
+    private:
+        TUring* Poller_;
+        std::array<int, 2> Fds_;
+        bool Empty_ = false;
+    };
     /**
      * @brief Posts an asynchronous accept operation.
      *
@@ -128,6 +345,73 @@ public:
      * @param handle Coroutine handle to resume upon connection.
      */
     void Connect(int fd, const sockaddr* addr, socklen_t len, std::coroutine_handle<> handle);
+    /**
+     * @brief Posts a connect bounded by a linked timeout.
+     *
+     * If @p deadline passes first the kernel cancels the connect and @p handle is resumed
+     * with -ECANCELED, no timer of the poller is involved.
+     */
+    void Connect(int fd, const sockaddr* addr, socklen_t len, std::coroutine_handle<> handle, TTime deadline);
+    /**
+     * @brief Posts a send and a receive that starts only after the whole request is sent.
+     *
+     * Both operations are submitted together and linked, so a request/response exchange costs
+     * one submission. @p handle is resumed once with the result of the receive; it is -ECANCELED
+     * if the send failed (its result is stored into @p sent before) or @p deadline passed.
+     *
+     * @param sent Receives the result of the send; must stay valid until @p handle is resumed.
+     */
+    void SendThenRecv(int fd, const void* out, int outSize, void* in, int inSize, int* sent,
+                      std::coroutine_handle<> handle, TTime deadline = TTime::max());
+    /**
+     * @brief Makes sure the next @p count submissions fit into the submission queue.
+     *
+     * Call before queueing a chain: a chain split by an automatic @ref Submit() loses its links.
+     */
+    void Reserve(unsigned count) {
+        if (io_uring_sq_space_left(&Ring_) < count) {
+            Submit();
+        }
+    }
+    /// Makes the next submission start only after the last queued one succeeds (IOSQE_IO_LINK).
+    void Link() {
+        LastSqe_->flags |= IOSQE_IO_LINK;
+    }
+    /**
+     * @brief Cancels the last queued submission if it does not complete by @p deadline.
+     *
+     * Queues an IORING_OP_LINK_TIMEOUT linked to the last submission, which completes
+     * with -ECANCELED on expiration.
+     */
+    void LinkTimeout(TTime deadline);
+    /**
+     * @brief Posts a multishot accept: one submission produces a completion per connection.
+     *
+     * Accepted descriptors are appended to @p state and the waiter of @p state is resumed.
+     * Falls back to a single-shot accept if multishot accept is not available.
+     */
+    void AcceptMultishot(int fd, TUringMultishot* state);
+    /**
+     * @brief Posts a multishot receive served from the provided buffer ring.
+     *
+     * Received data is appended to @p state and the waiter of @p state is resumed.
+     * The submission is cancelled while more than @c MaxStreamBuffered bytes are buffered.
+     * Requires @ref HasProvidedBuffers().
+     */
+    void RecvMultishot(int fd, TUringMultishot* state);
+    /**
+     * @brief Detaches @p state from its submission and cancels it.
+     *
+     * Completions arriving afterwards are dropped: accepted descriptors are closed and
+     * provided buffers are recycled.
+     */
+    void CancelMultishot(TUringMultishot* state);
+    /// Buffered bytes of a @ref TUringRecvStream above which the multishot receive is paused.
+    static constexpr size_t MaxStreamBuffered = 1 << 20;
+    /// Returns true if the provided buffer ring is available.
+    bool HasProvidedBuffers() const {
+        return BufRing_ != nullptr;
+    }
     /**
      * @brief Cancels pending operations on the specified file descriptor.
      *
@@ -135,7 +419,13 @@ public:
      */
     void Cancel(int fd);
     /**
-     * @brief Cancels pending operations associated with a specific coroutine handle.
+     * @brief Cancels the pending operation of a specific coroutine handle.
+     *
+     * Called by awaitables of @ref TPollerDrivenSocket destroyed while their coroutine waits.
+     * The operation is cancelled by its user_data (IORING_OP_ASYNC_CANCEL) and its completion
+     * is dropped; a completion already collected by @ref Wait() is dropped with its result.
+     * Both the operation and the dropped completion are looked up by hash, whatever the
+     * number of operations in flight. Other operations on the same descriptor are not affected.
      *
      * @param h The coroutine handle.
      */
@@ -143,9 +433,19 @@ public:
     /**
      * @brief Registers a file descriptor with the IO_uring poller.
      *
+     * Installs @p fd into a slot of the registered file table; operations on it are then
+     * submitted with IOSQE_FIXED_FILE. Does nothing if the table is unsupported or full.
+     * Called by @ref TPollerDrivenSocket, which releases the slot with @ref Unregister() on close.
+     *
      * @param fd The file descriptor to register.
      */
     void Register(int fd);
+    /**
+     * @brief Removes @p fd from the registered file table.
+     *
+     * Must be called before @p fd is closed: the table holds its own reference to the file.
+     */
+    void Unregister(int fd);
    /**
      * @brief Waits for I/O completions.
      *
@@ -171,6 +471,30 @@ public:
     void Submit();
 
 private:
+    /// Queues a poll of @c RingFd_ which completes when @ref Post() is called from another thread.
+    void ArmWakeup();
+    /// Registers the fixed write buffers, the provided receive buffer ring and the file table, if supported.
+    void SetupBuffers();
+    /// Allocates an operation record; returns its tagged user_data.
+    void* NewOp(std::coroutine_handle<> handle, int fd, void* buf, int size, int fixedSlot);
+    /// Detaches the coroutine from the operation record @p index.
+    void ReleaseHandle(uint32_t index);
+    /// Finishes a tagged completion: copies provided-buffer data and recycles buffers.
+    void CompleteOp(uint32_t index, int res, unsigned flags);
+    /// Handles a completion of @ref SendZeroCopy(); returns true when the operation is done.
+    bool CompleteZeroCopy(uint32_t index, int res, unsigned flags);
+    /// Handles a completion of @ref AcceptMultishot() or @ref RecvMultishot().
+    void CompleteMultishot(uint32_t index, int res, unsigned flags);
+    /// Queues a cancellation of the operation record @p index.
+    void CancelOp(uint32_t index);
+    /// Switches @p sqe to the registered slot of @p fd, if any.
+    void UseFixedFile(io_uring_sqe* sqe, int fd) {
+        if (fd >= 0 && fd < static_cast<int>(FileSlots_.size()) && FileSlots_[fd] >= 0) {
+            sqe->fd = FileSlots_[fd];
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+    }
+
     /**
      * @brief Obtains an available submission queue entry (SQE) for io_uring.
      *
@@ -184,14 +508,211 @@ private:
             Submit();
             r = io_uring_get_sqe(&Ring_);
         }
+        LastSqe_ = r;
         return r;
     }
 
     int RingFd_; ///< File descriptor for the io_uring.
     int EpollFd_; ///< Epoll file descriptor (for integration with epoll).
     struct io_uring Ring_; ///< The io_uring structure.
-    std::queue<int> Results_; ///< Queue of results for completed operations.
-    std::vector<char> Buffer_; ///< Buffer used for internal I/O operations.
+    std::deque<int> Results_; ///< Queue of results for completed operations.
+    std::unordered_set<void*> Cancelled_; ///< Handles of cancelled submissions whose completion is dropped.
+    /**
+     * @brief An operation that needs work on completion.
+     *
+     * Its index is stored in the user_data of the SQE with the low bit set
+     * (coroutine handles are aligned, so the low bit of their address is zero).
+     */
+    struct TOp {
+        std::coroutine_handle<> Handle;
+        int Fd = -1;
+        void* Buf = nullptr; ///< Destination of a Recv() served from a provided buffer.
+        int Size = 0;
+        int FixedSlot = -1; ///< Registered buffer holding the data of a Write()/Send().
+        enum EStream : uint8_t { None, Accept, Recv } Stream = None; ///< Kind of a multishot operation.
+        TUringMultishot* State = nullptr; ///< Consumer of a multishot operation, nullptr once detached.
+        bool ZeroCopy = false; ///< A @ref SendZeroCopy() waiting for its notification.
+        int Result = 0; ///< Result of a zero-copy send, reported with the notification.
+        int* Status = nullptr; ///< Receives the result of a chained operation.
+        bool LinkTimeout = false; ///< A @ref LinkTimeout(), completes without a coroutine.
+        __kernel_timespec Timeout = {}; ///< Read by the kernel when the link timeout is submitted.
+    };
+
+    static constexpr int FixedBufferCount = 64;
+    static constexpr int FixedBufferSize = 16384;
+    static constexpr int ProvidedBufferCount = 256; // must be a power of 2
+    static constexpr int ProvidedBufferSize = 16384;
+    static constexpr int BufferGroup = 0;
+    static constexpr int FixedFileCount = 4096;
+    /// Offset asking the kernel for the file position (IORING_FEAT_RW_CUR_POS), ignored by sockets and pipes.
+    static constexpr int64_t CurrentPosition = -1;
+
+    std::vector<char> Buffer_; ///< Storage of the fixed and provided buffers.
+    char* FixedBase_ = nullptr; ///< Registered buffers, nullptr if registration failed.
+    std::vector<int> FreeFixed_; ///< Unused registered buffers.
+    char* ProvidedBase_ = nullptr; ///< Buffers of the provided buffer ring.
+    struct io_uring_buf_ring* BufRing_ = nullptr; ///< Provided buffer ring, nullptr if unsupported.
+    std::deque<TOp> Ops_; ///< Operation records, see @ref TOp; a deque keeps @c Timeout in place.
+    std::vector<uint32_t> FreeOps_; ///< Unused operation records.
+    std::unordered_map<void*, uint32_t> HandleOps_; ///< Operation record of a waiting coroutine, see @ref Cancel().
+    eventfd_t WakeupValue_ = 0; ///< Drained wakeup counter; its address tags the wakeup completion.
+    bool ZeroCopy_ = true; ///< Cleared when the kernel rejects IORING_OP_SEND_ZC.
+    bool FixedFiles_ = false; ///< The sparse registered file table was created.
+    std::vector<int> FileSlots_; ///< Registered slot by descriptor, -1 if none.
+    std::vector<int> FreeFileSlots_; ///< Unused slots of the registered file table.
+    bool Splice_ = false; ///< The kernel knows IORING_OP_SPLICE.
+    std::vector<std::array<int, 2>> FreePipes_; ///< Drained pipes of @ref TPipe.
+    static constexpr size_t MaxFreePipes = 16;
+    io_uring_sqe* LastSqe_ = nullptr; ///< Last entry returned by @ref GetSqe(), see @ref Link().
+};
+
+/**
+ * @class TUringAcceptStream
+ * @brief Stream of connections accepted by a single multishot accept submission.
+ *
+ * Returned by @ref TPollerDrivenSocket::AcceptStream() of a listening @ref TUring socket.
+ * The submission is armed on the first @ref Next() and stays armed while the kernel
+ * keeps producing completions, so a busy listener costs no submission per connection.
+ * Connections accepted before @ref Next() is called are queued.
+ *
+ * @code{.cpp}
+ * auto connections = listener.AcceptStream();
+ * while (true) {
+ *     auto client = co_await connections.Next();
+ *     serve(std::move(client));
+ * }
+ * @endcode
+ *
+ * The stream must outlive neither its listener nor its poller.
+ */
+class TUringAcceptStream {
+public:
+    TUringAcceptStream(TUring& poller, int fd)
+        : Poller_(&poller)
+        , Fd_(fd)
+    { }
+
+    TUringAcceptStream(const TUringAcceptStream&) = delete;
+    TUringAcceptStream& operator=(const TUringAcceptStream&) = delete;
+
+    ~TUringAcceptStream();
+
+    /**
+     * @brief Waits for the next accepted connection.
+     *
+     * @return An awaitable yielding a @ref TUring::TSocket; throws std::system_error if accept failed.
+     */
+    auto Next() {
+        struct TAwaitable {
+            bool await_ready() {
+                if (!Self->State_.Accepted.empty()) {
+                    return true;
+                }
+                if (!Self->State_.Armed) {
+                    Self->Poller_->AcceptMultishot(Self->Fd_, &Self->State_);
+                }
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                Self->State_.Waiter = h;
+            }
+
+            TUring::TSocket await_resume() {
+                return Self->Pop();
+            }
+
+            TUringAcceptStream* Self;
+        };
+        return TAwaitable{this};
+    }
+
+private:
+    TUring::TSocket Pop();
+
+    TUring* Poller_;
+    int Fd_;
+    TUringMultishot State_;
+};
+
+/**
+ * @class TUringRecvStream
+ * @brief Receives from a socket with a single multishot receive submission.
+ *
+ * Returned by @ref TPollerDrivenSocket::RecvStream() of a @ref TUring socket. Data arrives
+ * in buffers of the poller's provided buffer ring, so an idle connection holds no buffer;
+ * it is copied into an internal queue and handed out by @ref ReadSome(). The submission is
+ * paused while more than @ref TUring::MaxStreamBuffered bytes wait to be read.
+ *
+ * Falls back to a plain @ref TUring::Recv() per call if the provided buffer ring is unavailable.
+ * The stream must outlive neither its socket nor its poller.
+ */
+class TUringRecvStream {
+public:
+    TUringRecvStream(TUring& poller, int fd)
+        : Poller_(&poller)
+        , Fd_(fd)
+    { }
+
+    TUringRecvStream(const TUringRecvStream&) = delete;
+    TUringRecvStream& operator=(const TUringRecvStream&) = delete;
+
+    ~TUringRecvStream();
+
+    /**
+     * @brief Reads up to @p size bytes.
+     *
+     * @return An awaitable yielding the number of bytes read, 0 at end of stream;
+     *         throws std::system_error if the receive failed.
+     */
+    auto ReadSome(void* buf, size_t size) {
+        struct TAwaitable {
+            bool await_ready() {
+                auto& state = Self->State_;
+                if (state.Data.size() > state.Offset || state.Eof || state.Error) {
+                    return true;
+                }
+                if (!Self->Poller_->HasProvidedBuffers()) {
+                    Fallback = true;
+                } else if (!state.Armed) {
+                    Self->Poller_->RecvMultishot(Self->Fd_, &state);
+                }
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                if (Fallback) {
+                    Self->Poller_->Recv(Self->Fd_, Buf, Size, h);
+                } else {
+                    Self->State_.Waiter = h;
+                }
+            }
+
+            ssize_t await_resume() {
+                if (Fallback) {
+                    int ret = Self->Poller_->Result();
+                    if (ret < 0) {
+                        throw std::system_error(-ret, std::generic_category(), "recv");
+                    }
+                    return ret;
+                }
+                return Self->Pop(Buf, Size);
+            }
+
+            TUringRecvStream* Self;
+            void* Buf;
+            int Size;
+            bool Fallback = false;
+        };
+        return TAwaitable{this, buf, static_cast<int>(std::min<size_t>(size, INT_MAX))};
+    }
+
+private:
+    ssize_t Pop(void* buf, size_t size);
+
+    TUring* Poller_;
+    int Fd_;
+    TUringMultishot State_;
 };
 
 } // namespace NNet
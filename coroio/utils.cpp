@@ -1,19 +1,148 @@
 // © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
 #include "utils.hpp"
 
+#include <bit>
 #include <cstdint>
 #include <vector>
 #include <cstring>
 #include <sstream>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define COROIO_SCAN_SSE2
+#if defined(__GNUC__)
+#define COROIO_SCAN_AVX2
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COROIO_SCAN_NEON
+#endif
+
 namespace NNet::NUtils {
 
 namespace {
 
+struct TBufferCache {
+    static constexpr size_t MaxCached = 64; ///< Per size.
+    static constexpr size_t MaxBuckets = 8;
+
+    struct TBucket {
+        size_t Size = 0;
+        std::vector<std::vector<char>> Buffers;
+    };
+
+    TBucket* Find(size_t size) {
+        for (auto& bucket : Buckets) {
+            if (bucket.Size == size) {
+                return &bucket;
+            }
+        }
+        return nullptr;
+    }
+
+    // a handful of sizes are in use: the default ones of each reader type
+    std::vector<TBucket> Buckets;
+};
+
+thread_local TBufferCache BufferCache;
+
 uint32_t rol(uint32_t value, unsigned int bits) {
     return (value << bits) | (value >> (32 - bits));
 }
 
+// the block functions scan whole blocks only: they return the offset of the first match,
+// or the number of bytes scanned if there is none
+#if defined(COROIO_SCAN_AVX2)
+__attribute__((target("avx2")))
+size_t FindAvx2(const char* data, size_t size, char c, bool* found) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), needle);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32)), needle);
+        uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(a))
+            | (static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(b))) << 32);
+        if (mask) {
+            *found = true;
+            return i + std::countr_zero(mask);
+        }
+    }
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)), needle);
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(a));
+        if (mask) {
+            *found = true;
+            return i + std::countr_zero(mask);
+        }
+    }
+    return i;
+}
+
+bool HasAvx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+#if defined(COROIO_SCAN_SSE2)
+size_t FindSse2(const char* data, size_t size, char c, bool* found) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16)), needle);
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(a))
+            | (static_cast<uint32_t>(_mm_movemask_epi8(b)) << 16);
+        if (mask) {
+            *found = true;
+            return i + std::countr_zero(mask);
+        }
+    }
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), needle);
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(a));
+        if (mask) {
+            *found = true;
+            return i + std::countr_zero(mask);
+        }
+    }
+    return i;
+}
+#endif
+
+#if defined(COROIO_SCAN_NEON)
+// four bits per byte of the comparison result
+uint64_t NeonMask(uint8x16_t eq) {
+    uint8x8_t nibbles = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+    return vget_lane_u64(vreinterpret_u64_u8(nibbles), 0);
+}
+
+size_t FindNeon(const char* data, size_t size, char c, bool* found) {
+    const uint8x16_t needle = vdupq_n_u8(static_cast<uint8_t>(c));
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        uint8x16_t a = vceqq_u8(vld1q_u8(p + i), needle);
+        uint8x16_t b = vceqq_u8(vld1q_u8(p + i + 16), needle);
+        if (uint64_t mask = NeonMask(a)) {
+            *found = true;
+            return i + std::countr_zero(mask) / 4;
+        }
+        if (uint64_t mask = NeonMask(b)) {
+            *found = true;
+            return i + 16 + std::countr_zero(mask) / 4;
+        }
+    }
+    for (; i + 16 <= size; i += 16) {
+        if (uint64_t mask = NeonMask(vceqq_u8(vld1q_u8(p + i), needle))) {
+            *found = true;
+            return i + std::countr_zero(mask) / 4;
+        }
+    }
+    return i;
+}
+#endif
+
 } // namespace
 
 std::string Base64Encode(const unsigned char* data, size_t dataLen) {
@@ -116,4 +245,56 @@ void SHA1Digest(const unsigned char* data, size_t dataLen, unsigned char* output
              h0, h1, h2, h3, h4);
 }
 
+const char* FindByte(const char* data, size_t size, char c) {
+    size_t i = 0;
+    bool found = false;
+#if defined(COROIO_SCAN_AVX2)
+    if (HasAvx2()) {
+        i = FindAvx2(data, size, c, &found);
+    }
+#endif
+#if defined(COROIO_SCAN_SSE2)
+    if (!found) {
+        i += FindSse2(data + i, size - i, c, &found);
+    }
+#elif defined(COROIO_SCAN_NEON)
+    i += FindNeon(data, size, c, &found);
+#endif
+    if (found) {
+        return data + i;
+    }
+    for (; i < size; ++i) {
+        if (data[i] == c) {
+            return data + i;
+        }
+    }
+    return nullptr;
+}
+
+std::vector<char> AcquireBuffer(size_t size) {
+    auto* bucket = BufferCache.Find(size);
+    if (!bucket || bucket->Buffers.empty()) {
+        return std::vector<char>(size);
+    }
+    auto buffer = std::move(bucket->Buffers.back());
+    bucket->Buffers.pop_back();
+    return buffer;
+}
+
+void ReleaseBuffer(std::vector<char>&& buffer) {
+    if (buffer.empty()) {
+        return;
+    }
+    auto& cache = BufferCache;
+    auto* bucket = cache.Find(buffer.size());
+    if (!bucket && cache.Buckets.size() < TBufferCache::MaxBuckets) {
+        bucket = &cache.Buckets.emplace_back();
+        bucket->Size = buffer.size();
+    }
+    if (bucket && bucket->Buffers.size() < TBufferCache::MaxCached) {
+        bucket->Buffers.push_back(std::move(buffer));
+    }
+    std::vector<char>().swap(buffer);
+}
+
 } // namespace NNet::NUtils
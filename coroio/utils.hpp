@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace NNet {
 
@@ -9,6 +10,27 @@ namespace NUtils {
 std::string Base64Encode(const unsigned char* data, size_t dataLen);
 void SHA1Digest(const unsigned char* data, size_t dataLen, unsigned char* output);
 
+/**
+ * @brief Finds the first byte equal to @p c, like memchr().
+ *
+ * Compares 64 bytes per step with AVX2 when the CPU has it, 32 with SSE2 or NEON otherwise.
+ * Multi-byte delimiters are found by checking the candidates of their first byte.
+ *
+ * @return A pointer to the byte, nullptr if there is none.
+ */
+const char* FindByte(const char* data, size_t size, char c);
+
+/**
+ * @brief Takes a buffer of @p size bytes from the per-thread cache, or allocates one.
+ *
+ * Readers of hibernating connections return their storage with @ref ReleaseBuffer()
+ * while they wait and take it back here on the next readiness, so a million idle
+ * connections share the buffers of the few active ones.
+ */
+std::vector<char> AcquireBuffer(size_t size);
+/// Puts @p buffer back into the per-thread cache, or frees it if the cache is full.
+void ReleaseBuffer(std::vector<char>&& buffer);
+
 } // namespace NUtils
 
 } // namespace NNet
@@ -0,0 +1,93 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "wakeup.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+#include <cerrno>
+#include <system_error>
+
+#ifdef _WIN32
+int socketpair(int domain, int type, int protocol, SOCKET socks[2]);
+#endif
+
+namespace NNet {
+
+TWakeupFd::TWakeupFd() {
+#if defined(__linux__)
+    ReadFd_ = WriteFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (ReadFd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "eventfd");
+    }
+#elif defined(_WIN32)
+    SOCKET socks[2];
+    if (socketpair(AF_INET, SOCK_STREAM, 0, socks) != 0) {
+        throw std::system_error(WSAGetLastError(), std::generic_category(), "socketpair");
+    }
+    ReadFd_ = (int)socks[0];
+    WriteFd_ = (int)socks[1];
+#else
+    int p[2];
+    if (pipe(p) < 0) {
+        throw std::system_error(errno, std::generic_category(), "pipe");
+    }
+    ReadFd_ = p[0];
+    WriteFd_ = p[1];
+    for (int fd : p) {
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+            int err = errno;
+            close(ReadFd_);
+            close(WriteFd_);
+            throw std::system_error(err, std::generic_category(), "fcntl");
+        }
+    }
+#endif
+}
+
+TWakeupFd::~TWakeupFd() {
+#if defined(__linux__)
+    close(ReadFd_);
+#elif defined(_WIN32)
+    closesocket(ReadFd_);
+    closesocket(WriteFd_);
+#else
+    close(ReadFd_);
+    close(WriteFd_);
+#endif
+}
+
+void TWakeupFd::Notify() {
+    // A full pipe or an overflowing counter already means "readable", errors are ignored
+#if defined(__linux__)
+    eventfd_write(WriteFd_, 1);
+#elif defined(_WIN32)
+    char c = 0;
+    send(WriteFd_, &c, 1, 0);
+#else
+    char c = 0;
+    [[maybe_unused]] auto r = write(WriteFd_, &c, 1);
+#endif
+}
+
+void TWakeupFd::Drain() {
+#if defined(__linux__)
+    eventfd_t value;
+    eventfd_read(ReadFd_, &value);
+#elif defined(_WIN32)
+    char buf[256];
+    while (recv(ReadFd_, buf, sizeof(buf), 0) > 0) { }
+#else
+    char buf[256];
+    while (read(ReadFd_, buf, sizeof(buf)) > 0) { }
+#endif
+}
+
+} // namespace NNet
@@ -0,0 +1,39 @@
+#pragma once
+
+namespace NNet {
+
+/**
+ * @class TWakeupFd
+ * @brief A descriptor that can be made readable from any thread.
+ *
+ * Used by the readiness-based pollers to interrupt a blocking poll system call:
+ * the poller watches @ref Fd() for reading, other threads call @ref Notify().
+ *
+ * Implemented with eventfd on Linux, a non-blocking pipe on other Unix systems and a
+ * loopback socket pair on Windows.
+ */
+class TWakeupFd {
+public:
+    TWakeupFd();
+    ~TWakeupFd();
+
+    TWakeupFd(const TWakeupFd&) = delete;
+    TWakeupFd& operator=(const TWakeupFd&) = delete;
+
+    /// Returns the descriptor to watch for reading.
+    int Fd() const {
+        return ReadFd_;
+    }
+
+    /// Makes @ref Fd() readable. Thread-safe.
+    void Notify();
+
+    /// Consumes all pending notifications.
+    void Drain();
+
+private:
+    int ReadFd_ = -1;
+    int WriteFd_ = -1;
+};
+
+} // namespace NNet
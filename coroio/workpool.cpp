@@ -0,0 +1,188 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include "workpool.hpp"
+
+#include <algorithm>
+
+namespace NNet {
+
+namespace NDetail {
+
+TWorkStealingDeque::TWorkStealingDeque(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    Arrays_.emplace_back(std::make_unique<TArray>(size));
+    Array_.store(Arrays_.back().get(), std::memory_order_relaxed);
+}
+
+TWorkStealingDeque::TArray* TWorkStealingDeque::Grow(TArray* array, int64_t bottom, int64_t top) {
+    auto bigger = std::make_unique<TArray>(array->Capacity() * 2);
+    for (int64_t i = top; i < bottom; i++) {
+        bigger->Put(i, array->Get(i));
+    }
+    Arrays_.emplace_back(std::move(bigger));
+    auto* result = Arrays_.back().get();
+    Array_.store(result, std::memory_order_release);
+    return result;
+}
+
+void TWorkStealingDeque::Push(void* item) {
+    int64_t bottom = Bottom_.load(std::memory_order_relaxed);
+    int64_t top = Top_.load(std::memory_order_acquire);
+    auto* array = Array_.load(std::memory_order_relaxed);
+    if (bottom - top > static_cast<int64_t>(array->Capacity()) - 1) {
+        array = Grow(array, bottom, top);
+    }
+    array->Put(bottom, item);
+    std::atomic_thread_fence(std::memory_order_release);
+    Bottom_.store(bottom + 1, std::memory_order_relaxed);
+}
+
+void* TWorkStealingDeque::Take() {
+    int64_t bottom = Bottom_.load(std::memory_order_relaxed) - 1;
+    auto* array = Array_.load(std::memory_order_relaxed);
+    Bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = Top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+        Bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    void* item = array->Get(bottom);
+    if (top == bottom) {
+        // the last item, races with thieves
+        if (!Top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            item = nullptr;
+        }
+        Bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+void* TWorkStealingDeque::Steal() {
+    int64_t top = Top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = Bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return nullptr;
+    }
+    auto* array = Array_.load(std::memory_order_acquire);
+    void* item = array->Get(top);
+    if (!Top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return item;
+}
+
+size_t TWorkStealingDeque::Size() const {
+    int64_t bottom = Bottom_.load(std::memory_order_relaxed);
+    int64_t top = Top_.load(std::memory_order_relaxed);
+    return bottom > top ? bottom - top : 0;
+}
+
+} // namespace NDetail
+
+namespace {
+
+struct TCurrentWorker {
+    const TWorkPool* Pool = nullptr;
+    size_t Index = 0;
+};
+
+thread_local TCurrentWorker CurrentWorker;
+
+} // namespace
+
+TWorkPool::TWorkPool(int threads) {
+    if (threads <= 0) {
+        threads = std::max<int>(1, std::thread::hardware_concurrency());
+    }
+    Workers_.reserve(threads);
+    for (int i = 0; i < threads; i++) {
+        Workers_.emplace_back(std::make_unique<TWorker>());
+    }
+    // the deques exist before any worker may steal from them
+    for (int i = 0; i < threads; i++) {
+        Workers_[i]->Thread = std::thread([this, i]() { Run(i); });
+    }
+}
+
+TWorkPool::~TWorkPool() {
+    {
+        std::lock_guard lock(SleepMutex_);
+        Stopped_ = true;
+    }
+    Sleep_.notify_all();
+    for (auto& worker : Workers_) {
+        worker->Thread.join();
+    }
+}
+
+bool TWorkPool::InWorker() const {
+    return CurrentWorker.Pool == this;
+}
+
+void TWorkPool::Submit(std::coroutine_handle<> h) {
+    if (InWorker()) {
+        Workers_[CurrentWorker.Index]->Deque.Push(h.address());
+    } else {
+        std::lock_guard lock(InjectedMutex_);
+        Injected_.push_back(h.address());
+    }
+    // pairs with the check of Queued_ by a worker going to sleep, both are seq_cst
+    Queued_.fetch_add(1);
+    if (Sleeping_.load() > 0) {
+        std::lock_guard lock(SleepMutex_);
+        Sleep_.notify_one();
+    }
+}
+
+void* TWorkPool::FindWork(size_t index, uint64_t& seed) {
+    if (void* item = Workers_[index]->Deque.Take()) {
+        return item;
+    }
+    {
+        std::lock_guard lock(InjectedMutex_);
+        if (!Injected_.empty()) {
+            void* item = Injected_.front();
+            Injected_.pop_front();
+            return item;
+        }
+    }
+    size_t count = Workers_.size();
+    // xorshift picks the first victim, so thieves do not all hit the same deque
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    size_t start = seed % count;
+    for (size_t k = 0; k < count; k++) {
+        size_t victim = (start + k) % count;
+        if (victim == index) {
+            continue;
+        }
+        if (void* item = Workers_[victim]->Deque.Steal()) {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+void TWorkPool::Run(size_t index) {
+    CurrentWorker = {this, index};
+    uint64_t seed = 0x9e3779b97f4a7c15ULL * (index + 1);
+    while (!Stopped_.load(std::memory_order_relaxed)) {
+        if (void* item = FindWork(index, seed)) {
+            Queued_.fetch_sub(1, std::memory_order_relaxed);
+            std::coroutine_handle<>::from_address(item).resume();
+            continue;
+        }
+        std::unique_lock lock(SleepMutex_);
+        Sleeping_.fetch_add(1);
+        // a steal may have lost a race while items are still queued, so recheck the counter
+        Sleep_.wait(lock, [this]() { return Stopped_.load() || Queued_.load() > 0; });
+        Sleeping_.fetch_sub(1);
+    }
+}
+
+} // namespace NNet
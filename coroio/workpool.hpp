@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NNet {
+
+namespace NDetail {
+
+/**
+ * @class TWorkStealingDeque
+ * @brief Chase-Lev deque of pointers.
+ *
+ * The owner thread pushes and takes at the bottom, any other thread steals from the top.
+ * The storage grows as needed; replaced arrays are kept until the deque is destroyed,
+ * because a concurrent thief may still read them.
+ */
+class TWorkStealingDeque {
+public:
+    explicit TWorkStealingDeque(size_t capacity = 256);
+    TWorkStealingDeque(const TWorkStealingDeque&) = delete;
+    TWorkStealingDeque& operator=(const TWorkStealingDeque&) = delete;
+
+    /// Adds @p item at the bottom. Owner only.
+    void Push(void* item);
+    /// Removes the most recently pushed item, nullptr if empty. Owner only.
+    void* Take();
+    /// Removes the oldest item, nullptr if empty or lost to a concurrent take. Thread-safe.
+    void* Steal();
+    /// Returns an estimate of the number of items.
+    size_t Size() const;
+
+private:
+    struct TArray {
+        explicit TArray(size_t capacity)
+            : Mask(capacity - 1)
+            , Items(new std::atomic<void*>[capacity])
+        { }
+
+        void Put(int64_t i, void* item) {
+            Items[i & Mask].store(item, std::memory_order_relaxed);
+        }
+
+        void* Get(int64_t i) const {
+            return Items[i & Mask].load(std::memory_order_relaxed);
+        }
+
+        size_t Capacity() const {
+            return Mask + 1;
+        }
+
+        size_t Mask;
+        std::unique_ptr<std::atomic<void*>[]> Items;
+    };
+
+    TArray* Grow(TArray* array, int64_t bottom, int64_t top);
+
+    alignas(64) std::atomic<int64_t> Top_ = 0;
+    alignas(64) std::atomic<int64_t> Bottom_ = 0;
+    std::atomic<TArray*> Array_;
+    std::vector<std::unique_ptr<TArray>> Arrays_; ///< The current array is the last.
+};
+
+} // namespace NDetail
+
+/**
+ * @class TWorkPool
+ * @brief Work-stealing thread pool for the CPU-bound parts of coroutines.
+ *
+ * A coroutine running on a poller thread awaits @ref Offload() to continue on a worker,
+ * does its computation there, and awaits @ref TPollerBase::SwitchTo() (or
+ * @ref TLoop::Resume()) to get back to its poller before touching sockets again. I/O stays
+ * on the poller threads while the computation spreads across all cores, and a slow
+ * request no longer stalls the other coroutines of its loop.
+ *
+ * Every worker keeps its own Chase-Lev deque: an @ref Offload() from a worker pushes
+ * to the worker's deque, an @ref Offload() from any other thread goes to a shared
+ * injection queue, and idle workers steal from the oldest end of the others' deques.
+ * Workers with nothing to do sleep until new work is submitted.
+ *
+ * Example:
+ * @code{.cpp}
+ * TFuture<void> handle(TLoop<TEPoll>& loop, TWorkPool& pool, TSocket socket) {
+ *     auto request = co_await ReadRequest(socket);
+ *     co_await pool.Offload();
+ *     auto response = Render(request);   // on a worker thread
+ *     co_await loop.Resume();
+ *     co_await WriteResponse(socket, response);
+ * }
+ * @endcode
+ *
+ * The pool must outlive the coroutines it runs. Coroutines still queued when the
+ * pool is destroyed are not resumed.
+ */
+class TWorkPool {
+public:
+    /**
+     * @brief Starts @p threads workers.
+     *
+     * @param threads Number of workers; 0 means hardware concurrency.
+     */
+    explicit TWorkPool(int threads = 0);
+    TWorkPool(const TWorkPool&) = delete;
+    TWorkPool& operator=(const TWorkPool&) = delete;
+    /// Stops the workers and waits for them.
+    ~TWorkPool();
+
+    /// Returns the number of workers.
+    int Size() const {
+        return Workers_.size();
+    }
+
+    /**
+     * @brief Moves the awaiting coroutine onto a worker thread.
+     *
+     * Thread-safe.
+     */
+    auto Offload() {
+        struct TAwaitableOffload {
+            bool await_ready() {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> h) {
+                pool->Submit(h);
+            }
+
+            void await_resume() { }
+
+            TWorkPool* pool;
+        };
+        return TAwaitableOffload{this};
+    }
+
+    /// Returns true if the calling thread is a worker of this pool.
+    bool InWorker() const;
+
+private:
+    struct TWorker {
+        NDetail::TWorkStealingDeque Deque;
+        std::thread Thread;
+    };
+
+    void Submit(std::coroutine_handle<> h);
+    void Run(size_t index);
+    void* FindWork(size_t index, uint64_t& seed);
+
+    std::vector<std::unique_ptr<TWorker>> Workers_;
+
+    std::mutex InjectedMutex_;
+    std::deque<void*> Injected_; ///< Work submitted from outside the pool.
+
+    std::mutex SleepMutex_;
+    std::condition_variable Sleep_;
+    std::atomic<int64_t> Queued_ = 0;  ///< Items submitted and not yet taken.
+    std::atomic<int> Sleeping_ = 0;
+    std::atomic<bool> Stopped_ = false;
+};
+
+} // namespace NNet
@@ -8,9 +8,26 @@
 #define HAVE_OPENSSL
 #endif
 
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include <climits>
+#include <cstring>
 #include <sstream>
 #include <stdexcept>
 
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define COROIO_WS_SSE2
+#if defined(__GNUC__)
+#define COROIO_WS_AVX2
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COROIO_WS_NEON
+#endif
+
 namespace NNet
 {
 
@@ -39,12 +56,16 @@ std::string Base64Encode(const unsigned char* data, size_t dataLen) {
 }
 #endif
 
-std::string FindSecWebSocketAccept(const std::string& response) {
-    std::string lower = response;
-    std::transform(lower.begin(), lower.end(), lower.begin(),
+std::string Lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(),
                    [](unsigned char c){ return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+// headerName is lowercase, with the leading '\n' and the trailing ':'
+std::string FindHeader(const std::string& response, const std::string& headerName) {
+    std::string lower = Lower(response);
 
-    const std::string headerName = "sec-websocket-accept:";
     auto pos = lower.find(headerName);
     if (pos == std::string::npos) {
         return {};
@@ -70,18 +91,198 @@ std::string FindSecWebSocketAccept(const std::string& response) {
     return val;
 }
 
+std::string FindSecWebSocketAccept(const std::string& response) {
+    return FindHeader(response, "\nsec-websocket-accept:");
+}
+
+std::string_view Trim(std::string_view s) {
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front()))) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back()))) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// calls f for every trimmed non-empty item of the delimited list
+template<typename F>
+void Split(std::string_view s, char delimiter, F&& f) {
+    while (!s.empty()) {
+        auto pos = s.find(delimiter);
+        auto item = Trim(s.substr(0, pos));
+        if (!item.empty()) {
+            f(item);
+        }
+        s.remove_prefix(pos == std::string_view::npos ? s.size() : pos + 1);
+    }
+}
+
+struct TDeflateParams {
+    bool ServerNoContextTakeover = false;
+    bool ClientNoContextTakeover = false;
+    int ServerMaxWindowBits = 0; ///< 0 if absent.
+    int ClientMaxWindowBits = 0; ///< 0 if absent, -1 if present without a value.
+};
+
+// one element of a Sec-WebSocket-Extensions list, false unless it is a valid permessage-deflate one
+bool ParseDeflateParams(std::string_view element, TDeflateParams& params) {
+    bool first = true;
+    bool valid = true;
+    unsigned seen = 0;
+    Split(element, ';', [&](std::string_view item) {
+        if (first) {
+            first = false;
+            valid = Lower(std::string(item)) == "permessage-deflate";
+            return;
+        }
+        auto pos = item.find('=');
+        auto name = Lower(std::string(Trim(item.substr(0, pos))));
+        std::string_view value;
+        int bits = 0;
+        if (pos != std::string_view::npos) {
+            value = Trim(item.substr(pos + 1));
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+                value = value.substr(1, value.size() - 2);
+            }
+            if (value.empty() || value.size() > 2 || !std::all_of(value.begin(), value.end(), ::isdigit)) {
+                valid = false;
+                return;
+            }
+            bits = std::stoi(std::string(value));
+            if (bits < 8 || bits > 15) {
+                valid = false;
+                return;
+            }
+        }
+        unsigned bit;
+        if (name == "server_no_context_takeover" && !bits) {
+            bit = 1;
+            params.ServerNoContextTakeover = true;
+        } else if (name == "client_no_context_takeover" && !bits) {
+            bit = 2;
+            params.ClientNoContextTakeover = true;
+        } else if (name == "server_max_window_bits" && bits) {
+            bit = 4;
+            params.ServerMaxWindowBits = bits;
+        } else if (name == "client_max_window_bits") {
+            bit = 8;
+            params.ClientMaxWindowBits = bits ? bits : -1;
+        } else {
+            valid = false;
+            return;
+        }
+        // every parameter may be given once
+        valid = valid && !(seen & bit);
+        seen |= bit;
+    });
+    return valid && !first;
+}
+
+// zlib's raw deflate does not support 8, a request for it gives 9
+int ClampWindowBits(int bits) {
+    return std::clamp(bits, 9, 15);
+}
+
+size_t WriteFrameHeader(uint8_t* header, uint8_t head, size_t payloadSize, const uint8_t* key) {
+    size_t headerSize = 0;
+    header[headerSize++] = head;
+
+    uint8_t maskBit = key ? 0x80 : 0;
+    if (payloadSize <= 125) {
+        header[headerSize++] = maskBit | static_cast<uint8_t>(payloadSize);
+    } else if (payloadSize <= 0xFFFF) {
+        header[headerSize++] = maskBit | 126;
+        uint16_t length = htons(static_cast<uint16_t>(payloadSize));
+        memcpy(header + headerSize, &length, sizeof(length));
+        headerSize += sizeof(length);
+    } else {
+        header[headerSize++] = maskBit | 127;
+        uint64_t length = htonll(payloadSize);
+        memcpy(header + headerSize, &length, sizeof(length));
+        headerSize += sizeof(length);
+    }
+
+    if (key) {
+        memcpy(header + headerSize, key, 4);
+        headerSize += 4;
+    }
+    return headerSize;
+}
+
 std::string CalculateSecWebSocketAccept(const std::string& clientKeyBase64) {
     static const std::string magicGUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
     std::string toSha = clientKeyBase64 + magicGUID;
 
-    unsigned char sha[41];
+    unsigned char sha[20];
 #ifdef HAVE_OPENSSL
     SHA1(reinterpret_cast<const unsigned char*>(toSha.data()), toSha.size(), sha);
 #else
     NUtils::SHA1Digest(reinterpret_cast<const unsigned char*>(toSha.data()), toSha.size(), sha);
 #endif
 
-    return Base64Encode(sha, 40);
+    return Base64Encode(sha, sizeof(sha));
+}
+
+// the block functions return the number of processed bytes, always a multiple of 4,
+// so the tail starts at the key phase 0
+#if defined(COROIO_WS_AVX2)
+__attribute__((target("avx2")))
+size_t MaskAvx2(uint8_t* dst, const uint8_t* src, size_t size, uint32_t key) {
+    const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, k));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), _mm256_xor_si256(b, k));
+    }
+    for (; i + 32 <= size; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, k));
+    }
+    return i;
+}
+
+bool HasAvx2() {
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+#if defined(COROIO_WS_SSE2)
+size_t MaskSse2(uint8_t* dst, const uint8_t* src, size_t size, uint32_t key) {
+    const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(a, k));
+    }
+    return i;
+}
+#endif
+
+#if defined(COROIO_WS_NEON)
+size_t MaskNeon(uint8_t* dst, const uint8_t* src, size_t size, uint32_t key) {
+    const uint8x16_t k = vreinterpretq_u8_u32(vdupq_n_u32(key));
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), k));
+    }
+    return i;
+}
+#endif
+
+size_t MaskWords(uint8_t* dst, const uint8_t* src, size_t size, uint32_t key) {
+    const uint64_t k = (static_cast<uint64_t>(key) << 32) | key;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, sizeof(word));
+        word ^= k;
+        memcpy(dst + i, &word, sizeof(word));
+    }
+    return i;
 }
 
 } // namespace
@@ -112,6 +313,365 @@ void CheckSecWebSocketAccept(const std::string& allServerHeaders, const std::str
     }
 }
 
+std::string WebSocketUpgradeResponse(const std::string& request, const std::string& extensions) {
+    auto key = FindHeader(request, "\nsec-websocket-key:");
+    if (key.empty() || Lower(FindHeader(request, "\nupgrade:")) != "websocket") {
+        return {};
+    }
+    return
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        + (extensions.empty() ? "" : "Sec-WebSocket-Extensions: " + extensions + "\r\n") +
+        "Sec-WebSocket-Accept: " + CalculateSecWebSocketAccept(key) + "\r\n\r\n";
+}
+
+size_t ParseFrameHeader(const uint8_t* data, size_t size, TFrameHeader& header) {
+    if (size < 2) {
+        return 2;
+    }
+    header.Fin = data[0] & 0x80;
+    header.Rsv = data[0] & 0x70;
+    header.Opcode = data[0] & 0x0F;
+    header.Masked = data[1] & 0x80;
+    uint64_t payloadLength = data[1] & 0x7F;
+    size_t headerSize = 2 + (payloadLength == 126 ? 2 : 0) + (payloadLength == 127 ? 8 : 0) + (header.Masked ? 4 : 0);
+    if (size < headerSize) {
+        return headerSize;
+    }
+
+    size_t pos = 2;
+    if (payloadLength == 126) {
+        uint16_t extendedLength;
+        memcpy(&extendedLength, data + pos, sizeof(extendedLength));
+        payloadLength = ntohs(extendedLength);
+        pos += sizeof(extendedLength);
+    } else if (payloadLength == 127) {
+        uint64_t extendedLength;
+        memcpy(&extendedLength, data + pos, sizeof(extendedLength));
+        payloadLength = ntohll(extendedLength);
+        pos += sizeof(extendedLength);
+        // the most significant bit must be 0, the rest has to be addressable together with the buffered data
+        if (payloadLength > std::numeric_limits<size_t>::max() / 2) {
+            throw std::runtime_error("Frame is too large");
+        }
+    }
+    if (header.Masked) {
+        memcpy(header.Key, data + pos, sizeof(header.Key));
+    }
+    header.PayloadSize = payloadLength;
+    header.Size = headerSize;
+    return 0;
+}
+
+void EncodeFrame(TFrameBuffer& out, uint8_t head, std::string_view payload, const uint8_t* key) {
+    auto* header = out.Prepare(14 + payload.size());
+    size_t headerSize = WriteFrameHeader(header, head, payload.size(), key);
+    auto* data = reinterpret_cast<const uint8_t*>(payload.data());
+    if (key) {
+        // the caller's payload is const, it is masked while copied right after the header
+        Mask(header + headerSize, data, payload.size(), key);
+    } else if (!payload.empty()) {
+        memcpy(header + headerSize, data, payload.size());
+    }
+    out.Commit(headerSize + payload.size());
+}
+
+void EncodeCompressedFrame(TFrameBuffer& out, uint8_t head, std::string_view payload, const uint8_t* key, TDeflate& deflate) {
+    // the longest header is reserved: its size is known after compression
+    constexpr size_t reserved = 14;
+    out.Prepare(reserved);
+    out.Commit(reserved);
+    deflate.Compress(payload, out);
+    size_t size = out.Size() - reserved;
+    uint8_t* data = out.Data() + reserved;
+    if (key) {
+        Mask(data, data, size, key);
+    }
+    uint8_t header[reserved];
+    size_t headerSize = WriteFrameHeader(header, head | 0x40, size, key);
+    memcpy(data - headerSize, header, headerSize);
+    out.Consume(reserved - headerSize);
+}
+
+struct TDeflate::TState {
+#ifdef HAVE_ZLIB
+    z_stream Deflater = {};
+    z_stream Inflater = {};
+#endif
+    bool NoContextTakeover = false;
+    bool PeerNoContextTakeover = false;
+    bool ResetPending = false;
+    size_t MaxMessageSize = 0;
+};
+
+TDeflate::TDeflate(const TWebSocketDeflateOptions& options, int windowBits, bool noContextTakeover, bool peerNoContextTakeover)
+    : State_(std::make_unique<TState>())
+    , WindowBits_(windowBits)
+    , MinSize_(options.MinSize)
+{
+    State_->NoContextTakeover = noContextTakeover;
+    State_->PeerNoContextTakeover = peerNoContextTakeover;
+    State_->MaxMessageSize = options.MaxMessageSize;
+#ifdef HAVE_ZLIB
+    // negative window bits: raw deflate without the zlib header and trailer
+    if (deflateInit2(&State_->Deflater, options.Level, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("deflateInit2 failed");
+    }
+    // the largest window decodes any peer's stream
+    if (inflateInit2(&State_->Inflater, -15) != Z_OK) {
+        deflateEnd(&State_->Deflater);
+        throw std::runtime_error("inflateInit2 failed");
+    }
+#else
+    throw std::runtime_error("coroio is built without zlib");
+#endif
+}
+
+TDeflate::~TDeflate() {
+#ifdef HAVE_ZLIB
+    deflateEnd(&State_->Deflater);
+    inflateEnd(&State_->Inflater);
+#endif
+}
+
+void TDeflate::Reset() {
+    State_->ResetPending = true;
+}
+
+void TDeflate::Compress(std::string_view payload, TFrameBuffer& out) {
+#ifdef HAVE_ZLIB
+    auto& z = State_->Deflater;
+    if (State_->ResetPending) {
+        // keeps the allocated window, unlike deflateEnd() + deflateInit2()
+        deflateReset(&z);
+        State_->ResetPending = false;
+    }
+    size_t start = out.Size();
+    auto* in = reinterpret_cast<const uint8_t*>(payload.data());
+    size_t left = payload.size();
+    do {
+        uInt chunk = static_cast<uInt>(std::min<size_t>(left, UINT_MAX));
+        z.next_in = const_cast<Bytef*>(in);
+        z.avail_in = chunk;
+        int flush = left == chunk ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+        do {
+            auto* data = out.Prepare(deflateBound(&z, z.avail_in) + 16);
+            uInt writable = static_cast<uInt>(std::min<size_t>(out.Writable(), UINT_MAX));
+            z.next_out = data;
+            z.avail_out = writable;
+            deflate(&z, flush);
+            out.Commit(writable - z.avail_out);
+        } while (z.avail_out == 0 || z.avail_in != 0);
+        in += chunk;
+        left -= chunk;
+    } while (left != 0);
+    // the sync flush ends with an empty stored block, 00 00 ff ff, the frame goes without it
+    if (out.Size() - start >= 4) {
+        out.Truncate(out.Size() - 4);
+    }
+    if (State_->NoContextTakeover) {
+        State_->ResetPending = true;
+    }
+#else
+    (void)payload;
+    (void)out;
+#endif
+}
+
+void TDeflate::Decompress(std::string_view payload, TFrameBuffer& out) {
+#ifdef HAVE_ZLIB
+    static const uint8_t tail[4] = {0x00, 0x00, 0xff, 0xff};
+    auto& z = State_->Inflater;
+    std::string_view parts[2] = {payload, {reinterpret_cast<const char*>(tail), sizeof(tail)}};
+    bool end = false;
+    for (auto part : parts) {
+        auto* in = reinterpret_cast<const uint8_t*>(part.data());
+        size_t left = part.size();
+        while (left != 0 && !end) {
+            uInt chunk = static_cast<uInt>(std::min<size_t>(left, UINT_MAX));
+            z.next_in = const_cast<Bytef*>(in);
+            z.avail_in = chunk;
+            int ret;
+            do {
+                auto* data = out.Prepare(std::max<size_t>(z.avail_in * 2, 4096));
+                uInt writable = static_cast<uInt>(std::min<size_t>(out.Writable(), UINT_MAX));
+                z.next_out = data;
+                z.avail_out = writable;
+                ret = inflate(&z, Z_SYNC_FLUSH);
+                out.Commit(writable - z.avail_out);
+                if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+                    throw std::runtime_error("Invalid compressed message");
+                }
+                if (out.Size() > State_->MaxMessageSize) {
+                    throw std::runtime_error("Decompressed message is too large");
+                }
+            } while (ret != Z_STREAM_END && (z.avail_out == 0 || (z.avail_in != 0 && ret != Z_BUF_ERROR)));
+            // a final block ends the stream, the rest of the input is its padding
+            end = ret == Z_STREAM_END;
+            in += chunk;
+            left -= chunk;
+        }
+    }
+    if (end || State_->PeerNoContextTakeover) {
+        inflateReset(&z);
+    }
+#else
+    (void)payload;
+    (void)out;
+#endif
+}
+
+std::string DeflateOffer(const TWebSocketDeflateOptions& options) {
+#ifdef HAVE_ZLIB
+    // the client speaks of itself as "client"
+    std::string offer = "permessage-deflate; client_max_window_bits";
+    if (ClampWindowBits(options.MaxWindowBits) < 15) {
+        offer += "=" + std::to_string(ClampWindowBits(options.MaxWindowBits));
+    }
+    if (options.NoContextTakeover) {
+        offer += "; client_no_context_takeover";
+    }
+    if (options.PeerNoContextTakeover) {
+        offer += "; server_no_context_takeover";
+    }
+    if (ClampWindowBits(options.PeerMaxWindowBits) < 15) {
+        offer += "; server_max_window_bits=" + std::to_string(ClampWindowBits(options.PeerMaxWindowBits));
+    }
+    return offer;
+#else
+    (void)options;
+    return {};
+#endif
+}
+
+std::unique_ptr<TDeflate> DeflateAccepted(const std::string& response, const TWebSocketDeflateOptions& options) {
+    auto extensions = FindHeader(response, "\nsec-websocket-extensions:");
+    if (extensions.empty()) {
+        return nullptr;
+    }
+    TDeflateParams params;
+    if (!ParseDeflateParams(extensions, params) || params.ClientMaxWindowBits < 0) {
+        throw std::runtime_error("Unsupported WebSocket extensions: " + extensions);
+    }
+    int bits = ClampWindowBits(options.MaxWindowBits);
+    if (params.ClientMaxWindowBits > 0) {
+        if (params.ClientMaxWindowBits < 9) {
+            throw std::runtime_error("Unsupported WebSocket extensions: " + extensions);
+        }
+        bits = std::min(bits, params.ClientMaxWindowBits);
+    }
+    return std::make_unique<TDeflate>(
+        options, bits,
+        options.NoContextTakeover || params.ClientNoContextTakeover,
+        params.ServerNoContextTakeover);
+}
+
+std::unique_ptr<TDeflate> DeflateNegotiate(const std::string& request, const TWebSocketDeflateOptions& options, std::string& extensions) {
+#ifdef HAVE_ZLIB
+    std::unique_ptr<TDeflate> deflate;
+    // the first acceptable offer wins
+    Split(FindHeader(request, "\nsec-websocket-extensions:"), ',', [&](std::string_view element) {
+        TDeflateParams offer;
+        if (deflate || !ParseDeflateParams(element, offer)) {
+            return;
+        }
+        int bits = ClampWindowBits(options.MaxWindowBits);
+        if (offer.ServerMaxWindowBits > 0) {
+            if (offer.ServerMaxWindowBits < 9) {
+                return;
+            }
+            bits = std::min(bits, offer.ServerMaxWindowBits);
+        }
+        bool noContextTakeover = options.NoContextTakeover || offer.ServerNoContextTakeover;
+        bool peerNoContextTakeover = options.PeerNoContextTakeover || offer.ClientNoContextTakeover;
+
+        extensions = "permessage-deflate";
+        if (noContextTakeover) {
+            extensions += "; server_no_context_takeover";
+        }
+        if (peerNoContextTakeover) {
+            extensions += "; client_no_context_takeover";
+        }
+        if (bits < 15 || offer.ServerMaxWindowBits > 0) {
+            extensions += "; server_max_window_bits=" + std::to_string(bits);
+        }
+        // the client's window may be limited only if it has offered that
+        int peerBits = ClampWindowBits(options.PeerMaxWindowBits);
+        if (offer.ClientMaxWindowBits > 0) {
+            peerBits = std::min(peerBits, offer.ClientMaxWindowBits);
+        }
+        if (offer.ClientMaxWindowBits != 0 && peerBits < 15) {
+            extensions += "; client_max_window_bits=" + std::to_string(peerBits);
+        }
+        deflate = std::make_unique<TDeflate>(options, bits, noContextTakeover, peerNoContextTakeover);
+    });
+    return deflate;
+#else
+    (void)request;
+    (void)options;
+    (void)extensions;
+    return nullptr;
+#endif
+}
+
+void Mask(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t key[4]) {
+    uint32_t k;
+    // in memory order, the same for any endianness
+    memcpy(&k, key, sizeof(k));
+    size_t i = 0;
+#if defined(COROIO_WS_AVX2)
+    if (HasAvx2()) {
+        i = MaskAvx2(dst, src, size, k);
+    }
+#endif
+#if defined(COROIO_WS_SSE2)
+    i += MaskSse2(dst + i, src + i, size - i, k);
+#elif defined(COROIO_WS_NEON)
+    i += MaskNeon(dst + i, src + i, size - i, k);
+#endif
+    i += MaskWords(dst + i, src + i, size - i, k);
+    for (; i < size; ++i) {
+        dst[i] = src[i] ^ key[i & 3];
+    }
+}
+
+uint8_t* TFrameBuffer::Prepare(size_t size) {
+    if (Writable() >= size) {
+        return Data_.get() + End_;
+    }
+    size_t used = Size();
+    if (Capacity_ - used >= size) {
+        // enough space once the consumed prefix is dropped
+        memmove(Data_.get(), Data(), used);
+    } else {
+        size_t capacity = std::max(Capacity_ * 2, used + size);
+        std::unique_ptr<uint8_t[]> data(new uint8_t[capacity]);
+        if (used) {
+            memcpy(data.get(), Data(), used);
+        }
+        Data_ = std::move(data);
+        Capacity_ = capacity;
+    }
+    Begin_ = 0;
+    End_ = used;
+    return Data_.get() + End_;
+}
+
 } // namespace NDetail
 
+TWebSocketFrame::TWebSocketFrame(EWebSocketOpcode opcode, std::string_view payload, bool compress) {
+    uint8_t head = 0x80 | static_cast<uint8_t>(opcode);
+    NDetail::EncodeFrame(Buffer_, head, payload, nullptr);
+#ifdef HAVE_ZLIB
+    if (compress) {
+        // on its own: the frame must not refer to anything a subscriber has not seen
+        NDetail::TDeflate deflate({}, 15, true, true);
+        NDetail::EncodeCompressedFrame(Compressed_, head, payload, nullptr, deflate);
+    }
+#else
+    (void)compress;
+#endif
+}
+
 } // namespace NNet
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "sockutils.hpp"
+#include "sync.hpp"
 
 #if defined(__linux__)
 #include <arpa/inet.h>
@@ -18,30 +19,288 @@
 #include <WinSock2.h>
 #endif
 
+#if __has_include(<zlib.h>)
+#define HAVE_ZLIB
+#endif
+
+#include <limits>
+#include <memory>
+#include <optional>
 #include <random>
+#include <string_view>
 
 namespace NNet
 {
 
+/**
+ * @struct TWebSocketDeflateOptions
+ * @brief Settings of the permessage-deflate extension (RFC 7692) of a @ref TWebSocket.
+ *
+ * "Own" settings apply to the messages this side compresses, "peer" settings are
+ * requested for the other side. The negotiated values may be stricter.
+ */
+struct TWebSocketDeflateOptions {
+    int Level = -1;                    ///< zlib compression level, -1 for its default.
+    int MaxWindowBits = 15;            ///< Window of the own compressor, 9 to 15.
+    int PeerMaxWindowBits = 15;        ///< Window requested for the peer's compressor, 9 to 15.
+    bool NoContextTakeover = false;    ///< Compress every message on its own, the window is not kept between them.
+    bool PeerNoContextTakeover = false; ///< Ask the peer to compress every message on its own.
+    size_t MinSize = 64;               ///< Shorter messages are sent uncompressed.
+    size_t MaxMessageSize = 64 << 20;  ///< Larger messages are rejected, compressed or not, see @ref TWebSocket::SetMaxMessageSize().
+};
+
 namespace NDetail {
 
 std::string GenerateWebSocketKey(std::random_device& rd);
 void CheckSecWebSocketAccept(const std::string& allServerHeaders, const std::string& clientKeyBase64);
+/**
+ * @brief Returns the "101 Switching Protocols" response to an upgrade @p request,
+ *        or an empty string if it is not one.
+ *
+ * @param extensions The value of the Sec-WebSocket-Extensions response header, none if empty.
+ */
+std::string WebSocketUpgradeResponse(const std::string& request, const std::string& extensions = {});
+
+/**
+ * @brief XORs @p size bytes of @p src with the repeated 4-byte WebSocket masking @p key.
+ *
+ * Processes 16 (SSE2, NEON) or 32 (AVX2, chosen at run time) bytes per step and uses
+ * 8-byte words elsewhere. @p dst may be equal to @p src for in-place unmasking.
+ */
+void Mask(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t key[4]);
+
+/**
+ * @class TFrameBuffer
+ * @brief Growable byte buffer with a consumed prefix, the storage of @ref TWebSocket frames.
+ *
+ * Unlike @c std::vector it does not zero-fill on growth: every byte is written by
+ * the socket or by @ref Mask() anyway.
+ */
+class TFrameBuffer {
+public:
+    /// Unconsumed bytes.
+    uint8_t* Data() {
+        return Data_.get() + Begin_;
+    }
+
+    const uint8_t* Data() const {
+        return Data_.get() + Begin_;
+    }
+
+    size_t Size() const {
+        return End_ - Begin_;
+    }
+
+    /// Drops @p size bytes from the front, the memory is reused by the next @ref Prepare().
+    void Consume(size_t size) {
+        Begin_ += size;
+        if (Begin_ == End_) {
+            Begin_ = End_ = 0;
+        }
+    }
+
+    /// Returns room for at least @p size bytes after the data, moving or reallocating it if needed.
+    uint8_t* Prepare(size_t size);
+
+    /// Writable bytes after the data.
+    size_t Writable() const {
+        return Capacity_ - End_;
+    }
+
+    /// Appends @p size bytes written into the space returned by @ref Prepare().
+    void Commit(size_t size) {
+        End_ += size;
+    }
+
+    /// Drops the data after the first @p size bytes.
+    void Truncate(size_t size) {
+        End_ = Begin_ + size;
+    }
+
+private:
+    std::unique_ptr<uint8_t[]> Data_;
+    size_t Capacity_ = 0;
+    size_t Begin_ = 0;
+    size_t End_ = 0;
+};
+
+/**
+ * @struct TFrameHeader
+ * @brief Parsed WebSocket frame header.
+ */
+struct TFrameHeader {
+    bool Fin = false;
+    uint8_t Rsv = 0;          ///< RSV1-3 bits in their places of the first byte.
+    uint8_t Opcode = 0;
+    bool Masked = false;
+    uint8_t Key[4] = {};
+    uint64_t PayloadSize = 0;
+    size_t Size = 0;          ///< Size of the header itself.
+};
+
+/**
+ * @brief Parses the frame header at the start of @p data.
+ *
+ * @return 0 if the header is parsed, otherwise the number of bytes needed to parse it.
+ * @throws std::runtime_error if the payload length is invalid.
+ */
+size_t ParseFrameHeader(const uint8_t* data, size_t size, TFrameHeader& header);
+
+/**
+ * @brief Appends a frame to @p out.
+ *
+ * @param head    The first header byte: FIN, RSV bits and the opcode.
+ * @param payload The payload, copied into the frame.
+ * @param key     The masking key, null for an unmasked frame.
+ */
+void EncodeFrame(TFrameBuffer& out, uint8_t head, std::string_view payload, const uint8_t* key);
+
+/**
+ * @class TDeflate
+ * @brief Per-connection permessage-deflate streams.
+ *
+ * Both zlib streams live as long as the connection. Without context takeover they are
+ * reset after every message, which keeps their window buffers allocated.
+ */
+class TDeflate {
+public:
+    TDeflate(const TWebSocketDeflateOptions& options, int windowBits, bool noContextTakeover, bool peerNoContextTakeover);
+    ~TDeflate();
+
+    /// Appends the compressed @p payload to @p out, without the trailing 00 00 ff ff.
+    void Compress(std::string_view payload, TFrameBuffer& out);
+    /// Appends the decompressed @p payload to @p out.
+    void Decompress(std::string_view payload, TFrameBuffer& out);
+    /// Stops referring to the previous messages in the next compressed one.
+    void Reset();
+
+    /// Window bits of own compressor.
+    int WindowBits() const {
+        return WindowBits_;
+    }
+
+    /// Below it messages are sent uncompressed.
+    size_t MinSize() const {
+        return MinSize_;
+    }
+
+private:
+    struct TState;
+    std::unique_ptr<TState> State_;
+    int WindowBits_;
+    size_t MinSize_;
+};
+
+/// Returns the client's Sec-WebSocket-Extensions offer, empty if coroio is built without zlib.
+std::string DeflateOffer(const TWebSocketDeflateOptions& options);
+
+/**
+ * @brief Sets up the client side of the extension from the server's handshake @p response.
+ *
+ * @return The streams, null if the server did not accept the offer.
+ * @throws std::runtime_error if the response parameters are invalid.
+ */
+std::unique_ptr<TDeflate> DeflateAccepted(const std::string& response, const TWebSocketDeflateOptions& options);
+
+/**
+ * @brief Sets up the server side of the extension from the client's upgrade @p request.
+ *
+ * @param extensions Receives the Sec-WebSocket-Extensions response value.
+ * @return The streams, null if the client made no acceptable offer.
+ */
+std::unique_ptr<TDeflate> DeflateNegotiate(const std::string& request, const TWebSocketDeflateOptions& options, std::string& extensions);
+
+/**
+ * @brief Appends a compressed data frame (RSV1 set) to the empty @p out.
+ */
+void EncodeCompressedFrame(TFrameBuffer& out, uint8_t head, std::string_view payload, const uint8_t* key, TDeflate& deflate);
 
 } // namespace detail
 
+/**
+ * @enum EWebSocketOpcode
+ * @brief WebSocket frame opcodes (RFC 6455, section 5.2).
+ */
+enum class EWebSocketOpcode : uint8_t {
+    Continuation = 0x0,
+    Text = 0x1,
+    Binary = 0x2,
+    Close = 0x8,
+    Ping = 0x9,
+    Pong = 0xA,
+};
+
+/**
+ * @struct TWebSocketMessage
+ * @brief A received message: text, binary or close.
+ *
+ * @c Payload points into the receive buffer of the @ref TWebSocket and is valid until its next receive call.
+ */
+struct TWebSocketMessage {
+    EWebSocketOpcode Opcode;
+    std::string_view Payload;
+};
+
+/**
+ * @class TWebSocketFrame
+ * @brief An unmasked frame encoded once, for @ref Broadcast() from the server side.
+ *
+ * With @p compress the payload is also compressed once, on its own, and the compressed
+ * frame is sent to the connections that negotiated permessage-deflate with a full window.
+ */
+class TWebSocketFrame {
+public:
+    TWebSocketFrame(EWebSocketOpcode opcode, std::string_view payload, bool compress = false);
+
+    /// The encoded frame, header included.
+    std::string_view Data() const {
+        return {reinterpret_cast<const char*>(Buffer_.Data()), Buffer_.Size()};
+    }
+
+    /// The compressed frame, empty unless requested and supported.
+    std::string_view Compressed() const {
+        return {reinterpret_cast<const char*>(Compressed_.Data()), Compressed_.Size()};
+    }
+
+private:
+    NDetail::TFrameBuffer Buffer_;
+    NDetail::TFrameBuffer Compressed_;
+};
+
 /**
  * @class TWebSocket
  * @brief Implements a WebSocket protocol layer on top of a given socket.
  *
  * The TWebSocket class wraps an underlying socket (of type @c TSocket) to implement
- * the WebSocket handshake, sending, and receiving of text frames. It uses asynchronous
- * operations (via TFuture) for I/O, and it internally maintains a reader and writer.
+ * the client (@ref Connect()) or server (@ref Accept()) handshake, sending, and receiving
+ * of text and binary messages. It uses asynchronous operations (via TFuture) for I/O.
+ *
+ * Incoming bytes are read in large chunks into one buffer, frames are parsed and
+ * unmasked in place there (see @ref NDetail::Mask()), and the received payload is
+ * returned as a view into that buffer: it stays valid until the next receive call.
+ * Fragmented messages are reassembled in the same buffer by moving the payloads of
+ * continuation frames over the headers between them.
+ *
+ * Pings are answered while receiving, pongs are dropped, and a close frame is echoed
+ * and returned to the caller. While a send is in flight the answer to a ping is deferred
+ * until it completes. Sends themselves must not overlap: a second concurrent send throws
+ * std::logic_error.
+ *
+ * Client frames are masked while being copied next to their header, server frames are
+ * sent unmasked. Either way a frame is written at once.
+ *
+ * After @ref EnableDeflate() the handshake offers (client) or accepts (server) the
+ * permessage-deflate extension. Once negotiated, data messages of at least
+ * @c TWebSocketDeflateOptions::MinSize bytes are compressed straight into the output
+ * buffer, and compressed messages are inflated into a second buffer that the payload
+ * views then point to.
  *
  * ### Overview
- *  - @ref Connect() initiates the WebSocket handshake.
- *  - @ref SendText() sends a text frame.
- *  - @ref ReceiveText() receives a text frame.
+ *  - @ref Connect() / @ref Accept() perform the client / server handshake.
+ *  - @ref SendText() / @ref SendBinary() send a text / binary message.
+ *  - @ref Receive() receives the next message of any kind.
+ *  - @ref ReceiveText() / @ref ReceiveBinary() receive a text / binary message.
+ *  - @ref SendClose() starts the closing handshake.
  *
  * @tparam TSocket The underlying socket type used for network communication.
  *
@@ -76,10 +335,53 @@ public:
      */
     explicit TWebSocket(TSocket& socket)
         : Socket(socket)
-        , Reader(socket)
         , Writer(socket)
     { }
 
+    /**
+     * @brief Negotiates permessage-deflate in the next @ref Connect() or @ref Accept().
+     *
+     * Without zlib support the extension is never offered nor accepted.
+     */
+    void EnableDeflate(TWebSocketDeflateOptions options = {}) {
+        DeflateOptions = options;
+        MaxMessageSize = options.MaxMessageSize;
+    }
+
+    /**
+     * @brief Limits the size of received messages, 64 MiB by default.
+     *
+     * Checked against frame headers before their payload is read, against the fragments of
+     * a message reassembled so far and against inflated messages; @ref Receive() throws
+     * once it is exceeded. Set it before the handshake for compressed messages.
+     */
+    void SetMaxMessageSize(size_t size) {
+        MaxMessageSize = size;
+        if (DeflateOptions) {
+            DeflateOptions->MaxMessageSize = size;
+        }
+    }
+
+    /**
+     * @brief Limits the @ref Broadcast() frames waiting for the send in flight, 16 by default.
+     *
+     * A frame broadcast while the queue is full is dropped and counted by
+     * @ref DroppedFrames(), the subscriber then misses it and is best closed.
+     */
+    void SetMaxQueuedFrames(size_t count) {
+        MaxQueuedFrames = count;
+    }
+
+    /// Returns the number of @ref Broadcast() frames dropped because the queue was full.
+    size_t DroppedFrames() const {
+        return Dropped;
+    }
+
+    /// Returns true if the handshake has negotiated permessage-deflate.
+    bool DeflateNegotiated() const {
+        return !!Deflate;
+    }
+
     /**
      * @brief Initiates the WebSocket handshake.
      *
@@ -94,6 +396,10 @@ public:
      */
     TFuture<void> Connect(const std::string& host, const std::string& path) {
         auto key = NDetail::GenerateWebSocketKey(Rd);
+        std::string extensions;
+        if (DeflateOptions) {
+            extensions = NDetail::DeflateOffer(*DeflateOptions);
+        }
         std::string request =
             "GET " + path + " HTTP/1.1\r\n"
             "Host: " + host + "\r\n"
@@ -102,11 +408,12 @@ public:
             "Connection: Upgrade\r\n"
             "Upgrade: websocket\r\n"
             "Sec-WebSocket-Key: " + key + "\r\n"
+            + (extensions.empty() ? "" : "Sec-WebSocket-Extensions: " + extensions + "\r\n") +
             "Sec-WebSocket-Version: 13\r\n\r\n";
 
         co_await Writer.Write(request.data(), request.size());
 
-        auto response = co_await Reader.ReadUntil("\r\n\r\n");
+        auto response = co_await ReadHead();
 
         NDetail::CheckSecWebSocketAccept(response, key);
 
@@ -114,9 +421,40 @@ public:
             throw std::runtime_error("Failed to establish WebSocket connection");
         }
 
+        if (!extensions.empty()) {
+            Deflate = NDetail::DeflateAccepted(response, *DeflateOptions);
+        }
+
         co_return;
     }
 
+    /**
+     * @brief Performs the server side of the handshake on an accepted connection.
+     *
+     * Reads the HTTP upgrade request and answers it with "101 Switching Protocols"
+     * or, if it is not a WebSocket upgrade, with "400 Bad Request".
+     *
+     * @return A TFuture that yields the request head, e.g. to route by its path.
+     * @throws std::runtime_error if the request is not a WebSocket upgrade.
+     */
+    TFuture<std::string> Accept() {
+        auto request = co_await ReadHead();
+        std::string extensions;
+        if (DeflateOptions) {
+            Deflate = NDetail::DeflateNegotiate(request, *DeflateOptions, extensions);
+        }
+        auto response = NDetail::WebSocketUpgradeResponse(request, extensions);
+        if (response.empty()) {
+            Deflate.reset();
+            static constexpr std::string_view badRequest = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+            co_await Writer.Write(badRequest.data(), badRequest.size());
+            throw std::runtime_error("Not a WebSocket upgrade request");
+        }
+        co_await Writer.Write(response.data(), response.size());
+        Server = true;
+        co_return request;
+    }
+
     /**
      * @brief Sends a text message as a WebSocket frame.
      *
@@ -124,102 +462,403 @@ public:
      * @return A TFuture that completes when the message has been sent.
      */
     TFuture<void> SendText(std::string_view message) {
-        co_await SendFrame(0x1, message);
+        co_await SendFrame(EWebSocketOpcode::Text, message);
+    }
+
+    /**
+     * @brief Sends a binary message as a WebSocket frame.
+     *
+     * @param message The bytes to send.
+     * @return A TFuture that completes when the message has been sent.
+     */
+    TFuture<void> SendBinary(std::string_view message) {
+        co_await SendFrame(EWebSocketOpcode::Binary, message);
+    }
+
+    /**
+     * @brief Sends a close frame with the status @p code.
+     *
+     * The peer answers with its own close frame, returned by @ref Receive().
+     */
+    TFuture<void> SendClose(uint16_t code = 1000) {
+        uint8_t payload[2] = {static_cast<uint8_t>(code >> 8), static_cast<uint8_t>(code & 0xFF)};
+        CloseSent = true;
+        co_await SendFrame(EWebSocketOpcode::Close, {reinterpret_cast<char*>(payload), sizeof(payload)});
+    }
+
+    /**
+     * @brief Sends a frame encoded in advance. Only a server may send it: client frames must be masked.
+     *
+     * The compressed variant of the frame is chosen when permessage-deflate is negotiated
+     * with a full window; the next own message then does not refer to the previous ones,
+     * because the peer's window now also holds the frame.
+     *
+     * @throws std::logic_error on the client side.
+     */
+    TFuture<void> SendFrame(const TWebSocketFrame& frame) {
+        if (!Server) {
+            throw std::logic_error("Client frames must be masked");
+        }
+        auto data = frame.Data();
+        if (Deflate && Deflate->WindowBits() == 15 && !frame.Compressed().empty()) {
+            data = frame.Compressed();
+            Deflate->Reset();
+        }
+        co_await Write(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    }
+
+    /**
+     * @brief Sends a frame encoded in advance once the send in flight, if any, is done.
+     *
+     * Queued frames are written in order, each right after the previous send completes,
+     * so a send started later by the owner still overlaps them and throws. At most
+     * @ref SetMaxQueuedFrames() frames wait, a frame beyond that is dropped.
+     *
+     * @return A TFuture that yields false if the frame was dropped.
+     * @throws std::logic_error on the client side.
+     */
+    TFuture<bool> SendFrameQueued(const TWebSocketFrame& frame) {
+        if (Writing || !SendWaiters.Empty()) {
+            if (Queued >= MaxQueuedFrames) {
+                Dropped++;
+                co_return false;
+            }
+            co_await TAwaitableTurn{this};
+        }
+        co_await SendFrame(frame);
+        co_return true;
+    }
+
+    /**
+     * @brief Receives the next text, binary or close message.
+     *
+     * Answers pings and reassembles fragmented messages on the way.
+     *
+     * @return A TFuture that yields the message; its payload is valid until the next receive call.
+     * @throws std::runtime_error on a protocol violation (e.g. an unmasked frame from a client,
+     *         a message larger than @ref SetMaxMessageSize()) or if the connection is closed.
+     */
+    TFuture<TWebSocketMessage> Receive() {
+        In.Consume(Received);
+        Received = 0;
+        size_t pos = 0;      // the next frame, from In.Data()
+        size_t size = 0;     // the fragments received so far, moved to the front of In
+        uint8_t opcode = 0;  // of the fragmented message, 0 if there is none
+        bool compressed = false;
+        while (true) {
+            NDetail::TFrameHeader header;
+            size_t need;
+            while ((need = NDetail::ParseFrameHeader(In.Data() + pos, In.Size() - pos, header)) != 0) {
+                co_await Fill(pos + need);
+            }
+            if (Server && !header.Masked) {
+                throw std::runtime_error("Unmasked client frame");
+            }
+            if (header.Opcode & 0x8) {
+                if (!header.Fin || header.PayloadSize > 125) {
+                    throw std::runtime_error("Invalid control frame");
+                }
+            } else if (header.PayloadSize > MaxMessageSize - size) {
+                // before reading, a header alone must not make us allocate its length
+                throw std::runtime_error("Message is too large");
+            }
+            size_t end = pos + header.Size + header.PayloadSize;
+            if (In.Size() < end) {
+                co_await Fill(end);
+            }
+            uint8_t* payload = In.Data() + pos + header.Size;
+            if (header.Masked) {
+                NDetail::Mask(payload, payload, header.PayloadSize, header.Key);
+            }
+            std::string_view data(reinterpret_cast<char*>(payload), header.PayloadSize);
+            // RSV1 marks the first frame of a compressed message
+            bool first = header.Opcode == static_cast<uint8_t>(EWebSocketOpcode::Text)
+                || header.Opcode == static_cast<uint8_t>(EWebSocketOpcode::Binary);
+            if (header.Rsv & ~(Deflate && first ? 0x40 : 0)) {
+                throw std::runtime_error("Unexpected RSV bits");
+            }
+
+            if (header.Opcode & 0x8) {
+                if (header.Opcode == static_cast<uint8_t>(EWebSocketOpcode::Close)) {
+                    Received = end;
+                    if (!CloseSent && !Writing) {
+                        CloseSent = true;
+                        co_await SendFrame(EWebSocketOpcode::Close, data.substr(0, 2));
+                    }
+                    co_return TWebSocketMessage{EWebSocketOpcode::Close, data};
+                }
+                if (header.Opcode == static_cast<uint8_t>(EWebSocketOpcode::Ping)) {
+                    co_await SendPong(data);
+                }
+                if (opcode) {
+                    pos = end; // overwritten by the next fragment
+                } else {
+                    In.Consume(end);
+                    pos = 0;
+                }
+                continue;
+            }
+
+            if (header.Opcode == static_cast<uint8_t>(EWebSocketOpcode::Continuation)) {
+                if (!opcode) {
+                    throw std::runtime_error("Unexpected continuation frame");
+                }
+            } else if (opcode) {
+                throw std::runtime_error("Expected continuation frame");
+            } else if (header.Fin) {
+                Received = end;
+                co_return TWebSocketMessage{static_cast<EWebSocketOpcode>(header.Opcode), Inflate(data, header.Rsv)};
+            } else {
+                opcode = header.Opcode;
+                compressed = header.Rsv;
+            }
+
+            memmove(In.Data() + size, payload, header.PayloadSize);
+            size += header.PayloadSize;
+            pos = end;
+            if (header.Fin) {
+                Received = end;
+                co_return TWebSocketMessage{
+                    static_cast<EWebSocketOpcode>(opcode),
+                    Inflate(std::string_view(reinterpret_cast<char*>(In.Data()), size), compressed)};
+            }
+        }
     }
 
     /**
      * @brief Receives a text message from the WebSocket.
      *
-     * Waits for an incoming frame, validates that it is a text frame, and returns its payload.
+     * Waits for an incoming message, validates that it is a text message, and returns its payload.
      *
-     * @return A TFuture that yields a string_view containing the text message.
-     * @throws std::runtime_error if a non-text frame is received.
+     * @return A TFuture that yields a string_view containing the text message,
+     *         valid until the next receive call.
+     * @throws std::runtime_error if a non-text message is received.
      */
     TFuture<std::string_view> ReceiveText() {
-        auto [opcode, payload] = co_await ReceiveFrame();
-        if (opcode != 0x1) {
+        auto message = co_await Receive();
+        if (message.Opcode != EWebSocketOpcode::Text) {
             throw std::runtime_error(
                 "Unexpected opcode: " +
-                std::to_string(opcode) +
+                std::to_string(static_cast<int>(message.Opcode)) +
                 " , expected text frame, got: '" +
-                std::string(payload) + "'");
+                std::string(message.Payload) + "'");
+        }
+        co_return message.Payload;
+    }
+
+    /**
+     * @brief Receives a binary message from the WebSocket.
+     *
+     * @return A TFuture that yields a view of the message bytes, valid until the next receive call.
+     * @throws std::runtime_error if a non-binary message is received.
+     */
+    TFuture<std::string_view> ReceiveBinary() {
+        auto message = co_await Receive();
+        if (message.Opcode != EWebSocketOpcode::Binary) {
+            throw std::runtime_error(
+                "Unexpected opcode: " +
+                std::to_string(static_cast<int>(message.Opcode)) +
+                " , expected binary frame");
         }
-        co_return payload;
+        co_return message.Payload;
     }
 
 private:
-    TSocket& Socket;
-    TByteReader<TSocket> Reader;
-    TByteWriter<TSocket> Writer;
-    std::random_device Rd;
-    std::string Payload;
-    std::vector<uint8_t> Frame;
+    static constexpr size_t ReadChunk = 16384;
+    static constexpr size_t DefaultMaxMessageSize = 64 << 20;
+    static constexpr size_t DefaultMaxQueuedFrames = 16;
 
-    TFuture<void> SendFrame(uint8_t opcode, std::string_view payload) {
-        Frame.clear();
-        Frame.push_back(0x80 | opcode);
+    struct TSendWaiter : NDetail::TWaitNode {
+        std::coroutine_handle<> Handle = {};
+    };
 
-        uint8_t maskingKey[4];
-        for (int i = 0; i < 4; ++i) {
-            maskingKey[i] = static_cast<uint8_t>(Rd());
-        }
+    // waits in SendWaiters, the finished send hands the socket over to the first waiter
+    struct TAwaitableTurn {
+        TAwaitableTurn(TWebSocket* ws)
+            : Ws(ws)
+        { }
 
-        if (payload.size() <= 125) {
-            Frame.push_back(0x80 | static_cast<uint8_t>(payload.size()));
-        } else if (payload.size() <= 0xFFFF) {
-            Frame.push_back(0x80 | 126);
-            uint16_t length = htons(static_cast<uint16_t>(payload.size()));
-            Frame.insert(Frame.end(), reinterpret_cast<uint8_t*>(&length), reinterpret_cast<uint8_t*>(&length) + 2);
-        } else {
-            Frame.push_back(0x80 | 127);
-            uint64_t length = htonll(payload.size());
-            Frame.insert(Frame.end(), reinterpret_cast<uint8_t*>(&length), reinterpret_cast<uint8_t*>(&length) + 8);
+        TAwaitableTurn(const TAwaitableTurn&) = delete;
+        TAwaitableTurn& operator=(const TAwaitableTurn&) = delete;
+
+        ~TAwaitableTurn() {
+            if (Waiter.Linked) {
+                Ws->SendWaiters.Remove(&Waiter);
+                Ws->Queued--;
+            }
         }
 
-        Frame.insert(Frame.end(), std::begin(maskingKey), std::end(maskingKey));
+        bool await_ready() const { return false; }
 
-        for (size_t i = 0; i < payload.size(); ++i) {
-            Frame.push_back(payload[i] ^ maskingKey[i % 4]);
+        void await_suspend(std::coroutine_handle<> h) {
+            Waiter.Handle = h;
+            Ws->SendWaiters.Push(&Waiter);
+            Ws->Queued++;
         }
 
-        co_await Writer.Write(Frame.data(), Frame.size());
-        co_return;
+        void await_resume() { }
+
+        TWebSocket* Ws;
+        TSendWaiter Waiter = {};
+    };
+
+    TSocket& Socket;
+    TByteWriter<TSocket> Writer;
+    std::random_device Rd;
+    NDetail::TFrameBuffer In;
+    NDetail::TFrameBuffer Out;
+    size_t Received = 0; ///< Size of the last returned message frames, still at the front of @c In.
+    size_t MaxMessageSize = DefaultMaxMessageSize;
+    bool Server = false;
+    bool CloseSent = false;
+    bool Writing = false;
+    bool PongPending = false;
+    NDetail::TWaitQueue SendWaiters;
+    size_t Queued = 0;
+    size_t MaxQueuedFrames = DefaultMaxQueuedFrames;
+    size_t Dropped = 0;
+    uint8_t PongSize = 0;
+    uint8_t PongPayload[125];
+    std::optional<TWebSocketDeflateOptions> DeflateOptions;
+    std::unique_ptr<NDetail::TDeflate> Deflate;
+    NDetail::TFrameBuffer Inflated;
+
+    std::string_view Inflate(std::string_view payload, bool compressed) {
+        if (!compressed) {
+            return payload;
+        }
+        Inflated.Consume(Inflated.Size());
+        Deflate->Decompress(payload, Inflated);
+        return {reinterpret_cast<char*>(Inflated.Data()), Inflated.Size()};
     }
 
-    TFuture<std::pair<uint8_t, std::string_view>> ReceiveFrame() {
-        uint8_t header[2];
-        co_await Reader.Read(header, sizeof(header));
+    // reads until at least @p size bytes are buffered
+    TFuture<void> Fill(size_t size) {
+        while (In.Size() < size) {
+            // the buffer grows with the bytes that arrived, not with the length a header claims
+            auto* data = In.Prepare(std::max(std::min(size - In.Size(), In.Size()), ReadChunk));
+            auto readSize = co_await Socket.ReadSome(data, In.Writable());
+            if (readSize == 0) {
+                throw std::runtime_error("Connection closed");
+            }
+            if (readSize < 0) {
+                continue; // retry
+            }
+            In.Commit(readSize);
+        }
+    }
 
-        uint8_t opcode = header[0] & 0x0F;
-        bool masked = header[1] & 0x80;
-        uint64_t payloadLength = header[1] & 0x7F;
+    // reads the HTTP head of the handshake; frames sent right after it stay in the buffer
+    TFuture<std::string> ReadHead() {
+        static constexpr std::string_view delimiter = "\r\n\r\n";
+        size_t end;
+        while ((end = std::string_view(reinterpret_cast<char*>(In.Data()), In.Size()).find(delimiter)) == std::string_view::npos) {
+            co_await Fill(In.Size() + 1);
+        }
+        end += delimiter.size();
+        std::string head(reinterpret_cast<char*>(In.Data()), end);
+        In.Consume(end);
+        co_return head;
+    }
 
-        if (payloadLength == 126) {
-            uint16_t extendedLength;
-            co_await Reader.Read(&extendedLength, sizeof(extendedLength));
-            payloadLength = ntohs(extendedLength);
-        } else if (payloadLength == 127) {
-            uint64_t extendedLength;
-            co_await Reader.Read(&extendedLength, sizeof(extendedLength));
-            payloadLength = ntohll(extendedLength);
+    void Encode(EWebSocketOpcode opcode, std::string_view payload) {
+        Out.Consume(Out.Size()); // left by an interrupted write
+        uint8_t key[4];
+        if (!Server) {
+            for (int i = 0; i < 4; ++i) {
+                key[i] = static_cast<uint8_t>(Rd());
+            }
         }
+        uint8_t head = 0x80 | static_cast<uint8_t>(opcode);
+        bool data = opcode == EWebSocketOpcode::Text || opcode == EWebSocketOpcode::Binary;
+        if (Deflate && data && payload.size() >= Deflate->MinSize()) {
+            NDetail::EncodeCompressedFrame(Out, head, payload, Server ? nullptr : key, *Deflate);
+        } else {
+            NDetail::EncodeFrame(Out, head, payload, Server ? nullptr : key);
+        }
+    }
 
-        uint8_t mask[4] = {0};
-        if (masked) {
-            co_await Reader.Read(mask, sizeof(mask));
+    TFuture<void> SendFrame(EWebSocketOpcode opcode, std::string_view payload) {
+        if (Writing) {
+            throw std::logic_error("WebSocket send is already in progress");
         }
+        Encode(opcode, payload);
+        co_await Write(Out.Data(), Out.Size());
+    }
 
-        Payload.resize(payloadLength);
-        co_await Reader.Read(Payload.data(), Payload.size());
+    TFuture<void> SendPong(std::string_view payload) {
+        if (Writing) {
+            // only the last ping has to be answered
+            memcpy(PongPayload, payload.data(), payload.size());
+            PongSize = payload.size();
+            PongPending = true;
+            co_return;
+        }
+        co_await SendFrame(EWebSocketOpcode::Pong, payload);
+    }
 
-        if (masked) {
-            for (size_t i = 0; i < Payload.size(); ++i) {
-                Payload[i] ^= mask[i % 4];
+    TFuture<void> Write(const uint8_t* data, size_t size) {
+        if (Writing) {
+            throw std::logic_error("WebSocket send is already in progress");
+        }
+        Writing = true;
+        try {
+            co_await Writer.Write(data, size);
+            while (PongPending) {
+                PongPending = false;
+                Encode(EWebSocketOpcode::Pong, {reinterpret_cast<char*>(PongPayload), PongSize});
+                co_await Writer.Write(Out.Data(), Out.Size());
             }
+        } catch (...) {
+            EndWrite();
+            throw;
         }
+        EndWrite();
+    }
 
-        co_return {opcode, Payload};
+    // a queued frame is written next, a failed socket fails it as well
+    void EndWrite() {
+        Writing = false;
+        if (auto* waiter = static_cast<TSendWaiter*>(SendWaiters.Pop())) {
+            Queued--;
+            waiter->Handle.resume();
+        }
     }
 };
 
+/**
+ * @brief Sends one pre-encoded @p frame to every server-side WebSocket of @p sockets concurrently.
+ *
+ * The frame is serialized once and its bytes are written to all sockets as they are,
+ * so the cost per subscriber is the write only. A failing socket does not stop the others.
+ *
+ * On a socket with a send in flight, e.g. a slow subscriber still taking an earlier
+ * broadcast, the frame waits for it with @ref TWebSocket::SendFrameQueued(), and the
+ * returned future completes after the queued write. If the socket's queue is full the
+ * frame is dropped for that socket, counted in @ref TWebSocket::DroppedFrames() and not
+ * in the result.
+ *
+ * @param sockets Destinations, they and @p frame must stay alive until the returned future completes.
+ * @return A TFuture that yields the number of sockets the frame was written to.
+ */
+template<typename TSocket>
+TFuture<size_t> Broadcast(const std::vector<TWebSocket<TSocket>*>& sockets, const TWebSocketFrame& frame) {
+    size_t failed = 0;
+    std::vector<TFuture<void>> writes;
+    writes.reserve(sockets.size());
+    for (auto* ws : sockets) {
+        writes.emplace_back([](TWebSocket<TSocket>* ws, const TWebSocketFrame& frame, size_t* failed) -> TFuture<void> {
+            try {
+                if (!co_await ws->SendFrameQueued(frame)) {
+                    ++*failed;
+                }
+            } catch (const std::exception&) {
+                ++*failed;
+            }
+        }(ws, frame, &failed));
+    }
+    co_await All(std::move(writes));
+    co_return sockets.size() - failed;
+}
+
 } // namespace NNet {
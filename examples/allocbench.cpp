@@ -0,0 +1,227 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#include <string.h>
+#include <stdio.h>
+
+#include <coroio/all.hpp>
+
+using namespace NNet;
+
+namespace {
+
+std::atomic<uint64_t> Allocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+    Allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace {
+
+void usage(const char* name) {
+    printf("%s [-n num_messages] [-s message_size] [-p port] [-m method] [-w echo|frames] [-a]\n", name);
+    printf("  -w frames: awaits nested futures without I/O, -n times\n");
+    printf("  -a: runs every echo or iteration in a TArena (with COROIO_ARENA)\n");
+}
+
+void print_config(bool arena) {
+#ifdef COROIO_FRAME_POOL
+    printf("frame pool: on\n");
+#else
+    printf("frame pool: off\n");
+#endif
+#ifdef COROIO_ARENA
+    printf("arena: on, %s\n", arena ? "active" : "not active");
+#else
+    printf("arena: off%s\n", arena ? ", frames ignore -a" : "");
+#endif
+}
+
+TFuture<int> leaf(int i) {
+    co_return i;
+}
+
+TFuture<int> middle(int i) {
+    int a = co_await leaf(i);
+    int b = co_await leaf(i + 1);
+    co_return a + b;
+}
+
+TFuture<void> frames(int iterations, TArena* arena, int64_t* sum) {
+    for (int i = 0; i < iterations; i++) {
+        if (arena) {
+            *sum += co_await WithArena(*arena, [i]() { return middle(i); });
+        } else {
+            *sum += co_await middle(i);
+        }
+    }
+}
+
+void run_frames(int iterations, bool useArena) {
+    TArena arena;
+    int64_t sum = 0;
+    uint64_t start = Allocations.load();
+    auto t1 = TClock::now();
+    // nothing suspends, the future is done when it returns
+    auto future = frames(iterations, useArena ? &arena : nullptr, &sum);
+    auto t2 = TClock::now();
+    uint64_t allocations = Allocations.load() - start;
+
+    print_config(useArena);
+    printf("iterations: %d, frames per iteration: 3, sum: %lld\n", iterations, static_cast<long long>(sum));
+    printf("allocations per iteration: %.3f\n", static_cast<double>(allocations) / std::max(1, iterations));
+    printf("time per iteration: %.1f ns\n", static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count()) / std::max(1, iterations));
+}
+
+template<typename TSocket>
+TFuture<void> echo_server(TSocket& listener, int messages, int size) {
+    auto client = co_await listener.Accept();
+    std::vector<char> buffer(size);
+    TByteReader reader(client);
+    TByteWriter writer(client);
+    for (int i = 0; i < messages; i++) {
+        co_await reader.Read(buffer.data(), size);
+        co_await writer.Write(buffer.data(), size);
+    }
+}
+
+template<typename TSocket>
+TFuture<void> echo(TByteWriter<TSocket>& writer, TByteReader<TSocket>& reader, std::vector<char>& out, std::vector<char>& in) {
+    co_await writer.Write(out.data(), out.size());
+    co_await reader.Read(in.data(), in.size());
+}
+
+template<typename TSocket>
+TFuture<void> echo_client(TSocket& socket, TAddress addr, int messages, int size, TArena* arena, uint64_t* allocations) {
+    co_await socket.Connect(addr);
+    std::vector<char> out(size, 'x');
+    std::vector<char> in(size);
+    TByteReader reader(socket);
+    TByteWriter writer(socket);
+    constexpr int warmup = 100;
+    uint64_t start = 0;
+    for (int i = 0; i < messages; i++) {
+        if (i == warmup) {
+            start = Allocations.load();
+        }
+        if (arena) {
+            co_await WithArena(*arena, [&]() { return echo(writer, reader, out, in); });
+        } else {
+            co_await echo(writer, reader, out, in);
+        }
+    }
+    *allocations = Allocations.load() - start;
+}
+
+template<typename TPoller>
+void run(int messages, int size, int port, bool useArena) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    TSocket socket(loop.Poller(), addr.Domain());
+
+    TArena arena;
+    uint64_t allocations = 0;
+    auto t1 = TClock::now();
+    auto server = echo_server(listener, messages, size);
+    auto client = echo_client(socket, addr, messages, size, useArena ? &arena : nullptr, &allocations);
+    while (!client.done() || !server.done()) {
+        loop.Step();
+    }
+    auto t2 = TClock::now();
+
+    int measured = std::max(1, messages - 100);
+    print_config(useArena);
+    printf("messages: %d, size: %d\n", messages, size);
+    printf("allocations per echo: %.3f\n", static_cast<double>(allocations) / measured);
+    printf("elapsed: %lld us\n", static_cast<long long>(
+        std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    TInitializer init;
+    int messages = 100000;
+    int size = 64;
+    int port = 8898;
+    const char* method = "poll";
+    const char* workload = "echo";
+    bool useArena = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i < argc-1) {
+            messages = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i < argc-1) {
+            size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && i < argc-1) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-m") && i < argc-1) {
+            method = argv[++i];
+        } else if (!strcmp(argv[i], "-w") && i < argc-1) {
+            workload = argv[++i];
+        } else if (!strcmp(argv[i], "-a")) {
+            useArena = true;
+        } else {
+            usage(argv[0]); return 1;
+        }
+    }
+
+    if (!strcmp(workload, "frames")) {
+        run_frames(messages, useArena);
+    } else if (strcmp(workload, "echo")) {
+        printf("Unknown workload: %s\n", workload);
+        return 1;
+    } else if (!strcmp(method, "select")) {
+        run<TSelect>(messages, size, port, useArena);
+    } else if (!strcmp(method, "poll")) {
+        run<TPoll>(messages, size, port, useArena);
+    }
+#ifdef HAVE_EPOLL
+    else if (!strcmp(method, "epoll")) {
+        run<TEPoll>(messages, size, port, useArena);
+    }
+#endif
+#ifdef HAVE_URING
+    else if (!strcmp(method, "uring")) {
+        run<TUring>(messages, size, port, useArena);
+    }
+#endif
+#ifdef HAVE_KQUEUE
+    else if (!strcmp(method, "kqueue")) {
+        run<TKqueue>(messages, size, port, useArena);
+    }
+#endif
+#ifdef HAVE_IOCP
+    else if (!strcmp(method, "iocp")) {
+        run<TIOCp>(messages, size, port, useArena);
+    }
+#endif
+    else {
+        printf("Unknown method: %s\n", method);
+        return 1;
+    }
+
+    return 0;
+}
@@ -6,7 +6,6 @@
 #include <chrono>
 #include <coroutine>
 #include <exception>
-#include <algorithm>
 
 #include <string.h>
 #include <stdlib.h>
@@ -14,13 +13,19 @@
 
 #include <coroio/all.hpp>
 
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
 using namespace NNet;
 using namespace std;
 
 namespace {
 
 void usage(const char* name) {
-    printf("%s [-n num_pipes] [-a num_active] [-w num_writes] [-m method]\n", name);
+    printf("%s [-n num_pipes] [-a num_active] [-w num_writes] [-i num_idle] [-m method]\n", name);
+    printf("  -i num_idle: extra pipes waited for but never written, e.g. -n 100 -i 10000\n");
+    printf("               shows what idle descriptors cost per loop iteration\n");
 }
 
 struct Stat {
@@ -68,7 +73,7 @@ TFuture<void> yield(TPollerBase& poller) {
 }
 
 template<typename TPoller>
-std::chrono::microseconds run_one(int num_pipes, int num_writes, int num_active) {
+std::chrono::microseconds run_one(int num_pipes, int num_writes, int num_active, int num_idle) {
     Stat s;
     using TFileHandle = typename TPoller::TFileHandle;
     using TSocket = typename TPoller::TSocket;
@@ -79,10 +84,10 @@ std::chrono::microseconds run_one(int num_pipes, int num_writes, int num_active)
     vector<TFileHandle> pipes;
 #endif
     vector<TFuture<void>> handles;
-    pipes.reserve(num_pipes*2);
-    handles.reserve(num_pipes+num_writes);
+    pipes.reserve((num_pipes+num_idle)*2);
+    handles.reserve(num_pipes+num_idle+num_writes);
     int fired = 0;
-    for (int i = 0; i < num_pipes; i++) {
+    for (int i = 0; i < num_pipes+num_idle; i++) {
         int p[2];
 #ifdef _WIN32
         if (socketpair(AF_INET, SOCK_STREAM, 0, &p[0]) < 0) {
@@ -105,6 +110,10 @@ std::chrono::microseconds run_one(int num_pipes, int num_writes, int num_active)
     for (int i = 0; i < num_pipes; i++) {
         handles.emplace_back(pipe_reader(pipes[i*2], pipes[((i+1)%num_pipes)*2+1], s));
     }
+    Stat idle;
+    for (int i = num_pipes; i < num_pipes+num_idle; i++) {
+        handles.emplace_back(pipe_reader(pipes[i*2], pipes[i*2+1], idle));
+    }
 
     handles.emplace_back(yield(loop.Poller())); // initialize events (sleep in readers)
     loop.Step();
@@ -131,26 +140,31 @@ std::chrono::microseconds run_one(int num_pipes, int num_writes, int num_active)
          << "failures: " << s.failures << ", "
          << "out: " << s.out << endl;
     cerr << "elapsed: " <<  duration.count() << endl;
+#ifdef COROIO_STATS
+    auto stats = loop.Poller().Stats().Snapshot();
+    cerr << "polls: " << stats.Polls << ", "
+         << "events/poll p50: " << stats.EventsPerPoll.Percentile(50) << ", "
+         << "poll ns p99: " << stats.PollTime.Percentile(99) << ", "
+         << "wakeup ns p99: " << stats.WakeupTime.Percentile(99) << endl;
+#endif
 
     return duration;
 }
 
 template<typename TPoller>
-void run_test(int num_pipes, int num_writes, int num_active) {
+void run_test(int num_pipes, int num_writes, int num_active, int num_idle) {
     int runs = 25;
-    vector<uint64_t> results;
-    results.reserve(runs);
+    THistogram results;
     for (int i = 0; i < runs; i++) {
-        auto d = run_one<TPoller>(num_pipes, num_writes, num_active).count();
-        results.emplace_back(d);
+        results.Record(run_one<TPoller>(num_pipes, num_writes, num_active, num_idle).count());
     }
-    sort(results.begin(), results.end());
-    cout << "min: " << results[0] << endl;
-    cout << "max: " << results[runs-1] << endl;
-    cout << "p50: " << results[0.5*runs] << endl;
-    cout << "p90: " << results[0.9*runs] << endl;
-    cout << "p95: " << results[0.95*runs] << endl;
-    cout << "p99: " << results[0.99*runs] << endl;
+    auto snapshot = results.Snapshot();
+    cout << "min: " << snapshot.Min << endl;
+    cout << "max: " << snapshot.Max << endl;
+    cout << "p50: " << snapshot.Percentile(50) << endl;
+    cout << "p90: " << snapshot.Percentile(90) << endl;
+    cout << "p95: " << snapshot.Percentile(95) << endl;
+    cout << "p99: " << snapshot.Percentile(99) << endl;
 }
 
 } // namespace {
@@ -160,6 +174,7 @@ int main(int argc, char** argv) {
     int num_pipes = 100;
     int num_writes = num_pipes;
     int num_active = 1;
+    int num_idle = 0;
     const char* method = "poll";
 
     for (int i = 1; i < argc; ++i) {
@@ -169,36 +184,46 @@ int main(int argc, char** argv) {
             num_active = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "-w") && i < argc-1) {
             num_writes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-i") && i < argc-1) {
+            num_idle = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "-m") && i < argc-1) {
             method = argv[++i];
         } else {
             usage(argv[0]); return 1;
         }
     }
+#ifndef _WIN32
+    // two descriptors per pipe
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
     if (!strcmp(method, "select")) {
-        run_test<TSelect>(num_pipes, num_writes, num_active);
+        run_test<TSelect>(num_pipes, num_writes, num_active, num_idle);
     }
     else if (!strcmp(method, "poll")) {
-        run_test<TPoll>(num_pipes, num_writes, num_active);
+        run_test<TPoll>(num_pipes, num_writes, num_active, num_idle);
     }
 #ifdef HAVE_EPOLL
     else if (!strcmp(method, "epoll")) {
-        run_test<TEPoll>(num_pipes, num_writes, num_active);
+        run_test<TEPoll>(num_pipes, num_writes, num_active, num_idle);
     }
 #endif
 #ifdef HAVE_URING
     else if (!strcmp(method, "uring")) {
-        run_test<TUring>(num_pipes, num_writes, num_active);
+        run_test<TUring>(num_pipes, num_writes, num_active, num_idle);
     }
 #endif
 #ifdef HAVE_KQUEUE
     else if (!strcmp(method, "kqueue")) {
-        run_test<TKqueue>(num_pipes, num_writes, num_active);
+        run_test<TKqueue>(num_pipes, num_writes, num_active, num_idle);
     }
 #endif
 #ifdef HAVE_IOCP
     else if (!strcmp(method, "iocp")) {
-        run_test<TIOCp>(num_pipes, num_writes, num_active);
+        run_test<TIOCp>(num_pipes, num_writes, num_active, num_idle);
     }
 #endif
 
@@ -0,0 +1,630 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#if defined(__APPLE__)
+#define _DARWIN_UNLIMITED_SELECT
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <string.h>
+#include <stdio.h>
+
+#include <coroio/all.hpp>
+#include <coroio/ws.hpp>
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace NNet;
+
+namespace {
+
+std::atomic<uint64_t> Allocations = 0;
+
+} // namespace
+
+void* operator new(size_t size) {
+    Allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+namespace {
+
+void usage(const char* name) {
+    printf("%s [-m method|all] [-s scenario,...] [-c connections] [-n ops] [-p port] [-C cert -K key] [-o file]\n", name);
+    printf("  scenarios: echo, tls, ws, connect, timers, dns (default: all)\n");
+    printf("  prints one JSON document with p50/p99/p999 latencies, allocations and\n");
+    printf("  poller calls per operation for every scenario and backend\n");
+}
+
+struct TOptions {
+    int Connections = 100;
+    int Ops = 100000;
+    int Port = 8900;
+    int Size = 64;
+    const char* Cert = nullptr;
+    const char* Key = nullptr;
+};
+
+struct TResult {
+    std::string Name;
+    bool Skipped = false;
+    int Connections = 0;
+    uint64_t Ops = 0;
+    double Seconds = 0;
+    THistogramSnapshot Latency = {};
+    uint64_t Allocations = 0;
+    uint64_t Polls = 0;
+    uint64_t Submissions = 0;
+};
+
+/// Common bookkeeping of a scenario: timing, allocations and poller counters.
+template<typename TPoller>
+class TMeasure {
+public:
+    TMeasure(TLoop<TPoller>& loop, std::string name, int connections)
+        : Loop(loop)
+    {
+        Result.Name = std::move(name);
+        Result.Connections = connections;
+    }
+
+    void Start() {
+        StartTime = TClock::now();
+        StartAllocations = Allocations.load();
+#ifdef COROIO_STATS
+        auto stats = Loop.Poller().Stats().Snapshot();
+        StartPolls = stats.Polls;
+        StartSubmissions = stats.Submissions;
+#endif
+    }
+
+    void Record(TClock::duration latency) {
+        Latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+        Result.Ops++;
+    }
+
+    TResult Finish() {
+        Result.Seconds = std::chrono::duration<double>(TClock::now() - StartTime).count();
+        Result.Allocations = Allocations.load() - StartAllocations;
+#ifdef COROIO_STATS
+        auto stats = Loop.Poller().Stats().Snapshot();
+        Result.Polls = stats.Polls - StartPolls;
+        Result.Submissions = stats.Submissions - StartSubmissions;
+#endif
+        Result.Latency = Latency.Snapshot();
+        return Result;
+    }
+
+    void Run(const std::function<bool()>& done) {
+        while (!done()) {
+            Loop.Step();
+        }
+    }
+
+private:
+    TLoop<TPoller>& Loop;
+    TResult Result;
+    THistogram Latency;
+    TTime StartTime = {};
+    uint64_t StartAllocations = 0;
+    uint64_t StartPolls = 0;
+    uint64_t StartSubmissions = 0;
+};
+
+template<typename TStream>
+TFuture<void> echo_session(TStream& stream, int size) {
+    std::vector<char> buffer(size);
+    TByteReader reader(stream);
+    TByteWriter writer(stream);
+    try {
+        while (true) {
+            co_await reader.Read(buffer.data(), size);
+            co_await writer.Write(buffer.data(), size);
+        }
+    } catch (const std::exception&) {
+        // the client has gone
+    }
+}
+
+template<typename TStream, typename TPoller>
+TFuture<void> echo_requests(TStream& stream, int requests, int size, TMeasure<TPoller>& measure) {
+    std::vector<char> out(size, 'x');
+    std::vector<char> in(size);
+    TByteReader reader(stream);
+    TByteWriter writer(stream);
+    for (int i = 0; i < requests; i++) {
+        auto start = TClock::now();
+        co_await writer.Write(out.data(), size);
+        co_await reader.Read(in.data(), size);
+        measure.Record(TClock::now() - start);
+    }
+}
+
+template<typename TPoller>
+TResult run_echo(const TOptions& options, int port) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TMeasure<TPoller> measure(loop, "echo", options.Connections);
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen(4096);
+
+    std::vector<TSocket> accepted;
+    std::vector<TFuture<void>> sessions;
+    accepted.reserve(options.Connections);
+    sessions.reserve(options.Connections);
+    auto server = [&]() -> TFuture<void> {
+        for (int i = 0; i < options.Connections; i++) {
+            accepted.emplace_back(co_await listener.Accept());
+            sessions.emplace_back(echo_session(accepted.back(), options.Size));
+        }
+    }();
+
+    // connections are established first, a semaphore keeps the listen queue from overflowing
+    TSemaphore connecting(128);
+    std::vector<TSocket> clients;
+    clients.reserve(options.Connections);
+    int connected = 0;
+    std::vector<TFuture<void>> connects;
+    for (int i = 0; i < options.Connections; i++) {
+        clients.emplace_back(loop.Poller(), addr.Domain());
+        connects.emplace_back([&](TSocket& socket) -> TFuture<void> {
+            auto permit = co_await connecting.Acquire();
+            co_await socket.Connect(addr);
+            connected++;
+        }(clients.back()));
+    }
+    measure.Run([&]() { return connected == options.Connections && server.done(); });
+
+    int requests = std::max(1, options.Ops / options.Connections);
+    int finished = 0;
+    std::vector<TFuture<void>> tasks;
+    measure.Start();
+    for (auto& client : clients) {
+        tasks.emplace_back([&](TSocket& socket) -> TFuture<void> {
+            co_await echo_requests(socket, requests, options.Size, measure);
+            finished++;
+        }(client));
+    }
+    measure.Run([&]() { return finished == options.Connections; });
+    return measure.Finish();
+}
+
+template<typename TPoller>
+TResult run_tls(const TOptions& options, int port) {
+#ifdef HAVE_OPENSSL
+    if (options.Cert && options.Key) {
+        using TSocket = typename TPoller::TSocket;
+        TLoop<TPoller> loop;
+        int connections = std::min(options.Connections, 100);
+        TMeasure<TPoller> measure(loop, "tls", connections);
+        TAddress addr{"127.0.0.1", port};
+        TSocket listener(loop.Poller(), addr.Domain());
+        listener.Bind(addr);
+        listener.Listen(4096);
+        auto serverCtx = TSslContext::Server(options.Cert, options.Key);
+        auto clientCtx = TSslContext::Client();
+
+        std::vector<TFuture<void>> sessions;
+        auto server = [&]() -> TFuture<void> {
+            for (int i = 0; i < connections; i++) {
+                sessions.emplace_back([](TSocket socket, TSslContext& ctx, int size) -> TFuture<void> {
+                    TSslSocket<TSocket> ssl(std::move(socket), ctx);
+                    co_await ssl.AcceptHandshake();
+                    co_await echo_session(ssl, size);
+                }(co_await listener.Accept(), serverCtx, options.Size));
+            }
+        }();
+
+        int requests = std::max(1, options.Ops / connections);
+        int ready = 0, finished = 0;
+        bool go = false;
+        std::vector<TFuture<void>> tasks;
+        for (int i = 0; i < connections; i++) {
+            tasks.emplace_back([&]() -> TFuture<void> {
+                TSslSocket<TSocket> ssl(TSocket(loop.Poller(), addr.Domain()), clientCtx);
+                co_await ssl.Connect(addr);
+                ready++;
+                while (!go) {
+                    co_await loop.Poller().Yield();
+                }
+                co_await echo_requests(ssl, requests, options.Size, measure);
+                finished++;
+            }());
+        }
+        measure.Run([&]() { return ready == connections; });
+        measure.Start();
+        go = true;
+        measure.Run([&]() { return finished == connections; });
+        return measure.Finish();
+    }
+#endif
+    (void)options;
+    (void)port;
+    return TResult{.Name = "tls", .Skipped = true};
+}
+
+template<typename TPoller>
+TResult run_ws(const TOptions& options, int port) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TMeasure<TPoller> measure(loop, "ws", 1);
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    auto server = [&]() -> TFuture<void> {
+        auto socket = co_await listener.Accept();
+        TWebSocket<TSocket> ws(socket);
+        co_await ws.Accept();
+        try {
+            while (true) {
+                auto frame = co_await ws.ReceiveBinary();
+                co_await ws.SendBinary(frame);
+            }
+        } catch (const std::exception&) {
+            // closed by the client
+        }
+    }();
+
+    bool ready = false, finished = false;
+    TSocket socket(loop.Poller(), addr.Domain());
+    TWebSocket<TSocket> ws(socket);
+    auto client = [&]() -> TFuture<void> {
+        co_await socket.Connect(addr);
+        co_await ws.Connect("127.0.0.1", "/");
+        ready = true;
+        std::string payload(options.Size, 'x');
+        for (int i = 0; i < options.Ops; i++) {
+            auto start = TClock::now();
+            co_await ws.SendBinary(payload);
+            co_await ws.ReceiveBinary();
+            measure.Record(TClock::now() - start);
+        }
+        finished = true;
+    };
+    auto task = client();
+    measure.Run([&]() { return ready; });
+    measure.Start();
+    measure.Run([&]() { return finished; });
+    return measure.Finish();
+}
+
+template<typename TPoller>
+TResult run_connect(const TOptions& options, int port) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    int total = std::min(options.Ops, 20000);
+    TMeasure<TPoller> measure(loop, "connect", total);
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen(4096);
+
+    // every accepted connection is closed right away
+    auto server = [&]() -> TFuture<void> {
+        for (int i = 0; i < total; i++) {
+            auto socket = co_await listener.Accept();
+        }
+    }();
+
+    TSemaphore inflight(64);
+    int finished = 0;
+    std::vector<TFuture<void>> tasks;
+    tasks.reserve(total);
+    measure.Start();
+    for (int i = 0; i < total; i++) {
+        tasks.emplace_back([&]() -> TFuture<void> {
+            auto permit = co_await inflight.Acquire();
+            auto start = TClock::now();
+            TSocket socket(loop.Poller(), addr.Domain());
+            co_await socket.Connect(addr);
+            measure.Record(TClock::now() - start);
+            finished++;
+        }());
+    }
+    measure.Run([&]() { return finished == total && server.done(); });
+    return measure.Finish();
+}
+
+template<typename TPoller>
+TResult run_timers(const TOptions& options, int) {
+    TLoop<TPoller> loop;
+    int sleepers = std::max(1, options.Connections * 100);
+    int rounds = std::max(1, options.Ops / sleepers);
+    TMeasure<TPoller> measure(loop, "timers", sleepers);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> delay(0, 10000);
+
+    // latency is the lateness of a timer after its deadline
+    int finished = 0;
+    std::vector<TFuture<void>> tasks;
+    tasks.reserve(sleepers);
+    measure.Start();
+    for (int i = 0; i < sleepers; i++) {
+        tasks.emplace_back([&]() -> TFuture<void> {
+            for (int r = 0; r < rounds; r++) {
+                auto deadline = TClock::now() + std::chrono::microseconds(delay(rng));
+                co_await loop.Poller().Sleep(deadline);
+                measure.Record(TClock::now() - deadline);
+            }
+            finished++;
+        }());
+    }
+    measure.Run([&]() { return finished == sleepers; });
+    return measure.Finish();
+}
+
+#ifndef _WIN32
+/// Answers every query with 127.0.0.1 from its own thread, like a local caching server.
+class TDnsResponder {
+public:
+    explicit TDnsResponder(int port) {
+        Fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(Fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            close(Fd);
+            throw std::system_error(errno, std::generic_category(), "bind");
+        }
+        Thread = std::thread([this] { Serve(); });
+    }
+
+    ~TDnsResponder() {
+        Running = false;
+        Thread.join();
+        close(Fd);
+    }
+
+private:
+    void Serve() {
+        uint8_t buf[512];
+        while (Running) {
+            pollfd fds = {Fd, POLLIN, 0};
+            if (poll(&fds, 1, 20) <= 0) {
+                continue;
+            }
+            sockaddr_in peer = {};
+            socklen_t len = sizeof(peer);
+            auto size = recvfrom(Fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr*>(&peer), &len);
+            if (size < 12) {
+                continue;
+            }
+            // keeps the header and the question, drops any additional records
+            ssize_t pos = 12;
+            while (pos < size && buf[pos]) {
+                pos += 1 + buf[pos];
+            }
+            pos += 5;
+            if (pos > size) {
+                continue;
+            }
+            static const uint8_t answer[] = {
+                0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 0, 0, 4, 127, 0, 0, 1
+            };
+            uint8_t out[512 + sizeof(answer)];
+            memcpy(out, buf, pos);
+            out[2] = 0x81; out[3] = 0x80;
+            out[6] = 0; out[7] = 1;
+            out[8] = out[9] = out[10] = out[11] = 0;
+            memcpy(out + pos, answer, sizeof(answer));
+            sendto(Fd, out, pos + sizeof(answer), 0, reinterpret_cast<sockaddr*>(&peer), len);
+        }
+    }
+
+    int Fd = -1;
+    std::atomic<bool> Running = true;
+    std::thread Thread;
+};
+#endif
+
+template<typename TPoller>
+TResult run_dns(const TOptions& options, int port) {
+#ifndef _WIN32
+    TDnsResponder responder(port);
+    TLoop<TPoller> loop;
+    int queries = std::min(options.Ops, 20000);
+    TMeasure<TPoller> measure(loop, "dns", 64);
+    TResolver<TPollerBase> resolver(TAddress{"127.0.0.1", port}, loop.Poller());
+    TSemaphore inflight(64);
+    int finished = 0;
+    std::vector<TFuture<void>> tasks;
+    tasks.reserve(queries);
+    measure.Start();
+    for (int i = 0; i < queries; i++) {
+        tasks.emplace_back([&](int i) -> TFuture<void> {
+            auto permit = co_await inflight.Acquire();
+            auto start = TClock::now();
+            // unique names, the cache is not measured
+            co_await resolver.Resolve("host" + std::to_string(i) + ".bench");
+            measure.Record(TClock::now() - start);
+            finished++;
+        }(i));
+    }
+    measure.Run([&]() { return finished == queries; });
+    return measure.Finish();
+#else
+    (void)options;
+    (void)port;
+    return TResult{.Name = "dns", .Skipped = true};
+#endif
+}
+
+void print_result(FILE* out, const TResult& r) {
+    fprintf(out, "        {\"name\": \"%s\"", r.Name.c_str());
+    if (r.Skipped) {
+        fprintf(out, ", \"skipped\": true}");
+        return;
+    }
+    double ops = r.Ops ? static_cast<double>(r.Ops) : 1.0;
+    fprintf(out, ", \"connections\": %d, \"ops\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.1f",
+        r.Connections, static_cast<unsigned long long>(r.Ops), r.Seconds, r.Seconds > 0 ? r.Ops / r.Seconds : 0.0);
+    fprintf(out, ", \"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu, \"mean\": %.1f}",
+        static_cast<unsigned long long>(r.Latency.Percentile(50)),
+        static_cast<unsigned long long>(r.Latency.Percentile(99)),
+        static_cast<unsigned long long>(r.Latency.Percentile(99.9)),
+        static_cast<unsigned long long>(r.Latency.Max),
+        r.Latency.Mean());
+    fprintf(out, ", \"allocs_per_op\": %.3f", r.Allocations / ops);
+#ifdef COROIO_STATS
+    fprintf(out, ", \"polls_per_op\": %.3f, \"submissions_per_op\": %.3f", r.Polls / ops, r.Submissions / ops);
+#endif
+    fprintf(out, "}");
+}
+
+template<typename TPoller>
+void run_backend(FILE* out, const char* backend, const TOptions& options, const std::vector<std::string>& scenarios, bool first) {
+    using TScenario = TResult(*)(const TOptions&, int);
+    static const std::pair<const char*, TScenario> all[] = {
+        {"echo", run_echo<TPoller>},
+        {"tls", run_tls<TPoller>},
+        {"ws", run_ws<TPoller>},
+        {"connect", run_connect<TPoller>},
+        {"timers", run_timers<TPoller>},
+        {"dns", run_dns<TPoller>},
+    };
+    fprintf(out, "%s    {\"backend\": \"%s\", \"scenarios\": [\n", first ? "" : ",\n", backend);
+    bool firstScenario = true;
+    int index = 0;
+    for (auto& [name, scenario] : all) {
+        int port = options.Port + index++;
+        if (!scenarios.empty() && std::find(scenarios.begin(), scenarios.end(), name) == scenarios.end()) {
+            continue;
+        }
+        fprintf(stderr, "%s: %s\n", backend, name);
+        TResult result;
+        try {
+            result = scenario(options, port);
+        } catch (const std::exception& ex) {
+            fprintf(stderr, "%s: %s failed: %s\n", backend, name, ex.what());
+            result = TResult{.Name = name, .Skipped = true};
+        }
+        fprintf(out, "%s", firstScenario ? "" : ",\n");
+        print_result(out, result);
+        firstScenario = false;
+    }
+    fprintf(out, "\n    ]}");
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    TInitializer init;
+    TOptions options;
+    const char* method = "all";
+    const char* output = nullptr;
+    std::vector<std::string> scenarios;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-m") && i < argc-1) {
+            method = argv[++i];
+        } else if (!strcmp(argv[i], "-s") && i < argc-1) {
+            std::string list = argv[++i];
+            for (size_t pos = 0; pos <= list.size(); ) {
+                auto end = std::min(list.find(',', pos), list.size());
+                scenarios.emplace_back(list.substr(pos, end - pos));
+                pos = end + 1;
+            }
+        } else if (!strcmp(argv[i], "-c") && i < argc-1) {
+            options.Connections = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "-n") && i < argc-1) {
+            options.Ops = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "-p") && i < argc-1) {
+            options.Port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-C") && i < argc-1) {
+            options.Cert = argv[++i];
+        } else if (!strcmp(argv[i], "-K") && i < argc-1) {
+            options.Key = argv[++i];
+        } else if (!strcmp(argv[i], "-o") && i < argc-1) {
+            output = argv[++i];
+        } else {
+            usage(argv[0]); return 1;
+        }
+    }
+#ifndef _WIN32
+    // two descriptors per connection
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        perror(output);
+        return 1;
+    }
+#ifdef COROIO_FRAME_POOL
+    const char* pool = "true";
+#else
+    const char* pool = "false";
+#endif
+    fprintf(out, "{\"frame_pool\": %s, \"connections\": %d, \"ops\": %d, \"size\": %d, \"runs\": [\n",
+        pool, options.Connections, options.Ops, options.Size);
+
+    bool all = !strcmp(method, "all");
+    bool first = true;
+    bool found = false;
+    auto run = [&]<typename TPoller>(const char* name) {
+        if (all || !strcmp(method, name)) {
+            run_backend<TPoller>(out, name, options, scenarios, first);
+            first = false;
+            found = true;
+        }
+    };
+    run.operator()<TSelect>("select");
+    run.operator()<TPoll>("poll");
+#ifdef HAVE_EPOLL
+    run.operator()<TEPoll>("epoll");
+#endif
+#ifdef HAVE_URING
+    run.operator()<TUring>("uring");
+#endif
+#ifdef HAVE_KQUEUE
+    run.operator()<TKqueue>("kqueue");
+#endif
+#ifdef HAVE_IOCP
+    run.operator()<TIOCp>("iocp");
+#endif
+    fprintf(out, "\n]}\n");
+    if (output) {
+        fclose(out);
+    }
+    if (!found) {
+        fprintf(stderr, "Unknown method: %s\n", method);
+        return 1;
+    }
+    return 0;
+}
@@ -40,10 +40,10 @@ TVoidTask client_handler(TSocket socket, int buffer_size) {
 }
 
 template<bool debug, typename TPoller>
-TVoidTask server(TPoller& poller, TAddress address, int buffer_size)
+TVoidTask server(TPoller& poller, TAddress address, int buffer_size, bool reuse_port)
 {
     typename TPoller::TSocket socket(poller, address.Domain());
-    socket.Bind(address);
+    socket.Bind(address, reuse_port);
     socket.Listen();
     std::cerr << "Listening on: " << socket.LocalAddr()->ToString() << std::endl;
 
@@ -55,19 +55,35 @@ TVoidTask server(TPoller& poller, TAddress address, int buffer_size)
 }
 
 template<typename TPoller>
-void run(bool debug, TAddress address, int buffer_size)
+void run(bool debug, TAddress address, int buffer_size, int threads)
 {
+    if (threads > 1) {
+        NNet::TMultiLoop<TPoller> loops(threads);
+        for (int k = 0; k < loops.Size(); k++) {
+            loops.Spawn(k, [=](TPoller& poller) {
+                if (debug) {
+                    server<true>(poller, address, buffer_size, true);
+                } else {
+                    server<false>(poller, address, buffer_size, true);
+                }
+            });
+        }
+        loops.Start();
+        loops.Join();
+        return;
+    }
+
     NNet::TLoop<TPoller> loop;
     if (debug) {
-        server<true>(loop.Poller(), std::move(address), buffer_size);
+        server<true>(loop.Poller(), std::move(address), buffer_size, false);
     } else {
-        server<false>(loop.Poller(), std::move(address), buffer_size);
+        server<false>(loop.Poller(), std::move(address), buffer_size, false);
     }
     loop.Loop();
 }
 
 void usage(const char* name) {
-    std::cerr << name << " [--port 80] [--method select|poll|epoll|kqueue] [--debug] [--buffer-size 100000] [--help]" << std::endl;
+    std::cerr << name << " [--port 80] [--method select|poll|epoll|kqueue] [--debug] [--buffer-size 100000] [--threads 1] [--help]" << std::endl;
     std::exit(1);
 }
 
@@ -77,6 +93,7 @@ int main(int argc, char** argv) {
     int buffer_size = 128;
     std::string method = "select";
     bool debug = false;
+    int threads = 1;
     for (int i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "--port") && i < argc-1) {
             port = atoi(argv[++i]);
@@ -86,6 +103,8 @@ int main(int argc, char** argv) {
             debug = true;
         } else if (!strcmp(argv[i], "--buffer-size") && i < argc-1) {
             buffer_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i < argc-1) {
+            threads = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "--help")) {
             usage(argv[0]);
         }
@@ -97,29 +116,29 @@ int main(int argc, char** argv) {
     std::cerr << "Method: " << method << "\n";
 
     if (method == "select") {
-        run<TSelect>(debug, address, buffer_size);
+        run<TSelect>(debug, address, buffer_size, threads);
     }
     else if (method == "poll") {
-        run<TPoll>(debug, address, buffer_size);
+        run<TPoll>(debug, address, buffer_size, threads);
     }
 #ifdef HAVE_EPOLL
     else if (method == "epoll") {
-        run<TEPoll>(debug, address, buffer_size);
+        run<TEPoll>(debug, address, buffer_size, threads);
     }
 #endif
 #ifdef HAVE_URING
     else if (method == "uring") {
-        run<TUring>(debug, address, buffer_size);
+        run<TUring>(debug, address, buffer_size, threads);
     }
 #endif
 #ifdef HAVE_KQUEUE
     else if (method == "kqueue") {
-        run<TKqueue>(debug, address, buffer_size);
+        run<TKqueue>(debug, address, buffer_size, threads);
     }
 #endif
 #ifdef HAVE_IOCP
     else if (method == "iocp") {
-        run<TIOCp>(debug, address, buffer_size);
+        run<TIOCp>(debug, address, buffer_size, threads);
     }
 #endif
     else {
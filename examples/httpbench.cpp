@@ -0,0 +1,177 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include <chrono>
+#include <cctype>
+#include <string>
+#include <vector>
+
+#include <string.h>
+#include <stdio.h>
+
+#include <coroio/all.hpp>
+#include <coroio/stats.hpp>
+
+using namespace NNet;
+
+/*
+ * A wrk-style load generator: keeps -c connections busy for -d seconds, each sending
+ * -P pipelined GET requests at a time and waiting for their responses.
+ * Latency is measured per batch.
+ */
+
+void usage(const char* name) {
+    printf("%s [-m method] [-a address] [-p port] [-c connections] [-d seconds] [-P pipeline] [-u path]\n", name);
+}
+
+struct TOptions {
+    std::string Address = "127.0.0.1";
+    int Port = 8080;
+    int Connections = 100;
+    int Seconds = 10;
+    int Pipeline = 1;
+    std::string Path = "/";
+};
+
+struct TTotals {
+    uint64_t Requests = 0;
+    uint64_t Bytes = 0;
+    uint64_t Errors = 0;
+    THistogram Latency;
+};
+
+/// Reads one response, returns its size.
+template<typename TSocket>
+TFuture<size_t> read_response(TByteReader<TSocket>& reader) {
+    auto head = co_await reader.ReadUntil("\r\n\r\n");
+    std::string lower = head;
+    for (auto& c : lower) {
+        c = tolower(static_cast<unsigned char>(c));
+    }
+    size_t length = 0;
+    auto pos = lower.find("\r\ncontent-length:");
+    if (pos != std::string::npos) {
+        length = strtoull(head.c_str() + pos + 17, nullptr, 10);
+    }
+    std::vector<char> body(length);
+    co_await reader.Read(body.data(), length);
+    co_return head.size() + length;
+}
+
+template<typename TPoller>
+TFuture<void> connection(TPoller& poller, const TOptions& options, TTime deadline, TTotals& totals) {
+    std::string batch;
+    for (int i = 0; i < options.Pipeline; i++) {
+        batch += "GET " + options.Path + " HTTP/1.1\r\nHost: " + options.Address + "\r\n\r\n";
+    }
+    while (TClock::now() < deadline) {
+        try {
+            TAddress addr{options.Address, options.Port};
+            typename TPoller::TSocket socket(poller, addr.Domain());
+            co_await socket.Connect(addr);
+            TByteReader reader(socket);
+            TByteWriter writer(socket);
+            while (TClock::now() < deadline) {
+                auto start = TClock::now();
+                co_await writer.Write(batch.data(), batch.size());
+                for (int i = 0; i < options.Pipeline; i++) {
+                    totals.Bytes += co_await read_response(reader);
+                }
+                totals.Latency.Record(std::chrono::duration_cast<std::chrono::nanoseconds>(TClock::now() - start).count());
+                totals.Requests += options.Pipeline;
+            }
+        } catch (const std::exception&) {
+            // reconnect, like wrk
+            totals.Errors++;
+        }
+    }
+}
+
+template<typename TPoller>
+void run(const TOptions& options) {
+    TLoop<TPoller> loop;
+    TTotals totals;
+    auto start = TClock::now();
+    auto deadline = start + std::chrono::seconds(options.Seconds);
+    std::vector<TFuture<void>> connections;
+    for (int i = 0; i < options.Connections; i++) {
+        connections.emplace_back(connection(loop.Poller(), options, deadline, totals));
+    }
+    auto finished = [&]() {
+        for (auto& c : connections) {
+            if (!c.done()) {
+                return false;
+            }
+        }
+        return true;
+    };
+    while (!finished()) {
+        loop.Step();
+    }
+    double seconds = std::chrono::duration<double>(TClock::now() - start).count();
+    auto latency = totals.Latency.Snapshot();
+
+    printf("%d connections, pipeline %d, %.2fs\n", options.Connections, options.Pipeline, seconds);
+    printf("  latency p50 %.1fus p99 %.1fus p999 %.1fus max %.1fus\n",
+        latency.Percentile(50) / 1000.0, latency.Percentile(99) / 1000.0,
+        latency.Percentile(99.9) / 1000.0, latency.Max / 1000.0);
+    printf("  %llu requests, %.1f MB read, %llu errors\n",
+        static_cast<unsigned long long>(totals.Requests), totals.Bytes / 1e6,
+        static_cast<unsigned long long>(totals.Errors));
+    printf("Requests/sec: %.1f\n", totals.Requests / seconds);
+}
+
+int main(int argc, char** argv) {
+    TInitializer init;
+    TOptions options;
+    std::string method = "epoll";
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-m") && i < argc - 1) {
+            method = argv[++i];
+        } else if (!strcmp(argv[i], "-a") && i < argc - 1) {
+            options.Address = argv[++i];
+        } else if (!strcmp(argv[i], "-p") && i < argc - 1) {
+            options.Port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-c") && i < argc - 1) {
+            options.Connections = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-d") && i < argc - 1) {
+            options.Seconds = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-P") && i < argc - 1) {
+            options.Pipeline = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(argv[i], "-u") && i < argc - 1) {
+            options.Path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (method == "select") {
+        run<TSelect>(options);
+    } else if (method == "poll") {
+        run<TPoll>(options);
+    }
+#ifdef HAVE_EPOLL
+    else if (method == "epoll") {
+        run<TEPoll>(options);
+    }
+#endif
+#ifdef HAVE_URING
+    else if (method == "uring") {
+        run<TUring>(options);
+    }
+#endif
+#ifdef HAVE_KQUEUE
+    else if (method == "kqueue") {
+        run<TKqueue>(options);
+    }
+#endif
+#ifdef HAVE_IOCP
+    else if (method == "iocp") {
+        run<TIOCp>(options);
+    }
+#endif
+    else {
+        usage(argv[0]);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include <coroio/all.hpp>
+#include <coroio/http.hpp>
+
+using NNet::TVoidTask;
+using NNet::TAddress;
+using NNet::TSelect;
+using NNet::TPoll;
+using NNet::THttpReader;
+using NNet::THttpResponse;
+using NNet::TByteWriter;
+
+#ifdef HAVE_EPOLL
+using NNet::TEPoll;
+#endif
+#ifdef HAVE_URING
+using NNet::TUring;
+#endif
+#ifdef HAVE_KQUEUE
+using NNet::TKqueue;
+#endif
+#ifdef HAVE_IOCP
+using NNet::TIOCp;
+#endif
+
+/*
+ * GET /         responds "Hello, World!"
+ * POST /echo    responds with the request body
+ * anything else 404
+ *
+ * Responses to pipelined requests are collected while more requests are buffered
+ * and sent with one write.
+ */
+template<typename TSocket>
+TVoidTask client_handler(TSocket socket, bool debug) {
+    THttpReader reader(socket);
+    std::string out;
+    std::string body;
+    bool bad = false;
+    try {
+        while (co_await reader.ReadRequest()) {
+            const auto& request = reader.Request();
+            if (debug) {
+                std::cerr << request.Method << " " << request.Target << "\n";
+            }
+            if (request.ExpectContinue) {
+                co_await TByteWriter(socket).Write("HTTP/1.1 100 Continue\r\n\r\n", 25);
+            }
+            body.clear();
+            co_await reader.ReadBody(body);
+
+            bool keepAlive = request.KeepAlive;
+            if (request.Method == "GET" && request.Target == "/") {
+                THttpResponse(200).Header("Content-Type", "text/plain").Body("Hello, World!").KeepAlive(keepAlive).AppendTo(out);
+            } else if (request.Method == "POST" && request.Target == "/echo") {
+                THttpResponse(200).Header("Content-Type", "application/octet-stream").Body(body).KeepAlive(keepAlive).AppendTo(out);
+            } else {
+                THttpResponse(404).Body("Not Found").KeepAlive(keepAlive).AppendTo(out);
+            }
+            if (!keepAlive || !reader.Buffered()) {
+                co_await TByteWriter(socket).Write(out.data(), out.size());
+                out.clear();
+            }
+            if (!keepAlive) {
+                break;
+            }
+        }
+    } catch (const std::exception& ex) {
+        if (debug) {
+            std::cerr << "Exception: " << ex.what() << "\n";
+        }
+        bad = true;
+    }
+    if (bad) {
+        // after the responses to the requests answered before the bad one
+        THttpResponse(400).KeepAlive(false).AppendTo(out);
+        try {
+            co_await TByteWriter(socket).Write(out.data(), out.size());
+        } catch (const std::exception&) {
+            // the client has gone
+        }
+    }
+    co_return;
+}
+
+template<typename TPoller>
+TVoidTask server(TPoller& poller, TAddress address, bool debug, bool reuse_port, int cpu = -1)
+{
+    typename TPoller::TSocket socket(poller, address.Domain());
+    if (cpu >= 0) {
+        // connections received on the core of this loop are accepted here
+        socket.SetIncomingCpu(cpu);
+    }
+    socket.Bind(address, reuse_port);
+    socket.Listen(4096);
+    std::cerr << "Listening on: " << socket.LocalAddr()->ToString() << std::endl;
+
+    while (true) {
+        auto client = co_await socket.Accept();
+        client_handler(std::move(client), debug);
+    }
+    co_return;
+}
+
+template<typename TPoller>
+void run(bool debug, TAddress address, int threads, bool pin)
+{
+    if (threads > 1) {
+        NNet::TMultiLoopOptions options;
+        if (pin) {
+            options.Cpus = NNet::NUtils::AllowedCpus();
+        }
+        NNet::TMultiLoop<TPoller> loops(threads, options);
+        for (int k = 0; k < loops.Size(); k++) {
+            loops.Spawn(k, [=, cpu = loops.Cpu(k)](TPoller& poller) {
+                server(poller, address, debug, true, cpu);
+            });
+        }
+        loops.Start();
+        loops.Join();
+        return;
+    }
+
+    NNet::TLoop<TPoller> loop;
+    server(loop.Poller(), std::move(address), debug, false);
+    loop.Loop();
+}
+
+void usage(const char* name) {
+    std::cerr << name << " [--port 8080] [--method select|poll|epoll|uring|kqueue|iocp] [--threads 1] [--pin] [--debug] [--help]" << std::endl;
+    std::exit(1);
+}
+
+int main(int argc, char** argv) {
+    NNet::TInitializer init;
+    int port = 8080;
+    std::string method = "select";
+    bool debug = false;
+    int threads = 1;
+    bool pin = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--port") && i < argc-1) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--method") && i < argc-1) {
+            method = argv[++i];
+        } else if (!strcmp(argv[i], "--debug")) {
+            debug = true;
+        } else if (!strcmp(argv[i], "--threads") && i < argc-1) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--pin")) {
+            pin = true;
+        } else if (!strcmp(argv[i], "--help")) {
+            usage(argv[0]);
+        }
+    }
+
+    TAddress address{"::", port};
+    std::cerr << "Method: " << method << "\n";
+
+    if (method == "select") {
+        run<TSelect>(debug, address, threads, pin);
+    }
+    else if (method == "poll") {
+        run<TPoll>(debug, address, threads, pin);
+    }
+#ifdef HAVE_EPOLL
+    else if (method == "epoll") {
+        run<TEPoll>(debug, address, threads, pin);
+    }
+#endif
+#ifdef HAVE_URING
+    else if (method == "uring") {
+        run<TUring>(debug, address, threads, pin);
+    }
+#endif
+#ifdef HAVE_KQUEUE
+    else if (method == "kqueue") {
+        run<TKqueue>(debug, address, threads, pin);
+    }
+#endif
+#ifdef HAVE_IOCP
+    else if (method == "iocp") {
+        run<TIOCp>(debug, address, threads, pin);
+    }
+#endif
+    else {
+        std::cerr << "Unknown method\n";
+    }
+    return 0;
+}
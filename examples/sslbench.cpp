@@ -0,0 +1,148 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include <chrono>
+#include <cstdlib>
+
+#include <string.h>
+#include <stdio.h>
+
+#include <coroio/all.hpp>
+
+using namespace NNet;
+
+namespace {
+
+void usage(const char* name) {
+    printf("%s [-n megabytes] [-s block_size] [-p port] [-m method] [-c cert] [-k key]\n", name);
+}
+
+} // namespace
+
+#ifdef HAVE_OPENSSL
+
+namespace {
+
+template<typename TSocket>
+TFuture<void> sink(TSocket& listener, TSslContext& ctx, size_t total, int size) {
+    auto ssl = TSslSocket(co_await listener.Accept(), ctx);
+    co_await ssl.AcceptHandshake();
+    std::vector<char> buffer(size);
+    size_t received = 0;
+    while (received < total) {
+        auto n = co_await ssl.ReadSome(buffer.data(), buffer.size());
+        if (n <= 0) {
+            break;
+        }
+        received += n;
+    }
+    // tells the sender everything arrived
+    co_await TByteWriter(ssl).Write("k", 1);
+}
+
+template<typename TSocket>
+TFuture<void> source(TSocket&& socket, TAddress addr, TSslContext& ctx, size_t total, int size, TTime* start) {
+    auto ssl = TSslSocket(std::move(socket), ctx);
+    co_await ssl.Connect(addr);
+    std::vector<char> buffer(size, 'x');
+    *start = TClock::now();
+    size_t sent = 0;
+    while (sent < total) {
+        size_t n = std::min<size_t>(size, total - sent);
+        co_await TByteWriter(ssl).Write(buffer.data(), n);
+        sent += n;
+    }
+    char c;
+    co_await TByteReader(ssl).Read(&c, 1);
+}
+
+template<typename TPoller>
+void run(size_t megabytes, int size, int port, const char* cert, const char* key) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    auto serverCtx = TSslContext::Server(cert, key);
+    auto clientCtx = TSslContext::Client();
+    size_t total = megabytes << 20;
+    TTime start = TClock::now();
+    auto server = sink(listener, serverCtx, total, size);
+    auto client = source(TSocket(loop.Poller(), addr.Domain()), addr, clientCtx, total, size, &start);
+    while (!client.done() || !server.done()) {
+        loop.Step();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(TClock::now() - start).count();
+
+    printf("transferred: %zu MB, block size: %d\n", megabytes, size);
+    printf("elapsed: %lld us\n", static_cast<long long>(elapsed));
+    printf("throughput: %.1f MB/s\n", elapsed > 0 ? megabytes * 1e6 / elapsed : 0.0);
+}
+
+} // namespace
+
+#endif
+
+int main(int argc, char** argv) {
+    TInitializer init;
+    size_t megabytes = 256;
+    int size = 16384;
+    int port = 8899;
+    const char* method = "poll";
+    const char* cert = "server.crt";
+    const char* key = "server.key";
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i < argc-1) {
+            megabytes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i < argc-1) {
+            size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && i < argc-1) {
+            port = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-m") && i < argc-1) {
+            method = argv[++i];
+        } else if (!strcmp(argv[i], "-c") && i < argc-1) {
+            cert = argv[++i];
+        } else if (!strcmp(argv[i], "-k") && i < argc-1) {
+            key = argv[++i];
+        } else {
+            usage(argv[0]); return 1;
+        }
+    }
+
+#ifdef HAVE_OPENSSL
+    if (!strcmp(method, "select")) {
+        run<TSelect>(megabytes, size, port, cert, key);
+    } else if (!strcmp(method, "poll")) {
+        run<TPoll>(megabytes, size, port, cert, key);
+    }
+#ifdef HAVE_EPOLL
+    else if (!strcmp(method, "epoll")) {
+        run<TEPoll>(megabytes, size, port, cert, key);
+    }
+#endif
+#ifdef HAVE_URING
+    else if (!strcmp(method, "uring")) {
+        run<TUring>(megabytes, size, port, cert, key);
+    }
+#endif
+#ifdef HAVE_KQUEUE
+    else if (!strcmp(method, "kqueue")) {
+        run<TKqueue>(megabytes, size, port, cert, key);
+    }
+#endif
+#ifdef HAVE_IOCP
+    else if (!strcmp(method, "iocp")) {
+        run<TIOCp>(megabytes, size, port, cert, key);
+    }
+#endif
+    else {
+        printf("Unknown method: %s\n", method);
+        return 1;
+    }
+#else
+    printf("coroio compiled without openssl support\n");
+#endif
+
+    return 0;
+}
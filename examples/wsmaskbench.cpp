@@ -0,0 +1,66 @@
+// © Licensed Authorship: Manuel J. Nieves (See LICENSE for terms)
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+
+#include <string.h>
+#include <stdio.h>
+
+#include <coroio/all.hpp>
+#include <coroio/ws.hpp>
+
+using namespace NNet;
+
+namespace {
+
+void usage(const char* name) {
+    printf("%s [-n megabytes_per_size] [-s max_frame_size]\n", name);
+}
+
+void mask_bytewise(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t key[4]) {
+    for (size_t i = 0; i < size; i++) {
+        dst[i] = src[i] ^ key[i % 4];
+    }
+}
+
+template<typename TMask>
+double measure(TMask mask, std::vector<uint8_t>& buffer, size_t size, size_t total) {
+    const uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+    size_t rounds = std::max<size_t>(1, total / size);
+    auto t1 = TClock::now();
+    for (size_t i = 0; i < rounds; i++) {
+        // in place, as TWebSocket unmasks received frames
+        mask(buffer.data(), buffer.data(), size, key);
+    }
+    auto t2 = TClock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+    return elapsed > 0 ? rounds * size / static_cast<double>(elapsed) : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t megabytes = 256;
+    size_t maxSize = 16 << 20;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i < argc-1) {
+            megabytes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i < argc-1) {
+            maxSize = atoi(argv[++i]);
+        } else {
+            usage(argv[0]); return 1;
+        }
+    }
+
+    size_t total = megabytes << 20;
+    std::vector<uint8_t> buffer(maxSize, 'x');
+    printf("%10s %14s %14s\n", "frame", "bytewise GB/s", "Mask GB/s");
+    for (size_t size = 64; size <= maxSize; size *= 4) {
+        double bytewise = measure(mask_bytewise, buffer, size, total);
+        double vector = measure(NDetail::Mask, buffer, size, total);
+        printf("%10zu %14.2f %14.2f\n", size, bytewise, vector);
+    }
+
+    return 0;
+}
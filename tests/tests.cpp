@@ -9,8 +9,13 @@
 #include <signal.h>
 
 #include <coroio/all.hpp>
+#include <coroio/ws.hpp>
+#include <coroio/http.hpp>
 
 #include <unordered_set>
+#include <mutex>
+#include <thread>
+#include <atomic>
 
 extern "C" {
 #include <cmocka.h>
@@ -172,6 +177,47 @@ void test_accept(void**) {
     assert_memory_equal(&addr1, &addr2, 4);
 }
 
+template<typename TPoller>
+void test_accept_backlog(void**) {
+    int port = getport();
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+    TLoop loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket socket(loop.Poller(), addr.Domain());
+    socket.Bind(addr);
+    socket.Listen();
+    constexpr int clients = 4;
+    int accepted = 0;
+
+    std::vector<TSocket> connected;
+    std::vector<TFuture<void>> connects;
+    for (int i = 0; i < clients; i++) {
+        connects.emplace_back([](TPoller& poller, TAddress addr, std::vector<TSocket>* connected) -> TFuture<void> {
+            TSocket client(poller, addr.Domain());
+            co_await client.Connect(addr);
+            connected->emplace_back(std::move(client));
+        }(loop.Poller(), addr, &connected));
+    }
+
+    TFuture<void> h = [](TPoller& poller, TSocket* socket, int* accepted) -> TFuture<void>
+    {
+        // let all connections queue up, they are announced by a single readiness event
+        co_await poller.Sleep(std::chrono::milliseconds(10));
+        std::vector<TSocket> sockets;
+        for (int i = 0; i < clients; i++) {
+            sockets.emplace_back(co_await socket->Accept());
+            (*accepted)++;
+        }
+    }(loop.Poller(), &socket, &accepted);
+
+    while (!h.done()) {
+        loop.Step();
+    }
+
+    assert_int_equal(accepted, clients);
+}
+
 template<typename TPoller>
 void test_write_after_connect(void**) {
     using TLoop = TLoop<TPoller>;
@@ -505,6 +551,96 @@ void test_timeout2(void**) {
     assert_true(val == 2);
 }
 
+void test_timer_wheel(void**) {
+    using namespace std::chrono;
+    TTimerWheel wheel;
+    auto now = TClock::now();
+    THandle h = std::noop_coroutine();
+    std::vector<unsigned> expired;
+
+    auto t1 = wheel.Add(now + microseconds(1500), h);
+    auto t2 = wheel.Add(now + microseconds(1200), h);
+    auto t3 = wheel.Add(now + milliseconds(100), h);
+    auto t4 = wheel.Add(now + hours(72), h);
+    auto t5 = wheel.Add(now + milliseconds(5000), h);
+    auto t6 = wheel.Add(now + microseconds(1200), h);
+    assert_int_equal(wheel.Size(), 6);
+
+    // same tick, only the earlier deadlines are due
+    wheel.Expire(now + microseconds(1300), expired);
+    assert_int_equal(expired.size(), 2);
+    assert_true(expired[0] == t2);
+    assert_true(expired[1] == t6);
+    for (auto id : expired) {
+        assert_true(wheel.Fire(id) == h);
+    }
+    expired.clear();
+    assert_true(wheel.NextExpiration() == now + microseconds(1500));
+
+    assert_true(wheel.Remove(t3));
+    assert_false(wheel.Remove(t3));
+    assert_false(wheel.Remove(t2));
+
+    wheel.Expire(now + milliseconds(4999), expired);
+    assert_int_equal(expired.size(), 1);
+    assert_true(expired[0] == t1);
+    wheel.Fire(t1);
+    expired.clear();
+
+    wheel.Expire(now + milliseconds(5000), expired);
+    assert_int_equal(expired.size(), 1);
+    assert_true(expired[0] == t5);
+    // removed before firing
+    assert_true(wheel.Remove(t5));
+    assert_true(!wheel.Fire(t5));
+    expired.clear();
+
+    assert_true(wheel.NextExpiration() <= now + hours(72));
+    wheel.Expire(now + hours(71), expired);
+    assert_true(expired.empty());
+    wheel.Expire(now + hours(72), expired);
+    assert_int_equal(expired.size(), 1);
+    assert_true(expired[0] == t4);
+    wheel.Fire(t4);
+    assert_true(wheel.Empty());
+    assert_true(wheel.NextExpiration() == TTime::max());
+}
+
+template<typename TPoller>
+void test_timer_wheel_poller(void**) {
+    using TLoop = TLoop<TPoller>;
+    TLoop loop;
+    loop.Poller().SetTimerWheel();
+    std::vector<int> order;
+    std::vector<TFuture<void>> futures;
+    for (int ms : {30, 10, 20, 10, 0}) {
+        futures.emplace_back([](TPollerBase& poller, int ms, std::vector<int>* order) -> TFuture<void> {
+            auto start = TClock::now();
+            co_await poller.Sleep(std::chrono::milliseconds(ms));
+            assert_true(TClock::now() >= start + std::chrono::milliseconds(ms));
+            order->push_back(ms);
+        }(loop.Poller(), ms, &order));
+    }
+    // cancelled timer
+    TFuture<void> h = [](TPollerBase& poller) -> TFuture<void> {
+        std::vector<TFuture<void>> any;
+        any.emplace_back([](TPollerBase& poller) -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::milliseconds(5));
+        }(poller));
+        any.emplace_back([](TPollerBase& poller) -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::seconds(100));
+        }(poller));
+        co_await Any(std::move(any));
+    }(loop.Poller());
+
+    while (loop.Poller().TimersSize() > 0) {
+        loop.Step();
+    }
+
+    assert_true(h.done());
+    assert_true((order == std::vector<int>{0, 10, 10, 20, 30}));
+}
+
 template<typename TPoller>
 void test_read_write_full(void**) {
     using TLoop = TLoop<TPoller>;
@@ -549,6 +685,248 @@ void test_read_write_full(void**) {
     assert_memory_equal(data.data(), received.data(), data.size());
 }
 
+template<typename TPoller>
+void test_read_write_zero_copy(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    std::vector<char> data(1024*1024);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = 'a' + i % 26;
+    }
+
+    TLoop loop;
+    TAddress saddr{"127.0.0.1", port};
+    TSocket socket(loop.Poller(), saddr.Domain());
+    socket.Bind(saddr);
+    socket.Listen();
+
+    TSocket client(loop.Poller(), saddr.Domain());
+    if (!client.SetZeroCopy(64 * 1024)) {
+        return; // not supported by the poller
+    }
+
+    TFuture<void> h1 = [](TSocket& client, TAddress addr, std::vector<char>& data) -> TFuture<void>
+    {
+        co_await client.Connect(addr);
+        co_await TByteWriter(client).Write(data.data(), data.size());
+        // the buffer is released once the write resumes
+        std::fill(data.begin(), data.end(), 'x');
+        co_await TByteWriter(client).Write(data.data(), 100);
+    }(client, saddr, data);
+
+    std::vector<char> received(data.size() + 100);
+    TFuture<void> h2 = [](TSocket& server, std::vector<char>& received) -> TFuture<void>
+    {
+        auto client = std::move(co_await server.Accept());
+        co_await TByteReader(client).Read(received.data(), received.size());
+    }(socket, received);
+
+    while (!(h1.done() && h2.done())) {
+        loop.Step();
+    }
+
+    for (size_t i = 0; i < data.size(); i++) {
+        assert_int_equal(received[i], 'a' + i % 26);
+    }
+    assert_memory_equal(received.data() + data.size(), std::string(100, 'x').data(), 100);
+}
+
+template<typename TPoller>
+void test_read_write_vectored(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    std::string head = "head:";
+    std::vector<char> body(512*1024);
+    for (size_t i = 0; i < body.size(); i++) {
+        body[i] = 'a' + i % 26;
+    }
+    std::string tail = ":tail";
+
+    TLoop loop;
+    TAddress saddr{"127.0.0.1", port};
+    TSocket socket(loop.Poller(), saddr.Domain());
+    socket.Bind(saddr);
+    socket.Listen();
+    TSocket client(loop.Poller(), saddr.Domain());
+
+    TFuture<void> h1 = [&]() -> TFuture<void>
+    {
+        co_await client.Connect(saddr);
+        iovec parts[4] = {
+            {head.data(), head.size()},
+            {nullptr, 0},
+            {body.data(), body.size()},
+            {tail.data(), tail.size()}
+        };
+        co_await TByteWriter(client).WriteAll(parts);
+    }();
+
+    std::string received;
+    TFuture<void> h2 = [&]() -> TFuture<void>
+    {
+        auto conn = std::move(co_await socket.Accept());
+        char a[3], b[4096];
+        size_t total = head.size() + body.size() + tail.size();
+        while (received.size() < total) {
+            iovec parts[2] = {{a, sizeof(a)}, {b, sizeof(b)}};
+            auto size = co_await conn.ReadSomeV(parts, 2);
+            if (size < 0) {
+                continue;
+            }
+            assert_true(size > 0);
+            received.append(a, std::min<size_t>(size, sizeof(a)));
+            if (size > (int)sizeof(a)) {
+                received.append(b, size - sizeof(a));
+            }
+        }
+    }();
+
+    while (!(h1.done() && h2.done())) {
+        loop.Step();
+    }
+
+    assert_int_equal(received.size(), head.size() + body.size() + tail.size());
+    assert_true(received == head + std::string(body.begin(), body.end()) + tail);
+}
+
+#ifndef _WIN32
+template<typename TPoller>
+void test_send_file(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    std::vector<char> data(1024*1024 + 123);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = 'a' + i % 26;
+    }
+    char path[] = "/tmp/coroio_send_fileXXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    unlink(path);
+    assert_int_equal(write(fd, data.data(), data.size()), (ssize_t)data.size());
+
+    TLoop loop;
+    TAddress saddr{"127.0.0.1", getport()};
+    TSocket socket(loop.Poller(), saddr.Domain());
+    socket.Bind(saddr);
+    socket.Listen();
+    TSocket client(loop.Poller(), saddr.Domain());
+
+    const int64_t offset = 1000;
+    int eof = -1;
+    TFuture<void> h1 = [&]() -> TFuture<void>
+    {
+        auto conn = std::move(co_await socket.Accept());
+        co_await TByteWriter(conn).SendFile(fd, offset, data.size() - offset);
+        eof = co_await conn.SendFile(fd, data.size(), 100);
+    }();
+
+    std::vector<char> received(data.size() - offset);
+    TFuture<void> h2 = [&]() -> TFuture<void>
+    {
+        co_await client.Connect(saddr);
+        co_await TByteReader(client).Read(received.data(), received.size());
+    }();
+
+    while (!(h1.done() && h2.done())) {
+        loop.Step();
+    }
+    close(fd);
+
+    assert_int_equal(eof, 0);
+    assert_true(std::equal(received.begin(), received.end(), data.begin() + offset));
+}
+
+template<typename TPoller>
+void test_file_read_write_at(void**) {
+    using TFileHandle = typename TPoller::TFileHandle;
+    char path[] = "/tmp/coroio_read_write_atXXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    unlink(path);
+
+    TLoop<TPoller> loop;
+    TFileHandle file(fd, loop.Poller());
+    std::string result;
+    TFuture<void> h = [](TFileHandle* file, std::string* result) -> TFuture<void> {
+        assert_int_equal(co_await file->WriteAt(6, "world", 5), 5);
+        assert_int_equal(co_await file->WriteAt(0, "hello ", 6), 6);
+        char tail[] = "!!";
+        char more[] = " again";
+        iovec out[] = {{tail, 1}, {more, 6}};
+        assert_int_equal(co_await file->WriteAtV(11, out, 2), 7);
+        assert_int_equal(co_await file->Sync(), 0);
+        assert_int_equal(co_await file->Sync(true), 0);
+
+        char first[6];
+        char second[64];
+        iovec in[] = {{first, sizeof(first)}, {second, sizeof(second)}};
+        int n = co_await file->ReadAtV(0, in, 2);
+        assert_int_equal(n, 18);
+        *result = std::string(first, sizeof(first)) + std::string(second, n - sizeof(first));
+
+        char buf[16];
+        assert_int_equal(co_await file->ReadAt(6, buf, 5), 5);
+        assert_memory_equal(buf, "world", 5);
+        assert_int_equal(co_await file->ReadAt(100, buf, sizeof(buf)), 0);
+    }(&file, &result);
+
+    while (!h.done()) {
+        loop.Step();
+    }
+    assert_string_equal(result.c_str(), "hello world! again");
+    // positional I/O leaves the file position alone
+    assert_int_equal(lseek(fd, 0, SEEK_CUR), 0);
+}
+
+template<typename TPoller>
+void test_read_ahead(void**) {
+    using TFileHandle = typename TPoller::TFileHandle;
+    std::vector<char> data(300000 + 17);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = 'a' + i % 23;
+    }
+    char path[] = "/tmp/coroio_read_aheadXXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    unlink(path);
+    assert_int_equal(write(fd, data.data(), data.size()), (ssize_t)data.size());
+
+    TLoop<TPoller> loop;
+    TFileHandle file(fd, loop.Poller());
+    const int64_t offset = 8192;
+    std::vector<char> received;
+    int chunks = 0;
+    TFuture<void> h = [](TFileHandle* file, int64_t offset, std::vector<char>* received, int* chunks) -> TFuture<void> {
+        TReadAhead reader(*file, offset, 10000, 3);
+        while (true) {
+            auto chunk = co_await reader.Next();
+            if (chunk.empty()) {
+                break;
+            }
+            assert_int_equal(reinterpret_cast<uintptr_t>(chunk.data()) % TAlignedBuffer::DefaultAlignment, 0);
+            received->insert(received->end(), chunk.begin(), chunk.end());
+            (*chunks)++;
+        }
+        assert_int_equal(reader.Offset(), offset + (int64_t)received->size());
+        auto tail = co_await reader.Next();
+        assert_true(tail.empty());
+    }(&file, offset, &received, &chunks);
+
+    while (!h.done()) {
+        loop.Step();
+    }
+    assert_int_equal(received.size(), data.size() - offset);
+    assert_true(std::equal(received.begin(), received.end(), data.begin() + offset));
+    // 10000 is rounded up to 12288
+    assert_int_equal(chunks, (int)((received.size() + 12287) / 12288));
+}
+#endif
+
 template<typename TPoller>
 void test_read_until(void**) {
     using TLoop = TLoop<TPoller>;
@@ -604,6 +982,146 @@ line9
     assert_true(received[2] == "ine3\n");
 }
 
+template<typename TPoller>
+void test_read_until_chain(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    // a head longer than a slab, followed by a body that arrives with it
+    std::string head;
+    for (int i = 0; head.size() < 3 * TChainBuffer::SlabSize; i++) {
+        head += "X-Header-" + std::to_string(i) + ": value\r\n";
+    }
+    head += "\r\n";
+    std::string body = "body";
+
+    TLoop loop;
+    TAddress saddr{"127.0.0.1", getport()};
+    TSocket socket(loop.Poller(), saddr.Domain());
+    socket.Bind(saddr);
+    socket.Listen();
+    TSocket client(loop.Poller(), saddr.Domain());
+
+    std::string echoed(head.size(), 0);
+    TFuture<void> h1 = [&]() -> TFuture<void>
+    {
+        co_await client.Connect(saddr);
+        co_await TByteWriter(client).Write((head + body).data(), head.size() + body.size());
+        co_await TByteReader(client).Read(echoed.data(), echoed.size());
+    }();
+
+    size_t size = 0;
+    std::string rest(body.size(), 0);
+    TFuture<void> h2 = [&]() -> TFuture<void>
+    {
+        auto conn = std::move(co_await socket.Accept());
+        TByteReader reader(conn);
+        TChainBuffer chain;
+        size = co_await reader.ReadUntil("\r\n\r\n", chain);
+        co_await reader.Read(rest.data(), rest.size());
+        co_await TByteWriter(conn).Write(chain);
+        assert_true(chain.Empty());
+    }();
+
+    while (!(h1.done() && h2.done())) {
+        loop.Step();
+    }
+
+    assert_int_equal(size, head.size());
+    assert_true(echoed == head);
+    assert_true(rest == body);
+}
+
+template<typename TSocket>
+struct TCountingSocket {
+    auto ReadSome(void* buf, size_t size) {
+        return Socket.ReadSome(buf, size);
+    }
+
+    auto WriteSome(const void* buf, size_t size) {
+        Writes++;
+        return Socket.WriteSome(buf, size);
+    }
+
+    auto WriteSomeV(const iovec* iov, int count) {
+        Writes++;
+        return Socket.WriteSomeV(iov, count);
+    }
+
+    int Fd() const {
+        return Socket.Fd();
+    }
+
+    TSocket& Socket;
+    int Writes = 0;
+};
+
+template<typename TPoller>
+void test_buffered_writer(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    for (bool cork : {false, true}) {
+        TLoop loop;
+        TAddress saddr{"127.0.0.1", getport()};
+        TSocket socket(loop.Poller(), saddr.Domain());
+        socket.Bind(saddr);
+        socket.Listen();
+        TSocket client(loop.Poller(), saddr.Domain());
+
+        const size_t small = 1000, large = 100000;
+        TFuture<void> h1 = [&]() -> TFuture<void>
+        {
+            auto conn = std::move(co_await socket.Accept());
+            std::vector<char> buffer(small + large);
+            co_await TByteReader(conn).Read(buffer.data(), small);
+            co_await TByteWriter(conn).Write(buffer.data(), small);
+            co_await TByteReader(conn).Read(buffer.data(), small + large);
+            co_await TByteWriter(conn).Write(buffer.data(), small + large);
+        }();
+
+        int afterWrites = -1, afterRead = -1, afterLimit = -1;
+        std::string reply(small, 0), expected;
+        std::vector<char> echo(small + large);
+        TFuture<void> h2 = [&]() -> TFuture<void>
+        {
+            co_await client.Connect(saddr);
+            TCountingSocket<TSocket> counting{client};
+            TBufferedWriter writer(counting, {.Limit = 300, .Cork = cork});
+            for (size_t i = 0; i < small / 10; i++) {
+                std::string field = std::to_string(1000000000 + i);
+                expected += field;
+                co_await writer.Write(field.data(), field.size());
+                if (i == 9) {
+                    afterWrites = counting.Writes;
+                }
+            }
+            afterLimit = counting.Writes;
+            // reading through the writer sends the rest
+            co_await TByteReader(writer).Read(reply.data(), reply.size());
+            afterRead = counting.Writes;
+
+            std::vector<char> big(large, 'x');
+            co_await writer.Write(expected.data(), small);
+            co_await writer.Write(big.data(), big.size());
+            co_await writer.Flush();
+            assert_int_equal(writer.Buffered(), 0);
+            co_await TByteReader(client).Read(echo.data(), echo.size());
+        }();
+
+        while (!(h1.done() && h2.done())) {
+            loop.Step();
+        }
+
+        assert_int_equal(afterWrites, 0);
+        assert_int_equal(afterLimit, 3); // 1000 bytes in 300-byte batches
+        assert_int_equal(afterRead, 4);
+        assert_true(reply == expected);
+        assert_true(std::string(echo.data(), small) == expected);
+        assert_true(std::all_of(echo.begin() + small, echo.end(), [](char c) { return c == 'x'; }));
+    }
+}
+
 template<typename TPoller>
 void test_read_write_struct(void**) {
     using TLoop = TLoop<TPoller>;
@@ -710,6 +1228,162 @@ void test_read_write_lines(void**) {
     }
 }
 
+template<typename TPoller>
+void test_hibernation(void**) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    // the server echoes lines, both sides wait between them without buffers
+    TFuture<void> server = [](TSocket* listener) -> TFuture<void> {
+        auto socket = co_await listener->Accept();
+        TLineReader reader(socket, 64);
+        reader.SetHibernation();
+        while (auto line = co_await reader.Read()) {
+            co_await TByteWriter(socket).Write(line);
+        }
+    }(&listener);
+
+    std::vector<std::string> received;
+    TFuture<void> client = [](TPoller& poller, TAddress addr, std::vector<std::string>* received) -> TFuture<void> {
+        TSocket socket(poller, addr.Domain());
+        co_await socket.Connect(addr);
+        TByteReader reader(socket);
+        reader.SetHibernation();
+        for (std::string line : {"first\n", "second\n", "third\n"}) {
+            co_await TByteWriter(socket).Write(line.data(), line.size());
+            received->push_back(co_await reader.ReadUntil("\n"));
+            co_await poller.Sleep(std::chrono::milliseconds(1));
+        }
+    }(loop.Poller(), addr, &received);
+
+    while (!client.done()) {
+        loop.Step();
+    }
+    assert_int_equal(received.size(), 3);
+    assert_string_equal(received[0].c_str(), "first\n");
+    assert_string_equal(received[1].c_str(), "second\n");
+    assert_string_equal(received[2].c_str(), "third\n");
+}
+
+void test_line_splitter_release(void**) {
+    TZeroCopyLineSplitter splitter(8);
+    splitter.Push("ab\ncd", 5);
+    splitter.Release(); // not empty, keeps the bytes
+    auto line = splitter.Pop();
+    assert_true(line.Part1 == "ab\n");
+    assert_false(splitter.Empty());
+    splitter.Push("\n", 1);
+    line = splitter.Pop();
+    assert_true(line.Part1 == "cd\n");
+    assert_true(splitter.Empty());
+    splitter.Release();
+    assert_false(!!splitter.Pop());
+    splitter.Push("ef\n", 3);
+    line = splitter.Pop();
+    assert_true(line.Part1 == "ef\n");
+}
+
+void test_find_byte(void**) {
+    // every length around the block sizes, every match position, unaligned starts
+    std::vector<char> data(300, 'a');
+    for (size_t shift = 0; shift < 4; shift++) {
+        for (size_t size = 0; size + shift <= data.size(); size++) {
+            const char* p = data.data() + shift;
+            assert_true(NUtils::FindByte(p, size, '\n') == nullptr);
+            for (size_t pos = 0; pos < size; pos += 7) {
+                // with a later match in the same or the next block
+                data[shift + pos] = '\n';
+                data[shift + size - 1] = '\n';
+                assert_ptr_equal(NUtils::FindByte(p, size, '\n'), p + pos);
+                data[shift + pos] = 'a';
+                data[shift + size - 1] = 'a';
+            }
+        }
+    }
+    // a match right after the end is not reported
+    data[100] = '\n';
+    assert_true(NUtils::FindByte(data.data(), 100, '\n') == nullptr);
+}
+
+void test_line_splitter_resume(void**) {
+    TZeroCopyLineSplitter splitter(64);
+    std::string part(50, 'x');
+    splitter.Push(part.data(), part.size());
+    assert_false(splitter.Pop());
+    splitter.Push("yy\nz", 4);
+    auto line = splitter.Pop();
+    assert_int_equal(line.Size(), 53);
+    assert_true(std::string(line.Part1) + std::string(line.Part2) == part + "yy\n");
+    assert_false(splitter.Pop());
+
+    // the rest of the line wraps around the ring
+    std::string tail(70, 'w');
+    splitter.Push(tail.data(), tail.size());
+    assert_false(splitter.Pop());
+    splitter.Push("\n", 1);
+    line = splitter.Pop();
+    assert_true(std::string(line.Part1) + std::string(line.Part2) == "z" + tail + "\n");
+}
+
+void test_chain_buffer(void**) {
+    const size_t slab = TChainBuffer::SlabSize;
+    std::string data(2 * slab + 100, 0);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = 'a' + i % 26;
+    }
+    // the delimiter straddles the first slab boundary
+    memcpy(&data[slab - 2], "\r\n\r\n", 4);
+
+    TChainBuffer chain;
+    assert_true(chain.Empty());
+    chain.Append(data.data(), data.size());
+    assert_int_equal(chain.Size(), data.size());
+    assert_true(chain.ToString() == data);
+
+    iovec iov[4];
+    assert_int_equal(chain.Iov(iov, 4), 3);
+    assert_int_equal(iov[0].iov_len, slab);
+    assert_int_equal(iov[2].iov_len, 100);
+
+    assert_int_equal(chain.Find("\r\n\r\n"), slab - 2);
+    assert_int_equal(chain.Find("\r\n\r\n", slab - 1), TChainBuffer::npos);
+    assert_int_equal(chain.Find("abc", slab + 2), data.find("abc", slab + 2));
+    assert_int_equal(chain.Find(""), 0);
+    assert_int_equal(chain.Find("zz"), TChainBuffer::npos);
+
+    // the prefix shares the slab it ends in
+    TChainBuffer head = chain.Cut(slab + 2);
+    assert_true(head.ToString() == data.substr(0, slab + 2));
+    assert_true(chain.ToString() == data.substr(slab + 2));
+    head.Append("+", 1);
+    assert_true(chain.ToString() == data.substr(slab + 2));
+    assert_int_equal(head.Iov(iov, 4), 3);
+
+    char out[10];
+    assert_int_equal(chain.Read(out, sizeof(out)), sizeof(out));
+    assert_memory_equal(out, data.data() + slab + 2, sizeof(out));
+    chain.Consume(slab - 20);
+    assert_true(chain.ToString() == data.substr(2 * slab - 8));
+
+    head.Append(std::move(chain));
+    assert_true(chain.Empty());
+    assert_true(head.ToString() == data.substr(0, slab + 2) + "+" + data.substr(2 * slab - 8));
+
+    auto free = head.Writable(8);
+    assert_true(free.size() >= 8);
+    memcpy(free.data(), "tail", 4);
+    head.Commit(4);
+    assert_int_equal(head.Find("tail"), head.Size() - 4);
+
+    head.Consume(head.Size());
+    assert_true(head.Empty());
+    assert_int_equal(head.Iov(iov, 4), 0);
+}
+
 void test_line_splitter(void**) {
     TLineSplitter splitter(16);
     uint32_t seed = 31337;
@@ -782,41 +1456,331 @@ void test_zero_copy_line_splitter(void**) {
     }
 }
 
-void test_self_id(void**) {
-    void* id;
-    TFuture<void> h = [](void** id) -> TFuture<void> {
-        *id = (co_await Self()).address();
-        co_return;
-    }(&id);
-
-    assert_ptr_equal(id, h.raw().address());
-}
+void test_frame_pool(void**) {
+    void* p1 = TFramePool::Allocate(100);
+    TFramePool::Deallocate(p1, 100);
+    // same size class
+    void* p2 = TFramePool::Allocate(120);
+    assert_true(p1 == p2);
+    TFramePool::Deallocate(p2, 120);
 
-void test_resolv_nameservers(void**) {
-    std::string data = R"__(nameserver 127.0.0.1
-nameserver 192.168.0.2
-nameserver 127.0.0.2
-    )__";
-    std::istringstream iss(data);
-    TResolvConf conf(iss);
+    void* big = TFramePool::Allocate(TFramePool::Granularity * TFramePool::Classes + 1);
+    TFramePool::Deallocate(big, TFramePool::Granularity * TFramePool::Classes + 1);
 
-    assert_int_equal(conf.Nameservers.size(), 3);
+#ifdef COROIO_FRAME_POOL
+    auto make = []() -> TFuture<int> { co_return 42; };
+    void* frame1;
+    {
+        auto f = make();
+        frame1 = f.raw().address();
+        assert_int_equal(f.await_resume(), 42);
+    }
+    auto f = make();
+    assert_true(frame1 == f.raw().address());
+#endif
+}
 
-    data = "";
-    iss = std::istringstream(data);
-    conf = TResolvConf(iss);
-    assert_int_equal(conf.Nameservers.size(), 1);
+void test_arena(void**) {
+    TArena arena(256);
+    void* p1 = arena.Allocate(100);
+    void* p2 = arena.Allocate(10, 8);
+    assert_true(reinterpret_cast<uintptr_t>(p2) % 8 == 0);
+    assert_int_equal(arena.Live(), 2);
+    // the last block is given back
+    arena.Deallocate(p2, 10);
+    assert_true(arena.Allocate(10, 8) == p2);
+    assert_false(arena.Reset());
+
+    // larger than a chunk
+    void* big = arena.Allocate(1000);
+    {
+        std::pmr::string s(300, 'x', &arena);
+        assert_int_equal(arena.Live(), 4);
+    }
+    arena.Deallocate(big, 1000);
+    arena.Deallocate(p2, 10);
+    arena.Deallocate(p1, 100);
+    assert_int_equal(arena.Live(), 0);
+    auto reserved = arena.Reserved();
+    assert_true(arena.Reset());
+    assert_true(arena.Allocate(100) == p1);
+    arena.Deallocate(p1, 100);
+    assert_int_equal(arena.Reserved(), reserved);
 }
 
+#ifdef COROIO_ARENA
 template<typename TPoller>
-void test_resolver(void**) {
-    using TLoop = TLoop<TPoller>;
-    using TSocket = typename TPoller::TSocket;
+void test_arena_frames(void**) {
+    TLoop<TPoller> loop;
+    TArena arena;
+    size_t live = 0;
+    size_t allocated = 0;
+    auto child = [](TPoller& poller) -> TFuture<int> {
+        co_await poller.Yield();
+        co_return 1;
+    };
+    auto request = [&](TPoller& poller) -> TFuture<int> {
+        int sum = co_await child(poller);
+        auto before = arena.Allocated();
+        // created after resuming from the poller, still in the arena
+        auto pending = child(poller);
+        assert_true(arena.Allocated() > before);
+        live = arena.Live();
+        sum += co_await pending;
+        co_return sum;
+    };
+    int result = 0;
+    auto serve = [&]() -> TFuture<void> {
+        for (int i = 0; i < 3; i++) {
+            result += co_await WithArena(arena, [&]() { return request(loop.Poller()); });
+            assert_int_equal(arena.Live(), 0);
+            if (i == 0) {
+                allocated = arena.Reserved();
+            }
+        }
+    }();
 
-    TLoop loop;
-#ifdef _WIN32
-    TResolver<TPollerBase> resolver(TAddress{"8.8.8.8", 53}, loop.Poller());
-#else
+    while (!serve.done()) {
+        // the loop does not run in the arena of the suspended request
+        auto outside = child(loop.Poller());
+        assert_true(TArena::Current() == nullptr);
+        loop.Step();
+        while (!outside.done()) {
+            loop.Step();
+        }
+    }
+    assert_int_equal(result, 6);
+    // the request frame and its pending child, the first one is freed already
+    assert_int_equal(live, 2);
+    // the chunk is reused by later requests
+    assert_int_equal(arena.Reserved(), allocated);
+}
+#endif
+
+void test_ws_mask(void**) {
+    const uint8_t key[4] = {0x12, 0x34, 0x56, 0x78};
+    std::vector<uint8_t> src(1024 + 7);
+    uint32_t seed = 31337;
+    for (auto& byte : src) {
+        byte = rand_(&seed);
+    }
+    std::vector<uint8_t> dst(src.size());
+    // every tail length and misalignment of the vector paths
+    for (size_t offset = 0; offset < 4; offset++) {
+        for (size_t size = 0; size + offset <= src.size(); size += 1 + size / 8) {
+            NDetail::Mask(dst.data() + offset, src.data() + offset, size, key);
+            for (size_t i = 0; i < size; i++) {
+                assert_int_equal(dst[offset + i], src[offset + i] ^ key[i % 4]);
+            }
+        }
+    }
+    // in place, masking twice restores the data
+    dst = src;
+    NDetail::Mask(dst.data() + 1, dst.data() + 1, dst.size() - 1, key);
+    NDetail::Mask(dst.data() + 1, dst.data() + 1, dst.size() - 1, key);
+    assert_memory_equal(src.data(), dst.data(), src.size());
+}
+
+void test_ws_upgrade_response(void**) {
+    // the example of RFC 6455
+    std::string request =
+        "GET /chat HTTP/1.1\r\n"
+        "Host: server.example.com\r\n"
+        "Upgrade: WebSocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+    auto response = NDetail::WebSocketUpgradeResponse(request);
+    assert_true(response.starts_with("HTTP/1.1 101 Switching Protocols\r\n"));
+    assert_true(response.find("\r\nSec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos);
+    NDetail::CheckSecWebSocketAccept(response, "dGhlIHNhbXBsZSBub25jZQ==");
+
+    assert_true(NDetail::WebSocketUpgradeResponse("GET / HTTP/1.1\r\nHost: a\r\n\r\n").empty());
+}
+
+void test_http_parser(void**) {
+    std::string data =
+        "\r\n"
+        "POST /upload?x=1 HTTP/1.1\r\n"
+        "Host: example.com\r\n"
+        "content-length:  5 \r\n"
+        "Connection: keep-alive, Upgrade\n"
+        "\r\n"
+        "helloGET / HTTP/1.0\r\n\r\n";
+    // fed byte by byte, as if every byte arrived alone
+    THttpParser parser;
+    size_t size = 1;
+    while (parser.Parse(std::string_view(data).substr(0, size)) == EHttpParseStatus::NeedMore) {
+        assert_true(size < data.size());
+        size++;
+    }
+    assert_int_equal(parser.HeadSize(), data.find("hello"));
+    const auto& request = parser.Request();
+    assert_true(request.Method == "POST");
+    assert_true(request.Target == "/upload?x=1");
+    assert_int_equal(request.MinorVersion, 1);
+    assert_int_equal(request.Headers.size(), 3);
+    assert_true(request.Header("HOST") == "example.com");
+    assert_true(request.Header("Content-Length") == "5");
+    assert_true(request.Header("X-Missing").empty());
+    assert_int_equal(request.ContentLength, 5);
+    assert_true(request.KeepAlive);
+    assert_false(request.Chunked);
+
+    // the pipelined request behind the body
+    auto next = std::string_view(data).substr(parser.HeadSize() + 5);
+    parser.Reset();
+    assert_int_equal((int)parser.Parse(next), (int)EHttpParseStatus::Done);
+    assert_true(parser.Request().Method == "GET");
+    assert_int_equal(parser.Request().MinorVersion, 0);
+    assert_false(parser.Request().KeepAlive);
+    assert_true(parser.Request().Headers.empty());
+
+    for (const char* bad : {
+        "GET /\r\n\r\n",
+        "GET / HTTP/2.0\r\n\r\n",
+        "G(T / HTTP/1.1\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost : a\r\n\r\n",
+        "GET / HTTP/1.1\r\nA: b\r\n  folded\r\n\r\n",
+        "GET / HTTP/1.1\r\nNoColon\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n",
+        "POST / HTTP/1.1\r\nContent-Length: 3\r\nTransfer-Encoding: chunked\r\n\r\n",
+        "POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",
+    }) {
+        parser.Reset();
+        assert_int_equal((int)parser.Parse(bad), (int)EHttpParseStatus::Error);
+        assert_false(parser.Error().empty());
+    }
+
+    THttpParser small(64);
+    assert_int_equal((int)small.Parse("GET / HTTP/1.1\r\nX: " + std::string(100, 'a')), (int)EHttpParseStatus::Error);
+}
+
+void test_http_chunked(void**) {
+    std::string encoded = "5;ext=1\r\nhello\r\n1A\r\n, chunked world of bytes!!\r\n0\r\nTrailer: x\r\n\r\nrest";
+    // every split point of the input gives the same body
+    for (size_t split = 0; split <= encoded.size(); split++) {
+        THttpChunkedDecoder decoder;
+        std::string body;
+        size_t pos = 0;
+        for (auto part : {std::string_view(encoded).substr(0, split), std::string_view(encoded).substr(split)}) {
+            std::string_view in = part;
+            while (!in.empty() && !decoder.Done()) {
+                std::string_view data;
+                size_t consumed = decoder.Decode(in, data);
+                assert_false(decoder.Failed());
+                body += data;
+                in.remove_prefix(consumed);
+                pos += consumed;
+            }
+        }
+        assert_true(decoder.Done());
+        assert_string_equal(body.c_str(), "hello, chunked world of bytes!!");
+        assert_int_equal(pos, encoded.size() - 4);
+    }
+
+    for (const char* bad : {"x\r\n", "5\r\nhelloXX", "\r\n", "10000000000000000\r\n"}) {
+        THttpChunkedDecoder decoder;
+        std::string_view data;
+        std::string_view in = bad;
+        while (!in.empty() && !decoder.Failed()) {
+            in.remove_prefix(decoder.Decode(in, data));
+        }
+        assert_true(decoder.Failed());
+    }
+}
+
+void test_http_response(void**) {
+    std::string out;
+    THttpResponse(200).Header("Content-Type", "text/plain").Body("hi").AppendTo(out);
+    THttpResponse(204).KeepAlive(false).AppendTo(out);
+    THttpResponse(799, "Custom").AppendTo(out);
+    assert_string_equal(out.c_str(),
+        "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n\r\nhi"
+        "HTTP/1.1 204 No Content\r\nConnection: close\r\n\r\n"
+        "HTTP/1.1 799 Custom\r\nContent-Length: 0\r\n\r\n");
+}
+
+#ifdef HAVE_ZLIB
+void test_ws_deflate_negotiation(void**) {
+    auto request = [](const std::string& extensions) {
+        return
+            "GET / HTTP/1.1\r\n"
+            "Upgrade: websocket\r\n"
+            "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+            "Sec-WebSocket-Extensions: " + extensions + "\r\n\r\n";
+    };
+    std::string extensions;
+    auto deflate = NDetail::DeflateNegotiate(
+        request("permessage-deflate; client_max_window_bits; server_max_window_bits=10"), {}, extensions);
+    assert_true(!!deflate);
+    assert_int_equal(deflate->WindowBits(), 10);
+    assert_string_equal(extensions.c_str(), "permessage-deflate; server_max_window_bits=10");
+
+    // an unknown parameter declines the first offer, 8 bits can't be honoured by zlib
+    extensions.clear();
+    deflate = NDetail::DeflateNegotiate(
+        request("permessage-deflate; foo, permessage-deflate; server_max_window_bits=8, permessage-deflate; client_no_context_takeover"),
+        {.PeerMaxWindowBits = 12}, extensions);
+    assert_true(!!deflate);
+    assert_string_equal(extensions.c_str(), "permessage-deflate; client_no_context_takeover");
+
+    extensions.clear();
+    assert_true(!NDetail::DeflateNegotiate(request("x-webkit-deflate-frame"), {}, extensions));
+    assert_true(extensions.empty());
+
+    // the client takes the limits of the response
+    auto response = NDetail::WebSocketUpgradeResponse(request("permessage-deflate"), "permessage-deflate; client_max_window_bits=11");
+    deflate = NDetail::DeflateAccepted(response, {});
+    assert_true(!!deflate);
+    assert_int_equal(deflate->WindowBits(), 11);
+    response = NDetail::WebSocketUpgradeResponse(request("permessage-deflate"), "permessage-deflate; bar");
+    bool failed = false;
+    try {
+        NDetail::DeflateAccepted(response, {});
+    } catch (const std::exception&) {
+        failed = true;
+    }
+    assert_true(failed);
+}
+#endif
+
+void test_self_id(void**) {
+    void* id;
+    TFuture<void> h = [](void** id) -> TFuture<void> {
+        *id = (co_await Self()).address();
+        co_return;
+    }(&id);
+
+    assert_ptr_equal(id, h.raw().address());
+}
+
+void test_resolv_nameservers(void**) {
+    std::string data = R"__(nameserver 127.0.0.1
+nameserver 192.168.0.2
+nameserver 127.0.0.2
+    )__";
+    std::istringstream iss(data);
+    TResolvConf conf(iss);
+
+    assert_int_equal(conf.Nameservers.size(), 3);
+
+    data = "";
+    iss = std::istringstream(data);
+    conf = TResolvConf(iss);
+    assert_int_equal(conf.Nameservers.size(), 1);
+}
+
+template<typename TPoller>
+void test_resolver(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    TLoop loop;
+#ifdef _WIN32
+    TResolver<TPollerBase> resolver(TAddress{"8.8.8.8", 53}, loop.Poller());
+#else
     TResolver<TPollerBase> resolver(loop.Poller());
 #endif
 
@@ -860,407 +1824,3317 @@ void test_resolve_bad_name(void**) {
     assert_true(!!ex);
 }
 
-#ifdef HAVE_OPENSSL
 template<typename TPoller>
-void test_read_write_full_ssl(void**) {
-    using TLoop = TLoop<TPoller>;
-    using TSocket = typename TPoller::TSocket;
+void test_datagram_batch(void**) {
+    using TDatagramSocket = typename TPoller::TDatagramSocket;
+    TLoop<TPoller> loop;
+    TAddress serverAddr{"127.0.0.1", getport()};
+    TAddress clientAddr{"127.0.0.1", getport()};
+    TDatagramSocket server(loop.Poller(), serverAddr.Domain());
+    TDatagramSocket client(loop.Poller(), clientAddr.Domain());
+    server.Bind(serverAddr);
+    client.Bind(clientAddr);
+
+    constexpr int total = 100;
+    std::vector<std::string> received;
+    std::vector<std::string> sources;
+    int calls = 0;
+    auto reader = [](TDatagramSocket& socket, auto& received, auto& sources, int& calls) -> TFuture<void> {
+        char buffers[16][64];
+        TDatagram batch[16];
+        while (received.size() < total) {
+            for (int i = 0; i < 16; i++) {
+                batch[i] = {.Data = buffers[i], .Size = sizeof(buffers[i])};
+            }
+            int n = co_await socket.RecvMany(batch, 16);
+            calls++;
+            for (int i = 0; i < n; i++) {
+                received.emplace_back(buffers[i], batch[i].Size);
+                sources.emplace_back(batch[i].Address->ToString());
+            }
+        }
+    }(server, received, sources, calls);
 
-    int port = getport();
-    std::vector<char> data(1024);
-    int cur = 0;
-    for (auto& ch : data) {
-        ch = cur + 'a';
-        cur = (cur + 1) % ('z' - 'a' + 1);
+    auto writer = [](TDatagramSocket& socket, TAddress to) -> TFuture<void> {
+        std::vector<std::string> payloads;
+        std::vector<TDatagram> batch;
+        for (int i = 0; i < total; i++) {
+            payloads.emplace_back("message " + std::to_string(i));
+        }
+        for (auto& payload : payloads) {
+            batch.emplace_back(TDatagram{.Data = payload.data(), .Size = payload.size(), .Address = to});
+        }
+        for (size_t sent = 0; sent < batch.size(); ) {
+            sent += co_await socket.SendMany(batch.data() + sent, std::min<size_t>(10, batch.size() - sent));
+        }
+    }(client, serverAddr);
+
+    while (!reader.done() || !writer.done()) {
+        loop.Step();
+    }
+    assert_int_equal(received.size(), total);
+    for (int i = 0; i < total; i++) {
+        assert_string_equal(received[i].c_str(), ("message " + std::to_string(i)).c_str());
+        assert_string_equal(sources[i].c_str(), clientAddr.ToString().c_str());
     }
+#ifdef __linux__
+    assert_true(calls < total);
+#endif
+}
 
-    TLoop loop;
-    TAddress saddr{"127.0.0.1", port};
-    TSocket socket(loop.Poller(), saddr.Domain());
-    socket.Bind(saddr);
-    socket.Listen();
+template<typename TPoller>
+void test_datagram_send_recv_from(void**) {
+    using TDatagramSocket = typename TPoller::TDatagramSocket;
+    TLoop<TPoller> loop;
+    TAddress serverAddr{"127.0.0.1", getport()};
+    TDatagramSocket server(loop.Poller(), serverAddr.Domain());
+    TDatagramSocket client(loop.Poller(), serverAddr.Domain());
+    server.Bind(serverAddr);
+
+    std::string reply;
+    auto echo = [](TDatagramSocket& socket) -> TFuture<void> {
+        char buf[64];
+        TAddress from;
+        int size = co_await socket.RecvFrom(buf, sizeof(buf), &from);
+        co_await socket.SendTo(buf, size, from);
+    }(server);
+    auto ask = [](TDatagramSocket& socket, TAddress to, std::string& reply) -> TFuture<void> {
+        co_await socket.SendTo("ping", 4, to);
+        char buf[64];
+        int size = co_await socket.RecvFrom(buf, sizeof(buf));
+        reply.assign(buf, size);
+    }(client, serverAddr, reply);
+
+    while (!echo.done() || !ask.done()) {
+        loop.Step();
+    }
+    assert_string_equal(reply.c_str(), "ping");
+}
 
-    TAddress caddr{"127.0.0.1", port};
-    TSocket client(loop.Poller(), caddr.Domain());
+#ifndef _WIN32
+template<typename TPoller>
+void test_handoff(void**) {
+    TLoop<TPoller> loop;
+    char path[] = "/tmp/coroio_handoffXXXXXX";
+    int tmp = mkstemp(path);
+    assert_true(tmp >= 0);
+    close(tmp);
+    THandoffListener control(loop.Poller(), path);
+
+    TAddress address{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), address.Domain());
+    listener.Bind(address);
+    listener.Listen();
+
+    // larger than the socket buffer, sent in parts
+    std::string keys(1 << 20, 'k');
+    auto old = [](THandoffListener& control, TSocket& listener, const std::string& keys) -> TFuture<void> {
+        auto channel = co_await control.Accept();
+        co_await channel.Send(listener.Fd(), "listen", "state");
+        co_await channel.Send(-1, "keys", keys);
+        co_await channel.Finish();
+        listener.Close();
+    }(control, listener, keys);
+
+    std::string reply;
+    auto next = [](TPoller& poller, const char* path, TAddress address, const std::string& keys, std::string& reply) -> TFuture<void> {
+        auto channel = THandoffChannel::Connect(poller, path);
+        std::vector<THandoffSocket> items;
+        while (true) {
+            auto item = co_await channel.Receive();
+            if (!item) {
+                break;
+            }
+            items.emplace_back(std::move(*item));
+        }
+        assert_int_equal(items.size(), 2);
+        assert_string_equal(items[0].Tag.c_str(), "listen");
+        assert_string_equal(items[0].State.c_str(), "state");
+        assert_true(items[0].Fd >= 0);
+        assert_string_equal(items[1].Tag.c_str(), "keys");
+        assert_true(items[1].State == keys);
+        assert_int_equal(items[1].Fd, -1);
+
+        auto adopted = items[0].template Take<typename TPoller::TSocket>(poller);
+        assert_int_equal(items[0].Fd, -1);
+        typename TPoller::TSocket client(poller, address.Domain());
+        co_await client.Connect(address);
+        auto accepted = co_await adopted.Accept();
+        co_await client.WriteSome("hi", 2);
+        char buf[2];
+        auto size = co_await accepted.ReadSome(buf, sizeof(buf));
+        reply.assign(buf, size);
+    }(loop.Poller(), path, address, keys, reply);
+
+    while (!old.done() || !next.done()) {
+        loop.Step();
+    }
+    assert_true(listener.Fd() < 0);
+    assert_string_equal(reply.c_str(), "hi");
+    unlink(path);
+}
 
-    TFuture<void> h1 = [](TSocket&& client, TAddress& caddr, const std::vector<char>& data) -> TFuture<void>
-    {
-        TSslContext ctx = TSslContext::Client();
-        auto sslClient = TSslSocket(std::move(client), ctx);
-        co_await sslClient.Connect(caddr);
-        co_await TByteWriter(sslClient).Write(data.data(), data.size());
-        co_return;
-    }(std::move(client), caddr, data);
+void test_handoff_no_listener(void**) {
+    TLoop<TPoll> loop;
+    bool thrown = false;
+    try {
+        THandoffChannel::Connect(loop.Poller(), "/tmp/coroio_handoff_missing");
+    } catch (const std::system_error&) {
+        thrown = true;
+    }
+    assert_true(thrown);
+}
+#endif
 
-    std::vector<char> received(1024*1024);
-    TFuture<void> h2 = [](TSocket& server, std::vector<char>& received) -> TFuture<void>
-    {
-        TSslContext ctx = TSslContext::ServerFromMem(testMemCert, testMemKey);
-        auto client = std::move(co_await server.Accept());
-        auto sslClient = TSslSocket(std::move(client), ctx);
-        co_await sslClient.AcceptHandshake();
-        co_await TByteReader(sslClient).Read(received.data(), received.size());
-        co_return;
-    }(socket, received);
+#ifdef __linux__
+template<typename TPoller>
+void test_datagram_segmentation(void**) {
+    using TDatagramSocket = typename TPoller::TDatagramSocket;
+    TLoop<TPoller> loop;
+    TAddress serverAddr{"127.0.0.1", getport()};
+    TDatagramSocket server(loop.Poller(), serverAddr.Domain());
+    TDatagramSocket client(loop.Poller(), serverAddr.Domain());
+    server.Bind(serverAddr);
+
+    std::string payload(1000, 'x');
+    for (size_t i = 0; i < payload.size(); i++) {
+        payload[i] = 'a' + (i / 100);
+    }
+    bool supported = true;
+    auto writer = [](TDatagramSocket& socket, TAddress to, std::string& payload, bool& supported) -> TFuture<void> {
+        TDatagram datagram{.Data = payload.data(), .Size = payload.size(), .Address = to, .Segment = 100};
+        try {
+            co_await socket.SendMany(&datagram, 1);
+        } catch (const std::system_error&) {
+            supported = false; // no UDP_SEGMENT in this kernel
+        }
+    }(client, serverAddr, payload, supported);
+    while (!writer.done()) {
+        loop.Step();
+    }
+    if (!supported) {
+        return;
+    }
 
-    while (!(h1.done() && h2.done())) {
+    std::string received;
+    auto reader = [](TDatagramSocket& socket, std::string& received) -> TFuture<void> {
+        char buffers[10][1000];
+        TDatagram batch[10];
+        while (received.size() < 1000) {
+            for (int i = 0; i < 10; i++) {
+                batch[i] = {.Data = buffers[i], .Size = sizeof(buffers[i])};
+            }
+            int n = co_await socket.RecvMany(batch, 10);
+            for (int i = 0; i < n; i++) {
+                // one datagram per segment without GRO
+                assert_int_equal(batch[i].Size, 100);
+                assert_int_equal(batch[i].Segment, 0);
+                received.append(buffers[i], batch[i].Size);
+            }
+        }
+    }(server, received);
+    while (!reader.done()) {
         loop.Step();
     }
+    assert_true(received == payload);
+}
+#endif
 
-    assert_memory_equal(data.data(), received.data(), data.size());
+#ifndef _WIN32
+// Answers from a table: A and AAAA addresses with a TTL, or NXDOMAIN with an SOA record
+class TFakeDns {
+public:
+    struct TRecord {
+        std::vector<std::string> A;
+        std::vector<std::string> AAAA;
+        uint32_t Ttl = 60;
+        bool NxDomain = false;
+        uint32_t SoaMinimum = 0;
+    };
+
+    enum EMode {
+        Normal,
+        Silent,   // drops queries
+        Truncate, // answers UDP queries with TC and no records
+        ServFail,
+        Cut,      // answers with the first CutAt bytes of the reply
+    };
+
+    TFakeDns(std::unordered_map<std::string, TRecord> records, EMode mode = Normal)
+        : Mode(mode)
+        , Records(std::move(records))
+    {
+        Fd = socket(AF_INET, SOCK_DGRAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(Fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        socklen_t len = sizeof(addr);
+        getsockname(Fd, reinterpret_cast<sockaddr*>(&addr), &len);
+        Port = ntohs(addr.sin_port);
+        TcpFd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(TcpFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        bind(TcpFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        listen(TcpFd, 8);
+        Thread = std::thread([this] { Serve(); });
+    }
+
+    ~TFakeDns() {
+        Running = false;
+        Thread.join();
+        close(Fd);
+        close(TcpFd);
+    }
+
+    TAddress Address() const {
+        return TAddress{"127.0.0.1", Port};
+    }
+
+    std::atomic<int> Queries = 0;
+    std::atomic<int> TcpQueries = 0;
+    std::atomic<EMode> Mode;
+    std::atomic<size_t> CutAt = 0;
+
+private:
+    void Serve() {
+        uint8_t buf[512];
+        while (Running) {
+            pollfd fds[2] = {{Fd, POLLIN, 0}, {TcpFd, POLLIN, 0}};
+            if (poll(fds, 2, 20) <= 0) {
+                continue;
+            }
+            if (fds[0].revents & POLLIN) {
+                sockaddr_in peer = {};
+                socklen_t len = sizeof(peer);
+                auto size = recvfrom(Fd, buf, sizeof(buf), 0, reinterpret_cast<sockaddr*>(&peer), &len);
+                if (size < 12) {
+                    continue;
+                }
+                Queries++;
+                if (Mode == Silent) {
+                    continue;
+                }
+                auto out = Answer(buf, size, Mode == Truncate);
+                if (Mode == Cut) {
+                    out.resize(std::min(out.size(), CutAt.load()));
+                }
+                sendto(Fd, out.data(), out.size(), 0, reinterpret_cast<sockaddr*>(&peer), len);
+            }
+            if (fds[1].revents & POLLIN) {
+                int client = accept(TcpFd, nullptr, nullptr);
+                uint8_t prefix[2];
+                if (recv(client, prefix, 2, MSG_WAITALL) == 2) {
+                    size_t size = (prefix[0] << 8) | prefix[1];
+                    if (recv(client, buf, size, MSG_WAITALL) == static_cast<ssize_t>(size)) {
+                        TcpQueries++;
+                        auto out = Answer(buf, size, false);
+                        uint8_t outPrefix[2] = {static_cast<uint8_t>(out.size() >> 8), static_cast<uint8_t>(out.size())};
+                        send(client, outPrefix, 2, 0);
+                        send(client, out.data(), out.size(), 0);
+                    }
+                }
+                close(client);
+            }
+        }
+    }
+
+    std::vector<uint8_t> Answer(const uint8_t* query, size_t size, bool truncate) {
+        std::string name;
+        size_t pos = 12;
+        while (pos < size && query[pos]) {
+            if (!name.empty()) {
+                name += '.';
+            }
+            name.append(reinterpret_cast<const char*>(query) + pos + 1, query[pos]);
+            pos += 1 + query[pos];
+        }
+        pos += 1;
+        uint16_t type = (query[pos] << 8) | query[pos + 1];
+        pos += 4;
+
+        auto put16 = [](std::vector<uint8_t>& out, uint16_t v) { out.push_back(v >> 8); out.push_back(v & 0xff); };
+        auto put32 = [&](std::vector<uint8_t>& out, uint32_t v) { put16(out, v >> 16); put16(out, v & 0xffff); };
+
+        std::vector<uint8_t> out(query, query + pos);
+        auto it = Records.find(name);
+        int rcode = Mode == ServFail ? 2 : (it == Records.end() || it->second.NxDomain) ? 3 : 0;
+        std::vector<std::string> empty;
+        const auto& addresses = rcode || truncate ? empty : (type == 28 ? it->second.AAAA : it->second.A);
+        bool soa = rcode == 3 || (rcode == 0 && !truncate && addresses.empty());
+        out[2] = truncate ? 0x83 : 0x81; out[3] = 0x80 | rcode;
+        out[6] = 0; out[7] = addresses.size();
+        out[8] = 0; out[9] = soa;
+        out[10] = 0; out[11] = 0;
+        for (const auto& address : addresses) {
+            put16(out, 0xC00C);
+            put16(out, type);
+            put16(out, 1);
+            put32(out, it->second.Ttl);
+            uint8_t raw[16];
+            int family = type == 28 ? AF_INET6 : AF_INET;
+            inet_pton(family, address.c_str(), raw);
+            put16(out, family == AF_INET6 ? 16 : 4);
+            out.insert(out.end(), raw, raw + (family == AF_INET6 ? 16 : 4));
+        }
+        if (soa) {
+            put16(out, 0xC00C);
+            put16(out, 6);
+            put16(out, 1);
+            put32(out, 3600);
+            put16(out, 2 + 2 + 20);
+            put16(out, 0xC00C); // MNAME
+            put16(out, 0xC00C); // RNAME
+            for (int i = 0; i < 4; i++) {
+                put32(out, 1);
+            }
+            put32(out, it == Records.end() ? 3600 : it->second.SoaMinimum);
+        }
+        return out;
+    }
+
+    std::unordered_map<std::string, TRecord> Records;
+    int Fd = -1;
+    int TcpFd = -1;
+    int Port = 0;
+    std::atomic<bool> Running = true;
+    std::thread Thread;
+};
+
+template<typename TPoller>
+TFuture<void> resolve_into(TResolver<TPoller>& resolver, std::string name, EDNSType type,
+                           std::vector<TAddress>* addresses, std::exception_ptr* error)
+{
+    try {
+        *addresses = co_await resolver.Resolve(name, type);
+    } catch (const std::exception&) {
+        *error = std::current_exception();
+    }
+}
+
+template<typename TLoop, typename TFuture>
+void run_until_done(TLoop& loop, TFuture& future) {
+    while (!future.done()) {
+        loop.Step();
+    }
 }
-#endif // HAVE_OPENSSL
 
 template<typename TPoller>
-void test_future_chaining(void**) {
-    TFuture<int> intFuture = []() -> TFuture<int> {
-        co_return 1;
-    }();
+void test_dns_cache_positive(void**) {
+    TFakeDns dns({{"host.test", {.A = {"10.0.0.1", "10.0.0.2"}, .Ttl = 60}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
 
-    TFuture<double> doubleFuture = intFuture.Apply([](int value) -> double {
-        return value * 1.5;
-    });
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    assert_false(error);
+    assert_int_equal(addresses.size(), 2);
+    assert_int_equal(dns.Queries, 1);
+    assert_int_equal(resolver.CacheSize(), 1);
+
+    // answered from the cache without suspending
+    addresses.clear();
+    auto h2 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    assert_true(h2.done());
+    assert_int_equal(addresses.size(), 2);
+    assert_string_equal(addresses[0].ToString().c_str(), "10.0.0.1:0");
+    assert_int_equal(dns.Queries, 1);
+}
 
-    double val = -1;
-    [&](TFuture<double>&& f, double* val) -> TFuture<void> {
-        *val = co_await f;
-    }(std::move(doubleFuture), &val);
+template<typename TPoller>
+void test_dns_cache_expiry(void**) {
+    TFakeDns dns({{"host.test", {.A = {"10.0.0.1"}, .Ttl = 60}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
+    resolver.SetCacheOptions({.MaxTtl = std::chrono::milliseconds(50), .PrefetchFraction = 0});
 
-    assert_true(std::abs(val - 1.5) < 1e-13);
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    assert_int_equal(dns.Queries, 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    addresses.clear();
+    auto h2 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    assert_false(h2.done());
+    run_until_done(loop, h2);
+    assert_false(error);
+    assert_int_equal(addresses.size(), 1);
+    assert_int_equal(dns.Queries, 2);
 }
 
 template<typename TPoller>
-void test_futures_any(void**) {
-    using TLoop = TLoop<TPoller>;
-    TLoop loop;
+void test_dns_cache_negative(void**) {
+    TFakeDns dns({
+        {"gone.test", {.NxDomain = true, .SoaMinimum = 30}},
+        {"v4only.test", {.A = {"10.0.0.1"}, .SoaMinimum = 30}},
+        {"nosoa.test", {.NxDomain = true, .SoaMinimum = 0}},
+    });
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
 
-    int ok = 0;
-    TFuture<void> h2 = [](TPoller& poller, int* ok) -> TFuture<void> {
-        std::vector<TFuture<void>> futures;
-        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
-            co_await poller.Sleep(std::chrono::milliseconds(100));
-            co_return;
-        }(poller));
-        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
-            co_await poller.Sleep(std::chrono::milliseconds(200));
-            co_return;
-        }(poller));
-        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
-            co_await poller.Sleep(std::chrono::milliseconds(201));
-            co_return;
-        }(poller));
-        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
-            co_await poller.Sleep(std::chrono::milliseconds(202));
-            co_return;
-        }(poller));
-        co_await Any(std::move(futures));
-        *ok = 1;
-        co_return;
-    }(loop.Poller(), &ok);
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto h1 = resolve_into(resolver, "gone.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    assert_true(error);
+
+    error = nullptr;
+    auto h2 = resolve_into(resolver, "gone.test", EDNSType::A, &addresses, &error);
+    assert_true(h2.done());
+    assert_true(error);
+    assert_int_equal(dns.Queries, 1);
+
+    // NODATA: the name exists without records of the type
+    error = nullptr;
+    auto h3 = resolve_into(resolver, "v4only.test", EDNSType::AAAA, &addresses, &error);
+    run_until_done(loop, h3);
+    assert_false(error);
+    assert_true(addresses.empty());
+    auto h4 = resolve_into(resolver, "v4only.test", EDNSType::AAAA, &addresses, &error);
+    assert_true(h4.done());
+    assert_int_equal(dns.Queries, 2);
+
+    // a zero SOA minimum is not cached
+    auto h5 = resolve_into(resolver, "nosoa.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h5);
+    auto h6 = resolve_into(resolver, "nosoa.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h6);
+    assert_int_equal(dns.Queries, 4);
+}
 
-    while (!h2.done()) {
-        loop.Step();
+template<typename TPoller>
+void test_dns_cache_eviction(void**) {
+    TFakeDns dns({
+        {"a.test", {.A = {"10.0.0.1"}}},
+        {"b.test", {.A = {"10.0.0.2"}}},
+        {"c.test", {.A = {"10.0.0.3"}}},
+    });
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
+    resolver.SetCacheOptions({.MaxSize = 2});
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    for (auto name : {"a.test", "b.test", "a.test", "c.test"}) {
+        auto h = resolve_into(resolver, name, EDNSType::A, &addresses, &error);
+        run_until_done(loop, h);
     }
+    assert_int_equal(resolver.CacheSize(), 2);
+    assert_int_equal(dns.Queries, 3);
+
+    // b.test was the least recently used
+    auto h1 = resolve_into(resolver, "a.test", EDNSType::A, &addresses, &error);
+    assert_true(h1.done());
+    auto h2 = resolve_into(resolver, "b.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h2);
+    assert_int_equal(dns.Queries, 4);
+}
 
-    while (loop.Poller().TimersSize() > 0) {
+template<typename TPoller>
+void test_dns_cache_prefetch(void**) {
+    TFakeDns dns({{"host.test", {.A = {"10.0.0.1"}}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
+    resolver.SetCacheOptions({.MaxTtl = std::chrono::milliseconds(200), .PrefetchFraction = 0.5});
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(120));
+    auto h2 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    assert_true(h2.done());
+    while (dns.Queries < 2) {
         loop.Step();
     }
 
-    assert_true(ok == 1);
+    // the refreshed entry lives for another TTL
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    loop.Step();
+    auto h3 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    assert_true(h3.done());
+    assert_false(error);
 }
 
 template<typename TPoller>
-void test_futures_any_result(void**) {
+void test_dns_abandoned_waiter(void**) {
+    TFakeDns dns({{"host.test", {.A = {"10.0.0.1"}}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
+
+    std::vector<TAddress> addresses1, addresses2;
+    std::exception_ptr error;
+    {
+        auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses1, &error);
+        assert_false(h1.done());
+    }
+    auto h2 = resolve_into(resolver, "host.test", EDNSType::A, &addresses2, &error);
+    run_until_done(loop, h2);
+    assert_true(addresses1.empty());
+    assert_int_equal(addresses2.size(), 1);
+}
+
+template<typename TPoller>
+void test_happy_eyeballs(void**) {
+    using TSocket = typename TPoller::TSocket;
+    int port = getport();
+    TFakeDns dns({{"dual.test", {.A = {"127.0.0.1"}, .AAAA = {"::1"}}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
+
+    TAddress address{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), address.Domain());
+    listener.Bind(address);
+    listener.Listen();
+
+    // nothing listens on [::1]:port, the IPv4 attempt wins
+    std::optional<TSocket> connected;
+    auto client = [](auto& resolver, auto& poller, int port, auto& connected) -> TFuture<void> {
+        connected.emplace(co_await THostPort("dual.test", port).template Connect<TSocket>(
+            resolver, poller, TClock::now() + std::chrono::seconds(5)));
+    }(resolver, loop.Poller(), port, connected);
+    auto server = [](TSocket& listener) -> TFuture<void> {
+        co_await listener.Accept();
+    }(listener);
+
+    while (!client.done() || !server.done()) {
+        loop.Step();
+    }
+    assert_true(connected.has_value());
+    assert_string_equal(connected->RemoteAddr()->ToString().c_str(), address.ToString().c_str());
+    assert_int_equal(dns.Queries, 2);
+}
+
+template<typename TPoller>
+void test_dns_nameserver_failover(void**) {
+    TFakeDns silent({{"host.test", {.A = {"10.0.0.1"}}}}, TFakeDns::Silent);
+    TFakeDns dns({{"host.test", {.A = {"10.0.0.1"}}}, {"other.test", {.A = {"10.0.0.2"}}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(std::vector<TAddress>{silent.Address(), dns.Address()}, loop.Poller());
+    resolver.SetQueryOptions({.InitialRto = std::chrono::milliseconds(50)});
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    assert_false(error);
+    assert_int_equal(addresses.size(), 1);
+    assert_int_equal(silent.Queries, 1);
+    assert_int_equal(dns.Queries, 1);
+    assert_true(resolver.Srtt(1) > TClock::duration::zero());
+    // the timeout is a penalty, not an RTT sample
+    assert_true(resolver.Srtt(0) == TClock::duration::zero());
+    assert_true(resolver.Penalty(0) > resolver.Srtt(1));
+    assert_true(resolver.Penalty(1) == TClock::duration::zero());
+
+    // the answering server is asked first now
+    auto h2 = resolve_into(resolver, "other.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h2);
+    assert_false(error);
+    assert_int_equal(silent.Queries, 1);
+    assert_int_equal(dns.Queries, 2);
+}
+
+template<typename TPoller>
+void test_dns_parallel_query(void**) {
+    TFakeDns silent({}, TFakeDns::Silent);
+    TFakeDns dns({{"host.test", {.A = {"10.0.0.1"}}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(std::vector<TAddress>{silent.Address(), dns.Address()}, loop.Poller());
+    resolver.SetQueryOptions({.InitialRto = std::chrono::seconds(1), .Parallel = 2});
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto t1 = TClock::now();
+    auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    assert_false(error);
+    assert_true(TClock::now() - t1 < std::chrono::milliseconds(500));
+    assert_int_equal(silent.Queries, 1);
+    assert_int_equal(dns.Queries, 1);
+}
+
+template<typename TPoller>
+void test_dns_servfail_next_server(void**) {
+    TFakeDns failing({}, TFakeDns::ServFail);
+    TFakeDns dns({{"host.test", {.A = {"10.0.0.1"}}}});
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(std::vector<TAddress>{failing.Address(), dns.Address()}, loop.Poller());
+    resolver.SetQueryOptions({.InitialRto = std::chrono::seconds(1)});
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto t1 = TClock::now();
+    auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    assert_false(error);
+    assert_int_equal(addresses.size(), 1);
+    assert_true(TClock::now() - t1 < std::chrono::milliseconds(500));
+}
+
+template<typename TPoller>
+void test_dns_truncated_reply(void**) {
+    TFakeDns dns({
+        {"host.test", {.A = {"10.0.0.1"}, .AAAA = {"::1"}}},
+        {"hos1.test", {.A = {"10.0.0.1"}}},
+        {"hos2.test", {.A = {"10.0.0.1"}}},
+    });
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
+    resolver.SetQueryOptions({
+        .Timeout = std::chrono::milliseconds(100),
+        .InitialRto = std::chrono::milliseconds(40),
+        .MaxRto = std::chrono::milliseconds(100)});
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    // a whole reply stays in the receive buffer behind the cut ones
+    auto h = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h);
+    assert_false(error);
+    assert_int_equal(addresses.size(), 1);
+
+    // the header is 12 bytes, the question "\4hos1\4test\0" and 4 more, the answer name is a pointer:
+    // cut within the first label and after the first byte of the pointer
+    const char* names[] = {"hos1.test", "hos2.test"};
+    size_t cuts[] = {12 + 3, 12 + 11 + 4 + 1};
+    for (size_t i = 0; i < std::size(cuts); i++) {
+        dns.Mode = TFakeDns::Cut;
+        dns.CutAt = cuts[i];
+        addresses.clear();
+        error = nullptr;
+        auto h = resolve_into(resolver, names[i], EDNSType::A, &addresses, &error);
+        run_until_done(loop, h);
+        // dropped as malformed, never parsed past its end
+        assert_true(error);
+        assert_true(addresses.empty());
+    }
+
+    dns.Mode = TFakeDns::Normal;
+    addresses.clear();
+    error = nullptr;
+    h = resolve_into(resolver, "host.test", EDNSType::AAAA, &addresses, &error);
+    run_until_done(loop, h);
+    assert_false(error);
+    assert_int_equal(addresses.size(), 1);
+}
+
+template<typename TPoller>
+void test_dns_retransmit_timeout(void**) {
+    TFakeDns silent({}, TFakeDns::Silent);
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(silent.Address(), loop.Poller());
+    resolver.SetQueryOptions({
+        .Timeout = std::chrono::milliseconds(300),
+        .InitialRto = std::chrono::milliseconds(40),
+        .MaxRto = std::chrono::milliseconds(1000)});
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto t1 = TClock::now();
+    auto h1 = resolve_into(resolver, "host.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    auto elapsed = TClock::now() - t1;
+    assert_true(error);
+    assert_true(elapsed >= std::chrono::milliseconds(300));
+    assert_true(elapsed < std::chrono::milliseconds(600));
+    // the timeout doubles every round: 40, 80, 160 ms
+    assert_true(silent.Queries >= 2);
+    assert_true(silent.Queries <= 4);
+}
+
+template<typename TPoller>
+void test_dns_tcp_fallback(void**) {
+    TFakeDns dns({{"big.test", {.A = {"10.0.0.1", "10.0.0.2", "10.0.0.3"}}}}, TFakeDns::Truncate);
+    TLoop<TPoller> loop;
+    TResolver<TPollerBase> resolver(dns.Address(), loop.Poller());
+
+    std::vector<TAddress> addresses;
+    std::exception_ptr error;
+    auto h1 = resolve_into(resolver, "big.test", EDNSType::A, &addresses, &error);
+    run_until_done(loop, h1);
+    assert_false(error);
+    assert_int_equal(addresses.size(), 3);
+    assert_int_equal(dns.Queries, 1);
+    assert_int_equal(dns.TcpQueries, 1);
+}
+
+void test_host_port_parse(void**) {
+    THostPort v4("127.0.0.1:80");
+    THostPort v6("[::1]:443");
+    TLoop<TPoll> loop;
+    TResolver<TPollerBase> resolver(TAddress{"127.0.0.1", 53}, loop.Poller());
+    auto r1 = v4.Resolve(resolver);
+    auto r2 = v6.Resolve(resolver);
+    assert_true(r1.done());
+    assert_true(r2.done());
+    assert_string_equal(r1.await_resume().ToString().c_str(), "127.0.0.1:80");
+    assert_string_equal(r2.await_resume().ToString().c_str(), "[::1]:443");
+}
+#endif
+
+#ifdef HAVE_OPENSSL
+void test_ssl_ring_buffer(void**) {
+    TSslRingBuffer ring(8);
+    char out[32];
+    ring.Write("abcdef", 6);
+    assert_int_equal(4, ring.Read(out, 4));
+    assert_memory_equal("abcd", out, 4);
+
+    // wraps around the end of the storage
+    ring.Write("ghij", 4);
+    assert_int_equal(6, ring.Size());
+    assert_int_equal(4, ring.Readable().size());
+    assert_int_equal(2, ring.Writable().size());
+
+    // grows keeping the order
+    ring.Write("klmnopqrst", 10);
+    assert_int_equal(16, ring.Size());
+    assert_int_equal(16, ring.Read(out, sizeof(out)));
+    assert_memory_equal("efghijklmnopqrst", out, 16);
+    assert_true(ring.Empty());
+    assert_int_equal(0, ring.Read(out, sizeof(out)));
+
+    // the storage is given back and taken again at the initial capacity
+    ring.Release();
+    assert_int_equal(0, ring.Writable().size());
+    ring.Write("uv", 2);
+    assert_int_equal(6, ring.Writable().size());
+}
+
+template<typename TPoller>
+void test_read_write_full_ssl(void**) {
     using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    std::vector<char> data(1024);
+    int cur = 0;
+    for (auto& ch : data) {
+        ch = cur + 'a';
+        cur = (cur + 1) % ('z' - 'a' + 1);
+    }
+
     TLoop loop;
+    TAddress saddr{"127.0.0.1", port};
+    TSocket socket(loop.Poller(), saddr.Domain());
+    socket.Bind(saddr);
+    socket.Listen();
 
-    int ok = 0;
-    TFuture<void> h2 = [](TPoller& poller, int* ok) -> TFuture<void> {
-        std::vector<TFuture<int>> futures;
-        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
-            co_await poller.Sleep(std::chrono::milliseconds(204));
-            co_return 1;
-        }(poller));
-        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
-            co_await poller.Sleep(std::chrono::milliseconds(100));
-            co_return 2;
-        }(poller));
-        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
-            co_await poller.Sleep(std::chrono::milliseconds(201));
-            co_return 3;
-        }(poller));
-        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
-            co_await poller.Sleep(std::chrono::milliseconds(202));
-            co_return 4;
-        }(poller));
-        *ok = co_await Any(std::move(futures));
+    TAddress caddr{"127.0.0.1", port};
+    TSocket client(loop.Poller(), caddr.Domain());
+
+    TFuture<void> h1 = [](TSocket&& client, TAddress& caddr, const std::vector<char>& data) -> TFuture<void>
+    {
+        TSslContext ctx = TSslContext::Client();
+        auto sslClient = TSslSocket(std::move(client), ctx);
+        co_await sslClient.Connect(caddr);
+        co_await TByteWriter(sslClient).Write(data.data(), data.size());
         co_return;
-    }(loop.Poller(), &ok);
+    }(std::move(client), caddr, data);
 
-    while (!h2.done()) {
+    std::vector<char> received(1024*1024);
+    TFuture<void> h2 = [](TSocket& server, std::vector<char>& received) -> TFuture<void>
+    {
+        TSslContext ctx = TSslContext::ServerFromMem(testMemCert, testMemKey);
+        auto client = std::move(co_await server.Accept());
+        auto sslClient = TSslSocket(std::move(client), ctx);
+        co_await sslClient.AcceptHandshake();
+        co_await TByteReader(sslClient).Read(received.data(), received.size());
+        co_return;
+    }(socket, received);
+
+    while (!(h1.done() && h2.done())) {
         loop.Step();
     }
 
-    while (loop.Poller().TimersSize() > 0) {
+    assert_memory_equal(data.data(), received.data(), data.size());
+}
+
+template<typename TPoller>
+void test_ssl_hibernation(void**) {
+    using TSocket = typename TPoller::TSocket;
+
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    TFuture<void> client = [](TPoller& poller, TAddress addr) -> TFuture<void> {
+        TSslContext ctx = TSslContext::Client();
+        TSslSocket socket(TSocket(poller, addr.Domain()), ctx);
+        co_await socket.Connect(addr);
+        for (std::string line : {"ping\n", "pong\n"}) {
+            co_await poller.Sleep(std::chrono::milliseconds(1));
+            co_await TByteWriter(socket).Write(line.data(), line.size());
+        }
+        // closing with the session tickets unread would reset the connection
+        co_await TByteReader(socket).ReadUntil("\n");
+    }(loop.Poller(), addr);
+
+    std::vector<std::string> received;
+    TFuture<void> server = [](TSocket& listener, std::vector<std::string>* received) -> TFuture<void> {
+        TSslContext ctx = TSslContext::ServerFromMem(testMemCert, testMemKey);
+        TSslSocket socket(co_await listener.Accept(), ctx);
+        socket.SetHibernation();
+        co_await socket.AcceptHandshake();
+        TByteReader reader(socket);
+        reader.SetHibernation();
+        received->push_back(co_await reader.ReadUntil("\n"));
+        received->push_back(co_await reader.ReadUntil("\n"));
+        co_await TByteWriter(socket).Write("ok\n", 3);
+    }(listener, &received);
+
+    while (!(client.done() && server.done())) {
         loop.Step();
     }
+    assert_int_equal(received.size(), 2);
+    assert_string_equal(received[0].c_str(), "ping\n");
+    assert_string_equal(received[1].c_str(), "pong\n");
+}
 
-    assert_true(ok == 2);
+template<typename TPoller>
+void test_ssl_handshake_offload(void**) {
+    using TSocket = typename TPoller::TSocket;
+
+    TLoop<TPoller> loop;
+    TWorkPool pool(2);
+    TSslHandshakeOffload offload(pool, 1);
+    TAddress addr{"127.0.0.1", getport()};
+    TSslContext serverCtx = TSslContext::ServerFromMem(testMemCert, testMemKey);
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    constexpr int clients = 3;
+    int served = 0;
+    // handshakes of both sides share the offload, one step on the pool at a time
+    TFuture<void> server = [](TSocket& listener, TSslContext& ctx, TSslHandshakeOffload* offload, int* served) -> TFuture<void> {
+        for (int i = 0; i < clients; i++) {
+            TSslSocket socket(co_await listener.Accept(), ctx);
+            socket.SetHandshakeOffload(offload);
+            co_await socket.AcceptHandshake();
+            char buf[4];
+            co_await TByteReader(socket).Read(buf, sizeof(buf));
+            co_await TByteWriter(socket).Write(buf, sizeof(buf));
+            (*served)++;
+        }
+    }(listener, serverCtx, &offload, &served);
+
+    std::vector<std::string> received(clients);
+    std::vector<TFuture<void>> futures;
+    TSslContext clientCtx = TSslContext::Client();
+    for (int i = 0; i < clients; i++) {
+        futures.emplace_back([](TPoller& poller, TAddress addr, TSslContext& ctx, TSslHandshakeOffload* offload, std::string* received) -> TFuture<void> {
+            TSslSocket socket(TSocket(poller, addr.Domain()), ctx);
+            socket.SetHandshakeOffload(offload);
+            co_await socket.Connect(addr);
+            co_await TByteWriter(socket).Write("ping", 4);
+            received->resize(4);
+            co_await TByteReader(socket).Read(received->data(), 4);
+        }(loop.Poller(), addr, clientCtx, &offload, &received[i]));
+    }
+
+    auto finished = [&]() {
+        for (auto& f : futures) {
+            if (!f.done()) {
+                return false;
+            }
+        }
+        return server.done();
+    };
+    while (!finished()) {
+        loop.Step();
+    }
+    assert_int_equal(served, clients);
+    for (auto& r : received) {
+        assert_string_equal(r.c_str(), "ping");
+    }
+    assert_int_equal(serverCtx.SessionStats().Misses, clients);
 }
 
 template<typename TPoller>
-void test_futures_any_same_wakeup(void**) {
-    using TLoop = TLoop<TPoller>;
-    TLoop loop;
+void test_ssl_handshake_offload_resume(void**) {
+    using TSocket = typename TPoller::TSocket;
 
-    int ok = 0;
-    TFuture<void> h2 = [](TPoller& poller, int* ok) -> TFuture<void> {
+    TLoop<TPoller> loop;
+    TWorkPool pool(4);
+    TSslHandshakeOffload offload(pool, 4);
+    TAddress addr{"127.0.0.1", getport()};
+    TSslContext serverCtx = TSslContext::ServerFromMem(testMemCert, testMemKey);
+    TSslContext clientCtx = TSslContext::Client();
+    // TLS 1.2 delivers the ticket within the handshake, so sessions are cached from the pool threads too
+    SSL_CTX_set_max_proto_version(clientCtx.Ctx, TLS1_2_VERSION);
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    constexpr int clients = 8;
+    constexpr int rounds = 3;
+    auto serve = [](TSocket accepted, TSslContext& ctx, TSslHandshakeOffload* offload) -> TFuture<void> {
+        TSslSocket socket(std::move(accepted), ctx);
+        socket.SetHandshakeOffload(offload);
+        co_await socket.AcceptHandshake();
+        char buf[4];
+        co_await TByteReader(socket).Read(buf, sizeof(buf));
+        co_await TByteWriter(socket).Write(buf, sizeof(buf));
+    };
+    std::vector<TFuture<void>> handlers;
+    // several handshakes at a time issue tickets and cache sessions from the pool threads
+    TFuture<void> server = [](TSocket& listener, TSslContext& ctx, TSslHandshakeOffload* offload, auto serve, std::vector<TFuture<void>>& handlers) -> TFuture<void> {
+        for (int i = 0; i < rounds * clients; i++) {
+            handlers.emplace_back(serve(co_await listener.Accept(), ctx, offload));
+        }
+    }(listener, serverCtx, &offload, serve, handlers);
+
+    int pongs = 0;
+    auto client = [](TPoller& poller, TAddress addr, TSslContext& ctx, TSslHandshakeOffload* offload, int* pongs) -> TFuture<void> {
+        TSslSocket socket(TSocket(poller, addr.Domain()), ctx);
+        socket.SetHandshakeOffload(offload);
+        co_await socket.Connect(addr);
+        co_await TByteWriter(socket).Write("ping", 4);
+        char buf[4];
+        co_await TByteReader(socket).Read(buf, sizeof(buf));
+        *pongs += memcmp(buf, "ping", 4) == 0;
+    };
+    auto round = [&](bool rotate) {
         std::vector<TFuture<void>> futures;
-        auto until = TClock::now() + std::chrono::milliseconds(100);
-        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
-            co_await poller.Sleep(until);
-            (*ok)++;
-            co_return;
-        }(poller, until, ok));
-        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
-            co_await poller.Sleep(until);
-            (*ok)++;
-            co_return;
-        }(poller, until, ok));
-        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
-            co_await poller.Sleep(until);
-            (*ok)++;
-            co_return;
-        }(poller, until, ok));
-        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
-            co_await poller.Sleep(until);
-            (*ok)++;
-            co_return;
-        }(poller, until, ok));
-        co_await Any(std::move(futures));
-        (*ok)++;
-        co_return;
-    }(loop.Poller(), &ok);
+        for (int i = 0; i < clients; i++) {
+            futures.emplace_back(client(loop.Poller(), addr, clientCtx, &offload, &pongs));
+        }
+        while (!std::all_of(futures.begin(), futures.end(), [](auto& f) { return f.done(); })) {
+            // the loop thread changes the ticket keys while the pool uses them
+            if (rotate) {
+                serverCtx.RotateTicketKey();
+            }
+            loop.Step();
+        }
+        for (auto& f : futures) {
+            f.await_resume();
+        }
+    };
+    round(true);
+    round(false);
+    // the last round resumes the sessions cached by the previous one, its ticket key is still current
+    auto before = serverCtx.SessionStats();
+    round(false);
+    while (!server.done() || !std::all_of(handlers.begin(), handlers.end(), [](auto& f) { return f.done(); })) {
+        loop.Step();
+    }
+    assert_int_equal(pongs, rounds * clients);
+    auto stats = serverCtx.SessionStats();
+    assert_int_equal(stats.Hits + stats.Misses, rounds * clients);
+    assert_int_equal(stats.Hits - before.Hits, clients);
+}
 
-    while (!h2.done()) {
+template<typename TPoller>
+void test_ssl_ktls(void**) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    std::string data(100000, 'x');
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = 'a' + i % 26;
+    }
+    std::string received(data.size(), 0);
+    std::string reply(data.size(), 0);
+
+    TFuture<void> server = [](TSocket* listener, std::string* received) -> TFuture<void> {
+        TSslContext ctx = TSslContext::ServerFromMem(testMemCert, testMemKey);
+        auto ssl = TSslSocket(co_await listener->Accept(), ctx);
+        ssl.EnableKtls();
+        co_await ssl.AcceptHandshake();
+        co_await TByteReader(ssl).Read(received->data(), received->size());
+        co_await TByteWriter(ssl).Write(received->data(), received->size());
+    }(&listener, &received);
+
+    TFuture<void> client = [](TPoller& poller, TAddress addr, const std::string* data, std::string* reply) -> TFuture<void> {
+        TSslContext ctx = TSslContext::Client();
+        auto ssl = TSslSocket(TSocket(poller, addr.Domain()), ctx);
+        ssl.EnableKtls();
+        co_await ssl.Connect(addr);
+        co_await TByteWriter(ssl).Write(data->data(), data->size());
+        co_await TByteReader(ssl).Read(reply->data(), reply->size());
+    }(loop.Poller(), addr, &data, &reply);
+
+    while (!(server.done() && client.done())) {
         loop.Step();
     }
+    // either offloaded or encrypted in userspace, the bytes are the same
+    assert_true(data == received);
+    assert_true(data == reply);
+}
 
-    while (loop.Poller().TimersSize() > 0) {
+template<typename TPoller>
+void test_ssl_send_file(void**) {
+    using TSocket = typename TPoller::TSocket;
+    std::vector<char> data(300000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = 'a' + i % 26;
+    }
+    char path[] = "/tmp/coroio_ssl_send_fileXXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    unlink(path);
+    assert_int_equal(write(fd, data.data(), data.size()), (ssize_t)data.size());
+
+    // through the kernel when it offloads TLS, copied and encrypted by OpenSSL otherwise
+    for (bool ktls : {true, false}) {
+        TLoop<TPoller> loop;
+        TAddress addr{"127.0.0.1", getport()};
+        TSocket listener(loop.Poller(), addr.Domain());
+        listener.Bind(addr);
+        listener.Listen();
+
+        const int64_t offset = 7;
+        std::vector<char> received(data.size() - offset);
+
+        TFuture<void> server = [](TSocket* listener, bool ktls, int fd, int64_t offset, size_t size) -> TFuture<void> {
+            TSslContext ctx = TSslContext::ServerFromMem(testMemCert, testMemKey);
+            auto ssl = TSslSocket(co_await listener->Accept(), ctx);
+            if (ktls) {
+                ssl.EnableKtls();
+            }
+            co_await ssl.AcceptHandshake();
+            co_await TByteWriter(ssl).Write("+", 1);
+            co_await TByteWriter(ssl).SendFile(fd, offset, size);
+            char c;
+            co_await TByteReader(ssl).Read(&c, 1);
+        }(&listener, ktls, fd, offset, received.size());
+
+        TFuture<void> client = [](TPoller& poller, TAddress addr, std::vector<char>* received) -> TFuture<void> {
+            TSslContext ctx = TSslContext::Client();
+            auto ssl = TSslSocket(TSocket(poller, addr.Domain()), ctx);
+            co_await ssl.Connect(addr);
+            char c;
+            co_await TByteReader(ssl).Read(&c, 1);
+            assert_int_equal(c, '+');
+            co_await TByteReader(ssl).Read(received->data(), received->size());
+            co_await TByteWriter(ssl).Write("k", 1);
+        }(loop.Poller(), addr, &received);
+
+        while (!(server.done() && client.done())) {
+            loop.Step();
+        }
+        assert_true(std::equal(received.begin(), received.end(), data.begin() + offset));
+    }
+    close(fd);
+}
+
+template<typename TPoller>
+void test_ssl_session_resumption(void**) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    TSslContext clientCtx = TSslContext::Client();
+    TSslContext serverCtx = TSslContext::ServerFromMem(testMemCert, testMemKey);
+
+    auto exchange = [&]() {
+        TFuture<void> server = [](TSocket* listener, TSslContext* ctx) -> TFuture<void> {
+            auto ssl = TSslSocket(co_await listener->Accept(), *ctx);
+            co_await ssl.AcceptHandshake();
+            char c;
+            co_await TByteReader(ssl).Read(&c, 1);
+            co_await TByteWriter(ssl).Write(&c, 1);
+        }(&listener, &serverCtx);
+        TFuture<void> client = [](TPoller& poller, TAddress addr, TSslContext* ctx) -> TFuture<void> {
+            auto ssl = TSslSocket(TSocket(poller, addr.Domain()), *ctx);
+            co_await ssl.Connect(addr);
+            char c = 'x';
+            co_await TByteWriter(ssl).Write(&c, 1);
+            // TLS 1.3 tickets arrive after the handshake, together with the reply
+            co_await TByteReader(ssl).Read(&c, 1);
+        }(loop.Poller(), addr, &clientCtx);
+        while (!(server.done() && client.done())) {
+            loop.Step();
+        }
+    };
+
+    exchange();
+    assert_int_equal(0, clientCtx.SessionStats().Hits);
+    assert_int_equal(1, clientCtx.SessionStats().Misses);
+
+    exchange();
+    assert_int_equal(1, clientCtx.SessionStats().Hits);
+    assert_int_equal(1, serverCtx.SessionStats().Hits);
+
+    // tickets of a previous key are still accepted
+    serverCtx.RotateTicketKey();
+    exchange();
+    assert_int_equal(2, clientCtx.SessionStats().Hits);
+
+    for (size_t i = 0; i < TSslContext::MaxTicketKeys; i++) {
+        serverCtx.RotateTicketKey();
+    }
+    exchange();
+    assert_int_equal(2, clientCtx.SessionStats().Hits);
+    assert_int_equal(2, clientCtx.SessionStats().Misses);
+    assert_int_equal(2, serverCtx.SessionStats().Misses);
+}
+#endif // HAVE_OPENSSL
+
+template<typename TPoller>
+void test_http_pipelined(void**) {
+    using TSocket = typename TPoller::TSocket;
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    std::vector<std::string> seen;
+    TFuture<void> server = [](TSocket* listener, std::vector<std::string>* seen) -> TFuture<void> {
+        auto socket = co_await listener->Accept();
+        THttpReader reader(socket, 1024);
+        std::string out;
+        while (co_await reader.ReadRequest()) {
+            std::string body;
+            co_await reader.ReadBody(body);
+            const auto& request = reader.Request();
+            seen->push_back(std::string(request.Method) + " " + std::string(request.Target) + " " + body);
+            THttpResponse(200).Body(body.empty() ? std::string_view("empty") : std::string_view(body)).KeepAlive(request.KeepAlive).AppendTo(out);
+            if (!request.KeepAlive || !reader.Buffered()) {
+                co_await TByteWriter(socket).Write(out.data(), out.size());
+                out.clear();
+            }
+            if (!request.KeepAlive) {
+                break;
+            }
+        }
+    }(&listener, &seen);
+
+    std::string response;
+    TFuture<void> client = [](TPoller& poller, TAddress addr, std::string* response) -> TFuture<void> {
+        TSocket socket(poller, addr.Domain());
+        co_await socket.Connect(addr);
+        std::string requests =
+            "GET /a HTTP/1.1\r\n\r\n"
+            "POST /b HTTP/1.1\r\nContent-Length: 3\r\n\r\nxyz"
+            "POST /c HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n2\r\nab\r\n1\r\nc\r\n0\r\n\r\n"
+            "POST /d HTTP/1.1\r\nContent-Length: 4\r\n\r\nskip"
+            "GET /e HTTP/1.1\r\nConnection: close\r\n\r\n";
+        // in small pieces, so heads and bodies are split between reads
+        for (size_t i = 0; i < requests.size(); i += 7) {
+            co_await TByteWriter(socket).Write(requests.data() + i, std::min<size_t>(7, requests.size() - i));
+            co_await poller.Sleep(std::chrono::milliseconds(0));
+        }
+        char buf[1024];
+        ssize_t size;
+        while ((size = co_await socket.ReadSome(buf, sizeof(buf))) > 0) {
+            response->append(buf, size);
+        }
+    }(loop.Poller(), addr, &response);
+
+    while (!(server.done() && client.done())) {
+        loop.Step();
+    }
+    assert_int_equal(seen.size(), 5);
+    assert_string_equal(seen[0].c_str(), "GET /a ");
+    assert_string_equal(seen[1].c_str(), "POST /b xyz");
+    assert_string_equal(seen[2].c_str(), "POST /c abc");
+    assert_string_equal(seen[3].c_str(), "POST /d skip");
+    assert_string_equal(seen[4].c_str(), "GET /e ");
+    assert_true(response.find("Content-Length: 3\r\n\r\nabc") != std::string::npos);
+    assert_true(response.find("Connection: close\r\n\r\nempty") != std::string::npos);
+}
+
+template<typename TPoller>
+void test_ws_frames(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    TLoop loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    TSocket client(loop.Poller(), addr.Domain());
+
+    std::string binary(70000, '\0');
+    uint32_t seed = 31337;
+    for (auto& ch : binary) {
+        ch = rand_(&seed);
+    }
+    std::string text(300, 'x');
+
+    auto frame = [](uint8_t opcode, std::string_view payload, bool masked) {
+        const uint8_t key[4] = {1, 2, 3, 4};
+        std::string out;
+        out.push_back(0x80 | opcode);
+        uint8_t bit = masked ? 0x80 : 0;
+        if (payload.size() <= 125) {
+            out.push_back(bit | payload.size());
+        } else if (payload.size() <= 0xFFFF) {
+            out.push_back(bit | 126);
+            out.push_back(payload.size() >> 8);
+            out.push_back(payload.size() & 0xFF);
+        } else {
+            out.push_back(bit | 127);
+            for (int i = 7; i >= 0; i--) {
+                out.push_back((uint64_t(payload.size()) >> (8 * i)) & 0xFF);
+            }
+        }
+        if (masked) {
+            out.append(reinterpret_cast<const char*>(key), 4);
+        }
+        for (size_t i = 0; i < payload.size(); i++) {
+            out.push_back(masked ? payload[i] ^ key[i % 4] : payload[i]);
+        }
+        return out;
+    };
+
+    // several frames in one write: all are parsed from the same buffer
+    std::string frames = frame(0x2, binary, true) + frame(0x1, "hello", false) + frame(0x2, "", true);
+    std::string echoed;
+    TFuture<void> server = [](TSocket& listener, const std::string& frames, std::string& echoed, size_t size) -> TFuture<void> {
+        auto socket = co_await listener.Accept();
+        co_await TByteWriter(socket).Write(frames.data(), frames.size());
+        echoed.resize(size);
+        co_await TByteReader(socket).Read(echoed.data(), echoed.size());
+    }(listener, frames, echoed, frame(0x1, text, true).size());
+
+    std::string receivedBinary, receivedText, receivedEmpty;
+    TFuture<void> wsClient = [](TSocket& client, TAddress addr, std::string& b, std::string& t, std::string& e, const std::string& text) -> TFuture<void> {
+        co_await client.Connect(addr);
+        TWebSocket ws(client);
+        b = co_await ws.ReceiveBinary();
+        t = co_await ws.ReceiveText();
+        e = co_await ws.ReceiveBinary();
+        co_await ws.SendText(text);
+    }(client, addr, receivedBinary, receivedText, receivedEmpty, text);
+
+    while (!server.done() || !wsClient.done()) {
         loop.Step();
     }
-
-    assert_true(ok == 2);
+
+    assert_true(receivedBinary == binary);
+    assert_string_equal(receivedText.c_str(), "hello");
+    assert_true(receivedEmpty.empty());
+
+    // 126-length header and the client mask
+    assert_int_equal(static_cast<uint8_t>(echoed[0]), 0x81);
+    assert_int_equal(static_cast<uint8_t>(echoed[1]), 0x80 | 126);
+    assert_int_equal((static_cast<uint8_t>(echoed[2]) << 8) | static_cast<uint8_t>(echoed[3]), text.size());
+    const char* key = echoed.data() + 4;
+    for (size_t i = 0; i < text.size(); i++) {
+        assert_int_equal(echoed[8 + i] ^ key[i % 4], 'x');
+    }
+}
+
+template<typename TPoller>
+void test_ws_control_frames(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    TLoop loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    TSocket client(loop.Poller(), addr.Domain());
+
+    auto frame = [](uint8_t head, std::string_view payload) {
+        std::string out;
+        out.push_back(head);
+        out.push_back(payload.size());
+        out.append(payload);
+        return out;
+    };
+    // a fragmented text message with a ping in the middle, then a close
+    std::string frames =
+        frame(0x01, "Hel") +
+        frame(0x89, "abc") +
+        frame(0x00, "lo, ") +
+        frame(0x80, "world") +
+        frame(0x88, "\x03\xe8");
+
+    std::string replies(9 + 8, '\0');
+    TFuture<void> server = [](TSocket& listener, const std::string& frames, std::string& replies) -> TFuture<void> {
+        auto socket = co_await listener.Accept();
+        co_await TByteWriter(socket).Write(frames.data(), frames.size());
+        co_await TByteReader(socket).Read(replies.data(), replies.size());
+    }(listener, frames, replies);
+
+    std::string text;
+    EWebSocketOpcode last = EWebSocketOpcode::Text;
+    std::string code;
+    TFuture<void> wsClient = [](TSocket& client, TAddress addr, std::string& text, EWebSocketOpcode& last, std::string& code) -> TFuture<void> {
+        co_await client.Connect(addr);
+        TWebSocket ws(client);
+        text = co_await ws.ReceiveText();
+        auto message = co_await ws.Receive();
+        last = message.Opcode;
+        code = message.Payload;
+    }(client, addr, text, last, code);
+
+    while (!server.done() || !wsClient.done()) {
+        loop.Step();
+    }
+
+    assert_string_equal(text.c_str(), "Hello, world");
+    assert_true(last == EWebSocketOpcode::Close);
+    assert_true(code == "\x03\xe8");
+
+    auto unmask = [](std::string_view frame) {
+        std::string payload(frame.substr(6));
+        for (size_t i = 0; i < payload.size(); i++) {
+            payload[i] ^= frame[2 + i % 4];
+        }
+        return payload;
+    };
+    // the masked pong and the echoed close
+    assert_int_equal(static_cast<uint8_t>(replies[0]), 0x8A);
+    assert_int_equal(static_cast<uint8_t>(replies[1]), 0x80 | 3);
+    assert_true(unmask(std::string_view(replies).substr(0, 9)) == "abc");
+    assert_int_equal(static_cast<uint8_t>(replies[9]), 0x88);
+    assert_int_equal(static_cast<uint8_t>(replies[10]), 0x80 | 2);
+    assert_true(unmask(std::string_view(replies).substr(9)) == "\x03\xe8");
+}
+
+template<typename TPoller>
+void test_ws_server_limits(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    TLoop loop;
+    TAddress addr{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    auto frame = [](uint8_t head, size_t size, bool masked, std::string_view payload = {}) {
+        std::string out;
+        out.push_back(head);
+        uint8_t bit = masked ? 0x80 : 0;
+        if (size <= 125) {
+            out.push_back(bit | size);
+        } else {
+            out.push_back(bit | 127);
+            for (int i = 7; i >= 0; i--) {
+                out.push_back((uint64_t(size) >> (8 * i)) & 0xFF);
+            }
+        }
+        if (masked) {
+            out.append(4, '\0'); // a zero key leaves the payload as is
+        }
+        out.append(payload);
+        return out;
+    };
+    std::string fragment(60, 'x');
+    struct TCase {
+        std::string Frames;
+        const char* Error;
+    };
+    std::vector<TCase> cases = {
+        // a header claiming a terabyte, without its payload
+        {frame(0x82, size_t(1) << 40, true), "Message is too large"},
+        {frame(0x81, 5, false, "hello"), "Unmasked client frame"},
+        // each fragment fits, the message does not
+        {frame(0x01, fragment.size(), true, fragment) + frame(0x80, fragment.size(), true, fragment), "Message is too large"},
+        {frame(0x81, 100, true, std::string(100, 'y')), nullptr},
+    };
+
+    static constexpr std::string_view upgrade =
+        "GET /chat HTTP/1.1\r\n"
+        "Host: server.example.com\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+        "Sec-WebSocket-Version: 13\r\n\r\n";
+    for (auto& c : cases) {
+        std::string error;
+        size_t received = 0;
+        TFuture<void> server = [](TSocket& listener, std::string& error, size_t& received) -> TFuture<void> {
+            auto socket = co_await listener.Accept();
+            TWebSocket ws(socket);
+            ws.SetMaxMessageSize(100);
+            co_await ws.Accept();
+            try {
+                auto message = co_await ws.Receive();
+                received = message.Payload.size();
+            } catch (const std::runtime_error& e) {
+                error = e.what();
+            }
+        }(listener, error, received);
+        TFuture<void> client = [](TPoller& poller, TAddress addr, const std::string& frames) -> TFuture<void> {
+            TSocket socket(poller, addr.Domain());
+            co_await socket.Connect(addr);
+            std::string data = std::string(upgrade) + frames;
+            co_await TByteWriter(socket).Write(data.data(), data.size());
+            char buf[256];
+            // until the server closes
+            while (co_await socket.ReadSome(buf, sizeof(buf)) > 0) { }
+        }(loop.Poller(), addr, c.Frames);
+        while (!server.done()) {
+            loop.Step();
+        }
+        if (c.Error) {
+            assert_string_equal(error.c_str(), c.Error);
+        } else {
+            assert_true(error.empty());
+            assert_int_equal(received, 100);
+        }
+    }
+}
+
+template<typename TPoller>
+void test_ws_broadcast(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    TLoop loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    constexpr int clients = 3;
+    std::vector<std::string> received(clients);
+    std::vector<TFuture<void>> futures;
+    for (int i = 0; i < clients; i++) {
+        futures.emplace_back([](TPoller& poller, TAddress addr, int id, std::string& received) -> TFuture<void> {
+            TSocket socket(poller, addr.Domain());
+            co_await socket.Connect(addr);
+            TWebSocket ws(socket);
+            co_await ws.Connect("localhost", "/feed");
+            co_await ws.SendBinary(std::string(200 + id, 'a' + id));
+            received = co_await ws.ReceiveText();
+            co_await ws.SendClose();
+            auto message = co_await ws.Receive();
+            assert_true(message.Opcode == EWebSocketOpcode::Close);
+        }(loop.Poller(), addr, i, received[i]));
+    }
+
+    size_t delivered = 0;
+    TFuture<void> server = [](TSocket& listener, size_t* delivered) -> TFuture<void> {
+        std::vector<std::unique_ptr<TSocket>> sockets;
+        std::vector<std::unique_ptr<TWebSocket<TSocket>>> subscribers;
+        std::vector<TWebSocket<TSocket>*> all;
+        for (int i = 0; i < clients; i++) {
+            sockets.emplace_back(std::make_unique<TSocket>(co_await listener.Accept()));
+            subscribers.emplace_back(std::make_unique<TWebSocket<TSocket>>(*sockets.back()));
+            auto request = co_await subscribers.back()->Accept();
+            assert_true(request.starts_with("GET /feed HTTP/1.1\r\n"));
+            auto payload = co_await subscribers.back()->ReceiveBinary();
+            assert_int_equal(payload.size(), 200 + (payload[0] - 'a'));
+            all.emplace_back(subscribers.back().get());
+        }
+        TWebSocketFrame frame(EWebSocketOpcode::Text, "news");
+        *delivered = co_await Broadcast(all, frame);
+        for (auto* ws : all) {
+            auto message = co_await ws->Receive();
+            assert_true(message.Opcode == EWebSocketOpcode::Close);
+        }
+    }(listener, &delivered);
+
+    auto done = [&]() {
+        return server.done() && std::all_of(futures.begin(), futures.end(), [](auto& f) { return f.done(); });
+    };
+    while (!done()) {
+        loop.Step();
+    }
+
+    assert_int_equal(delivered, clients);
+    for (const auto& message : received) {
+        assert_string_equal(message.c_str(), "news");
+    }
+}
+
+template<typename TPoller>
+void test_ws_broadcast_queue(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    TLoop loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    // the first frame does not fit into the socket buffers, the client reads only after all broadcasts
+    constexpr size_t bigSize = 16 << 20;
+    bool broadcasted = false;
+    std::vector<std::string> received;
+    TFuture<void> client = [](TPoller& poller, TAddress addr, bool& broadcasted, std::vector<std::string>& received) -> TFuture<void> {
+        TSocket socket(poller, addr.Domain());
+        co_await socket.Connect(addr);
+        TWebSocket ws(socket);
+        co_await ws.Connect("localhost", "/feed");
+        while (!broadcasted) {
+            co_await poller.Sleep(std::chrono::milliseconds(1));
+        }
+        for (int i = 0; i < 3; i++) {
+            auto message = co_await ws.Receive();
+            received.emplace_back(message.Payload.size() == bigSize ? "big" : std::string(message.Payload));
+        }
+    }(loop.Poller(), addr, broadcasted, received);
+
+    TFuture<void> server = [](TSocket& listener, bool& broadcasted) -> TFuture<void> {
+        auto socket = co_await listener.Accept();
+        int sndbuf = 65536;
+        setsockopt(socket.Fd(), SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        TWebSocket ws(socket);
+        co_await ws.Accept();
+        ws.SetMaxQueuedFrames(1);
+        std::vector<TWebSocket<TSocket>*> all = {&ws};
+        TWebSocketFrame big(EWebSocketOpcode::Binary, std::string(bigSize, 'x'));
+        TWebSocketFrame first(EWebSocketOpcode::Text, "first");
+        TWebSocketFrame second(EWebSocketOpcode::Text, "second");
+        auto sendBig = Broadcast(all, big);
+        assert_false(sendBig.done());
+        // waits for the big frame
+        auto sendFirst = Broadcast(all, first);
+        assert_false(sendFirst.done());
+        // the queue is full
+        auto sendSecond = Broadcast(all, second);
+        assert_true(sendSecond.done());
+        assert_int_equal(sendSecond.await_resume(), 0);
+        assert_int_equal(ws.DroppedFrames(), 1);
+        broadcasted = true;
+        assert_int_equal(co_await std::move(sendBig), 1);
+        assert_int_equal(co_await std::move(sendFirst), 1);
+        co_await ws.SendText("third");
+    }(listener, broadcasted);
+
+    while (!client.done() || !server.done()) {
+        loop.Step();
+    }
+    assert_int_equal(received.size(), 3);
+    assert_string_equal(received[0].c_str(), "big");
+    assert_string_equal(received[1].c_str(), "first");
+    assert_string_equal(received[2].c_str(), "third");
+}
+
+#ifdef HAVE_ZLIB
+template<typename TPoller>
+void test_ws_deflate_frames(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    TLoop loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    TSocket client(loop.Poller(), addr.Domain());
+
+    std::string json;
+    for (int i = 0; i < 100; i++) {
+        json += "{\"symbol\":\"ABC\",\"price\":" + std::to_string(100 + i % 7) + ",\"size\":10},";
+    }
+
+    std::string request;
+    std::string header(2, '\0');
+    size_t size = 0;
+    std::string small;
+    TFuture<void> server = [](TSocket& listener, std::string& request, std::string& header, size_t& size, std::string& small) -> TFuture<void> {
+        auto socket = co_await listener.Accept();
+        TByteReader reader(socket);
+        TByteWriter writer(socket);
+        request = co_await reader.ReadUntil("\r\n\r\n");
+        auto response = NDetail::WebSocketUpgradeResponse(request, "permessage-deflate");
+        co_await writer.Write(response.data(), response.size());
+        // "Hello" twice, the second one refers to the first (RFC 7692, 7.2.3.2)
+        static const uint8_t frames[] = {
+            0xc1, 0x07, 0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00,
+            0xc1, 0x05, 0xf2, 0x00, 0x11, 0x00, 0x00,
+        };
+        co_await writer.Write(frames, sizeof(frames));
+        co_await reader.Read(header.data(), header.size());
+        size = header[1] & 0x7F;
+        if (size == 126) {
+            uint8_t length[2];
+            co_await reader.Read(length, sizeof(length));
+            size = (length[0] << 8) | length[1];
+        }
+        std::string rest(size + 4, '\0');
+        co_await reader.Read(rest.data(), rest.size());
+        small.resize(2 + 4 + 2);
+        co_await reader.Read(small.data(), small.size());
+    }(listener, request, header, size, small);
+
+    std::string first, second;
+    bool negotiated = false;
+    TFuture<void> wsClient = [](TSocket& client, TAddress addr, std::string& first, std::string& second, bool& negotiated, const std::string& json) -> TFuture<void> {
+        co_await client.Connect(addr);
+        TWebSocket ws(client);
+        ws.EnableDeflate();
+        co_await ws.Connect("localhost", "/");
+        negotiated = ws.DeflateNegotiated();
+        first = co_await ws.ReceiveText();
+        second = co_await ws.ReceiveText();
+        co_await ws.SendText(json);
+        co_await ws.SendText("hi");
+    }(client, addr, first, second, negotiated, json);
+
+    while (!server.done() || !wsClient.done()) {
+        loop.Step();
+    }
+
+    assert_true(request.find("\r\nSec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n") != std::string::npos);
+    assert_true(negotiated);
+    assert_string_equal(first.c_str(), "Hello");
+    assert_string_equal(second.c_str(), "Hello");
+    // compressed, RSV1 set, at least 5 times smaller
+    assert_int_equal(static_cast<uint8_t>(header[0]), 0xc1);
+    assert_true(static_cast<uint8_t>(header[1]) & 0x80);
+    assert_true(size * 5 < json.size());
+    // below MinSize goes as is
+    assert_int_equal(static_cast<uint8_t>(small[0]), 0x81);
+    assert_int_equal(static_cast<uint8_t>(small[1]), 0x80 | 2);
+}
+
+template<typename TPoller>
+void test_ws_deflate_echo(void**) {
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+
+    int port = getport();
+    TLoop loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    TSocket client(loop.Poller(), addr.Domain());
+
+    std::vector<std::string> messages;
+    for (int i = 0; i < 5; i++) {
+        std::string message;
+        for (int j = 0; j < 50 * (i + 1); j++) {
+            message += "{\"id\":" + std::to_string(i * 1000 + j) + ",\"bid\":1.25,\"ask\":1.5}";
+        }
+        messages.emplace_back(std::move(message));
+    }
+    // 70 KB, a 64-bit length
+    messages.emplace_back(70000, 'z');
+
+    TFuture<void> server = [](TSocket& listener, size_t count) -> TFuture<void> {
+        auto socket = co_await listener.Accept();
+        TWebSocket ws(socket);
+        // the client's window stays, the own one is reset
+        ws.EnableDeflate({.NoContextTakeover = true});
+        co_await ws.Accept();
+        assert_true(ws.DeflateNegotiated());
+        for (size_t i = 0; i < count; i++) {
+            auto message = co_await ws.ReceiveText();
+            co_await ws.SendText(message);
+        }
+        TWebSocketFrame frame(EWebSocketOpcode::Text, std::string(1000, 'b'), true);
+        assert_true(frame.Compressed().size() * 10 < frame.Data().size());
+        std::vector<TWebSocket<TSocket>*> all = {&ws};
+        assert_int_equal(co_await Broadcast(all, frame), 1);
+        co_await ws.SendText(std::string(1000, 'c'));
+    }(listener, messages.size());
+
+    std::vector<std::string> echoed;
+    std::string broadcast, last;
+    TFuture<void> wsClient = [](TSocket& client, TAddress addr, const std::vector<std::string>& messages, std::vector<std::string>& echoed, std::string& broadcast, std::string& last) -> TFuture<void> {
+        co_await client.Connect(addr);
+        TWebSocket ws(client);
+        ws.EnableDeflate();
+        co_await ws.Connect("localhost", "/");
+        for (const auto& message : messages) {
+            co_await ws.SendText(message);
+            echoed.emplace_back(co_await ws.ReceiveText());
+        }
+        broadcast = co_await ws.ReceiveText();
+        last = co_await ws.ReceiveText();
+    }(client, addr, messages, echoed, broadcast, last);
+
+    while (!server.done() || !wsClient.done()) {
+        loop.Step();
+    }
+
+    assert_true(echoed == messages);
+    assert_true(broadcast == std::string(1000, 'b'));
+    assert_true(last == std::string(1000, 'c'));
+}
+#endif
+
+template<typename TPoller>
+void test_future_chaining(void**) {
+    TFuture<int> intFuture = []() -> TFuture<int> {
+        co_return 1;
+    }();
+
+    TFuture<double> doubleFuture = intFuture.Apply([](int value) -> double {
+        return value * 1.5;
+    });
+
+    double val = -1;
+    [&](TFuture<double>&& f, double* val) -> TFuture<void> {
+        *val = co_await f;
+    }(std::move(doubleFuture), &val);
+
+    assert_true(std::abs(val - 1.5) < 1e-13);
+}
+
+template<typename TPoller>
+void test_futures_any(void**) {
+    using TLoop = TLoop<TPoller>;
+    TLoop loop;
+
+    int ok = 0;
+    TFuture<void> h2 = [](TPoller& poller, int* ok) -> TFuture<void> {
+        std::vector<TFuture<void>> futures;
+        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::milliseconds(100));
+            co_return;
+        }(poller));
+        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::milliseconds(200));
+            co_return;
+        }(poller));
+        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::milliseconds(201));
+            co_return;
+        }(poller));
+        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::milliseconds(202));
+            co_return;
+        }(poller));
+        co_await Any(std::move(futures));
+        *ok = 1;
+        co_return;
+    }(loop.Poller(), &ok);
+
+    while (!h2.done()) {
+        loop.Step();
+    }
+
+    while (loop.Poller().TimersSize() > 0) {
+        loop.Step();
+    }
+
+    assert_true(ok == 1);
+}
+
+template<typename TPoller>
+void test_futures_any_result(void**) {
+    using TLoop = TLoop<TPoller>;
+    TLoop loop;
+
+    int ok = 0;
+    TFuture<void> h2 = [](TPoller& poller, int* ok) -> TFuture<void> {
+        std::vector<TFuture<int>> futures;
+        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
+            co_await poller.Sleep(std::chrono::milliseconds(204));
+            co_return 1;
+        }(poller));
+        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
+            co_await poller.Sleep(std::chrono::milliseconds(100));
+            co_return 2;
+        }(poller));
+        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
+            co_await poller.Sleep(std::chrono::milliseconds(201));
+            co_return 3;
+        }(poller));
+        futures.emplace_back([](TPoller& poller) -> TFuture<int> {
+            co_await poller.Sleep(std::chrono::milliseconds(202));
+            co_return 4;
+        }(poller));
+        *ok = co_await Any(std::move(futures));
+        co_return;
+    }(loop.Poller(), &ok);
+
+    while (!h2.done()) {
+        loop.Step();
+    }
+
+    while (loop.Poller().TimersSize() > 0) {
+        loop.Step();
+    }
+
+    assert_true(ok == 2);
+}
+
+template<typename TPoller>
+void test_futures_any_same_wakeup(void**) {
+    using TLoop = TLoop<TPoller>;
+    TLoop loop;
+
+    int ok = 0;
+    TFuture<void> h2 = [](TPoller& poller, int* ok) -> TFuture<void> {
+        std::vector<TFuture<void>> futures;
+        auto until = TClock::now() + std::chrono::milliseconds(100);
+        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
+            co_await poller.Sleep(until);
+            (*ok)++;
+            co_return;
+        }(poller, until, ok));
+        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
+            co_await poller.Sleep(until);
+            (*ok)++;
+            co_return;
+        }(poller, until, ok));
+        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
+            co_await poller.Sleep(until);
+            (*ok)++;
+            co_return;
+        }(poller, until, ok));
+        futures.emplace_back([](TPoller& poller, TTime until, int* ok) -> TFuture<void> {
+            co_await poller.Sleep(until);
+            (*ok)++;
+            co_return;
+        }(poller, until, ok));
+        co_await Any(std::move(futures));
+        (*ok)++;
+        co_return;
+    }(loop.Poller(), &ok);
+
+    while (!h2.done()) {
+        loop.Step();
+    }
+
+    while (loop.Poller().TimersSize() > 0) {
+        loop.Step();
+    }
+
+    assert_true(ok == 2);
+}
+
+template<typename TPoller>
+void test_futures_all(void**) {
+    std::vector<int> r;
+    TFuture<void> h1 = [](std::vector<int>* r) -> TFuture<void> {
+        std::vector<TFuture<int>> futures;
+        futures.emplace_back([]() -> TFuture<int> { co_return 1; }());
+        futures.emplace_back([]() -> TFuture<int> { co_return 2; }());
+        futures.emplace_back([]() -> TFuture<int> { co_return 3; }());
+        futures.emplace_back([]() -> TFuture<int> { co_return 4; }());
+        *r = co_await All(std::move(futures));
+        co_return;
+    }(&r);
+
+    assert_true(r == (std::vector<int>{1, 2, 3, 4}));
+
+    int ok = 0;
+    TFuture<void> h2 = [](int* ok) -> TFuture<void> {
+        std::vector<TFuture<void>> futures;
+        futures.emplace_back([]() -> TFuture<void> { co_return; }());
+        futures.emplace_back([]() -> TFuture<void> { co_return; }());
+        futures.emplace_back([]() -> TFuture<void> { co_return; }());
+        futures.emplace_back([]() -> TFuture<void> { co_return; }());
+        co_await All(std::move(futures));
+        *ok = 1;
+        co_return;
+    }(&ok);
+
+    assert_true(ok == 1);
+}
+
+#ifndef _WIN32
+template<typename TPoller>
+void test_close_and_reuse(void**) {
+    using TFileHandle = typename TPoller::TFileHandle;
+    TLoop<TPoller> loop;
+    loop.Poller().SetMaxDuration(std::chrono::milliseconds(10));
+    auto reader = [](TFileHandle* handle, bool* done) -> TFuture<void> {
+        char c;
+        co_await handle->ReadSome(&c, 1);
+        *done = true;
+    };
+
+    std::vector<std::unique_ptr<TFileHandle>> handles;
+    std::vector<int> writers;
+    std::vector<TFuture<void>> readers;
+    bool done[4] = {false};
+    for (int i = 0; i < 3; i++) {
+        int p[2]; assert_int_equal(0, pipe(p));
+        handles.emplace_back(std::make_unique<TFileHandle>(p[0], loop.Poller()));
+        writers.emplace_back(p[1]);
+        readers.emplace_back(reader(handles.back().get(), &done[i]));
+    }
+    loop.Step();
+
+    // drop two waiting descriptors in one batch, their numbers are reused below
+    handles[0]->Close();
+    handles[1]->Close();
+    loop.Step();
+
+    int p[2]; assert_int_equal(0, pipe(p));
+    handles.emplace_back(std::make_unique<TFileHandle>(p[0], loop.Poller()));
+    writers.emplace_back(p[1]);
+    readers.emplace_back(reader(handles.back().get(), &done[3]));
+    loop.Step();
+
+    assert_int_equal(1, write(writers[2], "x", 1));
+    assert_int_equal(1, write(writers[3], "x", 1));
+    for (int i = 0; i < 100 && !(done[2] && done[3]); i++) {
+        loop.Step();
+    }
+    assert_false(done[0]);
+    assert_false(done[1]);
+    assert_true(done[2]);
+    assert_true(done[3]);
+    for (int fd : writers) {
+        close(fd);
+    }
+}
+
+template<typename TPoller>
+void test_cancel_on_destroy(void**) {
+    using TFileHandle = typename TPoller::TFileHandle;
+    TLoop<TPoller> loop;
+    int p[2]; assert_int_equal(0, pipe(p));
+    TFileHandle handle(p[0], loop.Poller());
+    auto reader = [](TFileHandle* handle, int* resumed) -> TFuture<void> {
+        char c;
+        co_await handle->ReadSome(&c, 1);
+        (*resumed)++;
+    };
+
+    int resumed = 0;
+    TFuture<void> h = [](TPoller& poller, TFileHandle* handle, int* resumed, auto reader) -> TFuture<void> {
+        std::vector<TFuture<void>> futures;
+        futures.emplace_back(reader(handle, resumed));
+        futures.emplace_back([](TPoller& poller) -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::milliseconds(10));
+        }(poller));
+        // the timer wins, the reader is destroyed while it waits
+        co_await Any(std::move(futures));
+    }(loop.Poller(), &handle, &resumed, reader);
+
+    while (!h.done()) {
+        loop.Step();
+    }
+    loop.Step();
+
+    assert_int_equal(1, write(p[1], "x", 1));
+    for (int i = 0; i < 10; i++) {
+        loop.Step();
+    }
+    assert_int_equal(0, resumed);
+
+    // the descriptor is still usable by a new waiter
+    auto h2 = reader(&handle, &resumed);
+    for (int i = 0; i < 100 && resumed == 0; i++) {
+        loop.Step();
+    }
+    assert_int_equal(1, resumed);
+    close(p[1]);
+}
+#endif
+
+#ifdef __linux__
+
+namespace {
+
+struct TTestSuspendPromise;
+
+struct TTestSuspendTask : std::coroutine_handle<TTestSuspendPromise>
+{
+    using promise_type = TTestSuspendPromise;
+};
+
+struct TTestSuspendPromise
+{
+    TTestSuspendTask get_return_object() { return { TTestSuspendTask::from_promise(*this) }; }
+    std::suspend_always initial_suspend() { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() {}
+};
+
+} // namespace
+
+#ifdef HAVE_URING
+void test_uring_create(void**) {
+    TUring uring(256);
+}
+
+void test_uring_write(void**) {
+    TUring uring(256);
+    char buf[1] = {'e'};
+    char rbuf[1] = {'k'};
+    int p[2];
+    assert_int_equal(0, pipe(p));
+    uring.Write(p[1], buf, 1, nullptr);
+    assert_int_equal(uring.Wait(), 1);
+    int err = read(p[0], rbuf, 1);
+    assert_true(rbuf[0] == 'e');
+}
+
+void test_uring_read(void**) {
+    TUring uring(256);
+    char buf[1] = {'e'};
+    char rbuf[1] = {'k'};
+    int p[2];
+    assert_int_equal(0, pipe(p));
+    assert_int_equal(1, write(p[1], buf, 1));
+    uring.Read(p[0], rbuf, 1, nullptr);
+    assert_int_equal(uring.Wait(), 1);
+    assert_true(rbuf[0] == 'e');
+}
+
+void test_uring_read_more_than_write(void**) {
+    TUring uring(256);
+    char buf[1] = {'e'};
+    char rbuf[10] = "test test";
+    int p[2];
+    assert_int_equal(0, pipe(p));
+    assert_int_equal(1, write(p[1], buf, 1));
+    TFuture<void> h = []() -> TFuture<void> { co_return; }();
+    uring.Read(p[0], rbuf, sizeof(rbuf), h.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_int_equal(uring.Result(), 1);
+    assert_true(rbuf[0] == 'e');
+}
+
+void test_uring_write_resume(void**) {
+    TUring uring(256);
+    char buf[1] = {'e'};
+    char rbuf[1] = {'k'};
+    int p[2];
+    assert_int_equal(0, pipe(p));
+    int r = 31337;
+    TFuture<void> h = [](TUring* uring, int* r) -> TFuture<void> {
+        co_await std::suspend_always();
+        *r = uring->Result();
+        co_return;
+    }(&uring, &r);
+    uring.Write(p[1], buf, 1, h.raw());
+    assert_true(!h.done());
+    assert_int_equal(uring.Wait(), 1);
+    uring.WakeupReadyHandles();
+    int err = read(p[0], rbuf, 1);
+    assert_true(rbuf[0] == 'e');
+    assert_int_equal(r, 1);
+    assert_true(h.done());
+}
+
+void test_uring_read_resume(void**) {
+    TUring uring(256);
+    char buf[1] = {'e'};
+    char rbuf[1] = {'k'};
+    int p[2];
+    assert_int_equal(0, pipe(p));
+    int r = 31337;
+    TFuture<void> h = [](TUring* uring, int* r) -> TFuture<void> {
+        co_await std::suspend_always();
+        *r = uring->Result();
+        co_return;
+    }(&uring, &r);
+    assert_int_equal(1, write(p[1], buf, 1));
+    uring.Read(p[0], rbuf, 1, h.raw());
+    assert_true(!h.done());
+    assert_int_equal(uring.Wait(), 1);
+    uring.WakeupReadyHandles();
+    assert_true(rbuf[0] == 'e');
+    assert_int_equal(r, 1);
+    assert_true(h.done());
+}
+
+void test_uring_recv_send_buffers(void**) {
+    TUring uring(256);
+    int s[2];
+    assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, s));
+    TFuture<void> h = []() -> TFuture<void> { co_await std::suspend_always(); }();
+
+    // small send goes through a registered buffer
+    char sbuf[] = "hello";
+    uring.Send(s[1], sbuf, 5, h.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_int_equal(uring.Result(), 5);
+    uring.WakeupReadyHandles();
+
+    // the kernel picks a provided buffer, data is copied to rbuf
+    char rbuf[64] = {0};
+    uring.Recv(s[0], rbuf, sizeof(rbuf), h.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_int_equal(uring.Result(), 5);
+    assert_memory_equal(rbuf, "hello", 5);
+
+    // large send bypasses the registered buffers
+    std::vector<char> big(100000, 'x');
+    TFuture<void> h2 = []() -> TFuture<void> { co_await std::suspend_always(); }();
+    uring.Send(s[1], big.data(), big.size(), h2.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_true(uring.Result() > 0);
+
+    close(s[0]); close(s[1]);
+}
+
+void test_uring_multishot(void**) {
+    using TSocket = TUring::TSocket;
+    int port = getport();
+    TLoop<TUring> loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    constexpr int clients = 3;
+    std::vector<std::string> received;
+
+    TFuture<void> server = [](TSocket* listener, std::vector<std::string>* received) -> TFuture<void>
+    {
+        auto connections = listener->AcceptStream();
+        for (int i = 0; i < clients; i++) {
+            auto client = co_await connections.Next();
+            auto stream = client.RecvStream();
+            std::string data;
+            char buf[2];
+            ssize_t size;
+            while ((size = co_await stream.ReadSome(buf, sizeof(buf))) > 0) {
+                data.append(buf, size);
+            }
+            received->emplace_back(std::move(data));
+        }
+    }(&listener, &received);
+
+    std::vector<TFuture<void>> writers;
+    for (int i = 0; i < clients; i++) {
+        writers.emplace_back([](TUring& poller, TAddress addr, int i) -> TFuture<void> {
+            TSocket client(poller, addr.Domain());
+            co_await client.Connect(addr);
+            std::string message = "message " + std::to_string(i);
+            co_await client.WriteSome(message.data(), message.size());
+        }(loop.Poller(), addr, i));
+    }
+
+    while (!server.done()) {
+        loop.Step();
+    }
+
+    assert_int_equal(received.size(), clients);
+    std::sort(received.begin(), received.end());
+    for (int i = 0; i < clients; i++) {
+        assert_string_equal(received[i].c_str(), ("message " + std::to_string(i)).c_str());
+    }
+}
+
+void test_uring_options(void**) {
+    TUringOptions options;
+    options.CoopTaskRun = true;
+    options.SingleIssuer = true;
+    TUring uring(16, options);
+    int p[2]; assert_int_equal(0, pipe(p));
+    char wbuf[] = "ok";
+    char rbuf[2] = {0};
+    TFuture<void> h = []() -> TFuture<void> { co_await std::suspend_always(); }();
+    uring.Write(p[1], wbuf, 2, h.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_int_equal(uring.Result(), 2);
+    uring.WakeupReadyHandles();
+    uring.Read(p[0], rbuf, 2, h.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_int_equal(uring.Result(), 2);
+    assert_memory_equal(rbuf, "ok", 2);
+    close(p[0]); close(p[1]);
+}
+
+void test_uring_no_sqe(void** ) {
+    TUring uring(1);
+    char rbuf[1] = {'k'};
+    int p[2]; assert_int_equal(0, pipe(p));
+    assert_int_equal(1, write(p[1], rbuf, 1));
+    assert_int_equal(1, write(p[1], rbuf, 1));
+    uring.Read(p[0], rbuf, 1, nullptr);
+    uring.Read(p[0], rbuf, 1, nullptr);
+    int k = uring.Wait();
+    assert_true(k == 1 || k == 2);
+    if (k == 1) {
+        assert_int_equal(1, uring.Wait());
+    }
+}
+
+void test_uring_register(void**) {
+    TUring uring(16);
+    int s[2]; assert_int_equal(0, socketpair(AF_UNIX, SOCK_STREAM, 0, s));
+    uring.Register(s[0]);
+    uring.Register(s[1]);
+    char sbuf[] = "hello";
+    char rbuf[16] = {0};
+    TFuture<void> h = []() -> TFuture<void> { co_await std::suspend_always(); }();
+    uring.Send(s[1], sbuf, 5, h.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_int_equal(uring.Result(), 5);
+    uring.WakeupReadyHandles();
+    uring.Recv(s[0], rbuf, sizeof(rbuf), h.raw());
+    assert_int_equal(uring.Wait(), 1);
+    assert_int_equal(uring.Result(), 5);
+    assert_string_equal(rbuf, "hello");
+    uring.Unregister(s[0]);
+    uring.Unregister(s[1]);
+    close(s[0]); close(s[1]);
+}
+
+void test_uring_write_then_read(void**) {
+    using TSocket = TUring::TSocket;
+    int port = getport();
+    TLoop<TUring> loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    std::string response;
+    bool timedOut = false;
+
+    TFuture<void> server = [](TSocket* listener) -> TFuture<void> {
+        auto client = co_await listener->Accept();
+        char buf[4];
+        TByteReader reader(client);
+        co_await reader.Read(buf, sizeof(buf));
+        co_await client.WriteSome("pong", 4);
+        // the second request stays unanswered
+        co_await reader.Read(buf, sizeof(buf));
+        co_await listener->Accept();
+    }(&listener);
+
+    TFuture<void> client = [](TUring& poller, TAddress addr, std::string* response, bool* timedOut) -> TFuture<void> {
+        TSocket socket(poller, addr.Domain());
+        co_await socket.Connect(addr, TClock::now() + std::chrono::seconds(5));
+        char buf[16];
+        int size = co_await socket.WriteThenReadSome("ping", 4, buf, sizeof(buf));
+        response->assign(buf, size);
+        try {
+            co_await socket.WriteThenReadSome("ping", 4, buf, sizeof(buf), TClock::now() + std::chrono::milliseconds(50));
+        } catch (const std::system_error& ex) {
+            *timedOut = ex.code() == std::errc::timed_out;
+        }
+    }(loop.Poller(), addr, &response, &timedOut);
+
+    while (!client.done()) {
+        loop.Step();
+    }
+
+    assert_string_equal(response.c_str(), "pong");
+    assert_true(timedOut);
+}
+
+void test_uring_speculative(void**) {
+    using TSocket = TUring::TSocket;
+    int port = getport();
+    TLoop<TUring> loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+    std::string received;
+
+    TFuture<void> server = [](TSocket* listener, std::string* received) -> TFuture<void> {
+        auto client = co_await listener->Accept();
+        client.SetSpeculative();
+        char buf[16];
+        ssize_t size;
+        while ((size = co_await client.ReadSome(buf, sizeof(buf))) > 0) {
+            received->append(buf, size);
+        }
+    }(&listener, &received);
+
+    TFuture<void> client = [](TUring& poller, TAddress addr) -> TFuture<void> {
+        TSocket socket(poller, addr.Domain());
+        socket.SetSpeculative();
+        co_await socket.Connect(addr);
+        for (int i = 0; i < 3; i++) {
+            co_await socket.WriteSome("ping", 4);
+        }
+    }(loop.Poller(), addr);
+
+    while (!server.done()) {
+        loop.Step();
+    }
+
+    assert_string_equal(received.c_str(), "pingpingping");
+}
+#endif
+
+template<typename TPoller>
+void test_remote_disconnect(void**) {
+    bool changed = false;
+    using TLoop = TLoop<TPoller>;
+    using TSocket = typename TPoller::TSocket;
+    int port = getport();
+    TLoop loop;
+    TAddress saddr{"127.0.0.1", port};
+    TSocket socket(loop.Poller(), saddr.Domain());
+    socket.Bind(saddr);
+    socket.Listen();
+
+    TFuture<void> h1 = [](TPoller& poller, bool *changed, int port) -> TFuture<void>
+    {
+        TAddress addr{"127.0.0.1", port};
+        auto clientSocket = TSocket(poller, addr.Domain());
+        co_await clientSocket.Connect(addr);
+        co_await clientSocket.Monitor();
+        *changed = true;
+        co_return;
+    }(loop.Poller(), &changed, port);
+
+    TFuture<void> h2 = [](TSocket* socket) -> TFuture<void>
+    {
+        auto clientSocket = co_await socket->Accept();
+        clientSocket.Close();
+        co_return;
+    }(&socket);
+
+    while (!(h1.done() && h2.done())) {
+        loop.Step();
+    }
+
+    assert_true(changed);
+}
+
+template<typename TPoller>
+void test_connection_pool(void**) {
+    using TSocket = typename TPoller::TSocket;
+    using TPool = TConnectionPool<TSocket>;
+    using TLease = typename TPool::TLease;
+    TLoop<TPoller> loop;
+    loop.Poller().SetMaxDuration(std::chrono::milliseconds(10));
+    TAddress addr{"127.0.0.1", getport()};
+    TSocket listener(loop.Poller(), addr.Domain());
+    listener.Bind(addr);
+    listener.Listen();
+
+    std::vector<TSocket> accepted;
+    TFuture<void> server = [](TSocket* listener, std::vector<TSocket>* accepted) -> TFuture<void> {
+        while (true) {
+            accepted->emplace_back(co_await listener->Accept());
+        }
+    }(&listener, &accepted);
+
+    TPool pool(loop.Poller(), {.MaxIdle = 1});
+    auto acquire = [&](TLease* lease) {
+        TFuture<void> h = [](TPool* pool, TAddress addr, TLease* lease) -> TFuture<void> {
+            *lease = co_await pool->Acquire(addr);
+        }(&pool, addr, lease);
+        while (!h.done()) {
+            loop.Step();
+        }
+        assert_true(!!*lease);
+    };
+    auto waitAccepted = [&](size_t count) {
+        for (int i = 0; i < 100 && accepted.size() < count; i++) {
+            loop.Step();
+        }
+        assert_int_equal(count, accepted.size());
+    };
+
+    TLease l1, l2, l3, l4;
+    acquire(&l1);
+    assert_false(l1.Reused());
+    l1.Release();
+    assert_int_equal(1, pool.IdleSize(addr));
+
+    acquire(&l2);
+    assert_true(l2.Reused());
+    assert_int_equal(0, pool.IdleSize(addr));
+    l2.Release();
+    waitAccepted(1);
+
+    // the idle connection is evicted when the peer closes it
+    accepted[0].Close();
+    for (int i = 0; i < 100 && pool.IdleSize(addr) > 0; i++) {
+        loop.Step();
+    }
+    assert_int_equal(0, pool.IdleSize(addr));
+
+    acquire(&l3);
+    assert_false(l3.Reused());
+    acquire(&l4);
+    assert_false(l4.Reused());
+    waitAccepted(3);
+    l3.Release();
+    l4.Release();
+    assert_int_equal(1, pool.IdleSize(addr));
+
+    // a lease dropped without Release() closes its connection
+    acquire(&l1);
+    assert_true(l1.Reused());
+    l1 = {};
+    assert_int_equal(0, pool.IdleSize(addr));
+}
+
+/* temporary disable
+void test_uring_cancel(void** ) {
+    TUring uring(16);
+
+    char rbuf[1] = {'k'};
+    int p[2]; assert_int_equal(0, pipe(p));
+    assert_int_equal(1, write(p[1], rbuf, 1));
+    assert_int_equal(1, write(p[1], rbuf, 1));
+    TTestSuspendTask h = []() -> TTestSuspendTask { co_return; }();
+    uring.Read(p[0], rbuf, 1, h);
+    uring.Cancel(h);
+    assert_int_equal(1, uring.Wait());
+    assert_true(rbuf[0] == 'k');
+    h.destroy();
+}
+*/
+
+#endif
+
+template<typename TPoller>
+void test_multiloop_spawn(void**) {
+    TMultiLoop<TPoller> loops(2);
+    std::mutex mutex;
+    std::vector<std::thread::id> ids;
+    std::atomic<int> done = 0;
+
+    for (int k = 0; k < loops.Size(); k++) {
+        loops.Spawn(k, [&](TPoller& poller) {
+            {
+                std::lock_guard<std::mutex> guard(mutex);
+                ids.push_back(std::this_thread::get_id());
+            }
+            [](TPoller& poller, TMultiLoop<TPoller>& loops, std::atomic<int>& done) -> TVoidTask {
+                co_await poller.Sleep(std::chrono::milliseconds(1));
+                if (++done == loops.Size()) {
+                    loops.Stop();
+                }
+            }(poller, loops, done);
+        });
+    }
+
+    loops.Start();
+    loops.Join();
+
+    assert_int_equal(done, 2);
+    assert_int_equal(ids.size(), 2);
+    assert_true(ids[0] != ids[1]);
+    assert_true(ids[0] != std::this_thread::get_id());
+}
+
+void test_multiloop_affinity(void**) {
+    auto cpus = NUtils::AllowedCpus();
+    assert_false(cpus.empty());
+    assert_true(NUtils::CpuNode(cpus[0]) >= 0);
+    int sibling = NUtils::SiblingCpu(cpus[0]);
+    assert_true(sibling != cpus[0]);
+
+    std::vector<int> factoryCpus(2, -2);
+    TMultiLoopOptions options;
+    options.Cpus = {cpus.back()}; // the second loop is not pinned
+    TMultiLoop<TPoll> loops(2, options, [&](int k, int cpu) {
+        factoryCpus[k] = cpu;
+        return std::make_unique<TLoop<TPoll>>();
+    });
+#ifdef __linux__
+    assert_int_equal(loops.Cpu(0), cpus.back());
+#endif
+    assert_int_equal(loops.Cpu(1), -1);
+    assert_int_equal(factoryCpus[0], loops.Cpu(0));
+    assert_int_equal(factoryCpus[1], -1);
+
+    std::atomic<int> ranOn = -2;
+    loops.Spawn(0, [&](TPoll&) {
+        ranOn = NUtils::CurrentCpu();
+        loops.Stop();
+    });
+    loops.Start();
+    loops.Join();
+#ifdef __linux__
+    assert_int_equal(ranOn, cpus.back());
+#endif
+
+    bool thrown = false;
+    try {
+        TMultiLoop<TPoll> failing(2, {}, [](int k, int) -> std::unique_ptr<TLoop<TPoll>> {
+            if (k == 1) {
+                throw std::runtime_error("no loop");
+            }
+            return std::make_unique<TLoop<TPoll>>();
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert_true(thrown);
+}
+
+void test_work_stealing_deque(void**) {
+    NDetail::TWorkStealingDeque deque(4); // grows while thieves run
+    constexpr size_t count = 200000;
+    std::vector<std::atomic<int>> seen(count + 1);
+    std::atomic<bool> done = false;
+    std::atomic<size_t> stolen = 0;
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < 3; i++) {
+        thieves.emplace_back([&]() {
+            while (!done) {
+                if (void* item = deque.Steal()) {
+                    seen[reinterpret_cast<uintptr_t>(item)]++;
+                    stolen++;
+                }
+            }
+        });
+    }
+
+    for (uintptr_t i = 1; i <= count; i++) {
+        deque.Push(reinterpret_cast<void*>(i));
+        if (i % 3 == 0) {
+            if (void* item = deque.Take()) {
+                seen[reinterpret_cast<uintptr_t>(item)]++;
+            }
+        }
+    }
+    while (void* item = deque.Take()) {
+        seen[reinterpret_cast<uintptr_t>(item)]++;
+    }
+    while (deque.Size() != 0) { }
+    done = true;
+    for (auto& thread : thieves) {
+        thread.join();
+    }
+
+    for (size_t i = 1; i <= count; i++) {
+        assert_int_equal(seen[i].load(), 1);
+    }
+    assert_true(deque.Take() == nullptr);
+    assert_true(deque.Steal() == nullptr);
+}
+
+template<typename TPoller>
+void test_work_pool_offload(void**) {
+    TLoop<TPoller> loop;
+    TWorkPool pool(4);
+    auto loopId = std::this_thread::get_id();
+
+    constexpr int tasks = 32;
+    std::atomic<int> onWorker = 0, nested = 0;
+    int onLoop = 0;
+    std::vector<TFuture<void>> futures;
+    for (int i = 0; i < tasks; i++) {
+        futures.emplace_back([&](int i) -> TFuture<void> {
+            co_await pool.Offload();
+            if (std::this_thread::get_id() != loopId && pool.InWorker()) {
+                onWorker++;
+            }
+            volatile uint64_t x = i;
+            for (int k = 0; k < 100000; k++) {
+                x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            }
+            // from a worker: queued on its own deque, possibly stolen
+            co_await pool.Offload();
+            nested += pool.InWorker();
+            co_await loop.Resume();
+            onLoop += std::this_thread::get_id() == loopId && !pool.InWorker();
+        }(i));
+    }
+
+    auto deadline = TClock::now() + std::chrono::seconds(30);
+    // futures are not polled while they may run on a worker
+    while (onLoop < tasks && TClock::now() < deadline) {
+        loop.Step();
+    }
+
+    assert_int_equal(onWorker.load(), tasks);
+    assert_int_equal(nested.load(), tasks);
+    assert_int_equal(onLoop, tasks);
+}
+
+void test_histogram(void**) {
+    for (uint64_t value : {0ULL, 1ULL, 15ULL, 16ULL, 17ULL, 31ULL, 32ULL, 1000ULL, 123456789ULL, ~0ULL}) {
+        auto index = THistogram::Index(value);
+        assert_true(index < THistogram::Buckets);
+        assert_true(THistogram::LowerBound(index) <= value);
+        assert_true(value <= THistogram::UpperBound(index));
+    }
+    for (size_t i = 1; i < THistogram::Buckets; i++) {
+        assert_int_equal(THistogram::LowerBound(i), THistogram::UpperBound(i - 1) + 1);
+    }
+
+    THistogram histogram;
+    for (uint64_t value = 1; value <= 10000; value++) {
+        histogram.Record(value);
+    }
+    auto snapshot = histogram.Snapshot();
+    assert_int_equal(snapshot.Count, 10000);
+    assert_int_equal(snapshot.Min, 1);
+    assert_int_equal(snapshot.Max, 10000);
+    assert_true(std::abs(snapshot.Mean() - 5000.5) < 1e-6);
+    for (double p : {50.0, 90.0, 99.0, 99.9}) {
+        double expected = p * 100;
+        double got = snapshot.Percentile(p);
+        assert_true(got >= expected);
+        assert_true(got <= expected * (1 + 1.0 / THistogram::SubCount));
+    }
+    assert_int_equal(snapshot.Percentile(100), 10000);
+    assert_int_equal(THistogram().Snapshot().Percentile(50), 0);
+}
+
+void test_fd_table(void**) {
+    TFdTable<THandlePair> table;
+    assert_true(table.Find(3) == nullptr);
+    assert_int_equal(table.Generation(3), 0);
+    table.Release(3);
+
+    table[3].Read = std::noop_coroutine();
+    auto generation = table.Generation(3);
+    assert_true(generation != 0);
+    assert_true(table.Find(3) != nullptr);
+    assert_true(table.Find(3)->Read == std::noop_coroutine());
+    assert_true(table.Find(4) == nullptr);
+
+    // a far descriptor allocates only its own page
+    table[1000000].Write = std::noop_coroutine();
+    assert_int_equal(table.Size(), 2);
+    assert_int_equal(table.Pages(), 2);
+
+    table.Release(1000000);
+    assert_int_equal(table.Pages(), 1);
+    assert_true(table.Find(1000000) == nullptr);
+
+    // a reused descriptor is a new registration
+    table.Release(3);
+    assert_int_equal(table.Size(), 0);
+    assert_int_equal(table.Pages(), 0);
+    assert_true(!table[3].Read);
+    assert_true(table.Generation(3) != generation);
+}
+
+template<typename TPoller>
+void test_high_fd(void**) {
+    TLoop<TPoller> loop;
+    int p[2];
+    assert_int_equal(pipe(p), 0);
+    int fd = dup2(p[0], 1000);
+    assert_int_equal(fd, 1000);
+    close(p[0]);
+    TFileHandle input(fd, loop.Poller());
+    TFileHandle output(p[1], loop.Poller());
+    char buf[16] = {};
+    ssize_t size = 0;
+    auto reader = [&]() -> TFuture<void> {
+        size = co_await input.ReadSome(buf, sizeof(buf));
+    }();
+    auto writer = [&]() -> TFuture<void> {
+        co_await loop.Poller().Sleep(std::chrono::milliseconds(1));
+        co_await output.WriteSome("ping", 4);
+    }();
+    while (!reader.done()) {
+        loop.Step();
+    }
+    assert_int_equal(size, 4);
+    assert_memory_equal(buf, "ping", 4);
+}
+
+template<typename TPoller>
+void test_fd_reuse(void**) {
+    TLoop<TPoller> loop;
+    int p[2];
+    assert_int_equal(pipe(p), 0);
+    auto old = std::make_unique<TFileHandle>(p[0], loop.Poller());
+    char buf[16] = {};
+    // registers a wait on the old file and abandons it
+    {
+        auto reader = [&]() -> TFuture<void> {
+            co_await old->ReadSome(buf, sizeof(buf));
+        }();
+        loop.Step();
+    }
+    int dup = ::dup(p[0]);
+    int fd = p[0];
+    old.reset();
+
+    int q[2];
+    assert_int_equal(pipe(q), 0);
+    TFileHandle input(q[0], loop.Poller());
+    TFileHandle output(q[1], loop.Poller());
+    ssize_t size = 0;
+    auto reader = [&]() -> TFuture<void> {
+        size = co_await input.ReadSome(buf, sizeof(buf));
+    }();
+    // the old file stays open through the dup and becomes readable
+    assert_int_equal(write(p[1], "stale", 5), 5);
+    for (int i = 0; i < 5; i++) {
+        loop.Step();
+    }
+    assert_false(reader.done());
+    if (q[0] == fd) {
+        // the same fd number, a stale registration would have completed the wait
+        assert_int_equal(size, 0);
+    }
+
+    auto writer = [&]() -> TFuture<void> {
+        co_await output.WriteSome("fresh", 5);
+    }();
+    while (!reader.done()) {
+        loop.Step();
+    }
+    assert_int_equal(size, 5);
+    assert_memory_equal(buf, "fresh", 5);
+    close(dup);
+    close(p[1]);
+}
+
+#ifdef __linux__
+template<typename TPoller>
+void test_epoll_deregister_closed(void**) {
+    // the descriptor is closed behind the handle's back, EPOLL_CTL_DEL fails with EBADF
+    TLoop<TPoller> loop;
+    int p[2];
+    assert_int_equal(pipe(p), 0);
+    char buf[16] = {};
+    {
+        TFileHandle input(p[0], loop.Poller());
+        auto reader = [&]() -> TFuture<void> {
+            co_await input.ReadSome(buf, sizeof(buf));
+        }();
+        loop.Step();
+        close(p[0]);
+    }
+    // the slot was dropped, a new file with the same number registers afresh
+    int q[2];
+    assert_int_equal(pipe(q), 0);
+    TFileHandle input(q[0], loop.Poller());
+    ssize_t size = 0;
+    auto reader = [&]() -> TFuture<void> {
+        size = co_await input.ReadSome(buf, sizeof(buf));
+    }();
+    assert_int_equal(write(q[1], "fresh", 5), 5);
+    while (!reader.done()) {
+        loop.Step();
+    }
+    assert_int_equal(size, 5);
+    close(q[1]);
+    close(p[1]);
+}
+
+template<typename TPoller>
+void test_epoll_many_ready(void**) {
+    // more descriptors become ready at once than the initial out array holds
+    constexpr int count = 200;
+    TLoop<TPoller> loop;
+    std::vector<std::unique_ptr<TFileHandle>> inputs, outputs;
+    for (int i = 0; i < count; i++) {
+        int p[2];
+        assert_int_equal(pipe(p), 0);
+        inputs.emplace_back(std::make_unique<TFileHandle>(p[0], loop.Poller()));
+        outputs.emplace_back(std::make_unique<TFileHandle>(p[1], loop.Poller()));
+    }
+    int done = 0;
+    std::vector<TFuture<void>> readers;
+    for (auto& input : inputs) {
+        readers.emplace_back([&](TFileHandle& handle) -> TFuture<void> {
+            char buf[1];
+            assert_int_equal(co_await handle.ReadSome(buf, 1), 1);
+            done++;
+        }(*input));
+    }
+    loop.Step();
+    for (auto& output : outputs) {
+        assert_int_equal(write(output->Fd(), "x", 1), 1);
+    }
+    for (int i = 0; i < 10 && done < count; i++) {
+        loop.Step();
+    }
+    assert_int_equal(done, count);
+}
+
+template<typename TPoller>
+void test_epoll_busy_poll(void**) {
+    TLoop<TPoller> loop;
+    // the kernel part depends on the running kernel, the spinning does not
+    loop.Poller().SetBusyPoll({.Budget = std::chrono::milliseconds(2), .PreferBusyPoll = true});
+    int p[2];
+    assert_int_equal(pipe(p), 0);
+    TFileHandle input(p[0], loop.Poller());
+    TFileHandle output(p[1], loop.Poller());
+    char buf[4] = {};
+    ssize_t size = 0;
+    auto reader = [&]() -> TFuture<void> {
+        size = co_await input.ReadSome(buf, sizeof(buf));
+    }();
+    std::thread writer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert_int_equal(write(p[1], "ping", 4), 4);
+    });
+    while (!reader.done()) {
+        loop.Step();
+    }
+    writer.join();
+    assert_int_equal(size, 4);
+
+    // a timer longer than the budget still fires on time
+    auto start = TClock::now();
+    bool slept = false;
+    auto sleeper = [&]() -> TFuture<void> {
+        co_await loop.Poller().Sleep(std::chrono::milliseconds(10));
+        slept = true;
+    }();
+    while (!slept) {
+        loop.Step();
+    }
+    auto elapsed = TClock::now() - start;
+    assert_true(elapsed >= std::chrono::milliseconds(10));
+    assert_true(elapsed < std::chrono::milliseconds(200));
+
+    assert_true(loop.Poller().SetBusyPoll({}));
+}
+#endif
+
+#ifdef COROIO_STATS
+template<typename TPoller>
+void test_poller_stats(void**) {
+    TLoop<TPoller> loop;
+    auto& poller = loop.Poller();
+    int p[2]; assert_int_equal(0, pipe(p));
+    TFileHandle reader(p[0], poller);
+    TFileHandle writer(p[1], poller);
+    auto r = [&]() -> TFuture<void> {
+        char buf[4];
+        co_await reader.ReadSome(buf, sizeof(buf));
+    }();
+    auto w = [&]() -> TFuture<void> {
+        // the reader waits for readiness meanwhile
+        co_await poller.Sleep(std::chrono::milliseconds(1));
+        co_await writer.WriteSome("ping", 4);
+    }();
+    while (!r.done()) {
+        loop.Step();
+    }
+
+    TPollerStatsSnapshot stats;
+    // snapshots are taken from other threads
+    std::thread([&]() { stats = poller.Stats().Snapshot(); }).join();
+    assert_true(stats.Polls > 0);
+    assert_int_equal(stats.PollTime.Count, stats.Polls);
+    assert_true(stats.TimersFired >= 1);
+    assert_true(stats.TimerLateness.Count >= 1);
+    assert_true(stats.Events >= 1);
+    assert_true(stats.EventsPerPoll.Count > 0);
+    assert_true(stats.WakeupTime.Count > 0);
+    assert_true(stats.TimersTime.Count > 0);
+}
+
+template<typename TPoller>
+void test_stall_detector(void**) {
+    TLoop<TPoller> loop;
+    auto& poller = loop.Poller();
+    std::vector<TStall> stalls;
+    poller.SetStallDetector({.Threshold = std::chrono::milliseconds(20), .CpuTime = true},
+        [&](const TStall& stall) { stalls.push_back(stall); });
+
+    void* innerFrame = nullptr;
+    void* outerFrame = nullptr;
+    bool finish = false;
+    auto inner = [&]() -> TFuture<void> {
+        auto self = co_await Self();
+        innerFrame = self.address();
+        co_await poller.Sleep(std::chrono::milliseconds(1));
+        auto until = TClock::now() + std::chrono::milliseconds(30);
+        volatile uint64_t x = 0;
+        while (TClock::now() < until) {
+            x = x + 1;
+        }
+        // quick resumptions are not reported
+        while (!finish) {
+            co_await poller.Sleep(std::chrono::milliseconds(1));
+        }
+    };
+    auto outer = [&]() -> TFuture<void> {
+        auto self = co_await Self();
+        outerFrame = self.address();
+        co_await inner();
+    }();
+
+    auto deadline = TClock::now() + std::chrono::seconds(5);
+    while (stalls.empty() && TClock::now() < deadline) {
+        loop.Step();
+    }
+    for (int i = 0; i < 5; i++) {
+        loop.Step();
+    }
+    finish = true;
+    while (!outer.done()) {
+        loop.Step();
+    }
+
+    assert_int_equal(stalls.size(), 1);
+    auto& stall = stalls[0];
+    assert_true(stall.Source == EStallSource::Timer);
+    assert_true(stall.Handle == innerFrame);
+    assert_true(stall.Duration >= std::chrono::milliseconds(30));
+    assert_true(stall.CpuTime >= std::chrono::milliseconds(10));
+    assert_true(stall.Callers.size() >= 2);
+    assert_true(stall.Callers[0] == innerFrame);
+    assert_true(stall.Callers[1] == outerFrame);
+    poller.SetStallDetector({}, {});
+}
+#endif
+
+void test_channel(void**) {
+    TChannel<int, 2> channel;
+    std::vector<int> received;
+    int sent = 0;
+
+    auto producer = [&]() -> TFuture<void> {
+        for (int i = 0; i < 5; i++) {
+            assert_true(co_await channel.Send(i));
+            sent++;
+        }
+        channel.Close();
+        assert_false(co_await channel.Send(100));
+    }();
+    // two values fit, the third send waits for a receiver
+    assert_int_equal(sent, 2);
+    assert_int_equal(channel.Size(), 2);
+    assert_false(producer.done());
+
+    auto consumer = [&]() -> TFuture<void> {
+        while (auto value = co_await channel.Recv()) {
+            received.push_back(*value);
+        }
+    }();
+    assert_true(producer.done());
+    assert_true(consumer.done());
+    assert_int_equal(received.size(), 5);
+    for (int i = 0; i < 5; i++) {
+        assert_int_equal(received[i], i);
+    }
+
+    TChannel<std::string, 1> strings;
+    std::string value = "first";
+    assert_true(strings.TrySend(std::move(value)));
+    value = "second";
+    assert_false(strings.TrySend(std::move(value)));
+    assert_string_equal(value.c_str(), "second");
+    assert_string_equal(strings.TryRecv()->c_str(), "first");
+    assert_false(strings.TryRecv().has_value());
+}
+
+void test_channel_cancel(void**) {
+    TChannel<int, 1> channel;
+    std::optional<int> got;
+    auto first = [&]() -> TFuture<void> {
+        got = co_await channel.Recv();
+    }();
+    auto second = [&]() -> TFuture<void> {
+        got = co_await channel.Recv();
+    }();
+    { auto dead = std::move(first); }
+    // the cancelled receiver has left the queue, the value goes to the second one
+    assert_true(channel.TrySend(7));
+    assert_true(second.done());
+    assert_int_equal(*got, 7);
+}
+
+void test_semaphore(void**) {
+    TSemaphore semaphore(2);
+    int inside = 0, maxInside = 0, done = 0;
+    std::vector<std::coroutine_handle<>> parked;
+    auto park = [&]() -> TFuture<void> {
+        auto permit = co_await semaphore.Acquire();
+        inside++;
+        maxInside = std::max(maxInside, inside);
+        co_await [&]() {
+            struct TPark {
+                bool await_ready() { return false; }
+                void await_suspend(std::coroutine_handle<> h) { parked->push_back(h); }
+                void await_resume() { }
+                std::vector<std::coroutine_handle<>>* parked;
+            };
+            return TPark{&parked};
+        }();
+        inside--;
+        done++;
+    };
+    std::vector<TFuture<void>> tasks;
+    for (int i = 0; i < 5; i++) {
+        tasks.emplace_back(park());
+    }
+    assert_int_equal(inside, 2);
+    assert_int_equal(semaphore.Available(), 0);
+    assert_false(semaphore.TryAcquire());
+    while (!parked.empty()) {
+        auto h = parked.front();
+        parked.erase(parked.begin());
+        h.resume();
+    }
+    assert_int_equal(done, 5);
+    assert_int_equal(maxInside, 2);
+    assert_int_equal(semaphore.Available(), 2);
+    {
+        auto permit = semaphore.TryAcquire();
+        assert_true(static_cast<bool>(permit));
+        assert_int_equal(semaphore.Available(), 1);
+    }
+    assert_int_equal(semaphore.Available(), 2);
 }
 
 template<typename TPoller>
-void test_futures_all(void**) {
-    std::vector<int> r;
-    TFuture<void> h1 = [](std::vector<int>* r) -> TFuture<void> {
-        std::vector<TFuture<int>> futures;
-        futures.emplace_back([]() -> TFuture<int> { co_return 1; }());
-        futures.emplace_back([]() -> TFuture<int> { co_return 2; }());
-        futures.emplace_back([]() -> TFuture<int> { co_return 3; }());
-        futures.emplace_back([]() -> TFuture<int> { co_return 4; }());
-        *r = co_await All(std::move(futures));
-        co_return;
-    }(&r);
-
-    assert_true(r == (std::vector<int>{1, 2, 3, 4}));
-
-    int ok = 0;
-    TFuture<void> h2 = [](int* ok) -> TFuture<void> {
-        std::vector<TFuture<void>> futures;
-        futures.emplace_back([]() -> TFuture<void> { co_return; }());
-        futures.emplace_back([]() -> TFuture<void> { co_return; }());
-        futures.emplace_back([]() -> TFuture<void> { co_return; }());
-        futures.emplace_back([]() -> TFuture<void> { co_return; }());
-        co_await All(std::move(futures));
-        *ok = 1;
-        co_return;
-    }(&ok);
+void test_shared_channel(void**) {
+    TLoop<TPoller> consumerLoop;
+    TSharedChannel<int, 4> channel;
+    constexpr int count = 1000;
+    std::atomic<bool> producerDone = false;
+
+    std::thread producer([&]() {
+        TLoop<TPoller> producerLoop;
+        auto h = [&]() -> TFuture<void> {
+            for (int i = 0; i < count; i++) {
+                co_await channel.Send(producerLoop.Poller(), i);
+            }
+            channel.Close();
+        }();
+        while (!h.done()) {
+            producerLoop.Step();
+        }
+        producerDone = true;
+    });
 
-    assert_true(ok == 1);
+    long sum = 0;
+    int received = 0;
+    auto consumer = [&]() -> TFuture<void> {
+        while (auto value = co_await channel.Recv(consumerLoop.Poller())) {
+            sum += *value;
+            received++;
+        }
+    }();
+    auto deadline = TClock::now() + std::chrono::seconds(30);
+    while (!consumer.done() && TClock::now() < deadline) {
+        consumerLoop.Step();
+    }
+    producer.join();
+    assert_true(consumer.done());
+    assert_int_equal(received, count);
+    assert_int_equal(sum, static_cast<long>(count) * (count - 1) / 2);
 }
 
-#ifdef __linux__
-
 namespace {
 
-struct TTestSuspendPromise;
-
-struct TTestSuspendTask : std::coroutine_handle<TTestSuspendPromise>
-{
-    using promise_type = TTestSuspendPromise;
-};
+struct TDropGuard {
+    ~TDropGuard() {
+        ++*Dropped;
+    }
 
-struct TTestSuspendPromise
-{
-    TTestSuspendTask get_return_object() { return { TTestSuspendTask::from_promise(*this) }; }
-    std::suspend_always initial_suspend() { return {}; }
-    std::suspend_always final_suspend() noexcept { return {}; }
-    void return_void() {}
-    void unhandled_exception() {}
+    int* Dropped;
 };
 
 } // namespace
 
-#ifdef HAVE_URING
-void test_uring_create(void**) {
-    TUring uring(256);
-}
-
-void test_uring_write(void**) {
-    TUring uring(256);
-    char buf[1] = {'e'};
-    char rbuf[1] = {'k'};
-    int p[2];
-    assert_int_equal(0, pipe(p));
-    uring.Write(p[1], buf, 1, nullptr);
-    assert_int_equal(uring.Wait(), 1);
-    int err = read(p[0], rbuf, 1);
-    assert_true(rbuf[0] == 'e');
-}
-
-void test_uring_read(void**) {
-    TUring uring(256);
-    char buf[1] = {'e'};
-    char rbuf[1] = {'k'};
-    int p[2];
-    assert_int_equal(0, pipe(p));
-    assert_int_equal(1, write(p[1], buf, 1));
-    uring.Read(p[0], rbuf, 1, nullptr);
-    assert_int_equal(uring.Wait(), 1);
-    assert_true(rbuf[0] == 'e');
-}
+template<typename TPoller>
+void test_when_all(void**) {
+    TLoop<TPoller> loop;
+    auto& poller = loop.Poller();
+    std::optional<std::tuple<int, std::monostate, std::string>> result;
+    auto h = [&]() -> TFuture<void> {
+        auto number = [&]() -> TFuture<int> {
+            co_await poller.Sleep(std::chrono::milliseconds(5));
+            co_return 42;
+        };
+        auto nothing = [&]() -> TFuture<void> {
+            co_await poller.Yield();
+        };
+        auto text = []() -> TFuture<std::string> {
+            co_return "ready";
+        };
+        result = co_await WhenAll(number(), nothing(), text());
+    }();
 
-void test_uring_read_more_than_write(void**) {
-    TUring uring(256);
-    char buf[1] = {'e'};
-    char rbuf[10] = "test test";
-    int p[2];
-    assert_int_equal(0, pipe(p));
-    assert_int_equal(1, write(p[1], buf, 1));
-    TFuture<void> h = []() -> TFuture<void> { co_return; }();
-    uring.Read(p[0], rbuf, sizeof(rbuf), h.raw());
-    assert_int_equal(uring.Wait(), 1);
-    assert_int_equal(uring.Result(), 1);
-    assert_true(rbuf[0] == 'e');
+    while (!h.done()) {
+        loop.Step();
+    }
+    h.await_resume();
+    assert_true(result.has_value());
+    assert_int_equal(std::get<0>(*result), 42);
+    assert_string_equal(std::get<2>(*result).c_str(), "ready");
 }
 
-void test_uring_write_resume(void**) {
-    TUring uring(256);
-    char buf[1] = {'e'};
-    char rbuf[1] = {'k'};
-    int p[2];
-    assert_int_equal(0, pipe(p));
-    int r = 31337;
-    TFuture<void> h = [](TUring* uring, int* r) -> TFuture<void> {
-        co_await std::suspend_always();
-        *r = uring->Result();
-        co_return;
-    }(&uring, &r);
-    uring.Write(p[1], buf, 1, h.raw());
-    assert_true(!h.done());
-    assert_int_equal(uring.Wait(), 1);
-    uring.WakeupReadyHandles();
-    int err = read(p[0], rbuf, 1);
-    assert_true(rbuf[0] == 'e');
-    assert_int_equal(r, 1);
-    assert_true(h.done());
-}
+template<typename TPoller>
+void test_when_all_failure(void**) {
+    TLoop<TPoller> loop;
+    auto& poller = loop.Poller();
+    int dropped = 0;
+    bool caught = false;
+    auto h = [&]() -> TFuture<void> {
+        auto slow = [&]() -> TFuture<int> {
+            TDropGuard guard{&dropped};
+            co_await poller.Sleep(std::chrono::seconds(10));
+            co_return 1;
+        };
+        auto failing = [&]() -> TFuture<void> {
+            co_await poller.Yield();
+            throw std::runtime_error("failed");
+        };
+        try {
+            co_await WhenAll(slow(), failing());
+        } catch (const std::runtime_error& e) {
+            caught = std::string(e.what()) == "failed";
+        }
+    }();
 
-void test_uring_read_resume(void**) {
-    TUring uring(256);
-    char buf[1] = {'e'};
-    char rbuf[1] = {'k'};
-    int p[2];
-    assert_int_equal(0, pipe(p));
-    int r = 31337;
-    TFuture<void> h = [](TUring* uring, int* r) -> TFuture<void> {
-        co_await std::suspend_always();
-        *r = uring->Result();
-        co_return;
-    }(&uring, &r);
-    assert_int_equal(1, write(p[1], buf, 1));
-    uring.Read(p[0], rbuf, 1, h.raw());
-    assert_true(!h.done());
-    assert_int_equal(uring.Wait(), 1);
-    uring.WakeupReadyHandles();
-    assert_true(rbuf[0] == 'e');
-    assert_int_equal(r, 1);
+    auto deadline = TClock::now() + std::chrono::seconds(5);
+    while (!h.done() && TClock::now() < deadline) {
+        loop.Step();
+    }
     assert_true(h.done());
+    assert_true(caught);
+    assert_int_equal(dropped, 1);
 }
 
-void test_uring_no_sqe(void** ) {
-    TUring uring(1);
-    char rbuf[1] = {'k'};
+template<typename TPoller>
+void test_when_any(void**) {
+    TLoop<TPoller> loop;
+    auto& poller = loop.Poller();
+    int dropped = 0;
+    std::optional<std::variant<int, std::monostate>> result;
     int p[2]; assert_int_equal(0, pipe(p));
-    assert_int_equal(1, write(p[1], rbuf, 1));
-    assert_int_equal(1, write(p[1], rbuf, 1));
-    uring.Read(p[0], rbuf, 1, nullptr);
-    uring.Read(p[0], rbuf, 1, nullptr);
-    int k = uring.Wait();
-    assert_true(k == 1 || k == 2);
-    if (k == 1) {
-        assert_int_equal(1, uring.Wait());
+    TFileHandle reader(p[0], poller);
+    auto h = [&]() -> TFuture<void> {
+        auto read = [&]() -> TFuture<int> {
+            TDropGuard guard{&dropped};
+            char buf[16];
+            co_return co_await reader.ReadSome(buf, sizeof(buf));
+        };
+        auto sleep = [&]() -> TFuture<void> {
+            co_await poller.Sleep(std::chrono::milliseconds(5));
+        };
+        result = co_await WhenAny(read(), sleep());
+        // the loser is gone before WhenAny returns
+        assert_int_equal(dropped, 1);
+    }();
+
+    auto deadline = TClock::now() + std::chrono::seconds(5);
+    while (!h.done() && TClock::now() < deadline) {
+        loop.Step();
     }
+    assert_true(h.done());
+    h.await_resume();
+    assert_true(result.has_value());
+    assert_int_equal(result->index(), 1);
+    close(p[1]);
 }
-#endif
 
 template<typename TPoller>
-void test_remote_disconnect(void**) {
-    bool changed = false;
-    using TLoop = TLoop<TPoller>;
-    using TSocket = typename TPoller::TSocket;
-    int port = getport();
-    TLoop loop;
-    TAddress saddr{"127.0.0.1", port};
-    TSocket socket(loop.Poller(), saddr.Domain());
-    socket.Bind(saddr);
-    socket.Listen();
-
-    TFuture<void> h1 = [](TPoller& poller, bool *changed, int port) -> TFuture<void>
-    {
-        TAddress addr{"127.0.0.1", port};
-        auto clientSocket = TSocket(poller, addr.Domain());
-        co_await clientSocket.Connect(addr);
-        co_await clientSocket.Monitor();
-        *changed = true;
-        co_return;
-    }(loop.Poller(), &changed, port);
-
-    TFuture<void> h2 = [](TSocket* socket) -> TFuture<void>
-    {
-        auto clientSocket = co_await socket->Accept();
-        clientSocket.Close();
-        co_return;
-    }(&socket);
+void test_cancellation(void**) {
+    TLoop<TPoller> loop;
+    auto& poller = loop.Poller();
+    int dropped = 0;
+    std::vector<std::errc> errors;
+    auto sleeper = [&](std::chrono::milliseconds ms) -> TFuture<int> {
+        TDropGuard guard{&dropped};
+        co_await poller.Sleep(ms);
+        co_return 7;
+    };
+    auto run = [&](TCancellation& token, std::chrono::milliseconds ms) -> TFuture<void> {
+        try {
+            errors.push_back(co_await token.Run(sleeper(ms)) == 7 ? std::errc{} : std::errc::invalid_argument);
+        } catch (const std::system_error& e) {
+            errors.push_back(static_cast<std::errc>(e.code().value()));
+        }
+    };
 
-    while (!(h1.done() && h2.done())) {
+    TCancellation request(poller, TClock::now() + std::chrono::milliseconds(20));
+    TCancellation quick(request, TClock::now() + std::chrono::seconds(10));
+    assert_true(quick.Deadline() == request.Deadline());
+    TCancellation manual(poller);
+    TCancellation child(manual, TClock::now() + std::chrono::seconds(10));
+
+    std::vector<TFuture<void>> futures;
+    futures.emplace_back(run(request, std::chrono::milliseconds(1)));
+    futures.emplace_back(run(quick, std::chrono::seconds(10)));
+    futures.emplace_back(run(child, std::chrono::seconds(10)));
+    futures.emplace_back([&]() -> TFuture<void> {
+        co_await poller.Sleep(std::chrono::milliseconds(2));
+        manual.Cancel();
+    }());
+
+    auto deadline = TClock::now() + std::chrono::seconds(5);
+    while (errors.size() < 3 && TClock::now() < deadline) {
         loop.Step();
     }
+    assert_int_equal(errors.size(), 3);
+    assert_true(errors[0] == std::errc{});
+    assert_true(errors[1] == std::errc::operation_canceled);
+    assert_true(errors[2] == std::errc::timed_out);
+    assert_true(child.Cancelled());
+    assert_false(request.Cancelled());
+    assert_int_equal(dropped, 3);
+}
 
-    assert_true(changed);
+template<typename TPoller>
+void test_post(void**) {
+    TLoop<TPoller> loop;
+    loop.Poller().SetMaxDuration(std::chrono::seconds(10));
+    std::thread::id id;
+    std::thread thread([&]() {
+        id = std::this_thread::get_id();
+        loop.Loop();
+    });
+
+    std::atomic<bool> done = false;
+    std::thread::id postedId;
+    auto t1 = std::chrono::steady_clock::now();
+    loop.Post([&]() {
+        postedId = std::this_thread::get_id();
+        done = true;
+        loop.Stop();
+    });
+    thread.join();
+    auto t2 = std::chrono::steady_clock::now();
+
+    assert_true(done);
+    assert_true(postedId == id);
+    // the loop must have been woken up, not timed out
+    assert_true(t2 - t1 < std::chrono::seconds(5));
 }
 
-/* temporary disable
-void test_uring_cancel(void** ) {
-    TUring uring(16);
+template<typename TPoller>
+void test_switch_to(void**) {
+    TLoop<TPoller> loop;
+    loop.Poller().SetMaxDuration(std::chrono::seconds(10));
+    std::thread::id id;
+    std::thread thread([&]() {
+        id = std::this_thread::get_id();
+        loop.Loop();
+    });
 
-    char rbuf[1] = {'k'};
-    int p[2]; assert_int_equal(0, pipe(p));
-    assert_int_equal(1, write(p[1], rbuf, 1));
-    assert_int_equal(1, write(p[1], rbuf, 1));
-    TTestSuspendTask h = []() -> TTestSuspendTask { co_return; }();
-    uring.Read(p[0], rbuf, 1, h);
-    uring.Cancel(h);
-    assert_int_equal(1, uring.Wait());
-    assert_true(rbuf[0] == 'k');
-    h.destroy();
+    std::thread::id resumedId;
+    [](TPoller& poller, TLoop<TPoller>& loop, std::thread::id& resumedId) -> TVoidTask {
+        co_await poller.SwitchTo();
+        resumedId = std::this_thread::get_id();
+        loop.Stop();
+    }(loop.Poller(), loop, resumedId);
+    thread.join();
+
+    assert_true(resumedId == id);
 }
-*/
 
+#ifndef _WIN32
+template<typename TPoller>
+void test_reuse_port(void**) {
+    using TSocket = typename TPoller::TSocket;
+    int port = getport();
+    TLoop<TPoller> loop;
+    TAddress addr{"127.0.0.1", port};
+    TSocket s1(loop.Poller(), addr.Domain());
+    TSocket s2(loop.Poller(), addr.Domain());
+    s1.Bind(addr, true);
+    s1.Listen();
+    s2.Bind(addr, true);
+    s2.Listen();
+
+    TSocket s3(loop.Poller(), addr.Domain());
+    bool failed = false;
+    try {
+        s3.Bind(addr);
+    } catch (const std::system_error& ) {
+        failed = true;
+    }
+    assert_true(failed);
+}
 #endif
 
 void test_base64(void**) {
@@ -1292,6 +5166,16 @@ void test_sha1(void**) {
     assert_string_equal(digest.data(), "3567ba6828093bdf2a25c425bc3b6c21f7bfdc53");
 }
 
+#ifdef __linux__
+/// TEPoll in the edge-triggered mode.
+class TEPollEdge: public TEPoll {
+public:
+    TEPollEdge() {
+        SetEdgeTriggered();
+    }
+};
+#endif
+
 #define my_unit_test(f, a) { #f "(" #a ")", f<a>, NULL, NULL, NULL }
 #define my_unit_test2(f, a, b) \
     { #f "(" #a ")", f<a>, NULL, NULL, NULL }, \
@@ -1364,14 +5248,45 @@ int main(int argc, char* argv[]) {
     ADD_TEST(cmocka_unit_test, test_addr6);
     ADD_TEST(cmocka_unit_test, test_bad_addr);
     ADD_TEST(cmocka_unit_test, test_timespec);
+    ADD_TEST(cmocka_unit_test, test_timer_wheel);
+    ADD_TEST(cmocka_unit_test, test_chain_buffer);
     ADD_TEST(cmocka_unit_test, test_line_splitter);
+    ADD_TEST(cmocka_unit_test, test_line_splitter_resume);
+    ADD_TEST(cmocka_unit_test, test_find_byte);
     ADD_TEST(cmocka_unit_test, test_zero_copy_line_splitter);
+    ADD_TEST(cmocka_unit_test, test_line_splitter_release);
     ADD_TEST(cmocka_unit_test, test_self_id);
+    ADD_TEST(cmocka_unit_test, test_frame_pool);
+    ADD_TEST(cmocka_unit_test, test_arena);
+#ifdef COROIO_ARENA
+    ADD_TEST(my_unit_poller, test_arena_frames);
+#endif
+    ADD_TEST(cmocka_unit_test, test_work_stealing_deque);
+    ADD_TEST(cmocka_unit_test, test_histogram);
+    ADD_TEST(cmocka_unit_test, test_fd_table);
+    ADD_TEST(my_unit_poller, test_high_fd);
+    ADD_TEST(my_unit_poller, test_fd_reuse);
+    ADD_TEST(cmocka_unit_test, test_channel);
+    ADD_TEST(cmocka_unit_test, test_channel_cancel);
+    ADD_TEST(cmocka_unit_test, test_semaphore);
+    ADD_TEST(cmocka_unit_test, test_ws_mask);
+    ADD_TEST(cmocka_unit_test, test_ws_upgrade_response);
+    ADD_TEST(cmocka_unit_test, test_http_parser);
+    ADD_TEST(cmocka_unit_test, test_http_chunked);
+    ADD_TEST(cmocka_unit_test, test_http_response);
+#ifdef HAVE_ZLIB
+    ADD_TEST(cmocka_unit_test, test_ws_deflate_negotiation);
+#endif
+#ifdef HAVE_OPENSSL
+    ADD_TEST(cmocka_unit_test, test_ssl_ring_buffer);
+#endif
     ADD_TEST(cmocka_unit_test, test_resolv_nameservers);
     ADD_TEST(my_unit_poller, test_listen);
     ADD_TEST(my_unit_poller, test_timeout);
     ADD_TEST(my_unit_poller, test_timeout2);
+    ADD_TEST(my_unit_poller, test_timer_wheel_poller);
     ADD_TEST(my_unit_poller, test_accept);
+    ADD_TEST(my_unit_poller, test_accept_backlog);
     ADD_TEST(my_unit_poller, test_write_after_connect);
     ADD_TEST(my_unit_poller, test_write_after_accept);
     ADD_TEST(my_unit_poller, test_connection_timeout);
@@ -1380,23 +5295,120 @@ int main(int argc, char* argv[]) {
     ADD_TEST(my_unit_poller, test_connection_refused_on_read);
     ADD_TEST(my_unit_poller, test_read_write_same_socket);
     ADD_TEST(my_unit_poller, test_read_write_full);
+    ADD_TEST(my_unit_poller, test_read_write_zero_copy);
+    ADD_TEST(my_unit_poller, test_read_write_vectored);
+#ifndef _WIN32
+    ADD_TEST(my_unit_poller, test_send_file);
+    ADD_TEST(my_unit_poller, test_file_read_write_at);
+    ADD_TEST(my_unit_poller, test_read_ahead);
+#endif
     ADD_TEST(my_unit_poller, test_read_until);
+    ADD_TEST(my_unit_poller, test_read_until_chain);
+    ADD_TEST(my_unit_poller, test_buffered_writer);
     ADD_TEST(my_unit_poller, test_read_write_struct);
     ADD_TEST(my_unit_poller, test_read_write_lines);
+    ADD_TEST(my_unit_poller, test_hibernation);
+    ADD_TEST(my_unit_poller, test_http_pipelined);
+    ADD_TEST(my_unit_poller, test_ws_frames);
+    ADD_TEST(my_unit_poller, test_ws_control_frames);
+    ADD_TEST(my_unit_poller, test_ws_server_limits);
+    ADD_TEST(my_unit_poller, test_ws_broadcast);
+    ADD_TEST(my_unit_poller, test_ws_broadcast_queue);
+#ifdef HAVE_ZLIB
+    ADD_TEST(my_unit_poller, test_ws_deflate_frames);
+    ADD_TEST(my_unit_poller, test_ws_deflate_echo);
+#endif
     ADD_TEST(my_unit_poller, test_future_chaining);
     ADD_TEST(my_unit_poller, test_futures_any);
     ADD_TEST(my_unit_poller, test_futures_any_result);
     ADD_TEST(my_unit_poller, test_futures_any_same_wakeup);
     ADD_TEST(my_unit_poller, test_futures_all);
+    ADD_TEST(my_unit_poller, test_multiloop_spawn);
+    ADD_TEST(cmocka_unit_test, test_multiloop_affinity);
+    ADD_TEST(my_unit_poller, test_post);
+    ADD_TEST(my_unit_poller, test_work_pool_offload);
+    ADD_TEST(my_unit_poller, test_when_all);
+    ADD_TEST(my_unit_poller, test_when_all_failure);
+    ADD_TEST(my_unit_poller, test_when_any);
+    ADD_TEST(my_unit_poller, test_cancellation);
+    ADD_TEST(my_unit_poller, test_shared_channel);
+#ifdef COROIO_STATS
+    ADD_TEST(my_unit_poller, test_poller_stats);
+    ADD_TEST(my_unit_poller, test_stall_detector);
+#endif
+    ADD_TEST(my_unit_poller, test_switch_to);
+#ifndef _WIN32
+    ADD_TEST(my_unit_poller, test_reuse_port);
+    ADD_TEST(my_unit_poller, test_cancel_on_destroy);
+#endif
 #ifndef _WIN32
 #ifdef HAVE_OPENSSL
     ADD_TEST(my_unit_test2, test_read_write_full_ssl, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_ssl_hibernation, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_ssl_handshake_offload, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_ssl_handshake_offload_resume, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_ssl_session_resumption, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_ssl_ktls, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_ssl_send_file, TSelect, TPoll);
 #endif
 #endif
     ADD_TEST(my_unit_test2, test_resolver, TSelect, TPoll);
     ADD_TEST(my_unit_test2, test_resolve_bad_name, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_datagram_batch, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_datagram_send_recv_from, TSelect, TPoll);
+#ifndef _WIN32
+    ADD_TEST(my_unit_poller, test_handoff);
+    ADD_TEST(cmocka_unit_test, test_handoff_no_listener);
+#endif
+#ifdef __linux__
+    ADD_TEST(my_unit_test, test_datagram_batch, TEPoll);
+    ADD_TEST(my_unit_test, test_datagram_segmentation, TEPoll);
+#ifdef HAVE_URING
+    ADD_TEST(my_unit_test, test_datagram_batch, TUring);
+    ADD_TEST(my_unit_test, test_datagram_send_recv_from, TUring);
+    ADD_TEST(my_unit_test, test_datagram_segmentation, TUring);
+#endif
+#endif
+#ifndef _WIN32
+    ADD_TEST(my_unit_test2, test_dns_cache_positive, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_cache_expiry, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_cache_negative, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_cache_eviction, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_cache_prefetch, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_abandoned_waiter, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_nameserver_failover, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_parallel_query, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_servfail_next_server, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_retransmit_timeout, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_truncated_reply, TSelect, TPoll);
+    ADD_TEST(my_unit_test2, test_dns_tcp_fallback, TSelect, TPoll);
+    ADD_TEST(my_unit_poller, test_happy_eyeballs);
+    ADD_TEST(cmocka_unit_test, test_host_port_parse);
+#endif
+#if defined(__APPLE__) || defined(__FreeBSD__)
+    ADD_TEST(my_unit_test3, test_close_and_reuse, TSelect, TPoll, TKqueue);
+#endif
 #ifdef __linux__
-    ADD_TEST(my_unit_test2, test_remote_disconnect, TPoll, TEPoll);
+    ADD_TEST(my_unit_test3, test_remote_disconnect, TPoll, TEPoll, TEPollEdge);
+    ADD_TEST(my_unit_test3, test_connection_pool, TPoll, TEPoll, TEPollEdge);
+#ifdef HAVE_URING
+    ADD_TEST(my_unit_test, test_connection_pool, TUring);
+#endif
+    ADD_TEST(my_unit_test4, test_close_and_reuse, TSelect, TPoll, TEPoll, TEPollEdge);
+    ADD_TEST(my_unit_test, test_fd_reuse, TEPollEdge);
+    ADD_TEST(my_unit_test2, test_epoll_deregister_closed, TEPoll, TEPollEdge);
+    ADD_TEST(my_unit_test2, test_epoll_many_ready, TEPoll, TEPollEdge);
+    ADD_TEST(my_unit_test2, test_epoll_busy_poll, TEPoll, TEPollEdge);
+    ADD_TEST(my_unit_test, test_accept, TEPollEdge);
+    ADD_TEST(my_unit_test, test_accept_backlog, TEPollEdge);
+    ADD_TEST(my_unit_test, test_write_after_connect, TEPollEdge);
+    ADD_TEST(my_unit_test, test_connection_refused_on_read, TEPollEdge);
+    ADD_TEST(my_unit_test, test_read_write_same_socket, TEPollEdge);
+    ADD_TEST(my_unit_test, test_read_write_full, TEPollEdge);
+    ADD_TEST(my_unit_test, test_read_write_zero_copy, TEPollEdge);
+    ADD_TEST(my_unit_test, test_read_write_lines, TEPollEdge);
+    ADD_TEST(my_unit_test, test_futures_any_same_wakeup, TEPollEdge);
+    ADD_TEST(my_unit_test, test_cancel_on_destroy, TEPollEdge);
 #ifdef HAVE_URING
     ADD_TEST(cmocka_unit_test, test_uring_create);
     ADD_TEST(cmocka_unit_test, test_uring_write);
@@ -1405,6 +5417,12 @@ int main(int argc, char* argv[]) {
     ADD_TEST(cmocka_unit_test, test_uring_write_resume);
     ADD_TEST(cmocka_unit_test, test_uring_read_resume);
     ADD_TEST(cmocka_unit_test, test_uring_no_sqe);
+    ADD_TEST(cmocka_unit_test, test_uring_recv_send_buffers);
+    ADD_TEST(cmocka_unit_test, test_uring_multishot);
+    ADD_TEST(cmocka_unit_test, test_uring_options);
+    ADD_TEST(cmocka_unit_test, test_uring_register);
+    ADD_TEST(cmocka_unit_test, test_uring_write_then_read);
+    ADD_TEST(cmocka_unit_test, test_uring_speculative);
     // ADD_TEST(cmocka_unit_test, test_uring_cancel); // temporary disable
 #endif
 #endif